@@ -2,6 +2,8 @@
 #include <chrono>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cmath>
 #include "../include/fast_pdf_parser/tiktoken_tokenizer.h"
 
 using namespace fast_pdf_parser;
@@ -38,6 +40,7 @@ int main() {
     std::cout << "=== Chunking Performance Benchmark ===\n\n";
     
     TiktokenTokenizer tokenizer;
+    TiktokenTokenizer exact_tokenizer(TokenizerMode::ExactBpe);
     
     // Test different page counts
     std::vector<int> page_counts = {10, 50, 100, 500, 1000};
@@ -70,7 +73,60 @@ int main() {
         std::cout << "  Total tokens: " << total_tokens << "\n";
         std::cout << "  Time: " << duration.count() / 1000.0 << " ms\n";
         std::cout << "  Performance: " << static_cast<int>(tokens_per_second) << " tokens/second\n";
-        std::cout << "  Throughput: " << mb_per_second << " MB/second\n\n";
+        std::cout << "  Throughput: " << mb_per_second << " MB/second\n";
+        
+        // Same pages through the exact cl100k BPE path
+        start = high_resolution_clock::now();
+        
+        size_t exact_tokens = 0;
+        for (const auto& [text, _] : pages) {
+            exact_tokens += exact_tokenizer.count_tokens(text);
+        }
+        
+        end = high_resolution_clock::now();
+        auto exact_duration = duration_cast<microseconds>(end - start);
+        double exact_mb_per_second = (total_chars * 1000000.0) / (exact_duration.count() * 1024 * 1024);
+        double drift = 100.0 * (static_cast<double>(total_tokens) - exact_tokens) / exact_tokens;
+        
+        std::cout << "  Exact BPE tokens: " << exact_tokens << " (greedy off by " << drift << "%)\n";
+        std::cout << "  Exact BPE time: " << exact_duration.count() / 1000.0 << " ms\n";
+        std::cout << "  Exact BPE throughput: " << exact_mb_per_second << " MB/second"
+                  << " (greedy is " << exact_duration.count() / static_cast<double>(duration.count())
+                  << "x faster)\n";
+        
+        // The byte-class estimate, against the exact count line by line
+        start = high_resolution_clock::now();
+        
+        size_t estimated_tokens = 0;
+        for (const auto& [text, _] : pages) {
+            estimated_tokens += TiktokenTokenizer::estimate_tokens(text);
+        }
+        
+        end = high_resolution_clock::now();
+        auto estimate_duration = duration_cast<microseconds>(end - start);
+        
+        size_t lines = 0;
+        size_t close_lines = 0;  // within 25% of the exact count
+        for (const auto& [text, _] : pages) {
+            size_t begin = 0;
+            while (begin < text.size()) {
+                size_t newline = text.find('\n', begin);
+                if (newline == std::string::npos) newline = text.size();
+                std::string_view line(text.data() + begin, newline - begin);
+                begin = newline + 1;
+                if (line.empty()) continue;
+                
+                double exact = exact_tokenizer.count_tokens(line);
+                double estimate = TiktokenTokenizer::estimate_tokens(line);
+                ++lines;
+                if (std::abs(estimate - exact) <= 0.25 * exact) ++close_lines;
+            }
+        }
+        double estimate_drift = 100.0 * (static_cast<double>(estimated_tokens) - exact_tokens) / exact_tokens;
+        
+        std::cout << "  Estimated tokens: " << estimated_tokens << " (off by " << estimate_drift
+                  << "%, " << 100.0 * close_lines / lines << "% of lines within 25%)\n";
+        std::cout << "  Estimate time: " << estimate_duration.count() / 1000.0 << " ms\n\n";
     }
     
     return 0;
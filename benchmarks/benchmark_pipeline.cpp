@@ -0,0 +1,512 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <thread>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include "../include/fast_pdf_parser/hierarchical_chunker.h"
+#include "../include/fast_pdf_parser/metrics.h"
+#include "../include/fast_pdf_parser/parse_engine.h"
+
+using namespace fast_pdf_parser;
+using namespace std::chrono;
+namespace fs = std::filesystem;
+
+// Every C++ heap allocation of the process. MuPDF allocates with malloc,
+// so its own buffers are not counted here. Every form of operator new and
+// delete is replaced, so no block is freed by a different allocator than
+// the one that made it.
+static std::atomic<uint64_t> g_allocations{0};
+static std::atomic<uint64_t> g_allocated_bytes{0};
+
+static void* counted_alloc(size_t size, size_t alignment) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+    // aligned_alloc wants a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void* counted_alloc_or_throw(size_t size, size_t alignment) {
+    if (void* p = counted_alloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) {
+    return counted_alloc_or_throw(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return counted_alloc_or_throw(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return counted_alloc_or_throw(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return counted_alloc_or_throw(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+struct BenchOptions {
+    std::vector<std::string> inputs;   // PDFs and directories of PDFs
+    std::vector<int> thread_counts;    // empty = 1, 2, 4, ... up to the CPUs available
+    int repeat = 3;                    // the fastest run of each thread count is reported
+    TokenizerMode tokenizer_mode = TokenizerMode::Greedy;
+    CpuAffinity cpu_affinity = CpuAffinity::None;
+    bool auto_tune = false;
+    std::string output_file;           // "" = no JSON
+    std::vector<std::string> compare;  // base and new result files
+    double threshold = 10.0;           // % drop in pages/s that counts as a regression
+};
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [OPTIONS] [PDF or DIR ...]\n";
+    std::cout << "       " << program_name << " --compare BASE.json NEW.json [--threshold PCT]\n";
+    std::cout << "\nChunks every PDF of the corpus (default: n3797.pdf and test_pdfs/) at each\n";
+    std::cout << "thread count, each run in its own process, and reports per-stage time,\n";
+    std::cout << "pages/second, peak RSS and C++ heap allocations.\n";
+    std::cout << "\nOptions:\n";
+    std::cout << "  --threads LIST      Thread counts, e.g. 1,2,4,8 (default: powers of two up to\n";
+    std::cout << "                      the CPUs available, and that count)\n";
+    std::cout << "  --repeat N          Runs per thread count; the fastest is kept (default: 3)\n";
+    std::cout << "  --tokenizer MODE    greedy (default) or exact\n";
+    std::cout << "  --cpu-affinity MODE Pin workers: none (default), cores or numa\n";
+    std::cout << "  --auto-tune         Let each run's engine tune itself; the choice is recorded\n";
+    std::cout << "  -o, --output FILE   Write the results as JSON\n";
+    std::cout << "  --compare BASE NEW  Diff two result files; exits 1 on a regression\n";
+    std::cout << "  --threshold PCT     pages/second drop counted as a regression (default: 10)\n";
+    std::cout << "  -h, --help          Show this help message\n";
+}
+
+std::vector<int> parse_thread_list(const std::string& list) {
+    std::vector<int> counts;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int count = std::stoi(item);
+        if (count <= 0) {
+            throw std::invalid_argument("thread counts must be positive");
+        }
+        counts.push_back(count);
+    }
+    return counts;
+}
+
+BenchOptions parse_arguments(int argc, char* argv[]) {
+    BenchOptions options;
+    
+    const char* short_opts = "o:h";
+    const struct option long_opts[] = {
+        {"threads", required_argument, nullptr, 1001},
+        {"repeat", required_argument, nullptr, 1002},
+        {"tokenizer", required_argument, nullptr, 1003},
+        {"output", required_argument, nullptr, 'o'},
+        {"compare", no_argument, nullptr, 1004},
+        {"threshold", required_argument, nullptr, 1005},
+        {"cpu-affinity", required_argument, nullptr, 1006},
+        {"auto-tune", no_argument, nullptr, 1007},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    
+    bool compare = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, short_opts, long_opts, nullptr)) != -1) {
+        switch (opt) {
+            case 1001:
+                options.thread_counts = parse_thread_list(optarg);
+                break;
+            case 1002:
+                options.repeat = std::stoi(optarg);
+                if (options.repeat <= 0) {
+                    throw std::invalid_argument("repeat must be positive");
+                }
+                break;
+            case 1003: {
+                std::string mode = optarg;
+                if (mode == "exact") {
+                    options.tokenizer_mode = TokenizerMode::ExactBpe;
+                } else if (mode != "greedy") {
+                    throw std::invalid_argument("tokenizer must be 'greedy' or 'exact'");
+                }
+                break;
+            }
+            case 'o':
+                options.output_file = optarg;
+                break;
+            case 1004:
+                compare = true;
+                break;
+            case 1005:
+                options.threshold = std::stod(optarg);
+                break;
+            case 1006:
+                options.cpu_affinity = parse_cpu_affinity(optarg);
+                break;
+            case 1007:
+                options.auto_tune = true;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                std::exit(0);
+            default:
+                throw std::invalid_argument("Unknown option");
+        }
+    }
+    
+    for (int i = optind; i < argc; ++i) {
+        (compare ? options.compare : options.inputs).push_back(argv[i]);
+    }
+    if (compare && options.compare.size() != 2) {
+        throw std::invalid_argument("--compare takes exactly two result files");
+    }
+    
+    if (options.thread_counts.empty()) {
+        int cpus = static_cast<int>(available_cpus());
+        for (int count = 1; count < cpus; count *= 2) {
+            options.thread_counts.push_back(count);
+        }
+        options.thread_counts.push_back(cpus);
+    }
+    return options;
+}
+
+// The PDFs named directly, then those directly inside each directory, by name
+std::vector<std::string> collect_corpus(std::vector<std::string> inputs) {
+    if (inputs.empty()) {
+        for (const char* fallback : {"n3797.pdf", "test_pdfs"}) {
+            if (fs::exists(fallback)) inputs.push_back(fallback);
+        }
+    }
+    
+    std::vector<std::string> files;
+    for (const auto& input : inputs) {
+        if (!fs::exists(input)) {
+            throw std::runtime_error("Not found: " + input);
+        }
+        if (!fs::is_directory(input)) {
+            files.push_back(input);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (const auto& entry : fs::directory_iterator(input)) {
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (entry.is_regular_file() && extension == ".pdf") {
+                found.push_back(entry.path().string());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+size_t peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+    return usage.ru_maxrss;         // kilobytes on Linux
+#endif
+}
+
+// One pass over the corpus on a chunker of its own
+nlohmann::json run_once(const std::vector<std::string>& files, int threads, const BenchOptions& bench) {
+    ChunkOptions options;
+    options.thread_count = threads;
+    options.tokenizer_mode = bench.tokenizer_mode;
+    options.cpu_affinity = bench.cpu_affinity;
+    options.auto_tune = bench.auto_tune;
+    
+    reset_metrics();
+    uint64_t allocations_before = g_allocations.load();
+    uint64_t bytes_before = g_allocated_bytes.load();
+    auto start = steady_clock::now();
+    
+    int pages = 0;
+    int chunks = 0;
+    nlohmann::json errors = nlohmann::json::array();
+    nlohmann::json engine;
+    {
+        HierarchicalChunker chunker(options);
+        chunker.chunk_files(files, [&](const std::string& path, ChunkingResult&& result) {
+            if (!result.error.empty()) {
+                errors.push_back(path + ": " + result.error);
+            }
+            pages += result.total_pages;
+            chunks += result.total_chunks;
+        });
+        engine = chunker.engine()->settings();
+    }
+    
+    double wall_ms = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0;
+    nlohmann::json metrics = metrics_snapshot();
+    
+    nlohmann::json run;
+    run["threads"] = threads;
+    run["wall_ms"] = wall_ms;
+    run["pages"] = pages;
+    run["chunks"] = chunks;
+    run["pages_per_second"] = wall_ms > 0 ? pages * 1000.0 / wall_ms : 0.0;
+    run["peak_rss_kb"] = peak_rss_kb();
+    run["allocations"] = g_allocations.load() - allocations_before;
+    run["allocated_bytes"] = g_allocated_bytes.load() - bytes_before;
+    run["stages"] = metrics["stages"];
+    run["counters"] = metrics["counters"];
+    run["engine"] = std::move(engine);
+    run["errors"] = std::move(errors);
+    return run;
+}
+
+// run_once in a child process, so that peak RSS and the MuPDF caches
+// belong to this run alone
+nlohmann::json run_isolated(const std::vector<std::string>& files, int threads, const BenchOptions& bench) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::runtime_error("pipe failed");
+    }
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork failed");
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        std::string out;
+        try {
+            out = run_once(files, threads, bench).dump();
+        } catch (const std::exception& e) {
+            nlohmann::json failed;
+            failed["error"] = e.what();
+            out = failed.dump();
+        }
+        for (size_t written = 0; written < out.size();) {
+            ssize_t n = write(fds[1], out.data() + written, out.size() - written);
+            if (n <= 0) break;
+            written += static_cast<size_t>(n);
+        }
+        close(fds[1]);
+        _exit(0);
+    }
+    
+    close(fds[1]);
+    std::string in;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        in.append(buffer, static_cast<size_t>(n));
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    
+    if (in.empty()) {
+        throw std::runtime_error("benchmark run with " + std::to_string(threads) + " threads crashed");
+    }
+    nlohmann::json run = nlohmann::json::parse(in);
+    if (run.contains("error")) {
+        throw std::runtime_error(run["error"].get<std::string>());
+    }
+    return run;
+}
+
+double stage_ms(const nlohmann::json& run, const char* stage) {
+    return run["stages"][stage]["total_ms"].get<double>();
+}
+
+constexpr const char* kStages[] = {"open", "load_page", "stext", "tokenize", "chunk"};
+
+void print_runs(const nlohmann::json& runs) {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(8) << "threads" << std::setw(11) << "wall ms" << std::setw(10) << "pages/s"
+              << std::setw(9) << "speedup" << std::setw(10) << "RSS MB" << std::setw(12) << "allocs"
+              << std::setw(13) << "mupdf allocs" << std::setw(9) << "pooled";
+    for (const char* stage : kStages) std::cout << std::setw(11) << stage;
+    std::cout << "\n";
+    
+    double base = runs.empty() ? 0.0 : runs[0]["pages_per_second"].get<double>();
+    for (const auto& run : runs) {
+        double pages_per_second = run["pages_per_second"].get<double>();
+        std::cout << std::setw(8) << run["threads"].get<int>()
+                  << std::setw(11) << run["wall_ms"].get<double>()
+                  << std::setw(10) << pages_per_second
+                  << std::setw(8) << (base > 0 ? pages_per_second / base : 0.0) << "x"
+                  << std::setw(10) << run["peak_rss_kb"].get<double>() / 1024
+                  << std::setw(12) << run["allocations"].get<uint64_t>();
+        uint64_t mupdf_allocations = run["counters"].value("mupdf_allocations", uint64_t(0));
+        uint64_t pooled = run["counters"].value("mupdf_allocations_pooled", uint64_t(0));
+        std::cout << std::setw(13) << mupdf_allocations
+                  << std::setw(8) << (mupdf_allocations > 0 ? 100.0 * pooled / mupdf_allocations : 0.0) << "%";
+        for (const char* stage : kStages) std::cout << std::setw(11) << stage_ms(run, stage);
+        std::cout << "\n";
+    }
+    std::cout << "(stage columns: milliseconds summed over all threads)\n";
+}
+
+nlohmann::json load_results(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot read " + path);
+    }
+    return nlohmann::json::parse(in);
+}
+
+// Prints new against base per thread count; returns false on a regression
+bool compare_results(const std::string& base_path, const std::string& new_path, double threshold) {
+    nlohmann::json base = load_results(base_path);
+    nlohmann::json current = load_results(new_path);
+    
+    auto change = [](double before, double after) {
+        return before != 0 ? 100.0 * (after - before) / before : 0.0;
+    };
+    
+    bool ok = true;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto& run : current["runs"]) {
+        int threads = run["threads"].get<int>();
+        auto match = std::find_if(base["runs"].begin(), base["runs"].end(), [threads](const nlohmann::json& r) {
+            return r["threads"].get<int>() == threads;
+        });
+        if (match == base["runs"].end()) {
+            std::cout << threads << " threads: not in " << base_path << "\n";
+            continue;
+        }
+        
+        double before = (*match)["pages_per_second"].get<double>();
+        double after = run["pages_per_second"].get<double>();
+        bool regressed = change(before, after) < -threshold;
+        ok = ok && !regressed;
+        
+        std::cout << threads << " threads: " << before << " -> " << after << " pages/s ("
+                  << std::showpos << change(before, after) << "%" << std::noshowpos << ")"
+                  << (regressed ? "  REGRESSION" : "") << "\n";
+        std::cout << "  peak RSS " << (*match)["peak_rss_kb"].get<double>() / 1024 << " -> "
+                  << run["peak_rss_kb"].get<double>() / 1024 << " MB, allocations "
+                  << (*match)["allocations"].get<uint64_t>() << " -> " << run["allocations"].get<uint64_t>() << "\n";
+        for (const char* stage : kStages) {
+            double stage_before = stage_ms(*match, stage);
+            double stage_after = stage_ms(run, stage);
+            std::cout << "  " << std::setw(10) << std::left << stage << std::right
+                      << stage_before << " -> " << stage_after << " ms (" << std::showpos
+                      << change(stage_before, stage_after) << "%" << std::noshowpos << ")\n";
+        }
+    }
+    
+    if (base["corpus"] != current["corpus"]) {
+        std::cout << "Warning: the two results were measured on different corpora\n";
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        BenchOptions options = parse_arguments(argc, argv);
+        if (!options.compare.empty()) {
+            return compare_results(options.compare[0], options.compare[1], options.threshold) ? 0 : 1;
+        }
+        
+        std::vector<std::string> files = collect_corpus(options.inputs);
+        if (files.empty()) {
+            throw std::runtime_error("No PDFs found; pass files or directories");
+        }
+        
+        nlohmann::json corpus = nlohmann::json::array();
+        for (const auto& file : files) {
+            nlohmann::json entry;
+            entry["file"] = fs::path(file).filename().string();
+            entry["bytes"] = fs::file_size(file);
+            corpus.push_back(std::move(entry));
+        }
+        
+        std::cout << "=== Pipeline Benchmark ===\n";
+        std::cout << files.size() << " PDFs, best of " << options.repeat << " runs per thread count\n\n";
+        
+        nlohmann::json runs = nlohmann::json::array();
+        for (int threads : options.thread_counts) {
+            nlohmann::json best;
+            for (int r = 0; r < options.repeat; ++r) {
+                nlohmann::json run = run_isolated(files, threads, options);
+                if (best.is_null() || run["wall_ms"].get<double>() < best["wall_ms"].get<double>()) {
+                    best = std::move(run);
+                }
+            }
+            for (const auto& error : best["errors"]) {
+                std::cerr << "Warning: " << error.get<std::string>() << "\n";
+            }
+            runs.push_back(std::move(best));
+        }
+        print_runs(runs);
+        
+        if (!options.output_file.empty()) {
+            nlohmann::json results;
+            results["version"] = 1;
+            results["timestamp"] = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+            results["hardware_concurrency"] = std::thread::hardware_concurrency();
+            results["available_cpus"] = available_cpus();
+            results["tokenizer"] = options.tokenizer_mode == TokenizerMode::ExactBpe ? "exact" : "greedy";
+            results["cpu_affinity"] = cpu_affinity_name(options.cpu_affinity);
+            results["auto_tune"] = options.auto_tune;
+            results["repeat"] = options.repeat;
+            results["corpus"] = std::move(corpus);
+            results["runs"] = std::move(runs);
+            
+            std::ofstream out(options.output_file);
+            out << results.dump(2) << "\n";
+            if (!out) {
+                throw std::runtime_error("Cannot write " + options.output_file);
+            }
+            std::cout << "\nResults saved to: " << options.output_file << "\n";
+        }
+        return 0;
+    
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+#include "../include/fast_pdf_parser/thread_pool.h"
+
+using namespace fast_pdf_parser;
+using namespace std::chrono;
+
+// The pool's previous design, for comparison: one std::queue of
+// std::function behind one mutex, and a shared_ptr<packaged_task> per task
+class SingleQueuePool {
+public:
+    explicit SingleQueuePool(size_t num_threads) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers_.emplace_back([this] {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                        if (stop_ && tasks_.empty()) return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~SingleQueuePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        condition_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    template<typename F>
+    std::future<void> enqueue(F&& f) {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([task]() { (*task)(); });
+        }
+        condition_.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_ = false;
+};
+
+constexpr int kProducers = 4;
+constexpr int kTasksPerProducer = 25000;
+constexpr int kFanOut = 100000;
+
+// Runs produce(p) on kProducers threads at once; returns ns per task
+template<typename Produce>
+double time_producers(Produce produce) {
+    auto start = high_resolution_clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back(produce, p);
+    }
+    for (auto& producer : producers) producer.join();
+    auto elapsed = high_resolution_clock::now() - start;
+    return duration<double, std::nano>(elapsed).count() / (kProducers * kTasksPerProducer);
+}
+
+// Every producer enqueues its tasks and waits for all of their futures
+template<typename Pool>
+double time_enqueue(Pool& pool, std::atomic<int>& counter) {
+    return time_producers([&](int) {
+        std::vector<std::future<void>> futures;
+        futures.reserve(kTasksPerProducer);
+        for (int i = 0; i < kTasksPerProducer; ++i) {
+            futures.push_back(pool.enqueue([&counter]() { counter++; }));
+        }
+        for (auto& f : futures) f.get();
+    });
+}
+
+int main() {
+    std::cout << "=== Thread Pool Benchmark ===\n\n";
+
+    const size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    const int total = kProducers * kTasksPerProducer;
+    std::atomic<int> counter{0};
+
+    double single_ns;
+    {
+        SingleQueuePool pool(threads);
+        single_ns = time_enqueue(pool, counter);
+    }
+    bool complete = counter == total;
+
+    ThreadPool pool(threads);
+    counter = 0;
+    double enqueue_ns = time_enqueue(pool, counter);
+    complete = complete && counter == total;
+
+    counter = 0;
+    double submit_ns = time_producers([&](int) {
+        for (int i = 0; i < kTasksPerProducer; ++i) {
+            pool.submit([&counter]() { counter++; });
+        }
+    });
+    pool.wait_all();
+    complete = complete && counter == total;
+
+    std::cout << kProducers << " producers, " << threads << " workers, tiny tasks:\n";
+    std::cout << "  single queue enqueue:  " << single_ns << " ns/task\n";
+    std::cout << "  work-stealing enqueue: " << enqueue_ns << " ns/task\n";
+    std::cout << "  work-stealing submit:  " << submit_ns << " ns/task\n\n";
+
+    // One task fans out per-line style work onto its own deque, which the
+    // other workers have to steal from
+    std::atomic<long> sum{0};
+    std::mutex ids_mutex;
+    std::set<std::thread::id> ids;
+    auto start = high_resolution_clock::now();
+    pool.submit([&]() {
+        for (int i = 0; i < kFanOut; ++i) {
+            pool.submit([&sum, &ids, &ids_mutex, i]() {
+                sum += i;
+                if (i % 1000 == 0) {
+                    std::lock_guard<std::mutex> lock(ids_mutex);
+                    ids.insert(std::this_thread::get_id());
+                }
+            });
+        }
+    });
+    pool.wait_all();
+    auto elapsed = high_resolution_clock::now() - start;
+    complete = complete && sum == static_cast<long>(kFanOut) * (kFanOut - 1) / 2;
+
+    std::cout << "Nested fan-out of " << kFanOut << " tasks: "
+              << duration<double, std::nano>(elapsed).count() / kFanOut << " ns/task on "
+              << ids.size() << " of " << threads << " workers\n";
+
+    if (!complete) {
+        std::cerr << "Some tasks did not run\n";
+        return 1;
+    }
+    return 0;
+}
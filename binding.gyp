@@ -1,13 +1,68 @@
 {
   "targets": [
+    {
+      "target_name": "gen_vocab_table",
+      "type": "executable",
+      "sources": [
+        "src/gen_vocab_table.cpp",
+        "src/cl100k_base_data.cpp"
+      ],
+      "include_dirs": [
+        "include"
+      ],
+      "cflags_cc": [
+        "-std=c++17",
+        "-O2"
+      ],
+      "xcode_settings": {
+        "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+        "MACOSX_DEPLOYMENT_TARGET": "10.15"
+      },
+      "msvs_settings": {
+        "VCCLCompilerTool": {
+          "AdditionalOptions": [
+            "/std:c++17"
+          ]
+        }
+      }
+    },
     {
       "target_name": "fast_pdf_parser",
+      "actions": [
+        {
+          "action_name": "generate_vocab_table",
+          "inputs": [
+            "<(PRODUCT_DIR)/gen_vocab_table<(EXECUTABLE_SUFFIX)"
+          ],
+          "outputs": [
+            "<(INTERMEDIATE_DIR)/cl100k_vocab_table.cpp"
+          ],
+          "action": [
+            "<(PRODUCT_DIR)/gen_vocab_table<(EXECUTABLE_SUFFIX)",
+            "--cpp",
+            "<(INTERMEDIATE_DIR)/cl100k_vocab_table.cpp"
+          ],
+          "process_outputs_as_sources": 1
+        }
+      ],
+      "defines": [
+        "FAST_PDF_PARSER_PRECOMPILED_VOCAB"
+      ],
       "sources": [
         "src/binding.cc",
         "src/fast_pdf_parser.cpp",
+        "src/pdf_source.cpp",
+        "src/page_selection.cpp",
+        "src/metrics.cpp",
+        "src/content_hash.cpp",
+        "src/page_text_cache.cpp",
         "src/text_extractor.cpp",
         "src/thread_pool.cpp",
+        "src/cpu_topology.cpp",
+        "src/parse_engine.cpp",
         "src/hierarchical_chunker.cpp",
+        "src/chunk_output.cpp",
+        "src/line_classifier.cpp",
         "src/cl100k_base_data.cpp"
       ],
       "include_dirs": [
@@ -15,7 +70,8 @@
         "include"
       ],
       "dependencies": [
-        "<!(node -p \"require('node-addon-api').gyp\")"
+        "<!(node -p \"require('node-addon-api').gyp\")",
+        "gen_vocab_table"
       ],
       "cflags_cc": [
         "-std=c++17",
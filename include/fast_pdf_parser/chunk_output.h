@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdint>
+#include "fast_pdf_parser/hierarchical_chunker.h"
+#include "fast_pdf_parser/pdf_source.h"
+
+namespace fast_pdf_parser {
+
+// On-disk formats for a document's chunks
+enum class ChunkFormat {
+    Json,       // Docling-style JSON array; buffered, since every chunk's meta
+                // carries total_chunks
+    JsonLines,  // one Docling-style chunk object per line, written as it is
+                // produced; meta has no total_chunks
+    Binary      // length-prefixed records plus a footer index, written as
+                // produced; see BinaryChunkReader
+};
+
+// Parses "json", "jsonl" or "binary"; throws std::invalid_argument otherwise
+ChunkFormat parse_chunk_format(const std::string& name);
+
+// The document the chunks came from, as recorded in every output format
+struct ChunkOrigin {
+    std::string filename;
+    uint64_t binary_hash = 0;  // content_hash() of the PDF
+};
+
+// Writes chunks to a file in one of the ChunkFormats. Chunks must be
+// written in document order; nothing is complete until finish().
+class ChunkWriter {
+public:
+    // Creates the file; throws std::runtime_error if it cannot be opened
+    static std::unique_ptr<ChunkWriter> create(ChunkFormat format, const std::string& path,
+                                               const ChunkOrigin& origin);
+    
+    virtual ~ChunkWriter() = default;
+    
+    virtual void write(const ChunkResult& chunk) = 0;
+    
+    // Writes what follows the last chunk and closes the file. Throws
+    // std::runtime_error if anything failed to write.
+    virtual void finish() = 0;
+    
+    size_t chunks_written() const { return chunks_written_; }
+
+protected:
+    size_t chunks_written_ = 0;
+};
+
+// Random access to a ChunkFormat::Binary file, read in place from a
+// memory mapping; chunk i is found through the footer index without
+// reading the ones before it.
+//
+// Layout, integers little-endian:
+//   header:  "FPCHUNKS", u32 version, u32 reserved, u64 binary_hash,
+//            u32 filename size, filename bytes
+//   record:  u32 size of the rest of the record, i32 token_count,
+//            i32 overlap_tokens, i32 start_page, i32 end_page,
+//            i32 min_heading_level, u8 has_major_heading, 3 zero bytes,
+//            text bytes
+//   footer:  u64 offset of each record, u64 record count,
+//            u64 offset of the footer, "FPCHEND1"
+class BinaryChunkReader {
+public:
+    // Throws std::runtime_error if the file is missing or not a complete
+    // binary chunk file
+    explicit BinaryChunkReader(const std::string& path);
+    ~BinaryChunkReader();
+    
+    size_t size() const { return count_; }
+    const ChunkOrigin& origin() const { return origin_; }
+    
+    ChunkResult chunk(size_t i) const;
+    std::string_view text(size_t i) const;  // valid while the reader lives
+
+private:
+    const unsigned char* record(size_t i, uint32_t& size) const;
+    
+    PdfSource mapping_;
+    ChunkOrigin origin_;
+    const unsigned char* index_ = nullptr;
+    size_t count_ = 0;
+};
+
+} // namespace fast_pdf_parser
\ No newline at end of file
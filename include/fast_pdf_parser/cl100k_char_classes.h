@@ -0,0 +1,352 @@
+/**
+ * @file cl100k_char_classes.h
+ * @brief Unicode character classes used by the cl100k pre-tokenizer
+ *
+ * The cl100k_base split pattern only distinguishes letters (\p{L}), numbers
+ * (\p{N}), whitespace (\s) and everything else. Code points below 0x80 are
+ * classified with a lookup table; the rest with a binary search over the
+ * non-ASCII ranges below, which were generated from the Unicode 14.0.0
+ * character database (general categories L* and N*, property White_Space).
+ * Code points not covered by a range are Other.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+namespace fast_pdf_parser {
+namespace cl100k {
+
+enum class CharClass : uint8_t {
+    Other,
+    Letter,
+    Number,
+    Space,    // \s other than \r and \n
+    Newline   // \r or \n
+};
+
+struct CharClassRange {
+    uint32_t first;
+    uint32_t last;
+    CharClass cls;
+};
+
+// Classes of the ASCII range, indexed by byte
+inline constexpr CharClass kAsciiClasses[128] = {
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Space, CharClass::Newline, CharClass::Space,
+    CharClass::Space, CharClass::Newline, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Space, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Number, CharClass::Number, CharClass::Number, CharClass::Number,
+    CharClass::Number, CharClass::Number, CharClass::Number, CharClass::Number,
+    CharClass::Number, CharClass::Number, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+    CharClass::Other, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Letter,
+    CharClass::Letter, CharClass::Letter, CharClass::Letter, CharClass::Other,
+    CharClass::Other, CharClass::Other, CharClass::Other, CharClass::Other,
+};
+
+// Non-ASCII code points that are not Other, sorted and disjoint
+inline constexpr CharClassRange kCharClassRanges[] = {
+    {0x85, 0x85, CharClass::Space}, {0xA0, 0xA0, CharClass::Space}, {0xAA, 0xAA, CharClass::Letter},
+    {0xB2, 0xB3, CharClass::Number}, {0xB5, 0xB5, CharClass::Letter}, {0xB9, 0xB9, CharClass::Number},
+    {0xBA, 0xBA, CharClass::Letter}, {0xBC, 0xBE, CharClass::Number}, {0xC0, 0xD6, CharClass::Letter},
+    {0xD8, 0xF6, CharClass::Letter}, {0xF8, 0x2C1, CharClass::Letter}, {0x2C6, 0x2D1, CharClass::Letter},
+    {0x2E0, 0x2E4, CharClass::Letter}, {0x2EC, 0x2EC, CharClass::Letter}, {0x2EE, 0x2EE, CharClass::Letter},
+    {0x370, 0x374, CharClass::Letter}, {0x376, 0x377, CharClass::Letter}, {0x37A, 0x37D, CharClass::Letter},
+    {0x37F, 0x37F, CharClass::Letter}, {0x386, 0x386, CharClass::Letter}, {0x388, 0x38A, CharClass::Letter},
+    {0x38C, 0x38C, CharClass::Letter}, {0x38E, 0x3A1, CharClass::Letter}, {0x3A3, 0x3F5, CharClass::Letter},
+    {0x3F7, 0x481, CharClass::Letter}, {0x48A, 0x52F, CharClass::Letter}, {0x531, 0x556, CharClass::Letter},
+    {0x559, 0x559, CharClass::Letter}, {0x560, 0x588, CharClass::Letter}, {0x5D0, 0x5EA, CharClass::Letter},
+    {0x5EF, 0x5F2, CharClass::Letter}, {0x620, 0x64A, CharClass::Letter}, {0x660, 0x669, CharClass::Number},
+    {0x66E, 0x66F, CharClass::Letter}, {0x671, 0x6D3, CharClass::Letter}, {0x6D5, 0x6D5, CharClass::Letter},
+    {0x6E5, 0x6E6, CharClass::Letter}, {0x6EE, 0x6EF, CharClass::Letter}, {0x6F0, 0x6F9, CharClass::Number},
+    {0x6FA, 0x6FC, CharClass::Letter}, {0x6FF, 0x6FF, CharClass::Letter}, {0x710, 0x710, CharClass::Letter},
+    {0x712, 0x72F, CharClass::Letter}, {0x74D, 0x7A5, CharClass::Letter}, {0x7B1, 0x7B1, CharClass::Letter},
+    {0x7C0, 0x7C9, CharClass::Number}, {0x7CA, 0x7EA, CharClass::Letter}, {0x7F4, 0x7F5, CharClass::Letter},
+    {0x7FA, 0x7FA, CharClass::Letter}, {0x800, 0x815, CharClass::Letter}, {0x81A, 0x81A, CharClass::Letter},
+    {0x824, 0x824, CharClass::Letter}, {0x828, 0x828, CharClass::Letter}, {0x840, 0x858, CharClass::Letter},
+    {0x860, 0x86A, CharClass::Letter}, {0x870, 0x887, CharClass::Letter}, {0x889, 0x88E, CharClass::Letter},
+    {0x8A0, 0x8C9, CharClass::Letter}, {0x904, 0x939, CharClass::Letter}, {0x93D, 0x93D, CharClass::Letter},
+    {0x950, 0x950, CharClass::Letter}, {0x958, 0x961, CharClass::Letter}, {0x966, 0x96F, CharClass::Number},
+    {0x971, 0x980, CharClass::Letter}, {0x985, 0x98C, CharClass::Letter}, {0x98F, 0x990, CharClass::Letter},
+    {0x993, 0x9A8, CharClass::Letter}, {0x9AA, 0x9B0, CharClass::Letter}, {0x9B2, 0x9B2, CharClass::Letter},
+    {0x9B6, 0x9B9, CharClass::Letter}, {0x9BD, 0x9BD, CharClass::Letter}, {0x9CE, 0x9CE, CharClass::Letter},
+    {0x9DC, 0x9DD, CharClass::Letter}, {0x9DF, 0x9E1, CharClass::Letter}, {0x9E6, 0x9EF, CharClass::Number},
+    {0x9F0, 0x9F1, CharClass::Letter}, {0x9F4, 0x9F9, CharClass::Number}, {0x9FC, 0x9FC, CharClass::Letter},
+    {0xA05, 0xA0A, CharClass::Letter}, {0xA0F, 0xA10, CharClass::Letter}, {0xA13, 0xA28, CharClass::Letter},
+    {0xA2A, 0xA30, CharClass::Letter}, {0xA32, 0xA33, CharClass::Letter}, {0xA35, 0xA36, CharClass::Letter},
+    {0xA38, 0xA39, CharClass::Letter}, {0xA59, 0xA5C, CharClass::Letter}, {0xA5E, 0xA5E, CharClass::Letter},
+    {0xA66, 0xA6F, CharClass::Number}, {0xA72, 0xA74, CharClass::Letter}, {0xA85, 0xA8D, CharClass::Letter},
+    {0xA8F, 0xA91, CharClass::Letter}, {0xA93, 0xAA8, CharClass::Letter}, {0xAAA, 0xAB0, CharClass::Letter},
+    {0xAB2, 0xAB3, CharClass::Letter}, {0xAB5, 0xAB9, CharClass::Letter}, {0xABD, 0xABD, CharClass::Letter},
+    {0xAD0, 0xAD0, CharClass::Letter}, {0xAE0, 0xAE1, CharClass::Letter}, {0xAE6, 0xAEF, CharClass::Number},
+    {0xAF9, 0xAF9, CharClass::Letter}, {0xB05, 0xB0C, CharClass::Letter}, {0xB0F, 0xB10, CharClass::Letter},
+    {0xB13, 0xB28, CharClass::Letter}, {0xB2A, 0xB30, CharClass::Letter}, {0xB32, 0xB33, CharClass::Letter},
+    {0xB35, 0xB39, CharClass::Letter}, {0xB3D, 0xB3D, CharClass::Letter}, {0xB5C, 0xB5D, CharClass::Letter},
+    {0xB5F, 0xB61, CharClass::Letter}, {0xB66, 0xB6F, CharClass::Number}, {0xB71, 0xB71, CharClass::Letter},
+    {0xB72, 0xB77, CharClass::Number}, {0xB83, 0xB83, CharClass::Letter}, {0xB85, 0xB8A, CharClass::Letter},
+    {0xB8E, 0xB90, CharClass::Letter}, {0xB92, 0xB95, CharClass::Letter}, {0xB99, 0xB9A, CharClass::Letter},
+    {0xB9C, 0xB9C, CharClass::Letter}, {0xB9E, 0xB9F, CharClass::Letter}, {0xBA3, 0xBA4, CharClass::Letter},
+    {0xBA8, 0xBAA, CharClass::Letter}, {0xBAE, 0xBB9, CharClass::Letter}, {0xBD0, 0xBD0, CharClass::Letter},
+    {0xBE6, 0xBF2, CharClass::Number}, {0xC05, 0xC0C, CharClass::Letter}, {0xC0E, 0xC10, CharClass::Letter},
+    {0xC12, 0xC28, CharClass::Letter}, {0xC2A, 0xC39, CharClass::Letter}, {0xC3D, 0xC3D, CharClass::Letter},
+    {0xC58, 0xC5A, CharClass::Letter}, {0xC5D, 0xC5D, CharClass::Letter}, {0xC60, 0xC61, CharClass::Letter},
+    {0xC66, 0xC6F, CharClass::Number}, {0xC78, 0xC7E, CharClass::Number}, {0xC80, 0xC80, CharClass::Letter},
+    {0xC85, 0xC8C, CharClass::Letter}, {0xC8E, 0xC90, CharClass::Letter}, {0xC92, 0xCA8, CharClass::Letter},
+    {0xCAA, 0xCB3, CharClass::Letter}, {0xCB5, 0xCB9, CharClass::Letter}, {0xCBD, 0xCBD, CharClass::Letter},
+    {0xCDD, 0xCDE, CharClass::Letter}, {0xCE0, 0xCE1, CharClass::Letter}, {0xCE6, 0xCEF, CharClass::Number},
+    {0xCF1, 0xCF2, CharClass::Letter}, {0xD04, 0xD0C, CharClass::Letter}, {0xD0E, 0xD10, CharClass::Letter},
+    {0xD12, 0xD3A, CharClass::Letter}, {0xD3D, 0xD3D, CharClass::Letter}, {0xD4E, 0xD4E, CharClass::Letter},
+    {0xD54, 0xD56, CharClass::Letter}, {0xD58, 0xD5E, CharClass::Number}, {0xD5F, 0xD61, CharClass::Letter},
+    {0xD66, 0xD78, CharClass::Number}, {0xD7A, 0xD7F, CharClass::Letter}, {0xD85, 0xD96, CharClass::Letter},
+    {0xD9A, 0xDB1, CharClass::Letter}, {0xDB3, 0xDBB, CharClass::Letter}, {0xDBD, 0xDBD, CharClass::Letter},
+    {0xDC0, 0xDC6, CharClass::Letter}, {0xDE6, 0xDEF, CharClass::Number}, {0xE01, 0xE30, CharClass::Letter},
+    {0xE32, 0xE33, CharClass::Letter}, {0xE40, 0xE46, CharClass::Letter}, {0xE50, 0xE59, CharClass::Number},
+    {0xE81, 0xE82, CharClass::Letter}, {0xE84, 0xE84, CharClass::Letter}, {0xE86, 0xE8A, CharClass::Letter},
+    {0xE8C, 0xEA3, CharClass::Letter}, {0xEA5, 0xEA5, CharClass::Letter}, {0xEA7, 0xEB0, CharClass::Letter},
+    {0xEB2, 0xEB3, CharClass::Letter}, {0xEBD, 0xEBD, CharClass::Letter}, {0xEC0, 0xEC4, CharClass::Letter},
+    {0xEC6, 0xEC6, CharClass::Letter}, {0xED0, 0xED9, CharClass::Number}, {0xEDC, 0xEDF, CharClass::Letter},
+    {0xF00, 0xF00, CharClass::Letter}, {0xF20, 0xF33, CharClass::Number}, {0xF40, 0xF47, CharClass::Letter},
+    {0xF49, 0xF6C, CharClass::Letter}, {0xF88, 0xF8C, CharClass::Letter}, {0x1000, 0x102A, CharClass::Letter},
+    {0x103F, 0x103F, CharClass::Letter}, {0x1040, 0x1049, CharClass::Number}, {0x1050, 0x1055, CharClass::Letter},
+    {0x105A, 0x105D, CharClass::Letter}, {0x1061, 0x1061, CharClass::Letter}, {0x1065, 0x1066, CharClass::Letter},
+    {0x106E, 0x1070, CharClass::Letter}, {0x1075, 0x1081, CharClass::Letter}, {0x108E, 0x108E, CharClass::Letter},
+    {0x1090, 0x1099, CharClass::Number}, {0x10A0, 0x10C5, CharClass::Letter}, {0x10C7, 0x10C7, CharClass::Letter},
+    {0x10CD, 0x10CD, CharClass::Letter}, {0x10D0, 0x10FA, CharClass::Letter}, {0x10FC, 0x1248, CharClass::Letter},
+    {0x124A, 0x124D, CharClass::Letter}, {0x1250, 0x1256, CharClass::Letter}, {0x1258, 0x1258, CharClass::Letter},
+    {0x125A, 0x125D, CharClass::Letter}, {0x1260, 0x1288, CharClass::Letter}, {0x128A, 0x128D, CharClass::Letter},
+    {0x1290, 0x12B0, CharClass::Letter}, {0x12B2, 0x12B5, CharClass::Letter}, {0x12B8, 0x12BE, CharClass::Letter},
+    {0x12C0, 0x12C0, CharClass::Letter}, {0x12C2, 0x12C5, CharClass::Letter}, {0x12C8, 0x12D6, CharClass::Letter},
+    {0x12D8, 0x1310, CharClass::Letter}, {0x1312, 0x1315, CharClass::Letter}, {0x1318, 0x135A, CharClass::Letter},
+    {0x1369, 0x137C, CharClass::Number}, {0x1380, 0x138F, CharClass::Letter}, {0x13A0, 0x13F5, CharClass::Letter},
+    {0x13F8, 0x13FD, CharClass::Letter}, {0x1401, 0x166C, CharClass::Letter}, {0x166F, 0x167F, CharClass::Letter},
+    {0x1680, 0x1680, CharClass::Space}, {0x1681, 0x169A, CharClass::Letter}, {0x16A0, 0x16EA, CharClass::Letter},
+    {0x16EE, 0x16F0, CharClass::Number}, {0x16F1, 0x16F8, CharClass::Letter}, {0x1700, 0x1711, CharClass::Letter},
+    {0x171F, 0x1731, CharClass::Letter}, {0x1740, 0x1751, CharClass::Letter}, {0x1760, 0x176C, CharClass::Letter},
+    {0x176E, 0x1770, CharClass::Letter}, {0x1780, 0x17B3, CharClass::Letter}, {0x17D7, 0x17D7, CharClass::Letter},
+    {0x17DC, 0x17DC, CharClass::Letter}, {0x17E0, 0x17E9, CharClass::Number}, {0x17F0, 0x17F9, CharClass::Number},
+    {0x1810, 0x1819, CharClass::Number}, {0x1820, 0x1878, CharClass::Letter}, {0x1880, 0x1884, CharClass::Letter},
+    {0x1887, 0x18A8, CharClass::Letter}, {0x18AA, 0x18AA, CharClass::Letter}, {0x18B0, 0x18F5, CharClass::Letter},
+    {0x1900, 0x191E, CharClass::Letter}, {0x1946, 0x194F, CharClass::Number}, {0x1950, 0x196D, CharClass::Letter},
+    {0x1970, 0x1974, CharClass::Letter}, {0x1980, 0x19AB, CharClass::Letter}, {0x19B0, 0x19C9, CharClass::Letter},
+    {0x19D0, 0x19DA, CharClass::Number}, {0x1A00, 0x1A16, CharClass::Letter}, {0x1A20, 0x1A54, CharClass::Letter},
+    {0x1A80, 0x1A89, CharClass::Number}, {0x1A90, 0x1A99, CharClass::Number}, {0x1AA7, 0x1AA7, CharClass::Letter},
+    {0x1B05, 0x1B33, CharClass::Letter}, {0x1B45, 0x1B4C, CharClass::Letter}, {0x1B50, 0x1B59, CharClass::Number},
+    {0x1B83, 0x1BA0, CharClass::Letter}, {0x1BAE, 0x1BAF, CharClass::Letter}, {0x1BB0, 0x1BB9, CharClass::Number},
+    {0x1BBA, 0x1BE5, CharClass::Letter}, {0x1C00, 0x1C23, CharClass::Letter}, {0x1C40, 0x1C49, CharClass::Number},
+    {0x1C4D, 0x1C4F, CharClass::Letter}, {0x1C50, 0x1C59, CharClass::Number}, {0x1C5A, 0x1C7D, CharClass::Letter},
+    {0x1C80, 0x1C88, CharClass::Letter}, {0x1C90, 0x1CBA, CharClass::Letter}, {0x1CBD, 0x1CBF, CharClass::Letter},
+    {0x1CE9, 0x1CEC, CharClass::Letter}, {0x1CEE, 0x1CF3, CharClass::Letter}, {0x1CF5, 0x1CF6, CharClass::Letter},
+    {0x1CFA, 0x1CFA, CharClass::Letter}, {0x1D00, 0x1DBF, CharClass::Letter}, {0x1E00, 0x1F15, CharClass::Letter},
+    {0x1F18, 0x1F1D, CharClass::Letter}, {0x1F20, 0x1F45, CharClass::Letter}, {0x1F48, 0x1F4D, CharClass::Letter},
+    {0x1F50, 0x1F57, CharClass::Letter}, {0x1F59, 0x1F59, CharClass::Letter}, {0x1F5B, 0x1F5B, CharClass::Letter},
+    {0x1F5D, 0x1F5D, CharClass::Letter}, {0x1F5F, 0x1F7D, CharClass::Letter}, {0x1F80, 0x1FB4, CharClass::Letter},
+    {0x1FB6, 0x1FBC, CharClass::Letter}, {0x1FBE, 0x1FBE, CharClass::Letter}, {0x1FC2, 0x1FC4, CharClass::Letter},
+    {0x1FC6, 0x1FCC, CharClass::Letter}, {0x1FD0, 0x1FD3, CharClass::Letter}, {0x1FD6, 0x1FDB, CharClass::Letter},
+    {0x1FE0, 0x1FEC, CharClass::Letter}, {0x1FF2, 0x1FF4, CharClass::Letter}, {0x1FF6, 0x1FFC, CharClass::Letter},
+    {0x2000, 0x200A, CharClass::Space}, {0x2028, 0x2029, CharClass::Space}, {0x202F, 0x202F, CharClass::Space},
+    {0x205F, 0x205F, CharClass::Space}, {0x2070, 0x2070, CharClass::Number}, {0x2071, 0x2071, CharClass::Letter},
+    {0x2074, 0x2079, CharClass::Number}, {0x207F, 0x207F, CharClass::Letter}, {0x2080, 0x2089, CharClass::Number},
+    {0x2090, 0x209C, CharClass::Letter}, {0x2102, 0x2102, CharClass::Letter}, {0x2107, 0x2107, CharClass::Letter},
+    {0x210A, 0x2113, CharClass::Letter}, {0x2115, 0x2115, CharClass::Letter}, {0x2119, 0x211D, CharClass::Letter},
+    {0x2124, 0x2124, CharClass::Letter}, {0x2126, 0x2126, CharClass::Letter}, {0x2128, 0x2128, CharClass::Letter},
+    {0x212A, 0x212D, CharClass::Letter}, {0x212F, 0x2139, CharClass::Letter}, {0x213C, 0x213F, CharClass::Letter},
+    {0x2145, 0x2149, CharClass::Letter}, {0x214E, 0x214E, CharClass::Letter}, {0x2150, 0x2182, CharClass::Number},
+    {0x2183, 0x2184, CharClass::Letter}, {0x2185, 0x2189, CharClass::Number}, {0x2460, 0x249B, CharClass::Number},
+    {0x24EA, 0x24FF, CharClass::Number}, {0x2776, 0x2793, CharClass::Number}, {0x2C00, 0x2CE4, CharClass::Letter},
+    {0x2CEB, 0x2CEE, CharClass::Letter}, {0x2CF2, 0x2CF3, CharClass::Letter}, {0x2CFD, 0x2CFD, CharClass::Number},
+    {0x2D00, 0x2D25, CharClass::Letter}, {0x2D27, 0x2D27, CharClass::Letter}, {0x2D2D, 0x2D2D, CharClass::Letter},
+    {0x2D30, 0x2D67, CharClass::Letter}, {0x2D6F, 0x2D6F, CharClass::Letter}, {0x2D80, 0x2D96, CharClass::Letter},
+    {0x2DA0, 0x2DA6, CharClass::Letter}, {0x2DA8, 0x2DAE, CharClass::Letter}, {0x2DB0, 0x2DB6, CharClass::Letter},
+    {0x2DB8, 0x2DBE, CharClass::Letter}, {0x2DC0, 0x2DC6, CharClass::Letter}, {0x2DC8, 0x2DCE, CharClass::Letter},
+    {0x2DD0, 0x2DD6, CharClass::Letter}, {0x2DD8, 0x2DDE, CharClass::Letter}, {0x2E2F, 0x2E2F, CharClass::Letter},
+    {0x3000, 0x3000, CharClass::Space}, {0x3005, 0x3006, CharClass::Letter}, {0x3007, 0x3007, CharClass::Number},
+    {0x3021, 0x3029, CharClass::Number}, {0x3031, 0x3035, CharClass::Letter}, {0x3038, 0x303A, CharClass::Number},
+    {0x303B, 0x303C, CharClass::Letter}, {0x3041, 0x3096, CharClass::Letter}, {0x309D, 0x309F, CharClass::Letter},
+    {0x30A1, 0x30FA, CharClass::Letter}, {0x30FC, 0x30FF, CharClass::Letter}, {0x3105, 0x312F, CharClass::Letter},
+    {0x3131, 0x318E, CharClass::Letter}, {0x3192, 0x3195, CharClass::Number}, {0x31A0, 0x31BF, CharClass::Letter},
+    {0x31F0, 0x31FF, CharClass::Letter}, {0x3220, 0x3229, CharClass::Number}, {0x3248, 0x324F, CharClass::Number},
+    {0x3251, 0x325F, CharClass::Number}, {0x3280, 0x3289, CharClass::Number}, {0x32B1, 0x32BF, CharClass::Number},
+    {0x3400, 0x4DBF, CharClass::Letter}, {0x4E00, 0xA48C, CharClass::Letter}, {0xA4D0, 0xA4FD, CharClass::Letter},
+    {0xA500, 0xA60C, CharClass::Letter}, {0xA610, 0xA61F, CharClass::Letter}, {0xA620, 0xA629, CharClass::Number},
+    {0xA62A, 0xA62B, CharClass::Letter}, {0xA640, 0xA66E, CharClass::Letter}, {0xA67F, 0xA69D, CharClass::Letter},
+    {0xA6A0, 0xA6E5, CharClass::Letter}, {0xA6E6, 0xA6EF, CharClass::Number}, {0xA717, 0xA71F, CharClass::Letter},
+    {0xA722, 0xA788, CharClass::Letter}, {0xA78B, 0xA7CA, CharClass::Letter}, {0xA7D0, 0xA7D1, CharClass::Letter},
+    {0xA7D3, 0xA7D3, CharClass::Letter}, {0xA7D5, 0xA7D9, CharClass::Letter}, {0xA7F2, 0xA801, CharClass::Letter},
+    {0xA803, 0xA805, CharClass::Letter}, {0xA807, 0xA80A, CharClass::Letter}, {0xA80C, 0xA822, CharClass::Letter},
+    {0xA830, 0xA835, CharClass::Number}, {0xA840, 0xA873, CharClass::Letter}, {0xA882, 0xA8B3, CharClass::Letter},
+    {0xA8D0, 0xA8D9, CharClass::Number}, {0xA8F2, 0xA8F7, CharClass::Letter}, {0xA8FB, 0xA8FB, CharClass::Letter},
+    {0xA8FD, 0xA8FE, CharClass::Letter}, {0xA900, 0xA909, CharClass::Number}, {0xA90A, 0xA925, CharClass::Letter},
+    {0xA930, 0xA946, CharClass::Letter}, {0xA960, 0xA97C, CharClass::Letter}, {0xA984, 0xA9B2, CharClass::Letter},
+    {0xA9CF, 0xA9CF, CharClass::Letter}, {0xA9D0, 0xA9D9, CharClass::Number}, {0xA9E0, 0xA9E4, CharClass::Letter},
+    {0xA9E6, 0xA9EF, CharClass::Letter}, {0xA9F0, 0xA9F9, CharClass::Number}, {0xA9FA, 0xA9FE, CharClass::Letter},
+    {0xAA00, 0xAA28, CharClass::Letter}, {0xAA40, 0xAA42, CharClass::Letter}, {0xAA44, 0xAA4B, CharClass::Letter},
+    {0xAA50, 0xAA59, CharClass::Number}, {0xAA60, 0xAA76, CharClass::Letter}, {0xAA7A, 0xAA7A, CharClass::Letter},
+    {0xAA7E, 0xAAAF, CharClass::Letter}, {0xAAB1, 0xAAB1, CharClass::Letter}, {0xAAB5, 0xAAB6, CharClass::Letter},
+    {0xAAB9, 0xAABD, CharClass::Letter}, {0xAAC0, 0xAAC0, CharClass::Letter}, {0xAAC2, 0xAAC2, CharClass::Letter},
+    {0xAADB, 0xAADD, CharClass::Letter}, {0xAAE0, 0xAAEA, CharClass::Letter}, {0xAAF2, 0xAAF4, CharClass::Letter},
+    {0xAB01, 0xAB06, CharClass::Letter}, {0xAB09, 0xAB0E, CharClass::Letter}, {0xAB11, 0xAB16, CharClass::Letter},
+    {0xAB20, 0xAB26, CharClass::Letter}, {0xAB28, 0xAB2E, CharClass::Letter}, {0xAB30, 0xAB5A, CharClass::Letter},
+    {0xAB5C, 0xAB69, CharClass::Letter}, {0xAB70, 0xABE2, CharClass::Letter}, {0xABF0, 0xABF9, CharClass::Number},
+    {0xAC00, 0xD7A3, CharClass::Letter}, {0xD7B0, 0xD7C6, CharClass::Letter}, {0xD7CB, 0xD7FB, CharClass::Letter},
+    {0xF900, 0xFA6D, CharClass::Letter}, {0xFA70, 0xFAD9, CharClass::Letter}, {0xFB00, 0xFB06, CharClass::Letter},
+    {0xFB13, 0xFB17, CharClass::Letter}, {0xFB1D, 0xFB1D, CharClass::Letter}, {0xFB1F, 0xFB28, CharClass::Letter},
+    {0xFB2A, 0xFB36, CharClass::Letter}, {0xFB38, 0xFB3C, CharClass::Letter}, {0xFB3E, 0xFB3E, CharClass::Letter},
+    {0xFB40, 0xFB41, CharClass::Letter}, {0xFB43, 0xFB44, CharClass::Letter}, {0xFB46, 0xFBB1, CharClass::Letter},
+    {0xFBD3, 0xFD3D, CharClass::Letter}, {0xFD50, 0xFD8F, CharClass::Letter}, {0xFD92, 0xFDC7, CharClass::Letter},
+    {0xFDF0, 0xFDFB, CharClass::Letter}, {0xFE70, 0xFE74, CharClass::Letter}, {0xFE76, 0xFEFC, CharClass::Letter},
+    {0xFF10, 0xFF19, CharClass::Number}, {0xFF21, 0xFF3A, CharClass::Letter}, {0xFF41, 0xFF5A, CharClass::Letter},
+    {0xFF66, 0xFFBE, CharClass::Letter}, {0xFFC2, 0xFFC7, CharClass::Letter}, {0xFFCA, 0xFFCF, CharClass::Letter},
+    {0xFFD2, 0xFFD7, CharClass::Letter}, {0xFFDA, 0xFFDC, CharClass::Letter}, {0x10000, 0x1000B, CharClass::Letter},
+    {0x1000D, 0x10026, CharClass::Letter}, {0x10028, 0x1003A, CharClass::Letter}, {0x1003C, 0x1003D, CharClass::Letter},
+    {0x1003F, 0x1004D, CharClass::Letter}, {0x10050, 0x1005D, CharClass::Letter}, {0x10080, 0x100FA, CharClass::Letter},
+    {0x10107, 0x10133, CharClass::Number}, {0x10140, 0x10178, CharClass::Number}, {0x1018A, 0x1018B, CharClass::Number},
+    {0x10280, 0x1029C, CharClass::Letter}, {0x102A0, 0x102D0, CharClass::Letter}, {0x102E1, 0x102FB, CharClass::Number},
+    {0x10300, 0x1031F, CharClass::Letter}, {0x10320, 0x10323, CharClass::Number}, {0x1032D, 0x10340, CharClass::Letter},
+    {0x10341, 0x10341, CharClass::Number}, {0x10342, 0x10349, CharClass::Letter}, {0x1034A, 0x1034A, CharClass::Number},
+    {0x10350, 0x10375, CharClass::Letter}, {0x10380, 0x1039D, CharClass::Letter}, {0x103A0, 0x103C3, CharClass::Letter},
+    {0x103C8, 0x103CF, CharClass::Letter}, {0x103D1, 0x103D5, CharClass::Number}, {0x10400, 0x1049D, CharClass::Letter},
+    {0x104A0, 0x104A9, CharClass::Number}, {0x104B0, 0x104D3, CharClass::Letter}, {0x104D8, 0x104FB, CharClass::Letter},
+    {0x10500, 0x10527, CharClass::Letter}, {0x10530, 0x10563, CharClass::Letter}, {0x10570, 0x1057A, CharClass::Letter},
+    {0x1057C, 0x1058A, CharClass::Letter}, {0x1058C, 0x10592, CharClass::Letter}, {0x10594, 0x10595, CharClass::Letter},
+    {0x10597, 0x105A1, CharClass::Letter}, {0x105A3, 0x105B1, CharClass::Letter}, {0x105B3, 0x105B9, CharClass::Letter},
+    {0x105BB, 0x105BC, CharClass::Letter}, {0x10600, 0x10736, CharClass::Letter}, {0x10740, 0x10755, CharClass::Letter},
+    {0x10760, 0x10767, CharClass::Letter}, {0x10780, 0x10785, CharClass::Letter}, {0x10787, 0x107B0, CharClass::Letter},
+    {0x107B2, 0x107BA, CharClass::Letter}, {0x10800, 0x10805, CharClass::Letter}, {0x10808, 0x10808, CharClass::Letter},
+    {0x1080A, 0x10835, CharClass::Letter}, {0x10837, 0x10838, CharClass::Letter}, {0x1083C, 0x1083C, CharClass::Letter},
+    {0x1083F, 0x10855, CharClass::Letter}, {0x10858, 0x1085F, CharClass::Number}, {0x10860, 0x10876, CharClass::Letter},
+    {0x10879, 0x1087F, CharClass::Number}, {0x10880, 0x1089E, CharClass::Letter}, {0x108A7, 0x108AF, CharClass::Number},
+    {0x108E0, 0x108F2, CharClass::Letter}, {0x108F4, 0x108F5, CharClass::Letter}, {0x108FB, 0x108FF, CharClass::Number},
+    {0x10900, 0x10915, CharClass::Letter}, {0x10916, 0x1091B, CharClass::Number}, {0x10920, 0x10939, CharClass::Letter},
+    {0x10980, 0x109B7, CharClass::Letter}, {0x109BC, 0x109BD, CharClass::Number}, {0x109BE, 0x109BF, CharClass::Letter},
+    {0x109C0, 0x109CF, CharClass::Number}, {0x109D2, 0x109FF, CharClass::Number}, {0x10A00, 0x10A00, CharClass::Letter},
+    {0x10A10, 0x10A13, CharClass::Letter}, {0x10A15, 0x10A17, CharClass::Letter}, {0x10A19, 0x10A35, CharClass::Letter},
+    {0x10A40, 0x10A48, CharClass::Number}, {0x10A60, 0x10A7C, CharClass::Letter}, {0x10A7D, 0x10A7E, CharClass::Number},
+    {0x10A80, 0x10A9C, CharClass::Letter}, {0x10A9D, 0x10A9F, CharClass::Number}, {0x10AC0, 0x10AC7, CharClass::Letter},
+    {0x10AC9, 0x10AE4, CharClass::Letter}, {0x10AEB, 0x10AEF, CharClass::Number}, {0x10B00, 0x10B35, CharClass::Letter},
+    {0x10B40, 0x10B55, CharClass::Letter}, {0x10B58, 0x10B5F, CharClass::Number}, {0x10B60, 0x10B72, CharClass::Letter},
+    {0x10B78, 0x10B7F, CharClass::Number}, {0x10B80, 0x10B91, CharClass::Letter}, {0x10BA9, 0x10BAF, CharClass::Number},
+    {0x10C00, 0x10C48, CharClass::Letter}, {0x10C80, 0x10CB2, CharClass::Letter}, {0x10CC0, 0x10CF2, CharClass::Letter},
+    {0x10CFA, 0x10CFF, CharClass::Number}, {0x10D00, 0x10D23, CharClass::Letter}, {0x10D30, 0x10D39, CharClass::Number},
+    {0x10E60, 0x10E7E, CharClass::Number}, {0x10E80, 0x10EA9, CharClass::Letter}, {0x10EB0, 0x10EB1, CharClass::Letter},
+    {0x10F00, 0x10F1C, CharClass::Letter}, {0x10F1D, 0x10F26, CharClass::Number}, {0x10F27, 0x10F27, CharClass::Letter},
+    {0x10F30, 0x10F45, CharClass::Letter}, {0x10F51, 0x10F54, CharClass::Number}, {0x10F70, 0x10F81, CharClass::Letter},
+    {0x10FB0, 0x10FC4, CharClass::Letter}, {0x10FC5, 0x10FCB, CharClass::Number}, {0x10FE0, 0x10FF6, CharClass::Letter},
+    {0x11003, 0x11037, CharClass::Letter}, {0x11052, 0x1106F, CharClass::Number}, {0x11071, 0x11072, CharClass::Letter},
+    {0x11075, 0x11075, CharClass::Letter}, {0x11083, 0x110AF, CharClass::Letter}, {0x110D0, 0x110E8, CharClass::Letter},
+    {0x110F0, 0x110F9, CharClass::Number}, {0x11103, 0x11126, CharClass::Letter}, {0x11136, 0x1113F, CharClass::Number},
+    {0x11144, 0x11144, CharClass::Letter}, {0x11147, 0x11147, CharClass::Letter}, {0x11150, 0x11172, CharClass::Letter},
+    {0x11176, 0x11176, CharClass::Letter}, {0x11183, 0x111B2, CharClass::Letter}, {0x111C1, 0x111C4, CharClass::Letter},
+    {0x111D0, 0x111D9, CharClass::Number}, {0x111DA, 0x111DA, CharClass::Letter}, {0x111DC, 0x111DC, CharClass::Letter},
+    {0x111E1, 0x111F4, CharClass::Number}, {0x11200, 0x11211, CharClass::Letter}, {0x11213, 0x1122B, CharClass::Letter},
+    {0x11280, 0x11286, CharClass::Letter}, {0x11288, 0x11288, CharClass::Letter}, {0x1128A, 0x1128D, CharClass::Letter},
+    {0x1128F, 0x1129D, CharClass::Letter}, {0x1129F, 0x112A8, CharClass::Letter}, {0x112B0, 0x112DE, CharClass::Letter},
+    {0x112F0, 0x112F9, CharClass::Number}, {0x11305, 0x1130C, CharClass::Letter}, {0x1130F, 0x11310, CharClass::Letter},
+    {0x11313, 0x11328, CharClass::Letter}, {0x1132A, 0x11330, CharClass::Letter}, {0x11332, 0x11333, CharClass::Letter},
+    {0x11335, 0x11339, CharClass::Letter}, {0x1133D, 0x1133D, CharClass::Letter}, {0x11350, 0x11350, CharClass::Letter},
+    {0x1135D, 0x11361, CharClass::Letter}, {0x11400, 0x11434, CharClass::Letter}, {0x11447, 0x1144A, CharClass::Letter},
+    {0x11450, 0x11459, CharClass::Number}, {0x1145F, 0x11461, CharClass::Letter}, {0x11480, 0x114AF, CharClass::Letter},
+    {0x114C4, 0x114C5, CharClass::Letter}, {0x114C7, 0x114C7, CharClass::Letter}, {0x114D0, 0x114D9, CharClass::Number},
+    {0x11580, 0x115AE, CharClass::Letter}, {0x115D8, 0x115DB, CharClass::Letter}, {0x11600, 0x1162F, CharClass::Letter},
+    {0x11644, 0x11644, CharClass::Letter}, {0x11650, 0x11659, CharClass::Number}, {0x11680, 0x116AA, CharClass::Letter},
+    {0x116B8, 0x116B8, CharClass::Letter}, {0x116C0, 0x116C9, CharClass::Number}, {0x11700, 0x1171A, CharClass::Letter},
+    {0x11730, 0x1173B, CharClass::Number}, {0x11740, 0x11746, CharClass::Letter}, {0x11800, 0x1182B, CharClass::Letter},
+    {0x118A0, 0x118DF, CharClass::Letter}, {0x118E0, 0x118F2, CharClass::Number}, {0x118FF, 0x11906, CharClass::Letter},
+    {0x11909, 0x11909, CharClass::Letter}, {0x1190C, 0x11913, CharClass::Letter}, {0x11915, 0x11916, CharClass::Letter},
+    {0x11918, 0x1192F, CharClass::Letter}, {0x1193F, 0x1193F, CharClass::Letter}, {0x11941, 0x11941, CharClass::Letter},
+    {0x11950, 0x11959, CharClass::Number}, {0x119A0, 0x119A7, CharClass::Letter}, {0x119AA, 0x119D0, CharClass::Letter},
+    {0x119E1, 0x119E1, CharClass::Letter}, {0x119E3, 0x119E3, CharClass::Letter}, {0x11A00, 0x11A00, CharClass::Letter},
+    {0x11A0B, 0x11A32, CharClass::Letter}, {0x11A3A, 0x11A3A, CharClass::Letter}, {0x11A50, 0x11A50, CharClass::Letter},
+    {0x11A5C, 0x11A89, CharClass::Letter}, {0x11A9D, 0x11A9D, CharClass::Letter}, {0x11AB0, 0x11AF8, CharClass::Letter},
+    {0x11C00, 0x11C08, CharClass::Letter}, {0x11C0A, 0x11C2E, CharClass::Letter}, {0x11C40, 0x11C40, CharClass::Letter},
+    {0x11C50, 0x11C6C, CharClass::Number}, {0x11C72, 0x11C8F, CharClass::Letter}, {0x11D00, 0x11D06, CharClass::Letter},
+    {0x11D08, 0x11D09, CharClass::Letter}, {0x11D0B, 0x11D30, CharClass::Letter}, {0x11D46, 0x11D46, CharClass::Letter},
+    {0x11D50, 0x11D59, CharClass::Number}, {0x11D60, 0x11D65, CharClass::Letter}, {0x11D67, 0x11D68, CharClass::Letter},
+    {0x11D6A, 0x11D89, CharClass::Letter}, {0x11D98, 0x11D98, CharClass::Letter}, {0x11DA0, 0x11DA9, CharClass::Number},
+    {0x11EE0, 0x11EF2, CharClass::Letter}, {0x11FB0, 0x11FB0, CharClass::Letter}, {0x11FC0, 0x11FD4, CharClass::Number},
+    {0x12000, 0x12399, CharClass::Letter}, {0x12400, 0x1246E, CharClass::Number}, {0x12480, 0x12543, CharClass::Letter},
+    {0x12F90, 0x12FF0, CharClass::Letter}, {0x13000, 0x1342E, CharClass::Letter}, {0x14400, 0x14646, CharClass::Letter},
+    {0x16800, 0x16A38, CharClass::Letter}, {0x16A40, 0x16A5E, CharClass::Letter}, {0x16A60, 0x16A69, CharClass::Number},
+    {0x16A70, 0x16ABE, CharClass::Letter}, {0x16AC0, 0x16AC9, CharClass::Number}, {0x16AD0, 0x16AED, CharClass::Letter},
+    {0x16B00, 0x16B2F, CharClass::Letter}, {0x16B40, 0x16B43, CharClass::Letter}, {0x16B50, 0x16B59, CharClass::Number},
+    {0x16B5B, 0x16B61, CharClass::Number}, {0x16B63, 0x16B77, CharClass::Letter}, {0x16B7D, 0x16B8F, CharClass::Letter},
+    {0x16E40, 0x16E7F, CharClass::Letter}, {0x16E80, 0x16E96, CharClass::Number}, {0x16F00, 0x16F4A, CharClass::Letter},
+    {0x16F50, 0x16F50, CharClass::Letter}, {0x16F93, 0x16F9F, CharClass::Letter}, {0x16FE0, 0x16FE1, CharClass::Letter},
+    {0x16FE3, 0x16FE3, CharClass::Letter}, {0x17000, 0x187F7, CharClass::Letter}, {0x18800, 0x18CD5, CharClass::Letter},
+    {0x18D00, 0x18D08, CharClass::Letter}, {0x1AFF0, 0x1AFF3, CharClass::Letter}, {0x1AFF5, 0x1AFFB, CharClass::Letter},
+    {0x1AFFD, 0x1AFFE, CharClass::Letter}, {0x1B000, 0x1B122, CharClass::Letter}, {0x1B150, 0x1B152, CharClass::Letter},
+    {0x1B164, 0x1B167, CharClass::Letter}, {0x1B170, 0x1B2FB, CharClass::Letter}, {0x1BC00, 0x1BC6A, CharClass::Letter},
+    {0x1BC70, 0x1BC7C, CharClass::Letter}, {0x1BC80, 0x1BC88, CharClass::Letter}, {0x1BC90, 0x1BC99, CharClass::Letter},
+    {0x1D2E0, 0x1D2F3, CharClass::Number}, {0x1D360, 0x1D378, CharClass::Number}, {0x1D400, 0x1D454, CharClass::Letter},
+    {0x1D456, 0x1D49C, CharClass::Letter}, {0x1D49E, 0x1D49F, CharClass::Letter}, {0x1D4A2, 0x1D4A2, CharClass::Letter},
+    {0x1D4A5, 0x1D4A6, CharClass::Letter}, {0x1D4A9, 0x1D4AC, CharClass::Letter}, {0x1D4AE, 0x1D4B9, CharClass::Letter},
+    {0x1D4BB, 0x1D4BB, CharClass::Letter}, {0x1D4BD, 0x1D4C3, CharClass::Letter}, {0x1D4C5, 0x1D505, CharClass::Letter},
+    {0x1D507, 0x1D50A, CharClass::Letter}, {0x1D50D, 0x1D514, CharClass::Letter}, {0x1D516, 0x1D51C, CharClass::Letter},
+    {0x1D51E, 0x1D539, CharClass::Letter}, {0x1D53B, 0x1D53E, CharClass::Letter}, {0x1D540, 0x1D544, CharClass::Letter},
+    {0x1D546, 0x1D546, CharClass::Letter}, {0x1D54A, 0x1D550, CharClass::Letter}, {0x1D552, 0x1D6A5, CharClass::Letter},
+    {0x1D6A8, 0x1D6C0, CharClass::Letter}, {0x1D6C2, 0x1D6DA, CharClass::Letter}, {0x1D6DC, 0x1D6FA, CharClass::Letter},
+    {0x1D6FC, 0x1D714, CharClass::Letter}, {0x1D716, 0x1D734, CharClass::Letter}, {0x1D736, 0x1D74E, CharClass::Letter},
+    {0x1D750, 0x1D76E, CharClass::Letter}, {0x1D770, 0x1D788, CharClass::Letter}, {0x1D78A, 0x1D7A8, CharClass::Letter},
+    {0x1D7AA, 0x1D7C2, CharClass::Letter}, {0x1D7C4, 0x1D7CB, CharClass::Letter}, {0x1D7CE, 0x1D7FF, CharClass::Number},
+    {0x1DF00, 0x1DF1E, CharClass::Letter}, {0x1E100, 0x1E12C, CharClass::Letter}, {0x1E137, 0x1E13D, CharClass::Letter},
+    {0x1E140, 0x1E149, CharClass::Number}, {0x1E14E, 0x1E14E, CharClass::Letter}, {0x1E290, 0x1E2AD, CharClass::Letter},
+    {0x1E2C0, 0x1E2EB, CharClass::Letter}, {0x1E2F0, 0x1E2F9, CharClass::Number}, {0x1E7E0, 0x1E7E6, CharClass::Letter},
+    {0x1E7E8, 0x1E7EB, CharClass::Letter}, {0x1E7ED, 0x1E7EE, CharClass::Letter}, {0x1E7F0, 0x1E7FE, CharClass::Letter},
+    {0x1E800, 0x1E8C4, CharClass::Letter}, {0x1E8C7, 0x1E8CF, CharClass::Number}, {0x1E900, 0x1E943, CharClass::Letter},
+    {0x1E94B, 0x1E94B, CharClass::Letter}, {0x1E950, 0x1E959, CharClass::Number}, {0x1EC71, 0x1ECAB, CharClass::Number},
+    {0x1ECAD, 0x1ECAF, CharClass::Number}, {0x1ECB1, 0x1ECB4, CharClass::Number}, {0x1ED01, 0x1ED2D, CharClass::Number},
+    {0x1ED2F, 0x1ED3D, CharClass::Number}, {0x1EE00, 0x1EE03, CharClass::Letter}, {0x1EE05, 0x1EE1F, CharClass::Letter},
+    {0x1EE21, 0x1EE22, CharClass::Letter}, {0x1EE24, 0x1EE24, CharClass::Letter}, {0x1EE27, 0x1EE27, CharClass::Letter},
+    {0x1EE29, 0x1EE32, CharClass::Letter}, {0x1EE34, 0x1EE37, CharClass::Letter}, {0x1EE39, 0x1EE39, CharClass::Letter},
+    {0x1EE3B, 0x1EE3B, CharClass::Letter}, {0x1EE42, 0x1EE42, CharClass::Letter}, {0x1EE47, 0x1EE47, CharClass::Letter},
+    {0x1EE49, 0x1EE49, CharClass::Letter}, {0x1EE4B, 0x1EE4B, CharClass::Letter}, {0x1EE4D, 0x1EE4F, CharClass::Letter},
+    {0x1EE51, 0x1EE52, CharClass::Letter}, {0x1EE54, 0x1EE54, CharClass::Letter}, {0x1EE57, 0x1EE57, CharClass::Letter},
+    {0x1EE59, 0x1EE59, CharClass::Letter}, {0x1EE5B, 0x1EE5B, CharClass::Letter}, {0x1EE5D, 0x1EE5D, CharClass::Letter},
+    {0x1EE5F, 0x1EE5F, CharClass::Letter}, {0x1EE61, 0x1EE62, CharClass::Letter}, {0x1EE64, 0x1EE64, CharClass::Letter},
+    {0x1EE67, 0x1EE6A, CharClass::Letter}, {0x1EE6C, 0x1EE72, CharClass::Letter}, {0x1EE74, 0x1EE77, CharClass::Letter},
+    {0x1EE79, 0x1EE7C, CharClass::Letter}, {0x1EE7E, 0x1EE7E, CharClass::Letter}, {0x1EE80, 0x1EE89, CharClass::Letter},
+    {0x1EE8B, 0x1EE9B, CharClass::Letter}, {0x1EEA1, 0x1EEA3, CharClass::Letter}, {0x1EEA5, 0x1EEA9, CharClass::Letter},
+    {0x1EEAB, 0x1EEBB, CharClass::Letter}, {0x1F100, 0x1F10C, CharClass::Number}, {0x1FBF0, 0x1FBF9, CharClass::Number},
+    {0x20000, 0x2A6DF, CharClass::Letter}, {0x2A700, 0x2B738, CharClass::Letter}, {0x2B740, 0x2B81D, CharClass::Letter},
+    {0x2B820, 0x2CEA1, CharClass::Letter}, {0x2CEB0, 0x2EBE0, CharClass::Letter}, {0x2F800, 0x2FA1D, CharClass::Letter},
+    {0x30000, 0x3134A, CharClass::Letter},
+};
+
+inline CharClass classify(uint32_t cp) {
+    if (cp < 0x80) return kAsciiClasses[cp];
+    
+    const CharClassRange* first = std::begin(kCharClassRanges);
+    const CharClassRange* last = std::end(kCharClassRanges);
+    const CharClassRange* it = std::upper_bound(first, last, cp,
+        [](uint32_t value, const CharClassRange& range) { return value < range.first; });
+    if (it == first) return CharClass::Other;
+    --it;
+    return cp <= it->last ? it->cls : CharClass::Other;
+}
+
+} // namespace cl100k
+} // namespace fast_pdf_parser
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+
+namespace fast_pdf_parser {
+
+// Binary vocabulary table (see TiktokenTokenizer::VocabTableHeader), generated
+// at build time by gen_vocab_table from cl100k_base_data.h
+extern const unsigned char cl100k_vocab_table[];
+extern const unsigned int cl100k_vocab_table_len;
+
+} // namespace fast_pdf_parser
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "fast_pdf_parser/pdf_source.h"
+
+namespace fast_pdf_parser {
+
+// Fast non-cryptographic content hash (XXH64). Identifies documents by
+// their bytes, e.g. for Docling's binary_hash and the page text cache; it
+// is not meant to resist deliberate collisions.
+//
+// Bytes can be fed in any number of update() calls; the digest is the same
+// as hashing them in one go.
+class ContentHasher {
+public:
+    explicit ContentHasher(uint64_t seed = 0);
+    
+    void update(const void* data, size_t size);
+    
+    // Hash of everything passed to update() so far; update() may continue
+    uint64_t digest() const;
+
+private:
+    uint64_t acc_[4];
+    uint64_t seed_;
+    uint64_t total_size_ = 0;
+    unsigned char buffer_[32];  // input not yet consumed by a full stripe
+    size_t buffered_ = 0;
+};
+
+uint64_t content_hash(const void* data, size_t size, uint64_t seed = 0);
+
+// Hashes a memory source in place and maps a file source instead of
+// reading it into a buffer. Throws std::runtime_error if the file cannot
+// be opened.
+uint64_t content_hash(const PdfSource& source);
+
+// 16 lowercase hex digits
+std::string hash_to_hex(uint64_t hash);
+
+} // namespace fast_pdf_parser
\ No newline at end of file
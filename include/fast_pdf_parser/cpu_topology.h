@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace fast_pdf_parser {
+
+// CPUs this process can actually use: those in its affinity mask, capped
+// by the cgroup CPU quota (cgroup v2 cpu.max or v1 cfs_quota_us, rounded
+// up) of its own and every enclosing cgroup. A container given 2 CPUs on a
+// 64-CPU host gets 2. Outside Linux, std::thread::hardware_concurrency().
+// At least 1; detected once per process.
+size_t available_cpus();
+
+// How ParseEngine pins its workers
+enum class CpuAffinity {
+    None,   // left to the OS scheduler
+    Cores,  // one CPU per worker, every physical core's first before any
+            // hyperthread sibling
+    Numa    // workers dealt round-robin to NUMA nodes and kept to their
+            // node's CPUs, so the memory MuPDF allocates for a page is local
+};
+
+// "none", "cores" or "numa"; throws std::invalid_argument otherwise
+CpuAffinity parse_cpu_affinity(const std::string& name);
+const char* cpu_affinity_name(CpuAffinity affinity);
+
+// One CPU in the process's affinity mask
+struct CpuInfo {
+    int cpu = 0;
+    int node = 0;     // NUMA node
+    int sibling = 0;  // 0 for a core's first hardware thread, 1 for its second, ...
+};
+
+// From sysfs; a system without topology information has every CPU on node
+// 0 as its own core
+std::vector<CpuInfo> detect_cpus();
+
+// The CPUs each of thread_count workers should be kept to; every list is
+// empty for CpuAffinity::None
+std::vector<std::vector<int>> plan_cpu_affinity(CpuAffinity affinity, size_t thread_count,
+                                                const std::vector<CpuInfo>& cpus);
+
+// Keeps the calling thread to cpus; false if the OS refused, and always
+// false outside Linux, where threads are not pinned
+bool pin_current_thread(const std::vector<int>& cpus);
+
+// "0-3,8,10-11" as in sysfs cpulist files; malformed parts are skipped
+std::vector<int> parse_cpu_list(const std::string& list);
+
+// CPUs allowed by the content of a cgroup v2 cpu.max file ("200000 100000",
+// quota then period), or 0 for "max" or anything unreadable
+double parse_cgroup_cpu_max(const std::string& content);
+
+} // namespace fast_pdf_parser
\ No newline at end of file
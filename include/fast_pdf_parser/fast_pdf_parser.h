@@ -6,44 +6,92 @@
 #include <functional>
 #include <thread>
 #include <nlohmann/json.hpp>
+#include "fast_pdf_parser/text_extractor.h"
+#include "fast_pdf_parser/page_selection.h"
+#include "fast_pdf_parser/cpu_topology.h"
 
 namespace fast_pdf_parser {
 
+// What parse_streaming produces for each page
+enum class PageOutput {
+    Json,       // PageResult::content, full structured JSON
+    PlainText,  // PageResult::text, line text only (no JSON is built)
+    Layout      // PageResult::layout, columnar positions/fonts (see PageLayout)
+};
+
 struct ParseOptions {
-    size_t thread_count = std::thread::hardware_concurrency();
-    size_t max_memory_per_page = 50 * 1024 * 1024; // 50MB
+    // The CPUs the process may use, cgroup quota included; see available_cpus
+    size_t thread_count = available_cpus();
+    // See EngineTuning; like the memory limits, ignored with a shared engine
+    CpuAffinity cpu_affinity = CpuAffinity::None;
+    bool auto_tune = false;
+    // See MemoryLimits; ignored when the parser runs on a shared engine,
+    // which has its own
+    size_t max_memory_per_page = 50 * 1024 * 1024; // 50MB, 0 = no limit
+    size_t max_memory_in_flight = 0;                // 0 = no budget
+    size_t store_limit = 256 * 1024 * 1024;         // 0 = unlimited
     bool extract_positions = true;
     bool extract_fonts = true;
     bool extract_colors = false;
-    size_t batch_size = 10; // pages per batch
+    // Pages parse_streaming extracts ahead of the callback, finished or not;
+    // bounds the memory held by pages the callback has not taken yet.
+    // Fewer are started while MuPDF is over max_memory_in_flight.
+    // 0 = the engine's: twice thread_count, or what auto_tune settled on
+    size_t max_pages_in_flight = 0;
+    PageOutput page_output = PageOutput::Json;
+    // Pages parse, parse_streaming and parse_batch extract; the others are
+    // never loaded
+    PageSelection pages;
 };
 
 struct PageResult {
     int page_number;
-    nlohmann::json content;
+    nlohmann::json content;  // set for PageOutput::Json
+    PageText text;           // set for PageOutput::PlainText
+    PageLayout layout;       // set for PageOutput::Layout
     std::string error;
     bool success;
 };
 
 using ProgressCallback = std::function<void(size_t current, size_t total)>;
 using PageCallback = std::function<bool(PageResult)>; // Return false to stop processing
+// Per-page work done on the worker that extracted the page, right after a
+// successful extraction and before the page waits for its turn in page
+// order, so it runs in parallel while the page is hot in cache. Runs for
+// several pages at once and must be thread-safe; throwing fails the page.
+using PageWorkCallback = std::function<void(PageResult& page)>;
+
+class ParseEngine;
 
 class FastPdfParser {
 public:
     explicit FastPdfParser(const ParseOptions& options = ParseOptions{});
+    // Runs on a shared engine instead of starting its own threads;
+    // options.thread_count, max_pages_in_flight and the memory limits are
+    // then the engine's
+    FastPdfParser(const ParseOptions& options, std::shared_ptr<ParseEngine> engine);
     ~FastPdfParser();
 
-    // Single document parsing
-    nlohmann::json parse(const std::string& pdf_path);
+    // Single document parsing; a path or an in-memory/mapped PdfSource
+    nlohmann::json parse(const PdfSource& source);
     
-    // Streaming parse with callback for each page
-    void parse_streaming(const std::string& pdf_path, PageCallback callback);
+    // Streaming parse with callback for each page, in page order. Runs as
+    // a job on the engine (see ParseJob), so the callback runs on an engine
+    // worker, one page at a time, while this call waits; a callback that
+    // blocks holds that worker. on_extracted, if given, has finished for
+    // every page by the time this returns. An exception from the callback
+    // stops the parse and is rethrown here.
+    void parse_streaming(const PdfSource& source, PageCallback callback,
+                         PageWorkCallback on_extracted = nullptr);
     
-    // Batch processing of multiple documents
+    // Batch processing of multiple documents, scheduled page by page across
+    // all of them; results are in the order of pdf_paths
     std::vector<nlohmann::json> parse_batch(const std::vector<std::string>& pdf_paths,
                                            ProgressCallback progress = nullptr);
 
-    // Get parser statistics
+    // Documents, pages and time spent by this parser, its engine's settings
+    // (ParseEngine::settings) under "engine", and the process-wide counters
+    // and stage latencies of metrics_snapshot() under "metrics"
     nlohmann::json get_stats() const;
 
 private:
@@ -3,7 +3,13 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 #include <nlohmann/json.hpp>
+#include "tiktoken_tokenizer.h"
+#include "line_classifier.h"
+#include "text_extractor.h"
+#include "page_selection.h"
+#include "cpu_topology.h"
 
 namespace fast_pdf_parser {
 
@@ -11,14 +17,44 @@ namespace fast_pdf_parser {
 struct ChunkOptions {
     int max_tokens = 512;
     int min_tokens = 150;
+    // Each chunk after the first starts with this many tokens from the end
+    // of the previous one; they count towards max_tokens
     int overlap_tokens = 0;
-    int thread_count = 0;  // 0 = use hardware concurrency
+    int thread_count = 0;  // 0 = available_cpus(), which respects cgroup CPU quotas
+    // MuPDF memory limits of the chunker's own engine, see MemoryLimits
+    MemoryLimits memory;
+    // Worker pinning and self-tuning of the chunker's own engine, see
+    // EngineTuning
+    CpuAffinity cpu_affinity = CpuAffinity::None;
+    bool auto_tune = false;
+    // Greedy is fastest; ExactBpe matches tiktoken's cl100k counts exactly,
+    // so max_tokens needs no safety margin
+    TokenizerMode tokenizer_mode = TokenizerMode::Greedy;
+    // Token counts of short lines (headers, footers, page numbers) are
+    // memoized in a cache of this many entries, kept across files; 0 disables
+    int token_cache_entries = 8192;
+    // Decides headings, list items etc.; nullptr = built-in rules only.
+    // Shared, so copies of the options are cheap; must not be modified
+    // while a chunker is using it.
+    std::shared_ptr<const LineClassifier> line_classifier;
+    // Directory of an on-disk page text cache (see PageTextCache). Files
+    // whose content was fully parsed before are chunked from it without
+    // being opened; "" = no cache
+    std::string page_cache_dir;
+    // Pages to chunk; the others are never parsed. A page_limit argument
+    // then takes the first that many of them. Chunks may span the gaps
+    // between selected pages. Only files chunked with every page selected
+    // are stored in the page cache, but any selection is served from it.
+    PageSelection pages;
 };
 
 // Result for a single chunk
 struct ChunkResult {
     std::string text;
-    int token_count;
+    int token_count;  // of text, with the chunker's tokenizer mode
+    // Tokens of the start of text repeated from the previous chunk, counted
+    // on their own; that text is part of what token_count counts
+    int overlap_tokens = 0;
     int start_page;
     int end_page;
     bool has_major_heading;
@@ -32,24 +68,144 @@ struct ChunkingResult {
     int total_chunks;
     double processing_time_ms;
     std::string error;  // Empty if successful
+    // Token count cache lookups made while chunking this file
+    uint64_t token_cache_hits = 0;
+    uint64_t token_cache_misses = 0;
+    bool page_cache_hit = false;  // pages came from the page text cache
+};
+
+// Receives each finished chunk, in document order; return false to stop
+using ChunkCallback = std::function<bool(ChunkResult&& chunk)>;
+
+// Chunks pages as they are produced instead of a whole document at once.
+// A chunk is passed to the callback as soon as no later page can merge
+// into it, and only the lines of the chunks still being built (plus the
+// last emitted one, for overlap) are kept in memory. The chunks are the
+// same as chunk_file() would return for the same pages.
+class StreamingChunker {
+public:
+    StreamingChunker(const ChunkOptions& options, ChunkCallback on_chunk);
+    ~StreamingChunker();
+    
+    // Pages must be added in document order. Returns false once the
+    // callback has asked to stop.
+    bool add_page(PageText page);
+    
+    // Emits the chunks still held back; call once after the last page
+    bool finish();
+    
+    size_t chunks_emitted() const;
+    
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl;
 };
 
-// Main API class for hierarchical PDF chunking
+// Receives one file's chunks once the whole file is chunked
+using FileChunkCallback = std::function<void(const std::string& pdf_path, ChunkingResult&& result)>;
+
+class ParseEngine;
+class ChunkWriter;
+struct ChunkOrigin;
+
+// A document's extracted pages with pass 1 of chunking (line types,
+// headings, token counts) already run, from HierarchicalChunker::prepare.
+// HierarchicalChunker::chunk runs only the remaining passes on it, so a
+// document chunked at several sizes is extracted and tokenized once.
+// Immutable and cheap to copy (copies share the pages), so it can be
+// chunked from several threads at once.
+class PreparedDocument {
+public:
+    PreparedDocument() = default;  // no pages
+    
+    int page_count() const;
+    size_t line_count() const;
+    TokenizerMode tokenizer_mode() const;  // the mode its token counts are in
+    
+    // Shards: page ranges of one document prepared separately, e.g. on
+    // several machines, written out with save() and joined again with
+    // concatenate(). Chunking the joined document gives exactly the chunks
+    // of preparing all of its pages at once, since every chunking pass
+    // after pass 1 runs over the joined lines. Shards must be prepared with
+    // the same line classifier; the tokenizer mode is checked.
+    //
+    // Writes the pages, their annotations and the PDF they came from;
+    // throws std::runtime_error if the file cannot be written
+    void save(const std::string& path, const ChunkOrigin& origin) const;
+    
+    // Throws std::runtime_error if the file is missing, damaged or not a
+    // shard; origin, if given, receives the PDF recorded by save()
+    static PreparedDocument load(const std::string& path, ChunkOrigin* origin = nullptr);
+    
+    // Joins shards in page order, whatever order they are given in. Throws
+    // std::invalid_argument if their tokenizer modes differ or their pages
+    // overlap.
+    static PreparedDocument concatenate(const std::vector<PreparedDocument>& shards);
+
+private:
+    friend class HierarchicalChunker;
+    struct Data;
+    std::shared_ptr<const Data> data_;
+};
+
+// Main API class for hierarchical PDF chunking. chunk_file, chunk_file_streaming
+// and chunk_files may be called from several threads at once, sharing the
+// engine and token cache; their token cache counts then include each
+// other's lookups. set_options must not overlap with any of them.
 class HierarchicalChunker {
 public:
     explicit HierarchicalChunker(const ChunkOptions& options = ChunkOptions{});
+    // Parses on a shared engine, e.g. one also given to a FastPdfParser;
+    // options.thread_count is then ignored
+    HierarchicalChunker(const ChunkOptions& options, std::shared_ptr<ParseEngine> engine);
     ~HierarchicalChunker();
     
-    // Chunk a PDF file
-    ChunkingResult chunk_file(const std::string& pdf_path, int page_limit = -1);
+    // Chunk a PDF file; a path or an in-memory/mapped PdfSource
+    ChunkingResult chunk_file(const PdfSource& source, int page_limit = -1);
+    
+    // Chunk a PDF file, handing each chunk to on_chunk while later pages are
+    // still being parsed. on_chunk runs on an engine worker while this call
+    // waits. The returned result has everything but chunks.
+    ChunkingResult chunk_file_streaming(const PdfSource& source, const ChunkCallback& on_chunk,
+                                        int page_limit = -1);
     
-    // Process a PDF file and save JSON output
+    // Chunk a PDF file straight into writer, each chunk written as it is
+    // finalized. The caller finishes the writer; if the result has an error
+    // the output is incomplete.
+    ChunkingResult chunk_file_to(const PdfSource& source, ChunkWriter& writer, int page_limit = -1);
+    
+    // Chunk several PDF files at once. Their pages share the engine's
+    // workers, so a long file does not hold up the short ones; on_file runs
+    // on the calling thread as each file finishes, in completion order.
+    // processing_time_ms counts from the call; token cache counts are not
+    // split per file and stay 0.
+    void chunk_files(const std::vector<std::string>& pdf_paths, const FileChunkCallback& on_file,
+                     int page_limit = -1);
+    
+    // Extract and annotate a PDF for chunk(), with this chunker's tokenizer
+    // mode and line classifier; uses the page cache like chunk_file. Throws
+    // std::runtime_error if the file cannot be read.
+    PreparedDocument prepare(const PdfSource& source, int page_limit = -1);
+    
+    // Chunk a prepared document with the max_tokens, min_tokens and
+    // overlap_tokens of options; the rest of the options were fixed by
+    // prepare(). Nothing is extracted and only lines that need cutting are
+    // tokenized again, so this is cheap enough to sweep chunk sizes with.
+    // Gives the same chunks chunk_file would with those options.
+    ChunkingResult chunk(const PreparedDocument& prepared, const ChunkOptions& options) const;
+    ChunkingResult chunk(const PreparedDocument& prepared) const;  // with this chunker's options
+    
+    // The engine this chunker parses on; started on first use
+    std::shared_ptr<ParseEngine> engine();
+    
+    // Process a PDF file and save Docling-style JSON output; see
+    // ChunkWriter for the streaming formats
     bool process_pdf_to_json(const std::string& pdf_path, const std::string& output_path, int page_limit = -1);
     
     // Get/set options
     ChunkOptions get_options() const;
     void set_options(const ChunkOptions& options);
-    
+
 private:
     class Impl;
     std::unique_ptr<Impl> pImpl;
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace fast_pdf_parser {
+
+// Structural role of one line of page text, as used by the chunker
+enum class LineType {
+    NORMAL,
+    MAJOR_HEADING,  // #, ## level headings
+    MINOR_HEADING,  // ###+ level headings
+    LIST_ITEM,
+    BLANK,
+    CODE_BLOCK
+};
+
+struct LineClass {
+    LineType type = LineType::NORMAL;
+    int heading_level = 0;  // 0 = not a heading, 1 = #, 2 = ##, etc.
+};
+
+// Classifies lines with a single forward scan per rule, no regex.
+//
+// Built-in rules, tried in this order:
+//   blank      empty or only ASCII whitespace
+//   heading    "#... text"; levels 1-2 are major, 3+ minor
+//   list item  "- ", "* ", "+ " or a bullet (•, ◦, ▪, ●, ‣, ⁃) followed by
+//              text, or "12. text"; leading whitespace allowed
+//   code       contains ``` or starts with two spaces
+// Extra rules registered with add_rule() run after the blank check and
+// before the other built-ins, in registration order; the first rule that
+// returns true decides the class.
+class LineClassifier {
+public:
+    using Rule = std::function<bool(std::string_view line, LineClass& out)>;
+    
+    LineClassifier() = default;
+    
+    LineClass classify(std::string_view line) const;
+    
+    void add_rule(Rule rule);
+    
+    // "3.2 Title", "3.2.1. Title": two or more dot-separated numbers, then
+    // a capitalized title, on a line of at most 80 bytes. The level is the
+    // number of components, so 3.2 is a major heading and 3.2.1 a minor one.
+    static Rule numbered_section_rule();
+    
+    // The built-in rules alone; what the chunker uses by default
+    static const LineClassifier& default_classifier();
+
+private:
+    std::vector<Rule> rules_;
+};
+
+} // namespace fast_pdf_parser
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <nlohmann/json.hpp>
+
+namespace fast_pdf_parser {
+
+// Library log messages go through one process-wide sink. By default
+// warnings and errors are written to stderr; progress from the hot paths
+// is logged at Debug, so nothing reaches stdout unless a sink sends it
+// there.
+enum class LogLevel { Debug, Info, Warning, Error, Off };
+
+// Called from worker threads, one message at a time
+using LogSink = std::function<void(LogLevel level, const std::string& message)>;
+
+// nullptr restores the stderr sink
+void set_log_sink(LogSink sink);
+void set_log_level(LogLevel level);
+LogLevel log_level();
+
+// "debug", "info", "warning", "error" or "off"; throws
+// std::invalid_argument for anything else
+LogLevel parse_log_level(const std::string& name);
+
+namespace detail {
+extern std::atomic<int> log_threshold;
+}
+
+// Lets callers skip building a message that would be dropped
+inline bool log_enabled(LogLevel level) {
+    return static_cast<int>(level) >= detail::log_threshold.load(std::memory_order_relaxed);
+}
+
+void log_message(LogLevel level, const std::string& message);
+
+// Pipeline stages with a latency histogram each
+enum class Stage {
+    Open,      // opening a document in a worker's context
+    LoadPage,  // fz_load_page
+    Stext,     // building a page's structured text
+    Tokenize,  // pass 1 for one page: classifying and counting its lines
+    Chunk,     // passes 2-7 for one page's lines; they run interleaved, line by line
+    Count
+};
+
+enum class Counter {
+    DocumentsOpened,
+    PagesExtracted,
+    PageErrors,
+    PagesOverMemoryLimit,  // pages failed for needing more than max_memory_per_page
+    MemoryBudgetWaits,     // times a free worker was held back by max_memory_in_flight
+    PageCacheHits,    // documents served from the page text cache
+    PageCacheMisses,  // documents parsed for lack of a cache entry
+    LinesAnnotated,
+    TokensCounted,
+    ChunksEmitted,
+    MupdfAllocations,        // malloc calls made by MuPDF
+    MupdfAllocationsPooled,  // of those, served from a worker's own free blocks
+    Count
+};
+
+// Process-wide counters and latency histograms. Each thread updates its
+// own cache line of relaxed atomics, so recording never takes a lock or
+// shares a line with another thread; metrics_snapshot() adds the threads
+// up. Counts of threads that have exited are kept.
+void add_count(Counter counter, uint64_t n = 1);
+void record_latency(Stage stage, std::chrono::steady_clock::time_point start,
+                    std::chrono::steady_clock::time_point end);
+
+// {"counters": {name: n}, "stages": {name: {count, total_ms, mean_us,
+// p50_us, p90_us, p99_us, max_us}}}. Percentiles are the upper bounds of
+// power-of-two microsecond buckets, so they overstate by up to 2x.
+nlohmann::json metrics_snapshot();
+
+// Zeroes every counter and histogram; updates racing with it may survive
+void reset_metrics();
+
+// Trace spans: while tracing is on, every recorded latency is also kept as
+// a span, up to max_spans in total; the rest are dropped. Starting again
+// discards the spans collected so far.
+void start_tracing(size_t max_spans = 1 << 20);
+void stop_tracing();
+bool tracing_enabled();
+
+// The spans in Chrome's trace event format, loadable in chrome://tracing
+// or Perfetto; one track per thread
+nlohmann::json trace_json();
+
+const char* stage_name(Stage stage);
+const char* counter_name(Counter counter);
+
+// Records the latency of its own lifetime
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage)
+        : stage_(stage), start_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() { record_latency(stage_, start_, std::chrono::steady_clock::now()); }
+    
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace fast_pdf_parser
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace fast_pdf_parser {
+
+// Which pages of a document to extract: page ranges, each optionally
+// taking only every Nth page, plus an optional cap on how many pages are
+// taken. The default selects every page. Pages outside the selection are
+// never scheduled, so they are never loaded.
+//
+// As text, a comma-separated list of 1-based pages and ranges in the style
+// of qpdf's page ranges:
+//   "10-20,50"  pages 10 to 20 and page 50
+//   "z", "r3"   the last page, the third page from the end
+//   "1-3,r3-z"  the first three and the last three pages
+//   "400-"      page 400 to the end
+//   "1-z:10"    every 10th page: 1, 11, 21, ...
+// Pages past either end of a document are ignored and overlapping ranges
+// select a page once. Selected pages are always delivered in page order.
+class PageSelection {
+public:
+    PageSelection() = default;  // every page
+    
+    // Throws std::invalid_argument if spec is malformed
+    static PageSelection parse(const std::string& spec);
+    
+    // Adds 0-based pages first..last (inclusive), every stride-th from
+    // first; negative pages count from the end, -1 being the last page.
+    // Throws std::invalid_argument if stride < 1.
+    PageSelection& add_range(int first, int last, int stride = 1);
+    
+    // Takes at most the first max_pages selected pages; <= 0 removes the cap
+    PageSelection& limit(int max_pages);
+    int max_pages() const { return max_pages_; }
+    
+    // Whether every page is selected, whatever the document's length
+    bool all_pages() const { return ranges_.empty() && max_pages_ <= 0; }
+    
+    // The selected 0-based pages of a document of page_count pages, ascending
+    std::vector<int> resolve(int page_count) const;
+
+private:
+    struct Range {
+        int first;
+        int last;
+        int stride;
+    };
+    std::vector<Range> ranges_;  // empty = every page
+    int max_pages_ = 0;
+};
+
+} // namespace fast_pdf_parser
\ No newline at end of file
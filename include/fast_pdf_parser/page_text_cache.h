@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <fstream>
+#include "fast_pdf_parser/text_extractor.h"
+
+namespace fast_pdf_parser {
+
+// On-disk cache of extracted page text, addressed by document content.
+// Entries are keyed by the document's content_hash() plus everything that
+// changes what extraction produces, so an unchanged document is recognised
+// under any path and its pages can be chunked again without opening it.
+//
+// One file per document in the cache directory, written to a temporary
+// name and renamed into place once complete, so concurrent writers (other
+// threads or processes) never expose a partial entry and readers simply
+// see the last one written. The cache is best-effort: a missing, stale or
+// damaged entry is a miss and I/O errors only mean nothing gets stored.
+// Entries are never evicted; delete the directory to clear it.
+class PageTextCache {
+public:
+    // Bump when the extractor's text output changes for the same input
+    static constexpr uint32_t kTextVersion = 1;
+    
+    // The directory is created on the first store
+    explicit PageTextCache(std::string directory);
+    
+    const std::string& directory() const { return directory_; }
+    
+    static std::string key(uint64_t content_hash, const ExtractOptions& options = ExtractOptions{});
+    
+    // A stored document, read from a mapping of its cache file
+    class Entry {
+    public:
+        size_t page_count() const { return pages_.size(); }
+        PageText page(size_t i) const;
+
+    private:
+        friend class PageTextCache;
+        struct PageRecord {
+            int page_number;
+            const unsigned char* text;
+            uint32_t text_size;
+            const unsigned char* line_offsets;
+            uint32_t line_count;
+        };
+        PdfSource mapping_;
+        std::vector<PageRecord> pages_;
+    };
+    
+    // nullptr on a miss
+    std::unique_ptr<Entry> load(const std::string& key) const;
+    
+    // Writes one document's pages as they are extracted. Nothing is visible
+    // under the key until commit(); a writer destroyed without committing
+    // removes its temporary file.
+    class Writer {
+    public:
+        ~Writer();
+        
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+        
+        // Pages must be added in document order
+        void add_page(const PageText& page);
+        
+        // Makes the entry visible; false if anything failed to write
+        bool commit();
+
+    private:
+        friend class PageTextCache;
+        Writer(std::string temp_path, std::string final_path);
+        
+        std::string temp_path_;
+        std::string final_path_;
+        std::ofstream out_;
+        uint32_t page_count_ = 0;
+        bool committed_ = false;
+    };
+    
+    // nullptr if the directory or temporary file cannot be created
+    std::unique_ptr<Writer> store(const std::string& key) const;
+
+private:
+    std::string path_for(const std::string& key) const;
+    
+    std::string directory_;
+};
+
+} // namespace fast_pdf_parser
\ No newline at end of file
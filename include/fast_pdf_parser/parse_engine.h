@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <functional>
+#include "fast_pdf_parser/fast_pdf_parser.h"
+#include "fast_pdf_parser/text_extractor.h"
+#include "fast_pdf_parser/thread_pool.h"
+#include "fast_pdf_parser/cpu_topology.h"
+
+namespace fast_pdf_parser {
+
+// One document's worth of page extraction for ParseEngine::submit
+struct ParseJob {
+    PdfSource source;
+    PageOutput page_output = PageOutput::PlainText;
+    ExtractOptions extract_options;
+    PageSelection pages;  // the pages to extract, see PageSelection
+    int page_limit = -1;  // at most this many of the selected pages; <= 0 = all
+    // Pages extracted ahead of on_page; 0 = the engine's, which auto-tuning
+    // may change
+    size_t max_pages_in_flight = 0;
+    
+    // Runs on the worker that extracted each page, see PageWorkCallback
+    PageWorkCallback on_extracted;
+    
+    // Pages in page order, never two at once for the same job; runs on an
+    // engine worker. Return false to stop the job.
+    PageCallback on_page;
+    
+    // Runs once, after the last page was handed to on_page, after on_page
+    // returned false, or when the document could not be opened (error is
+    // then set), and after every on_extracted call of the job has returned.
+    // page_count is the number of selected pages the job covered.
+    std::function<void(int page_count, const std::string& error)> on_done;
+};
+
+// Where ParseEngine's workers run and whether it tunes itself
+struct EngineTuning {
+    CpuAffinity affinity = CpuAffinity::None;
+    // Probes a few settings on the first pages scheduled: pages/s with
+    // all, three quarters and half of the workers, then, unless
+    // max_pages_in_flight was given, in-flight depths of one, two and
+    // four pages per worker at the fastest. The best probe is kept for the
+    // engine's lifetime. A probe counts only pages started under its
+    // settings, and restarts whenever the engine runs out of work.
+    bool auto_tune = false;
+    
+    bool operator==(const EngineTuning& other) const {
+        return affinity == other.affinity && auto_tune == other.auto_tune;
+    }
+    bool operator!=(const EngineTuning& other) const { return !(*this == other); }
+};
+
+// Long-lived extraction engine: one thread pool and one TextExtractor
+// (so one cached MuPDF context per worker) shared by every parser and
+// chunker that is given it.
+//
+// Submitted documents are scheduled a page at a time. Whenever a worker
+// frees up it takes the next page of the unfinished document that has had
+// the fewest pages dispatched so far (oldest first on ties), so a large
+// file gets its share of the pool without holding up small ones. At most
+// max_pages_in_flight pages per document (or the job's own) are extracted
+// ahead of its on_page callback, and no new page or document is started
+// while the extractor is over its max_memory_in_flight budget, unless the
+// pool would otherwise be idle. With EngineTuning::auto_tune, fewer
+// workers than thread_count may take pages and the in-flight depth may
+// change.
+//
+// Destroying the engine abandons jobs that are still running; their
+// on_done does not run.
+class ParseEngine {
+public:
+    explicit ParseEngine(size_t thread_count = available_cpus(),
+                         size_t max_pages_in_flight = 0,  // 0 = twice thread_count
+                         const MemoryLimits& memory = MemoryLimits{},
+                         const EngineTuning& tuning = EngineTuning{});
+    ~ParseEngine();
+    
+    ParseEngine(const ParseEngine&) = delete;
+    ParseEngine& operator=(const ParseEngine&) = delete;
+    
+    // Returns immediately; on_page and on_done run on engine workers
+    void submit(ParseJob job);
+    
+    size_t thread_count() const;
+    const EngineTuning& tuning() const;
+    // Pages per document extracted ahead of its on_page; the tuned depth
+    // once auto-tuning is done
+    size_t max_pages_in_flight() const;
+    
+    // {"threads", "available_cpus", "affinity", "pinned_workers",
+    // "concurrency", "max_pages_in_flight", "auto_tune": "off", "probing"
+    // or "done", "probes": [{"concurrency", "max_pages_in_flight",
+    // "pages_per_second"}]}: the settings in effect, to keep per host
+    nlohmann::json settings() const;
+    
+    // For work that does not go through submit(); tasks on this pool
+    // compete with scheduled pages but are not counted by the scheduler
+    ThreadPool& pool();
+    TextExtractor& extractor();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl;
+};
+
+} // namespace fast_pdf_parser
\ No newline at end of file
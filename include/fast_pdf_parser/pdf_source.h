@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace fast_pdf_parser {
+
+// Where a PDF's bytes come from: a file MuPDF opens by name, or a block of
+// memory (a caller's buffer or a memory-mapped file) MuPDF reads in place.
+// Cheap to copy; copies share the bytes and identify the same document, so
+// the extractor's per-worker document cache works for memory sources too.
+//
+// A std::string converts implicitly to a file source, so every API that
+// takes a PdfSource still accepts a path.
+class PdfSource {
+public:
+    PdfSource() = default;  // an empty path
+    PdfSource(std::string path);
+    PdfSource(const char* path) : PdfSource(std::string(path)) {}
+    
+    // Reads from data[0, size), which must stay valid for as long as owner
+    // is held. The extractor keeps owner while it has the document open,
+    // which can be after the call that used the source returns.
+    static PdfSource memory(const void* data, size_t size, std::shared_ptr<const void> owner,
+                            std::string name = "memory.pdf");
+    
+    // Takes the bytes over
+    static PdfSource memory(std::string bytes, std::string name = "memory.pdf");
+    
+    // Maps the file read-only and reads from the mapping. The file must not
+    // be truncated while the mapping lives. Throws std::runtime_error if the
+    // file cannot be mapped.
+    static PdfSource mapped_file(const std::string& path);
+    
+    bool in_memory() const { return in_memory_; }
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::shared_ptr<const void>& owner() const { return owner_; }
+    
+    // The path for files (mapped or not), the given name for other memory
+    const std::string& name() const { return name_; }
+    
+    // Identifies the document to caches: the path for file sources, a
+    // per-buffer id for memory sources
+    const std::string& key() const { return key_; }
+
+private:
+    std::string name_;
+    std::string key_;
+    bool in_memory_ = false;
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+    std::shared_ptr<const void> owner_;
+};
+
+} // namespace fast_pdf_parser
\ No newline at end of file
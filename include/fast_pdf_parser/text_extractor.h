@@ -1,8 +1,12 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
 #include <memory>
 #include <nlohmann/json.hpp>
+#include "fast_pdf_parser/pdf_source.h"
 
 namespace fast_pdf_parser {
 
@@ -13,18 +17,137 @@ struct ExtractOptions {
     bool structured_output = true;
 };
 
+// Plain text of a single page, without any per-character metadata.
+// All lines live back to back in one UTF-8 buffer, each followed by '\n';
+// line_offsets holds the byte offset where each line starts.
+struct PageText {
+    int page_number = -1;
+    std::string text;
+    std::vector<uint32_t> line_offsets;
+
+    size_t line_count() const { return line_offsets.size(); }
+
+    // Line i without its trailing newline
+    std::string_view line(size_t i) const {
+        size_t begin = line_offsets[i];
+        size_t end = i + 1 < line_offsets.size() ? line_offsets[i + 1] : text.size();
+        return std::string_view(text).substr(begin, end - begin - 1);
+    }
+};
+
+struct FontInfo {
+    std::string name;
+    bool is_bold = false;
+    bool is_italic = false;
+    bool is_monospace = false;
+};
+
+// Character-level layout of a page in struct-of-arrays form. Carries the same
+// information as the JSON from extract_page, but in a few contiguous arrays
+// instead of one JSON object per glyph; to_json() rebuilds that JSON when a
+// caller needs it.
+//
+// Positions (quads, origins, bboxes) are only filled when extract_positions
+// is set, fonts (font_ids, sizes, fonts) only when extract_fonts is set.
+struct PageLayout {
+    static constexpr uint16_t kNoFont = 0xFFFF;
+
+    int page_number = -1;
+    bool has_positions = false;
+    bool has_fonts = false;
+
+    // UTF-8 text laid out exactly like PageText::text
+    std::string text;
+    std::vector<uint32_t> line_offsets;     // byte offset of each line in text
+
+    // Per character
+    std::vector<uint32_t> char_offsets;     // byte offset of the glyph in text
+    std::vector<float> quads;               // 8 per char: ul, ur, ll, lr as x,y
+    std::vector<float> origins;             // 2 per char: x,y
+    std::vector<float> sizes;               // font size per char
+    std::vector<uint16_t> font_ids;         // index into fonts, or kNoFont
+
+    // Interned fonts for this page
+    std::vector<FontInfo> fonts;
+
+    // Per line: characters [line_char_begin[l], line_char_begin[l + 1])
+    std::vector<uint32_t> line_char_begin;
+    std::vector<float> line_bboxes;         // 4 per line: x0, y0, x1, y1
+
+    // Per block: lines [block_line_begin[b], block_line_begin[b + 1])
+    std::vector<uint32_t> block_line_begin;
+    std::vector<float> block_bboxes;        // 4 per block
+
+    size_t char_count() const { return char_offsets.size(); }
+    size_t line_count() const { return line_char_begin.size(); }
+    size_t block_count() const { return block_line_begin.size(); }
+
+    // Same structure extract_page returns for these options
+    nlohmann::json to_json() const;
+};
+
+// Memory limits of a TextExtractor's MuPDF allocations
+struct MemoryLimits {
+    // MuPDF's resource store (decoded fonts, images, content streams),
+    // shared by every worker. Cached resources are evicted past it.
+    // 0 = unlimited
+    size_t store_limit = 256 * 1024 * 1024;
+    // Bytes a page may hold on to while it is loaded and its text built.
+    // A page that needs more fails with an error; the worker and the rest
+    // of the document carry on. 0 = no limit
+    size_t max_memory_per_page = 50 * 1024 * 1024;
+    // While MuPDF holds more than this in total (store included), no new
+    // page is started until one already running finishes; one page always
+    // runs, so an over-budget process slows down rather than stalls.
+    // 0 = no budget
+    size_t max_memory_in_flight = 0;
+    
+    bool operator==(const MemoryLimits& other) const {
+        return store_limit == other.store_limit &&
+               max_memory_per_page == other.max_memory_per_page &&
+               max_memory_in_flight == other.max_memory_in_flight;
+    }
+    bool operator!=(const MemoryLimits& other) const { return !(*this == other); }
+};
+
+// Bytes MuPDF currently holds, across every TextExtractor in the process.
+// Updated in batches per thread, so off by up to 64KB per worker.
+size_t mupdf_memory_in_use();
+
+// Safe to share between threads: every calling thread gets its own cloned
+// MuPDF context and keeps the documents it opened cached for later calls.
+// A cached memory document holds on to its source's bytes until it is
+// evicted (each thread keeps a handful of documents) or closed.
 class TextExtractor {
 public:
-    TextExtractor();
+    explicit TextExtractor(const MemoryLimits& limits = MemoryLimits{});
     ~TextExtractor();
+    
+    const MemoryLimits& memory_limits() const;
+    
+    // True while MuPDF holds more than max_memory_in_flight; new pages
+    // should wait for running ones to finish
+    bool over_memory_budget() const;
 
-    nlohmann::json extract_page(const std::string& pdf_path, int page_number, 
+    nlohmann::json extract_page(const PdfSource& source, int page_number, 
                                const ExtractOptions& options = ExtractOptions{});
     
-    nlohmann::json extract_all_pages(const std::string& pdf_path,
+    // Line text only; skips building the JSON tree entirely
+    PageText extract_page_text(const PdfSource& source, int page_number);
+    
+    // Glyph positions and fonts in columnar form
+    PageLayout extract_page_layout(const PdfSource& source, int page_number,
+                                   const ExtractOptions& options = ExtractOptions{});
+    
+    nlohmann::json extract_all_pages(const PdfSource& source,
                                     const ExtractOptions& options = ExtractOptions{});
     
-    int get_page_count(const std::string& pdf_path);
+    int get_page_count(const PdfSource& source);
+    
+    // Drops source from every thread's cache, releasing a memory source's
+    // bytes; a later call opens it again. Waits for threads extracting
+    // from this extractor to finish their current call.
+    void close(const PdfSource& source);
 
 private:
     class Impl;
@@ -1,19 +1,126 @@
 #pragma once
 
 #include <vector>
-#include <queue>
+#include <deque>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <atomic>
+#include <tuple>
+#include <new>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
 
 namespace fast_pdf_parser {
 
+// Move-only void() callable for ThreadPool queues. Callables of up to
+// kInlineSize bytes are stored in place, so queuing them allocates nothing;
+// larger ones are moved to the heap.
+class PoolTask {
+public:
+    static constexpr size_t kInlineSize = 48;
+    
+    PoolTask() = default;
+    
+    template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, PoolTask>>>
+    PoolTask(F&& f) {
+        using Fn = std::decay_t<F>;
+        if constexpr (fits_inline<Fn>()) {
+            new (storage_) Fn(std::forward<F>(f));
+            ops_ = &kInlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &kHeapOps<Fn>;
+        }
+    }
+    
+    PoolTask(PoolTask&& other) noexcept {
+        take(other);
+    }
+    
+    PoolTask& operator=(PoolTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+    
+    PoolTask(const PoolTask&) = delete;
+    PoolTask& operator=(const PoolTask&) = delete;
+    
+    ~PoolTask() { reset(); }
+    
+    explicit operator bool() const { return ops_ != nullptr; }
+    
+    void operator()() { ops_->invoke(storage_); }
+    
+    template<typename Fn>
+    static constexpr bool fits_inline() {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);  // leaves src destroyed
+        void (*destroy)(void* storage);
+    };
+    
+    template<typename Fn>
+    static constexpr Ops kInlineOps = {
+        [](void* storage) { (*static_cast<Fn*>(storage))(); },
+        [](void* dst, void* src) {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* storage) { static_cast<Fn*>(storage)->~Fn(); }
+    };
+    
+    template<typename Fn>
+    static constexpr Ops kHeapOps = {
+        [](void* storage) { (**static_cast<Fn**>(storage))(); },
+        [](void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); },
+        [](void* storage) { delete *static_cast<Fn**>(storage); }
+    };
+    
+    void take(PoolTask& other) {
+        ops_ = other.ops_;
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+    
+    void reset() {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+    
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+};
+
+// Work-stealing pool. Every worker owns a deque: tasks submitted from a
+// worker go to the back of its own deque, tasks from other threads are
+// spread round-robin, and an idle worker steals from another deque. Both
+// the owner and thieves take the oldest task, so tasks from one producer
+// start in submission order (ParseEngine relies on this to keep its
+// reorder window short). Each deque has its own mutex, so producers and
+// workers rarely contend on the same lock.
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t num_threads);
+    // on_start, if given, runs first on each new worker with its index,
+    // e.g. to pin it to a CPU; it has run on all of them by the time the
+    // constructor returns
+    explicit ThreadPool(size_t num_threads, std::function<void(size_t worker)> on_start = nullptr);
     ~ThreadPool();
 
     ThreadPool(const ThreadPool&) = delete;
@@ -21,41 +128,62 @@ public:
 
     template<typename F, typename... Args>
     auto enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type>;
+    
+    // Fire-and-forget: no future, and no allocation when f fits in a
+    // PoolTask. f must not throw; an escaping exception terminates.
+    // wait_all() still waits for these tasks.
+    template<typename F>
+    void submit(F&& f);
 
     void wait_all();
-    size_t queue_size() const;
-    size_t active_threads() const;
+    size_t queue_size() const;     // tasks not yet started
+    size_t active_threads() const; // tasks queued or running
+    size_t thread_count() const;
 
 private:
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<PoolTask> tasks;
+    };
+    
+    void push(PoolTask task);
+    bool pop_local(size_t index, PoolTask& task);
+    bool steal(size_t index, PoolTask& task);
+    void worker_loop(size_t index);
+    
     std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::atomic<size_t> next_queue{0};
     
-    mutable std::mutex queue_mutex;
-    std::condition_variable condition;
-    std::condition_variable finished;
+    std::atomic<size_t> pending{0};     // queued, not started
+    std::atomic<size_t> unfinished{0};  // queued or running
+    std::atomic<size_t> sleeping{0};
     std::atomic<bool> stop{false};
-    std::atomic<size_t> active_tasks{0};
+    
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::mutex done_mutex;
+    std::condition_variable finished;
 };
 
 template<typename F, typename... Args>
 auto ThreadPool::enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type> {
     using return_type = typename std::invoke_result<F, Args...>::type;
-
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-    );
     
-    std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        if(stop) {
-            throw std::runtime_error("enqueue on stopped ThreadPool");
+    std::packaged_task<return_type()> task(
+        [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+            return std::apply(std::move(f), std::move(args));
         }
-        active_tasks++;
-        tasks.emplace([task](){ (*task)(); });
-    }
-    condition.notify_one();
+    );
+    
+    std::future<return_type> res = task.get_future();
+    push(PoolTask(std::move(task)));
     return res;
 }
 
+template<typename F>
+void ThreadPool::submit(F&& f) {
+    push(PoolTask(std::forward<F>(f)));
+}
+
 } // namespace fast_pdf_parser
\ No newline at end of file
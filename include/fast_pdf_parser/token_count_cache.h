@@ -0,0 +1,117 @@
+/**
+ * @file token_count_cache.h
+ * @brief Bounded, thread-safe memo of token counts for short texts
+ * 
+ * PDFs repeat the same short lines constantly: running headers, footers,
+ * page numbers, boilerplate. TiktokenTokenizer consults this cache before
+ * tokenizing any text of at most kMaxKeyBytes bytes.
+ * 
+ * The cache is a fixed-size, two-way set-associative table split into
+ * independently locked shards. Entries keep the full key bytes, so a hash
+ * collision can never return a wrong count; when both ways of a set are
+ * taken, inserting evicts the older one. Memory use is fixed at
+ * construction, roughly capacity * sizeof(Entry).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace fast_pdf_parser {
+
+class TokenCountCache {
+public:
+    // Longer texts are not cached (and are rarely repeated verbatim)
+    static constexpr size_t kMaxKeyBytes = 96;
+    static constexpr size_t kDefaultCapacity = 8192;
+    
+    explicit TokenCountCache(size_t capacity = kDefaultCapacity) {
+        // Each shard holds a power-of-two number of two-entry sets
+        size_t sets = 1;
+        while (sets * 2 * kShards < capacity) sets <<= 1;
+        set_mask_ = sets - 1;
+        for (auto& shard : shards_) shard.entries.resize(sets * 2);
+    }
+    
+    TokenCountCache(const TokenCountCache&) = delete;
+    TokenCountCache& operator=(const TokenCountCache&) = delete;
+    
+    // Returns true and sets count if text is cached
+    bool lookup(std::string_view text, size_t& count) {
+        uint64_t hash = std::hash<std::string_view>{}(text);
+        Shard& shard = shards_[hash % kShards];
+        Entry* set = &shard.entries[((hash / kShards) & set_mask_) * 2];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (int way = 0; way < 2; ++way) {
+                if (set[way].matches(hash, text)) {
+                    count = set[way].count;
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    // Remembers the count of text; ignored for texts above kMaxKeyBytes
+    void insert(std::string_view text, size_t count) {
+        if (text.size() > kMaxKeyBytes) return;
+        
+        uint64_t hash = std::hash<std::string_view>{}(text);
+        Shard& shard = shards_[hash % kShards];
+        Entry* set = &shard.entries[((hash / kShards) & set_mask_) * 2];
+        
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (set[0].matches(hash, text) || set[1].matches(hash, text)) return;
+        set[1] = set[0];  // the older entry is the one evicted
+        set[0].hash = hash;
+        set[0].count = static_cast<uint32_t>(count);
+        set[0].length = static_cast<uint8_t>(text.size());
+        set[0].used = true;
+        std::memcpy(set[0].bytes, text.data(), text.size());
+    }
+    
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    
+    size_t capacity() const { return shards_[0].entries.size() * kShards; }
+
+private:
+    static constexpr size_t kShards = 16;
+    
+    struct Entry {
+        uint64_t hash = 0;
+        uint32_t count = 0;
+        uint8_t length = 0;
+        bool used = false;
+        char bytes[kMaxKeyBytes];
+        
+        bool matches(uint64_t h, std::string_view text) const {
+            return used && hash == h && length == text.size() &&
+                   std::memcmp(bytes, text.data(), text.size()) == 0;
+        }
+    };
+    static_assert(kMaxKeyBytes <= UINT8_MAX, "Entry::length is one byte");
+    
+    // Padded so neighbouring shard locks do not share a cache line
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+    };
+    
+    Shard shards_[kShards];
+    size_t set_mask_ = 0;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace fast_pdf_parser
\ No newline at end of file
@@ -1,11 +1,180 @@
 'use strict';
 
-const { HierarchicalChunker } = require('node-gyp-build')(__dirname);
+const { TextDecoder } = require('util');
+const native = require('node-gyp-build')(__dirname);
+const { HierarchicalChunker } = native;
 
-module.exports = { HierarchicalChunker };
+const decoder = new TextDecoder();
+
+// The chunks of a { compact: true } result: typed columns over native
+// memory, with a chunk's text decoded only when it is asked for
+class CompactChunkList {
+    constructor(columns) {
+        this.textBuffer = new Uint8Array(columns.text);
+        this.textOffsets = columns.textOffsets;
+        this.tokenCounts = columns.tokenCounts;
+        this.overlapTokens = columns.overlapTokens;
+        this.startPages = columns.startPages;
+        this.endPages = columns.endPages;
+        this.minHeadingLevels = columns.minHeadingLevels;
+        this.hasMajorHeading = columns.hasMajorHeading;
+    }
+
+    get length() {
+        return this.tokenCounts.length;
+    }
+
+    text(i) {
+        return decoder.decode(this.textBuffer.subarray(this.textOffsets[i], this.textOffsets[i + 1]));
+    }
+
+    // The chunk as the object a regular result would hold
+    get(i) {
+        return {
+            text: this.text(i),
+            tokenCount: this.tokenCounts[i],
+            overlapTokens: this.overlapTokens[i],
+            startPage: this.startPages[i],
+            endPage: this.endPages[i],
+            hasMajorHeading: this.hasMajorHeading[i] !== 0,
+            minHeadingLevel: this.minHeadingLevels[i]
+        };
+    }
+
+    *[Symbol.iterator]() {
+        for (let i = 0; i < this.length; i++) {
+            yield this.get(i);
+        }
+    }
+}
+
+function wrapResult(result, options) {
+    if (options && options.compact) {
+        result.chunks = new CompactChunkList(result.chunks);
+    }
+    return result;
+}
+
+const nativeChunkFile = HierarchicalChunker.prototype.chunkFile;
+HierarchicalChunker.prototype.chunkFile = function(pdfPath, pageLimit, options) {
+    return wrapResult(nativeChunkFile.call(this, pdfPath, pageLimit, options), options);
+};
+
+module.exports = { HierarchicalChunker, CompactChunkList };
+
+// Process-wide instrumentation, shared by every chunker
+module.exports.getStats = native.getStats;
+module.exports.resetStats = native.resetStats;
+module.exports.startTrace = native.startTrace;
+module.exports.stopTrace = native.stopTrace;
+module.exports.setLogLevel = native.setLogLevel;
+
+function abortError() {
+    const err = new Error('The operation was aborted');
+    err.name = 'AbortError';
+    return err;
+}
+
+// Starts chunking on a worker thread. Returns { promise, abort, pulled }; an
+// AbortSignal in options is wired to abort. Errors thrown by onChunk stop
+// the job and reject the promise with that error. With pull, onChunk only
+// queues chunks: the worker pauses once 16 are queued and pulled() frees a
+// slot for each one taken off the queue.
+function startChunkFile(chunker, pdfPath, options, onChunk, pull = false) {
+    const { pageLimit = -1, signal } = options;
+    if (signal && signal.aborted) {
+        return { promise: Promise.reject(abortError()), abort() {}, pulled() {} };
+    }
+
+    let callbackError = null;
+    let job;
+    const deliver = onChunk && (chunk => {
+        if (callbackError) return;
+        try {
+            onChunk(chunk);
+        } catch (err) {
+            callbackError = err;
+            job.abort();
+        }
+    });
+    job = chunker._startChunkFile(pdfPath, pageLimit, deliver, { compact: !onChunk && options.compact, pull });
+
+    const onAbort = () => job.abort();
+    if (signal) signal.addEventListener('abort', onAbort, { once: true });
+
+    const promise = job.promise.then(
+        result => {
+            if (callbackError) throw callbackError;
+            return onChunk ? result : wrapResult(result, options);
+        },
+        err => {
+            throw callbackError || err;
+        }
+    );
+    if (signal) {
+        promise.then(
+            () => signal.removeEventListener('abort', onAbort),
+            () => signal.removeEventListener('abort', onAbort)
+        );
+    }
+    return { promise, abort: job.abort, pulled: job.pulled };
+}
+
+// Asynchronous chunkFile: the event loop keeps running while the file is
+// chunked. With options.onChunk, chunks are passed to it as they are
+// produced and the resolved result has an empty chunks array; otherwise
+// options.compact works as for chunkFile.
+HierarchicalChunker.prototype.chunkFileAsync = function(pdfPath, options = {}) {
+    return startChunkFile(this, pdfPath, options, options.onChunk).promise;
+};
+
+// Async iterator over the chunks of a file, yielding each as soon as it is
+// produced. Chunking runs at most 16 chunks ahead of the loop and waits
+// for it to pull more. Breaking out of the loop stops the chunking; the
+// iterator's return value is the result without chunks.
+HierarchicalChunker.prototype.chunkFileStream = async function* (pdfPath, options = {}) {
+    const queue = [];
+    let head = 0;  // queue[head] is the next chunk to yield
+    let wake = null;
+    let summary = null;
+    let failure = null;
+    const notify = () => {
+        if (wake) {
+            const resolve = wake;
+            wake = null;
+            resolve();
+        }
+    };
+
+    const job = startChunkFile(this, pdfPath, options, chunk => {
+        queue.push(chunk);
+        notify();
+    }, true);
+    job.promise.then(result => { summary = result; }, err => { failure = err; }).then(notify);
+
+    try {
+        for (;;) {
+            while (head < queue.length) {
+                const chunk = queue[head];
+                queue[head++] = undefined;
+                if (head === queue.length) {
+                    queue.length = 0;
+                    head = 0;
+                }
+                job.pulled();
+                yield chunk;
+            }
+            if (failure) throw failure;
+            if (summary) return summary;
+            await new Promise(resolve => { wake = resolve; });
+        }
+    } finally {
+        job.abort();  // no-op once the job has finished
+    }
+};
 
 // Convenience function for one-shot chunking
 module.exports.chunkPdf = function(pdfPath, options = {}) {
     const chunker = new HierarchicalChunker(options);
-    return chunker.chunkFile(pdfPath, options.pageLimit);
+    return chunker.chunkFile(pdfPath, options.pageLimit, { compact: options.compact });
 };
\ No newline at end of file
@@ -1,3 +1,5 @@
+/// <reference types="node" />
+
 export interface ChunkOptions {
     /** Maximum tokens per chunk (default: 512) */
     maxTokens?: number;
@@ -5,8 +7,77 @@ export interface ChunkOptions {
     minTokens?: number;
     /** Number of overlapping tokens between chunks (default: 0) */
     overlapTokens?: number;
-    /** Number of threads to use (default: hardware concurrency) */
+    /** Number of threads to use (default: the CPUs available, cgroup CPU quota included) */
     threadCount?: number;
+    /**
+     * Pin worker threads: 'cores' gives each its own CPU, physical cores
+     * before hyperthread siblings; 'numa' keeps each to one NUMA node's
+     * CPUs (default: 'none')
+     */
+    cpuAffinity?: 'none' | 'cores' | 'numa';
+    /**
+     * Measure pages/s at a few worker counts and in-flight depths on the
+     * first pages parsed and keep the fastest; see getEngineSettings()
+     * (default: false)
+     */
+    autoTune?: boolean;
+    /**
+     * Bytes of MuPDF memory a page may need while its text is extracted;
+     * larger pages fail with an error instead of exhausting memory,
+     * 0 = no limit (default: 50MB)
+     */
+    maxMemoryPerPage?: number;
+    /**
+     * No new page is started while MuPDF holds more than this many bytes
+     * in total, 0 = no budget (default: 0)
+     */
+    maxMemoryInFlight?: number;
+    /** Bytes of fonts and images MuPDF keeps cached, 0 = unlimited (default: 256MB) */
+    storeLimit?: number;
+    /**
+     * Token counting: 'greedy' is fastest and within 1-3% of tiktoken,
+     * 'exact' matches tiktoken's cl100k_base counts (default: 'greedy')
+     */
+    tokenizer?: 'greedy' | 'exact';
+    /** Entries in the memo cache for short-line token counts, 0 disables (default: 8192) */
+    tokenCacheEntries?: number;
+    /** Treat numbered lines such as "3.2.1 Results" as headings (default: false) */
+    numberedSectionHeadings?: boolean;
+    /**
+     * Directory for an on-disk cache of extracted page text, keyed by file
+     * content. PDFs parsed in full before are chunked without being parsed
+     * again (default: no cache)
+     */
+    pageCacheDir?: string;
+    /**
+     * Pages to chunk, e.g. '10-20,50' or '1-3,r3-z': 1-based pages and
+     * ranges, 'z' = last page, 'rN' = Nth page from the end, ':N' suffix =
+     * every Nth page of a range. Other pages are never parsed. pageLimit
+     * then caps the selected pages (default: every page)
+     */
+    pages?: string;
+}
+
+/** One setting the auto-tuner measured */
+export interface EngineProbe {
+    concurrency: number;
+    max_pages_in_flight: number;
+    pages_per_second: number;
+}
+
+/** The settings a chunker's engine runs with, e.g. to keep per host */
+export interface EngineSettings {
+    threads: number;
+    /** CPUs the process may use, cgroup CPU quota included */
+    available_cpus: number;
+    affinity: 'none' | 'cores' | 'numa';
+    pinned_workers: number;
+    /** Workers pages may occupy at once; below threads if the tuner chose so */
+    concurrency: number;
+    /** Pages per document extracted ahead of chunking */
+    max_pages_in_flight: number;
+    auto_tune: 'off' | 'probing' | 'done';
+    probes: EngineProbe[];
 }
 
 export interface ChunkResult {
@@ -14,6 +85,8 @@ export interface ChunkResult {
     text: string;
     /** Number of tokens in the chunk */
     tokenCount: number;
+    /** Leading tokens of text repeated from the previous chunk, included in tokenCount */
+    overlapTokens: number;
     /** Starting page number (0-based) */
     startPage: number;
     /** Ending page number (0-based) */
@@ -33,6 +106,66 @@ export interface ChunkingResult {
     totalChunks: number;
     /** Processing time in milliseconds */
     processingTimeMs: number;
+    /** Token counts answered from the memo cache */
+    tokenCacheHits: number;
+    /** Token counts that had to be computed (and were then cached) */
+    tokenCacheMisses: number;
+    /** Whether the pages came from the page text cache */
+    pageCacheHit: boolean;
+}
+
+/**
+ * Chunks of a { compact: true } result. The columns are typed arrays over
+ * native memory; a chunk's text is only decoded when text(i) or get(i)
+ * asks for it.
+ */
+export class CompactChunkList implements Iterable<ChunkResult> {
+    /** All chunk texts back to back, UTF-8 */
+    readonly textBuffer: Uint8Array;
+    /** Chunk i's text is textBuffer[textOffsets[i] .. textOffsets[i + 1]) */
+    readonly textOffsets: Uint32Array;
+    readonly tokenCounts: Int32Array;
+    readonly overlapTokens: Int32Array;
+    readonly startPages: Int32Array;
+    readonly endPages: Int32Array;
+    readonly minHeadingLevels: Int32Array;
+    /** 1 where the chunk contains a major heading */
+    readonly hasMajorHeading: Uint8Array;
+    readonly length: number;
+    /** Decodes the text of chunk i */
+    text(i: number): string;
+    /** Chunk i as a regular ChunkResult */
+    get(i: number): ChunkResult;
+    [Symbol.iterator](): Iterator<ChunkResult>;
+}
+
+export interface CompactChunkingResult extends Omit<ChunkingResult, 'chunks'> {
+    chunks: CompactChunkList;
+}
+
+export interface ResultFormatOptions {
+    /**
+     * Return chunks as a CompactChunkList instead of one object per chunk,
+     * which avoids most of the marshalling cost for large documents
+     */
+    compact?: boolean;
+}
+
+export interface AsyncChunkOptions {
+    /** Optional limit on number of pages to process */
+    pageLimit?: number;
+    /** Stops chunking; the promise then rejects with an AbortError */
+    signal?: AbortSignal;
+}
+
+export interface ChunkFileAsyncOptions extends AsyncChunkOptions, ResultFormatOptions {
+    /**
+     * Receives each chunk as soon as it is produced, on the main thread.
+     * The resolved result's chunks array is then empty and compact is
+     * ignored. Throwing stops
+     * chunking and rejects the promise with the thrown error.
+     */
+    onChunk?: (chunk: ChunkResult) => void;
 }
 
 export class HierarchicalChunker {
@@ -44,12 +177,33 @@ export class HierarchicalChunker {
     
     /**
      * Chunk a PDF file into semantic text chunks
-     * @param pdfPath - Path to the PDF file
+     * @param pdfPath - Path to the PDF file, or a Buffer holding one (read in place, not copied)
      * @param pageLimit - Optional limit on number of pages to process
      * @returns Chunking results
      * @throws Error if PDF cannot be processed
      */
-    chunkFile(pdfPath: string, pageLimit?: number): ChunkingResult;
+    chunkFile(pdfPath: string | Buffer, pageLimit?: number): ChunkingResult;
+    chunkFile(pdfPath: string | Buffer, pageLimit: number | undefined, options: ResultFormatOptions & { compact: true }): CompactChunkingResult;
+    chunkFile(pdfPath: string | Buffer, pageLimit?: number, options?: ResultFormatOptions): ChunkingResult | CompactChunkingResult;
+    
+    /**
+     * Chunk a PDF file on a worker thread without blocking the event loop
+     * @param pdfPath - Path to the PDF file, or a Buffer holding one (read in place, not copied)
+     * @param options - Page limit, abort signal and optional chunk callback
+     * @returns Promise of the chunking results
+     */
+    chunkFileAsync(pdfPath: string | Buffer, options: ChunkFileAsyncOptions & { compact: true, onChunk?: undefined }): Promise<CompactChunkingResult>;
+    chunkFileAsync(pdfPath: string | Buffer, options?: ChunkFileAsyncOptions): Promise<ChunkingResult>;
+    
+    /**
+     * Iterate over the chunks of a PDF file as they are produced. Chunking
+     * runs at most 16 chunks ahead of the loop; leaving the loop early
+     * stops it.
+     * @param pdfPath - Path to the PDF file, or a Buffer holding one (read in place, not copied)
+     * @param options - Page limit and abort signal
+     * @returns Async iterator of chunks; its return value is the result without chunks
+     */
+    chunkFileStream(pdfPath: string | Buffer, options?: AsyncChunkOptions): AsyncGenerator<ChunkResult, ChunkingResult, undefined>;
     
     /**
      * Get current chunking options
@@ -60,15 +214,77 @@ export class HierarchicalChunker {
     /**
      * Update chunking options
      * @param options - New configuration options (partial update supported)
+     * @throws Error while a chunkFileAsync or chunkFileStream call is running
      */
     setOptions(options: ChunkOptions): void;
+    
+    /** Settings of this chunker's engine; starts it if no file was chunked yet */
+    getEngineSettings(): EngineSettings;
 }
 
 /**
  * Convenience function for one-shot PDF chunking
- * @param pdfPath - Path to the PDF file
+ * @param pdfPath - Path to the PDF file, or a Buffer holding one (read in place, not copied)
  * @param options - Configuration options including optional pageLimit
  * @returns Chunking results
  * @throws Error if PDF cannot be processed
  */
-export function chunkPdf(pdfPath: string, options?: ChunkOptions & { pageLimit?: number }): ChunkingResult;
\ No newline at end of file
+export function chunkPdf(pdfPath: string | Buffer, options: ChunkOptions & { pageLimit?: number, compact: true }): CompactChunkingResult;
+export function chunkPdf(pdfPath: string | Buffer, options?: ChunkOptions & ResultFormatOptions & { pageLimit?: number }): ChunkingResult;
+
+export interface StageStats {
+    count: number;
+    total_ms: number;
+    /** The latency fields are only set once the stage has run */
+    mean_us?: number;
+    /** Percentiles are upper bounds of power-of-two buckets, so at most 2x high */
+    p50_us?: number;
+    p90_us?: number;
+    p99_us?: number;
+    max_us?: number;
+}
+
+export interface PipelineStats {
+    counters: {
+        documents_opened: number;
+        pages_extracted: number;
+        page_errors: number;
+        /** Pages failed for needing more than maxMemoryPerPage */
+        pages_over_memory_limit: number;
+        /** Times a free worker was held back by maxMemoryInFlight */
+        memory_budget_waits: number;
+        /** Documents served from the page text cache */
+        page_cache_hits: number;
+        /** Documents parsed for lack of a page cache entry */
+        page_cache_misses: number;
+        lines_annotated: number;
+        tokens_counted: number;
+        chunks_emitted: number;
+        /** Allocations made by MuPDF, published as each page finishes */
+        mupdf_allocations: number;
+        /** Of those, served from the worker's cache of freed blocks */
+        mupdf_allocations_pooled: number;
+    };
+    stages: {
+        open: StageStats;
+        load_page: StageStats;
+        stext: StageStats;
+        tokenize: StageStats;
+        chunk: StageStats;
+    };
+}
+
+/** Counters and stage latencies of every chunker in the process since the last resetStats() */
+export function getStats(): PipelineStats;
+export function resetStats(): void;
+
+/**
+ * Record every pipeline stage as a trace span until stopTrace(), keeping
+ * at most maxSpans of them (default: 1048576). Discards earlier spans.
+ */
+export function startTrace(maxSpans?: number): void;
+/** The spans since startTrace(), in Chrome's trace event format */
+export function stopTrace(): { traceEvents: object[]; displayTimeUnit: string };
+
+/** Library messages at this level or above go to stderr (default: 'warning') */
+export function setLogLevel(level: 'debug' | 'info' | 'warning' | 'error' | 'off'): void;
\ No newline at end of file
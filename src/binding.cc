@@ -1,9 +1,180 @@
 #include <napi.h>
 #include "fast_pdf_parser/hierarchical_chunker.h"
+#include "fast_pdf_parser/metrics.h"
+#include "fast_pdf_parser/parse_engine.h"
 #include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 using namespace fast_pdf_parser;
 
+// Classifier for the numberedSectionHeadings option; nullptr keeps the built-ins
+static std::shared_ptr<const LineClassifier> section_heading_classifier(bool enabled) {
+    if (!enabled) return nullptr;
+    auto classifier = std::make_shared<LineClassifier>();
+    classifier->add_rule(LineClassifier::numbered_section_rule());
+    return classifier;
+}
+
+// Sets options.pages from a selection such as "1-3,r3-z"; "" selects every
+// page. Throws a TypeError into JS and returns false if it is malformed.
+static bool read_page_selection(Napi::Env env, const Napi::String& spec, ChunkOptions& options) {
+    std::string text = spec.Utf8Value();
+    try {
+        options.pages = text.empty() ? PageSelection() : PageSelection::parse(text);
+    } catch (const std::invalid_argument& e) {
+        Napi::TypeError::New(env, e.what()).ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+// Sets options.cpu_affinity from "none", "cores" or "numa". Throws a
+// TypeError into JS and returns false for anything else.
+static bool read_cpu_affinity(Napi::Env env, const Napi::String& name, ChunkOptions& options) {
+    try {
+        options.cpu_affinity = parse_cpu_affinity(name.Utf8Value());
+    } catch (const std::invalid_argument& e) {
+        Napi::TypeError::New(env, e.what()).ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+// Sets options.tokenizer_mode from "greedy" or "exact". Throws a TypeError
+// into JS and returns false for anything else.
+static bool read_tokenizer(Napi::Env env, const Napi::String& name, ChunkOptions& options) {
+    std::string mode = name.Utf8Value();
+    if (mode == "greedy") {
+        options.tokenizer_mode = TokenizerMode::Greedy;
+    } else if (mode == "exact") {
+        options.tokenizer_mode = TokenizerMode::ExactBpe;
+    } else {
+        Napi::TypeError::New(env, "Unknown tokenizer '" + mode + "' (expected greedy or exact)")
+            .ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+static Napi::Object chunk_to_js(Napi::Env env, const ChunkResult& chunk) {
+    Napi::Object chunk_obj = Napi::Object::New(env);
+    chunk_obj.Set("text", Napi::String::New(env, chunk.text));
+    chunk_obj.Set("tokenCount", Napi::Number::New(env, chunk.token_count));
+    chunk_obj.Set("overlapTokens", Napi::Number::New(env, chunk.overlap_tokens));
+    chunk_obj.Set("startPage", Napi::Number::New(env, chunk.start_page));
+    chunk_obj.Set("endPage", Napi::Number::New(env, chunk.end_page));
+    chunk_obj.Set("hasMajorHeading", Napi::Boolean::New(env, chunk.has_major_heading));
+    chunk_obj.Set("minHeadingLevel", Napi::Number::New(env, chunk.min_heading_level));
+    return chunk_obj;
+}
+
+// A file's chunks in columnar form, for { compact: true } results. JS gets
+// external ArrayBuffers over these vectors instead of an object and a
+// string per chunk; index.js decodes chunk text only when it is read.
+struct CompactChunks {
+    std::string text;                          // all chunk texts back to back, UTF-8
+    std::vector<uint32_t> text_offsets{0};     // chunk i is [offsets[i], offsets[i + 1])
+    std::vector<int32_t> token_counts;
+    std::vector<int32_t> overlap_tokens;
+    std::vector<int32_t> start_pages;
+    std::vector<int32_t> end_pages;
+    std::vector<int32_t> min_heading_levels;
+    std::vector<uint8_t> has_major_heading;
+    
+    void add(const ChunkResult& chunk) {
+        text += chunk.text;
+        text_offsets.push_back(static_cast<uint32_t>(text.size()));
+        token_counts.push_back(chunk.token_count);
+        overlap_tokens.push_back(chunk.overlap_tokens);
+        start_pages.push_back(chunk.start_page);
+        end_pages.push_back(chunk.end_page);
+        min_heading_levels.push_back(chunk.min_heading_level);
+        has_major_heading.push_back(chunk.has_major_heading ? 1 : 0);
+    }
+};
+
+// ArrayBuffer over data without copying; each buffer holds a reference to
+// owner, which is freed with the last of them
+static Napi::ArrayBuffer external_buffer(Napi::Env env, const std::shared_ptr<CompactChunks>& owner,
+                                         void* data, size_t bytes) {
+    if (bytes == 0) {
+        return Napi::ArrayBuffer::New(env, 0);
+    }
+    return Napi::ArrayBuffer::New(env, data, bytes,
+        [](Napi::Env, void*, std::shared_ptr<CompactChunks>* hint) { delete hint; },
+        new std::shared_ptr<CompactChunks>(owner));
+}
+
+template <typename TypedArray, typename T>
+static TypedArray external_array(Napi::Env env, const std::shared_ptr<CompactChunks>& owner,
+                                 std::vector<T>& values) {
+    Napi::ArrayBuffer buffer = external_buffer(env, owner, values.data(), values.size() * sizeof(T));
+    return TypedArray::New(env, values.size(), buffer, 0);
+}
+
+static Napi::Object compact_chunks_to_js(Napi::Env env, const std::shared_ptr<CompactChunks>& compact) {
+    Napi::Object chunks = Napi::Object::New(env);
+    chunks.Set("text", external_buffer(env, compact, compact->text.data(), compact->text.size()));
+    chunks.Set("textOffsets", external_array<Napi::Uint32Array>(env, compact, compact->text_offsets));
+    chunks.Set("tokenCounts", external_array<Napi::Int32Array>(env, compact, compact->token_counts));
+    chunks.Set("overlapTokens", external_array<Napi::Int32Array>(env, compact, compact->overlap_tokens));
+    chunks.Set("startPages", external_array<Napi::Int32Array>(env, compact, compact->start_pages));
+    chunks.Set("endPages", external_array<Napi::Int32Array>(env, compact, compact->end_pages));
+    chunks.Set("minHeadingLevels", external_array<Napi::Int32Array>(env, compact, compact->min_heading_levels));
+    chunks.Set("hasMajorHeading", external_array<Napi::Uint8Array>(env, compact, compact->has_major_heading));
+    return chunks;
+}
+
+// With compact set, chunks come from it and result.chunks is ignored
+static Napi::Object result_to_js(Napi::Env env, const ChunkingResult& result,
+                                 const std::shared_ptr<CompactChunks>& compact = nullptr) {
+    Napi::Object js_result = Napi::Object::New(env);
+    
+    if (compact) {
+        js_result.Set("chunks", compact_chunks_to_js(env, compact));
+    } else {
+        // Create chunks array
+        Napi::Array chunks_array = Napi::Array::New(env, result.chunks.size());
+        for (size_t i = 0; i < result.chunks.size(); ++i) {
+            chunks_array.Set(i, chunk_to_js(env, result.chunks[i]));
+        }
+        js_result.Set("chunks", chunks_array);
+    }
+    
+    js_result.Set("totalPages", Napi::Number::New(env, result.total_pages));
+    js_result.Set("totalChunks", Napi::Number::New(env, result.total_chunks));
+    js_result.Set("processingTimeMs", Napi::Number::New(env, result.processing_time_ms));
+    js_result.Set("tokenCacheHits", Napi::Number::New(env, static_cast<double>(result.token_cache_hits)));
+    js_result.Set("tokenCacheMisses", Napi::Number::New(env, static_cast<double>(result.token_cache_misses)));
+    js_result.Set("pageCacheHit", Napi::Boolean::New(env, result.page_cache_hit));
+    return js_result;
+}
+
+// { compact: true } in an options argument
+static bool compact_requested(const Napi::CallbackInfo& info, size_t index) {
+    if (info.Length() <= index || !info[index].IsObject()) return false;
+    Napi::Value compact = info[index].As<Napi::Object>().Get("compact");
+    return compact.IsBoolean() && compact.As<Napi::Boolean>().Value();
+}
+
+// Buffers handed to the chunker as memory sources. The extractor's cached
+// documents keep a source's owner after the call returns and may release it
+// on any thread, but a JS reference may only be dropped on the main thread,
+// so the owner's deleter just records the pin and the wrapper unpins the
+// recorded buffers the next time it runs on the main thread.
+struct PinnedBuffers {
+    std::mutex mutex;
+    std::vector<uint64_t> released;
+};
+
+class ChunkFileWorker;
+
 class HierarchicalChunkerWrapper : public Napi::ObjectWrap<HierarchicalChunkerWrapper> {
 public:
     static Napi::Object Init(Napi::Env env, Napi::Object exports);
@@ -11,12 +182,25 @@ public:
     ~HierarchicalChunkerWrapper();
 
 private:
+    friend class ChunkFileWorker;
+    
     static Napi::FunctionReference constructor;
     std::unique_ptr<HierarchicalChunker> chunker_;
+    int running_jobs_ = 0;  // started by StartChunkFile, not yet settled
+    
+    std::shared_ptr<PinnedBuffers> pins_ = std::make_shared<PinnedBuffers>();
+    std::unordered_map<uint64_t, Napi::Reference<Napi::Buffer<uint8_t>>> pinned_;
+    uint64_t next_pin_ = 0;
+    
+    // A path becomes a file source, a Buffer a memory source over its bytes
+    bool to_source(Napi::Env env, Napi::Value value, PdfSource& source);
+    void unpin_released();
     
     Napi::Value ChunkFile(const Napi::CallbackInfo& info);
+    Napi::Value StartChunkFile(const Napi::CallbackInfo& info);
     Napi::Value GetOptions(const Napi::CallbackInfo& info);
     void SetOptions(const Napi::CallbackInfo& info);
+    Napi::Value GetEngineSettings(const Napi::CallbackInfo& info);
 };
 
 Napi::FunctionReference HierarchicalChunkerWrapper::constructor;
@@ -24,8 +208,10 @@ Napi::FunctionReference HierarchicalChunkerWrapper::constructor;
 Napi::Object HierarchicalChunkerWrapper::Init(Napi::Env env, Napi::Object exports) {
     Napi::Function func = DefineClass(env, "HierarchicalChunker", {
         InstanceMethod("chunkFile", &HierarchicalChunkerWrapper::ChunkFile),
+        InstanceMethod("_startChunkFile", &HierarchicalChunkerWrapper::StartChunkFile),
         InstanceMethod("getOptions", &HierarchicalChunkerWrapper::GetOptions),
-        InstanceMethod("setOptions", &HierarchicalChunkerWrapper::SetOptions)
+        InstanceMethod("setOptions", &HierarchicalChunkerWrapper::SetOptions),
+        InstanceMethod("getEngineSettings", &HierarchicalChunkerWrapper::GetEngineSettings)
     });
     
     constructor = Napi::Persistent(func);
@@ -56,22 +242,92 @@ HierarchicalChunkerWrapper::HierarchicalChunkerWrapper(const Napi::CallbackInfo&
         if (opts.Has("threadCount") && opts.Get("threadCount").IsNumber()) {
             options.thread_count = opts.Get("threadCount").As<Napi::Number>().Int32Value();
         }
+        if (opts.Has("maxMemoryPerPage") && opts.Get("maxMemoryPerPage").IsNumber()) {
+            options.memory.max_memory_per_page = static_cast<size_t>(std::max<int64_t>(opts.Get("maxMemoryPerPage").As<Napi::Number>().Int64Value(), 0));
+        }
+        if (opts.Has("maxMemoryInFlight") && opts.Get("maxMemoryInFlight").IsNumber()) {
+            options.memory.max_memory_in_flight = static_cast<size_t>(std::max<int64_t>(opts.Get("maxMemoryInFlight").As<Napi::Number>().Int64Value(), 0));
+        }
+        if (opts.Has("storeLimit") && opts.Get("storeLimit").IsNumber()) {
+            options.memory.store_limit = static_cast<size_t>(std::max<int64_t>(opts.Get("storeLimit").As<Napi::Number>().Int64Value(), 0));
+        }
+        if (opts.Has("tokenizer") && opts.Get("tokenizer").IsString() &&
+            !read_tokenizer(info.Env(), opts.Get("tokenizer").As<Napi::String>(), options)) {
+            return;
+        }
+        if (opts.Has("tokenCacheEntries") && opts.Get("tokenCacheEntries").IsNumber()) {
+            options.token_cache_entries = opts.Get("tokenCacheEntries").As<Napi::Number>().Int32Value();
+        }
+        if (opts.Has("numberedSectionHeadings") && opts.Get("numberedSectionHeadings").IsBoolean()) {
+            options.line_classifier = section_heading_classifier(
+                opts.Get("numberedSectionHeadings").As<Napi::Boolean>().Value());
+        }
+        if (opts.Has("pageCacheDir") && opts.Get("pageCacheDir").IsString()) {
+            options.page_cache_dir = opts.Get("pageCacheDir").As<Napi::String>().Utf8Value();
+        }
+        if (opts.Has("pages") && opts.Get("pages").IsString() &&
+            !read_page_selection(info.Env(), opts.Get("pages").As<Napi::String>(), options)) {
+            return;
+        }
+        if (opts.Has("cpuAffinity") && opts.Get("cpuAffinity").IsString() &&
+            !read_cpu_affinity(info.Env(), opts.Get("cpuAffinity").As<Napi::String>(), options)) {
+            return;
+        }
+        if (opts.Has("autoTune") && opts.Get("autoTune").IsBoolean()) {
+            options.auto_tune = opts.Get("autoTune").As<Napi::Boolean>().Value();
+        }
     }
     
     chunker_ = std::make_unique<HierarchicalChunker>(options);
 }
 
-HierarchicalChunkerWrapper::~HierarchicalChunkerWrapper() = default;
+HierarchicalChunkerWrapper::~HierarchicalChunkerWrapper() {
+    chunker_.reset();  // closes cached documents, releasing their buffers
+    pinned_.clear();
+}
+
+bool HierarchicalChunkerWrapper::to_source(Napi::Env env, Napi::Value value, PdfSource& source) {
+    if (value.IsString()) {
+        source = value.As<Napi::String>().Utf8Value();
+        return true;
+    }
+    if (!value.IsBuffer()) {
+        Napi::Error::New(env, "First argument must be a PDF file path or a Buffer").ThrowAsJavaScriptException();
+        return false;
+    }
+    
+    Napi::Buffer<uint8_t> buffer = value.As<Napi::Buffer<uint8_t>>();
+    uint64_t pin = next_pin_++;
+    pinned_.emplace(pin, Napi::Persistent(buffer));
+    std::shared_ptr<const void> owner(buffer.Data(), [pins = pins_, pin](const void*) {
+        std::lock_guard<std::mutex> lock(pins->mutex);
+        pins->released.push_back(pin);
+    });
+    source = PdfSource::memory(buffer.Data(), buffer.Length(), std::move(owner), "buffer.pdf");
+    return true;
+}
+
+void HierarchicalChunkerWrapper::unpin_released() {
+    std::vector<uint64_t> released;
+    {
+        std::lock_guard<std::mutex> lock(pins_->mutex);
+        released.swap(pins_->released);
+    }
+    for (uint64_t pin : released) {
+        pinned_.erase(pin);
+    }
+}
 
 Napi::Value HierarchicalChunkerWrapper::ChunkFile(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    if (info.Length() < 1 || !info[0].IsString()) {
-        Napi::Error::New(env, "First argument must be a PDF file path").ThrowAsJavaScriptException();
+    unpin_released();
+    
+    PdfSource source;
+    if (!to_source(env, info[0], source)) {  // info[0] is undefined when missing
         return env.Null();
     }
     
-    std::string pdf_path = info[0].As<Napi::String>().Utf8Value();
     int page_limit = -1;
     
     if (info.Length() > 1 && info[1].IsNumber()) {
@@ -79,7 +335,18 @@ Napi::Value HierarchicalChunkerWrapper::ChunkFile(const Napi::CallbackInfo& info
     }
     
     try {
-        ChunkingResult result = chunker_->chunk_file(pdf_path, page_limit);
+        ChunkingResult result;
+        std::shared_ptr<CompactChunks> compact;
+        if (compact_requested(info, 2)) {
+            // Chunks go straight into the columns; no per-chunk results are kept
+            compact = std::make_shared<CompactChunks>();
+            result = chunker_->chunk_file_streaming(source, [&compact](ChunkResult&& chunk) {
+                compact->add(chunk);
+                return true;
+            }, page_limit);
+        } else {
+            result = chunker_->chunk_file(source, page_limit);
+        }
         
         // Check for errors
         if (!result.error.empty()) {
@@ -88,30 +355,7 @@ Napi::Value HierarchicalChunkerWrapper::ChunkFile(const Napi::CallbackInfo& info
         }
         
         // Convert result to JavaScript object
-        Napi::Object js_result = Napi::Object::New(env);
-        
-        // Create chunks array
-        Napi::Array chunks_array = Napi::Array::New(env, result.chunks.size());
-        for (size_t i = 0; i < result.chunks.size(); ++i) {
-            const auto& chunk = result.chunks[i];
-            
-            Napi::Object chunk_obj = Napi::Object::New(env);
-            chunk_obj.Set("text", Napi::String::New(env, chunk.text));
-            chunk_obj.Set("tokenCount", Napi::Number::New(env, chunk.token_count));
-            chunk_obj.Set("startPage", Napi::Number::New(env, chunk.start_page));
-            chunk_obj.Set("endPage", Napi::Number::New(env, chunk.end_page));
-            chunk_obj.Set("hasMajorHeading", Napi::Boolean::New(env, chunk.has_major_heading));
-            chunk_obj.Set("minHeadingLevel", Napi::Number::New(env, chunk.min_heading_level));
-            
-            chunks_array.Set(i, chunk_obj);
-        }
-        
-        js_result.Set("chunks", chunks_array);
-        js_result.Set("totalPages", Napi::Number::New(env, result.total_pages));
-        js_result.Set("totalChunks", Napi::Number::New(env, result.total_chunks));
-        js_result.Set("processingTimeMs", Napi::Number::New(env, result.processing_time_ms));
-        
-        return js_result;
+        return result_to_js(env, result, compact);
         
     } catch (const std::exception& e) {
         Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
@@ -119,6 +363,230 @@ Napi::Value HierarchicalChunkerWrapper::ChunkFile(const Napi::CallbackInfo& info
     }
 }
 
+// Settles the promise of one StartChunkFile call. When chunks are streamed
+// it is owned by the thread-safe function and settled from its finalizer,
+// which runs only after every queued chunk callback has run.
+struct ChunkFileCompletion {
+    Napi::Promise::Deferred deferred;
+    ChunkingResult result;
+    std::shared_ptr<CompactChunks> compact;  // set for compact results
+    bool aborted = false;
+    
+    explicit ChunkFileCompletion(Napi::Env env) : deferred(Napi::Promise::Deferred::New(env)) {}
+    
+    void settle(Napi::Env env) {
+        Napi::HandleScope scope(env);
+        if (aborted) {
+            Napi::Error error = Napi::Error::New(env, "The operation was aborted");
+            error.Set("name", Napi::String::New(env, "AbortError"));
+            deferred.Reject(error.Value());
+        } else if (!result.error.empty()) {
+            deferred.Reject(Napi::Error::New(env, result.error).Value());
+        } else {
+            deferred.Resolve(result_to_js(env, result, compact));
+        }
+    }
+};
+
+// A job's abort flag and, in pull mode, the chunks handed to onChunk that
+// JS has not taken yet. Shared by the worker and the job's JS functions.
+struct ChunkFileControl {
+    std::atomic<bool> aborted{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t unpulled = 0;
+    
+    void abort() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            aborted.store(true, std::memory_order_relaxed);
+        }
+        cv.notify_all();
+    }
+    
+    void pulled() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (unpulled > 0) unpulled--;
+        }
+        cv.notify_all();
+    }
+    
+    // Waits until fewer than max chunks are unpulled and counts one more;
+    // false once the job is aborted
+    bool reserve(size_t max) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return aborted.load(std::memory_order_relaxed) || unpulled < max; });
+        if (aborted.load(std::memory_order_relaxed)) return false;
+        unpulled++;
+        return true;
+    }
+};
+
+// Runs chunk_file_streaming on a libuv worker thread. Without an onChunk
+// function the chunks are collected into the result (or its compact
+// columns); with one, each chunk is handed to it on the main thread as
+// soon as it is produced, and the worker waits while kMaxQueuedChunks are
+// still undelivered. In pull mode onChunk only queues the chunk, so a
+// chunk stays undelivered until job.pulled() is called for it; a consumer
+// that stops pulling pauses the chunking until it pulls or aborts.
+class ChunkFileWorker : public Napi::AsyncWorker {
+public:
+    static constexpr size_t kMaxQueuedChunks = 16;
+    
+    ChunkFileWorker(Napi::Env env, HierarchicalChunkerWrapper* owner, Napi::Object owner_obj,
+                    PdfSource source, int page_limit, Napi::Value on_chunk, bool compact, bool pull,
+                    std::shared_ptr<ChunkFileControl> control)
+        : Napi::AsyncWorker(env, "chunkFileAsync"),
+          owner_(owner),
+          owner_ref_(Napi::Persistent(owner_obj)),  // keeps the chunker alive
+          source_(std::move(source)),
+          page_limit_(page_limit),
+          control_(std::move(control)),
+          completion_(new ChunkFileCompletion(env)) {
+        if (on_chunk.IsFunction()) {
+            streaming_ = true;
+            pull_ = pull;
+            tsfn_ = Napi::ThreadSafeFunction::New(
+                env, on_chunk.As<Napi::Function>(), "chunkFileAsync", kMaxQueuedChunks, 1,
+                completion_, [](Napi::Env env, ChunkFileCompletion* completion) {
+                    completion->settle(env);
+                    delete completion;
+                });
+        } else if (compact) {
+            completion_->compact = std::make_shared<CompactChunks>();
+        }
+        owner_->running_jobs_++;
+    }
+    
+    Napi::Promise promise() const { return completion_->deferred.Promise(); }
+    
+    void Execute() override {
+        try {
+            run_chunking();
+        } catch (const std::exception& e) {
+            SetError(e.what());  // OnError runs instead of OnOK
+        }
+    }
+    
+    // Chunking errors are reported through result_.error and end up here
+    void OnOK() override {
+        finish();
+    }
+    
+    // Chunking threw, e.g. std::bad_alloc; the job fails with its message
+    void OnError(const Napi::Error& error) override {
+        result_ = ChunkingResult();
+        result_.error = error.Message();
+        finish();
+    }
+
+private:
+    void run_chunking() {
+        std::vector<ChunkResult> chunks;
+        result_ = owner_->chunker_->chunk_file_streaming(source_, [&](ChunkResult&& chunk) {
+            if (control_->aborted.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            if (completion_->compact) {
+                completion_->compact->add(chunk);
+                return true;
+            }
+            if (!streaming_) {
+                chunks.push_back(std::move(chunk));
+                return true;
+            }
+            
+            if (pull_ && !control_->reserve(kMaxQueuedChunks)) {
+                return false;
+            }
+            auto* data = new ChunkResult(std::move(chunk));
+            napi_status status = tsfn_.BlockingCall(data,
+                [control = control_](Napi::Env env, Napi::Function on_chunk, ChunkResult* data) {
+                    std::unique_ptr<ChunkResult> chunk(data);
+                    if (env != nullptr && !control->aborted.load(std::memory_order_relaxed)) {
+                        on_chunk.Call({chunk_to_js(env, *chunk)});
+                    }
+                });
+            if (status != napi_ok) {  // the environment is shutting down
+                delete data;
+                return false;
+            }
+            return true;
+        }, page_limit_);
+        result_.chunks = std::move(chunks);
+    }
+    
+    // Settles the job however Execute ended
+    void finish() {
+        source_ = PdfSource();  // drop this job's hold on a Buffer's bytes
+        owner_->running_jobs_--;
+        owner_->unpin_released();
+        completion_->result = std::move(result_);
+        completion_->aborted = control_->aborted.load();
+        if (streaming_) {
+            tsfn_.Release();  // the finalizer settles once the queue drains
+        } else {
+            completion_->settle(Env());
+            delete completion_;
+        }
+    }
+    
+    HierarchicalChunkerWrapper* owner_;
+    Napi::ObjectReference owner_ref_;
+    PdfSource source_;
+    int page_limit_;
+    std::shared_ptr<ChunkFileControl> control_;
+    ChunkFileCompletion* completion_;
+    bool streaming_ = false;
+    bool pull_ = false;
+    Napi::ThreadSafeFunction tsfn_;
+    ChunkingResult result_;
+};
+
+// _startChunkFile(pdfPathOrBuffer, pageLimit, onChunk?, { compact, pull }?) ->
+// { promise, abort, pulled }. index.js builds chunkFileAsync and
+// chunkFileStream on top of it; see ChunkFileWorker for pull.
+Napi::Value HierarchicalChunkerWrapper::StartChunkFile(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    unpin_released();
+    
+    PdfSource source;
+    if (!to_source(env, info[0], source)) {  // info[0] is undefined when missing
+        return env.Null();
+    }
+    
+    int page_limit = -1;
+    
+    if (info.Length() > 1 && info[1].IsNumber()) {
+        page_limit = info[1].As<Napi::Number>().Int32Value();
+    }
+    Napi::Value on_chunk = info.Length() > 2 ? info[2] : env.Undefined();
+    bool compact = compact_requested(info, 3);
+    bool pull = false;
+    if (info.Length() > 3 && info[3].IsObject()) {
+        Napi::Value value = info[3].As<Napi::Object>().Get("pull");
+        pull = value.IsBoolean() && value.As<Napi::Boolean>().Value();
+    }
+    
+    auto control = std::make_shared<ChunkFileControl>();
+    auto* worker = new ChunkFileWorker(env, this, info.This().As<Napi::Object>(),
+                                       std::move(source), page_limit, on_chunk, compact, pull, control);
+    Napi::Promise promise = worker->promise();
+    worker->Queue();  // deletes itself after OnOK or OnError
+    
+    Napi::Object job = Napi::Object::New(env);
+    job.Set("promise", promise);
+    job.Set("abort", Napi::Function::New(env, [control](const Napi::CallbackInfo&) {
+        control->abort();
+    }, "abort"));
+    job.Set("pulled", Napi::Function::New(env, [control](const Napi::CallbackInfo&) {
+        control->pulled();
+    }, "pulled"));
+    return job;
+}
+
 Napi::Value HierarchicalChunkerWrapper::GetOptions(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
@@ -129,6 +597,16 @@ Napi::Value HierarchicalChunkerWrapper::GetOptions(const Napi::CallbackInfo& inf
     js_options.Set("minTokens", Napi::Number::New(env, options.min_tokens));
     js_options.Set("overlapTokens", Napi::Number::New(env, options.overlap_tokens));
     js_options.Set("threadCount", Napi::Number::New(env, options.thread_count));
+    js_options.Set("maxMemoryPerPage", Napi::Number::New(env, static_cast<double>(options.memory.max_memory_per_page)));
+    js_options.Set("maxMemoryInFlight", Napi::Number::New(env, static_cast<double>(options.memory.max_memory_in_flight)));
+    js_options.Set("storeLimit", Napi::Number::New(env, static_cast<double>(options.memory.store_limit)));
+    js_options.Set("tokenizer", Napi::String::New(env,
+        options.tokenizer_mode == TokenizerMode::ExactBpe ? "exact" : "greedy"));
+    js_options.Set("tokenCacheEntries", Napi::Number::New(env, options.token_cache_entries));
+    js_options.Set("numberedSectionHeadings", Napi::Boolean::New(env, options.line_classifier != nullptr));
+    js_options.Set("pageCacheDir", Napi::String::New(env, options.page_cache_dir));
+    js_options.Set("cpuAffinity", Napi::String::New(env, cpu_affinity_name(options.cpu_affinity)));
+    js_options.Set("autoTune", Napi::Boolean::New(env, options.auto_tune));
     
     return js_options;
 }
@@ -141,6 +619,11 @@ void HierarchicalChunkerWrapper::SetOptions(const Napi::CallbackInfo& info) {
         return;
     }
     
+    if (running_jobs_ > 0) {
+        Napi::Error::New(env, "Cannot change options while chunkFileAsync is running").ThrowAsJavaScriptException();
+        return;
+    }
+    
     Napi::Object opts = info[0].As<Napi::Object>();
     ChunkOptions options = chunker_->get_options();
     
@@ -156,11 +639,102 @@ void HierarchicalChunkerWrapper::SetOptions(const Napi::CallbackInfo& info) {
     if (opts.Has("threadCount") && opts.Get("threadCount").IsNumber()) {
         options.thread_count = opts.Get("threadCount").As<Napi::Number>().Int32Value();
     }
+    if (opts.Has("maxMemoryPerPage") && opts.Get("maxMemoryPerPage").IsNumber()) {
+        options.memory.max_memory_per_page = static_cast<size_t>(std::max<int64_t>(opts.Get("maxMemoryPerPage").As<Napi::Number>().Int64Value(), 0));
+    }
+    if (opts.Has("maxMemoryInFlight") && opts.Get("maxMemoryInFlight").IsNumber()) {
+        options.memory.max_memory_in_flight = static_cast<size_t>(std::max<int64_t>(opts.Get("maxMemoryInFlight").As<Napi::Number>().Int64Value(), 0));
+    }
+    if (opts.Has("storeLimit") && opts.Get("storeLimit").IsNumber()) {
+        options.memory.store_limit = static_cast<size_t>(std::max<int64_t>(opts.Get("storeLimit").As<Napi::Number>().Int64Value(), 0));
+    }
+    if (opts.Has("tokenizer") && opts.Get("tokenizer").IsString() &&
+        !read_tokenizer(env, opts.Get("tokenizer").As<Napi::String>(), options)) {
+        return;
+    }
+    if (opts.Has("tokenCacheEntries") && opts.Get("tokenCacheEntries").IsNumber()) {
+        options.token_cache_entries = opts.Get("tokenCacheEntries").As<Napi::Number>().Int32Value();
+    }
+    if (opts.Has("numberedSectionHeadings") && opts.Get("numberedSectionHeadings").IsBoolean()) {
+        options.line_classifier = section_heading_classifier(
+            opts.Get("numberedSectionHeadings").As<Napi::Boolean>().Value());
+    }
+    if (opts.Has("pageCacheDir") && opts.Get("pageCacheDir").IsString()) {
+        options.page_cache_dir = opts.Get("pageCacheDir").As<Napi::String>().Utf8Value();
+    }
+    if (opts.Has("pages") && opts.Get("pages").IsString() &&
+        !read_page_selection(env, opts.Get("pages").As<Napi::String>(), options)) {
+        return;
+    }
+    if (opts.Has("cpuAffinity") && opts.Get("cpuAffinity").IsString() &&
+        !read_cpu_affinity(env, opts.Get("cpuAffinity").As<Napi::String>(), options)) {
+        return;
+    }
+    if (opts.Has("autoTune") && opts.Get("autoTune").IsBoolean()) {
+        options.auto_tune = opts.Get("autoTune").As<Napi::Boolean>().Value();
+    }
     
     chunker_->set_options(options);
 }
 
+// JSON built natively, handed to JS through JSON.parse
+static Napi::Value json_to_js(Napi::Env env, const nlohmann::json& value) {
+    Napi::Object json = env.Global().Get("JSON").As<Napi::Object>();
+    Napi::Function parse = json.Get("parse").As<Napi::Function>();
+    return parse.Call(json, {Napi::String::New(env, value.dump())});
+}
+
+// getEngineSettings(): threads, affinity and tuned settings of the
+// chunker's engine, which is started if it was not yet
+Napi::Value HierarchicalChunkerWrapper::GetEngineSettings(const Napi::CallbackInfo& info) {
+    return json_to_js(info.Env(), chunker_->engine()->settings());
+}
+
+// getStats(): process-wide counters and stage latencies
+static Napi::Value GetStats(const Napi::CallbackInfo& info) {
+    return json_to_js(info.Env(), metrics_snapshot());
+}
+
+static void ResetStats(const Napi::CallbackInfo&) {
+    reset_metrics();
+}
+
+// startTrace(maxSpans?)
+static void StartTrace(const Napi::CallbackInfo& info) {
+    if (info.Length() > 0 && info[0].IsNumber()) {
+        int64_t max_spans = info[0].As<Napi::Number>().Int64Value();
+        start_tracing(static_cast<size_t>(std::max<int64_t>(max_spans, 0)));
+    } else {
+        start_tracing();
+    }
+}
+
+// stopTrace(): the spans since startTrace() in Chrome trace format
+static Napi::Value StopTrace(const Napi::CallbackInfo& info) {
+    stop_tracing();
+    return json_to_js(info.Env(), trace_json());
+}
+
+// setLogLevel(level): messages at level or above go to stderr
+static void SetLogLevel(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Log level must be a string").ThrowAsJavaScriptException();
+        return;
+    }
+    try {
+        set_log_level(parse_log_level(info[0].As<Napi::String>().Utf8Value()));
+    } catch (const std::invalid_argument& e) {
+        Napi::TypeError::New(env, e.what()).ThrowAsJavaScriptException();
+    }
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    exports.Set("getStats", Napi::Function::New(env, GetStats));
+    exports.Set("resetStats", Napi::Function::New(env, ResetStats));
+    exports.Set("startTrace", Napi::Function::New(env, StartTrace));
+    exports.Set("stopTrace", Napi::Function::New(env, StopTrace));
+    exports.Set("setLogLevel", Napi::Function::New(env, SetLogLevel));
     return HierarchicalChunkerWrapper::Init(env, exports);
 }
 
@@ -0,0 +1,396 @@
+#include "fast_pdf_parser/chunk_output.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace fast_pdf_parser {
+
+namespace {
+
+constexpr char kBinaryMagic[8] = {'F', 'P', 'C', 'H', 'U', 'N', 'K', 'S'};
+constexpr char kBinaryEndMagic[8] = {'F', 'P', 'C', 'H', 'E', 'N', 'D', '1'};
+constexpr uint32_t kBinaryVersion = 1;
+constexpr size_t kRecordFixedSize = 24;  // record fields before the text
+constexpr size_t kFooterTailSize = 24;   // count, footer offset, end magic
+
+void put_le(std::ofstream& out, uint64_t value, int bytes) {
+    unsigned char buffer[8];
+    for (int i = 0; i < bytes; ++i) buffer[i] = static_cast<unsigned char>(value >> (8 * i));
+    out.write(reinterpret_cast<const char*>(buffer), bytes);
+}
+
+uint64_t get_le(const unsigned char* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) value = (value << 8) | p[i];
+    return value;
+}
+
+std::ofstream open_output(const std::string& path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Failed to open output file: " + path);
+    }
+    return out;
+}
+
+void close_output(std::ofstream& out, const std::string& path) {
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Failed to write output file: " + path);
+    }
+}
+
+// One chunk in Docling's chunk schema; total_chunks < 0 leaves it out
+nlohmann::json docling_chunk(const ChunkResult& chunk, size_t index, long total_chunks,
+                             const ChunkOrigin& origin) {
+    nlohmann::json chunk_json;
+    chunk_json["text"] = chunk.text;
+    
+    nlohmann::json meta;
+    meta["schema_name"] = "docling_core.transforms.chunker.DocMeta";
+    meta["version"] = "1.0.0";
+    meta["start_page"] = chunk.start_page;
+    meta["end_page"] = chunk.end_page;
+    meta["page_count"] = chunk.end_page - chunk.start_page + 1;
+    meta["chunk_index"] = static_cast<int>(index);
+    if (total_chunks >= 0) {
+        meta["total_chunks"] = total_chunks;
+    }
+    meta["token_count"] = chunk.token_count;
+    meta["overlap_tokens"] = chunk.overlap_tokens;
+    meta["has_major_heading"] = chunk.has_major_heading;
+    meta["min_heading_level"] = chunk.min_heading_level;
+    
+    nlohmann::json json_origin;
+    json_origin["mimetype"] = "application/pdf";
+    json_origin["binary_hash"] = origin.binary_hash;
+    json_origin["filename"] = origin.filename;
+    json_origin["uri"] = nullptr;
+    
+    meta["origin"] = json_origin;
+    meta["doc_items"] = nlohmann::json::array();
+    meta["headings"] = nlohmann::json::array();
+    meta["captions"] = nullptr;
+    
+    chunk_json["meta"] = meta;
+    return chunk_json;
+}
+
+// The array dump(2) would produce, written one element at a time. Chunks
+// are held until finish() because each one records the total.
+class JsonChunkWriter : public ChunkWriter {
+public:
+    JsonChunkWriter(const std::string& path, const ChunkOrigin& origin)
+        : path_(path), origin_(origin), out_(open_output(path)) {
+    }
+    
+    void write(const ChunkResult& chunk) override {
+        chunks_.push_back(chunk);
+        chunks_written_++;
+    }
+    
+    void finish() override {
+        if (chunks_.empty()) {
+            out_ << "[]";
+        } else {
+            out_ << "[\n";
+            for (size_t i = 0; i < chunks_.size(); ++i) {
+                std::string element = docling_chunk(chunks_[i], i, static_cast<long>(chunks_.size()), origin_).dump(2);
+                out_ << "  ";
+                // Raw newlines only occur between tokens, never inside strings
+                for (char c : element) {
+                    out_ << c;
+                    if (c == '\n') out_ << "  ";
+                }
+                out_ << (i + 1 < chunks_.size() ? ",\n" : "\n");
+                chunks_[i] = ChunkResult();  // release the text as it is written
+            }
+            out_ << "]";
+        }
+        chunks_.clear();
+        close_output(out_, path_);
+    }
+
+private:
+    std::string path_;
+    ChunkOrigin origin_;
+    std::ofstream out_;
+    std::vector<ChunkResult> chunks_;
+};
+
+class JsonLinesChunkWriter : public ChunkWriter {
+public:
+    JsonLinesChunkWriter(const std::string& path, const ChunkOrigin& origin)
+        : path_(path), origin_(origin), out_(open_output(path)) {
+    }
+    
+    void write(const ChunkResult& chunk) override {
+        out_ << docling_chunk(chunk, chunks_written_, -1, origin_).dump() << '\n';
+        chunks_written_++;
+    }
+    
+    void finish() override {
+        close_output(out_, path_);
+    }
+
+private:
+    std::string path_;
+    ChunkOrigin origin_;
+    std::ofstream out_;
+};
+
+class BinaryChunkWriter : public ChunkWriter {
+public:
+    BinaryChunkWriter(const std::string& path, const ChunkOrigin& origin)
+        : path_(path), out_(open_output(path)) {
+        out_.write(kBinaryMagic, sizeof(kBinaryMagic));
+        put_le(out_, kBinaryVersion, 4);
+        put_le(out_, 0, 4);
+        put_le(out_, origin.binary_hash, 8);
+        put_le(out_, origin.filename.size(), 4);
+        out_.write(origin.filename.data(), origin.filename.size());
+        offset_ = sizeof(kBinaryMagic) + 20 + origin.filename.size();
+    }
+    
+    void write(const ChunkResult& chunk) override {
+        record_offsets_.push_back(offset_);
+        put_le(out_, kRecordFixedSize + chunk.text.size(), 4);
+        put_le(out_, static_cast<uint32_t>(chunk.token_count), 4);
+        put_le(out_, static_cast<uint32_t>(chunk.overlap_tokens), 4);
+        put_le(out_, static_cast<uint32_t>(chunk.start_page), 4);
+        put_le(out_, static_cast<uint32_t>(chunk.end_page), 4);
+        put_le(out_, static_cast<uint32_t>(chunk.min_heading_level), 4);
+        put_le(out_, chunk.has_major_heading ? 1 : 0, 4);  // flag byte and padding
+        out_.write(chunk.text.data(), chunk.text.size());
+        offset_ += 4 + kRecordFixedSize + chunk.text.size();
+        chunks_written_++;
+    }
+    
+    void finish() override {
+        uint64_t footer_offset = offset_;
+        for (uint64_t offset : record_offsets_) {
+            put_le(out_, offset, 8);
+        }
+        put_le(out_, record_offsets_.size(), 8);
+        put_le(out_, footer_offset, 8);
+        out_.write(kBinaryEndMagic, sizeof(kBinaryEndMagic));
+        close_output(out_, path_);
+    }
+
+private:
+    std::string path_;
+    std::ofstream out_;
+    uint64_t offset_ = 0;
+    std::vector<uint64_t> record_offsets_;
+};
+
+} // namespace
+
+ChunkFormat parse_chunk_format(const std::string& name) {
+    if (name == "json") return ChunkFormat::Json;
+    if (name == "jsonl") return ChunkFormat::JsonLines;
+    if (name == "binary") return ChunkFormat::Binary;
+    throw std::invalid_argument("format must be 'json', 'jsonl' or 'binary'");
+}
+
+std::unique_ptr<ChunkWriter> ChunkWriter::create(ChunkFormat format, const std::string& path,
+                                                 const ChunkOrigin& origin) {
+    switch (format) {
+        case ChunkFormat::JsonLines:
+            return std::make_unique<JsonLinesChunkWriter>(path, origin);
+        case ChunkFormat::Binary:
+            return std::make_unique<BinaryChunkWriter>(path, origin);
+        case ChunkFormat::Json:
+        default:
+            return std::make_unique<JsonChunkWriter>(path, origin);
+    }
+}
+
+BinaryChunkReader::BinaryChunkReader(const std::string& path)
+    : mapping_(PdfSource::mapped_file(path)) {
+    const unsigned char* data = mapping_.data();
+    size_t size = mapping_.size();
+    auto invalid = [&path]() {
+        return std::runtime_error("Not a complete binary chunk file: " + path);
+    };
+    
+    const size_t header_size = sizeof(kBinaryMagic) + 20;
+    if (size < header_size + kFooterTailSize ||
+        std::memcmp(data, kBinaryMagic, sizeof(kBinaryMagic)) != 0 ||
+        std::memcmp(data + size - sizeof(kBinaryEndMagic), kBinaryEndMagic, sizeof(kBinaryEndMagic)) != 0) {
+        throw invalid();
+    }
+    if (get_le(data + 8, 4) != kBinaryVersion) {
+        throw std::runtime_error("Unsupported binary chunk file version: " + path);
+    }
+    
+    origin_.binary_hash = get_le(data + 16, 8);
+    size_t name_size = get_le(data + 24, 4);
+    if (header_size + name_size > size) throw invalid();
+    origin_.filename.assign(reinterpret_cast<const char*>(data + header_size), name_size);
+    
+    const unsigned char* tail = data + size - kFooterTailSize;
+    uint64_t count = get_le(tail, 8);
+    uint64_t footer_offset = get_le(tail + 8, 8);
+    if (footer_offset < header_size + name_size || footer_offset > size - kFooterTailSize ||
+        (size - kFooterTailSize - footer_offset) / 8 != count ||
+        (size - kFooterTailSize - footer_offset) % 8 != 0) {
+        throw invalid();
+    }
+    index_ = data + footer_offset;
+    count_ = static_cast<size_t>(count);
+    
+    for (size_t i = 0; i < count_; ++i) {
+        uint64_t offset = get_le(index_ + 8 * i, 8);
+        if (offset + 4 + kRecordFixedSize > footer_offset ||
+            offset + 4 + get_le(data + offset, 4) > footer_offset ||
+            get_le(data + offset, 4) < kRecordFixedSize) {
+            throw invalid();
+        }
+    }
+}
+
+BinaryChunkReader::~BinaryChunkReader() = default;
+
+const unsigned char* BinaryChunkReader::record(size_t i, uint32_t& size) const {
+    if (i >= count_) {
+        throw std::out_of_range("Chunk index out of range");
+    }
+    const unsigned char* p = mapping_.data() + get_le(index_ + 8 * i, 8);
+    size = static_cast<uint32_t>(get_le(p, 4));
+    return p + 4;
+}
+
+ChunkResult BinaryChunkReader::chunk(size_t i) const {
+    uint32_t size;
+    const unsigned char* p = record(i, size);
+    ChunkResult chunk;
+    chunk.token_count = static_cast<int32_t>(get_le(p, 4));
+    chunk.overlap_tokens = static_cast<int32_t>(get_le(p + 4, 4));
+    chunk.start_page = static_cast<int32_t>(get_le(p + 8, 4));
+    chunk.end_page = static_cast<int32_t>(get_le(p + 12, 4));
+    chunk.min_heading_level = static_cast<int32_t>(get_le(p + 16, 4));
+    chunk.has_major_heading = p[20] != 0;
+    chunk.text.assign(reinterpret_cast<const char*>(p + kRecordFixedSize), size - kRecordFixedSize);
+    return chunk;
+}
+
+std::string_view BinaryChunkReader::text(size_t i) const {
+    uint32_t size;
+    const unsigned char* p = record(i, size);
+    return std::string_view(reinterpret_cast<const char*>(p + kRecordFixedSize), size - kRecordFixedSize);
+}
+
+} // namespace fast_pdf_parser
+
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+#include <filesystem>
+#include <sstream>
+
+TEST_CASE("Chunk writers") {
+    using namespace fast_pdf_parser;
+    
+    auto dir = std::filesystem::temp_directory_path() / "fast_pdf_parser_chunk_output_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    
+    std::vector<ChunkResult> chunks(3);
+    for (int i = 0; i < 3; ++i) {
+        chunks[i].text = "# Part " + std::to_string(i) + "\nSome \"quoted\" text\twith a tab.\n";
+        chunks[i].token_count = 10 + i;
+        chunks[i].overlap_tokens = i == 0 ? 0 : 2;
+        chunks[i].start_page = i;
+        chunks[i].end_page = i + 1;
+        chunks[i].has_major_heading = i != 1;
+        chunks[i].min_heading_level = i == 1 ? 999 : 1;
+    }
+    ChunkOrigin origin{"report.pdf", 0xEF46DB3751D8E999ULL};
+    
+    auto write_all = [&](ChunkFormat format, const std::string& path, size_t count) {
+        auto writer = ChunkWriter::create(format, path, origin);
+        for (size_t i = 0; i < count; ++i) writer->write(chunks[i]);
+        writer->finish();
+        CHECK(writer->chunks_written() == count);
+    };
+    auto read_file = [](const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        return buffer.str();
+    };
+    
+    SUBCASE("JSON matches a pretty-printed Docling array") {
+        for (size_t count : {size_t(0), size_t(1), size_t(3)}) {
+            std::string path = (dir / "chunks.json").string();
+            write_all(ChunkFormat::Json, path, count);
+            
+            nlohmann::json expected = nlohmann::json::array();
+            for (size_t i = 0; i < count; ++i) {
+                expected.push_back(docling_chunk(chunks[i], i, static_cast<long>(count), origin));
+            }
+            CHECK(read_file(path) == expected.dump(2));
+        }
+    }
+    
+    SUBCASE("JSON Lines has one chunk per line") {
+        std::string path = (dir / "chunks.jsonl").string();
+        write_all(ChunkFormat::JsonLines, path, 3);
+        
+        std::ifstream in(path);
+        std::string line;
+        size_t index = 0;
+        while (std::getline(in, line)) {
+            auto chunk = nlohmann::json::parse(line);
+            CHECK(chunk["text"] == chunks[index].text);
+            CHECK(chunk["meta"]["chunk_index"] == index);
+            CHECK(chunk["meta"]["origin"]["binary_hash"] == origin.binary_hash);
+            CHECK_FALSE(chunk["meta"].contains("total_chunks"));
+            index++;
+        }
+        CHECK(index == 3);
+    }
+    
+    SUBCASE("Binary round trip with random access") {
+        std::string path = (dir / "chunks.bin").string();
+        write_all(ChunkFormat::Binary, path, 3);
+        
+        BinaryChunkReader reader(path);
+        REQUIRE(reader.size() == 3);
+        CHECK(reader.origin().filename == "report.pdf");
+        CHECK(reader.origin().binary_hash == origin.binary_hash);
+        for (size_t i : {size_t(2), size_t(0), size_t(1)}) {
+            ChunkResult chunk = reader.chunk(i);
+            CHECK(chunk.text == chunks[i].text);
+            CHECK(reader.text(i) == chunks[i].text);
+            CHECK(chunk.token_count == chunks[i].token_count);
+            CHECK(chunk.overlap_tokens == chunks[i].overlap_tokens);
+            CHECK(chunk.start_page == chunks[i].start_page);
+            CHECK(chunk.end_page == chunks[i].end_page);
+            CHECK(chunk.has_major_heading == chunks[i].has_major_heading);
+            CHECK(chunk.min_heading_level == chunks[i].min_heading_level);
+        }
+        CHECK_THROWS_AS(reader.chunk(3), std::out_of_range);
+        
+        write_all(ChunkFormat::Binary, path, 0);
+        CHECK(BinaryChunkReader(path).size() == 0);
+    }
+    
+    SUBCASE("Truncated binary files are rejected") {
+        std::string path = (dir / "chunks.bin").string();
+        write_all(ChunkFormat::Binary, path, 3);
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 5);
+        CHECK_THROWS_AS(BinaryChunkReader{path}, std::runtime_error);
+    }
+    
+    SUBCASE("Formats by name") {
+        CHECK(parse_chunk_format("jsonl") == ChunkFormat::JsonLines);
+        CHECK(parse_chunk_format("binary") == ChunkFormat::Binary);
+        CHECK_THROWS_AS(parse_chunk_format("xml"), std::invalid_argument);
+    }
+    
+    std::filesystem::remove_all(dir);
+}
+#endif // ENABLE_TESTS
\ No newline at end of file
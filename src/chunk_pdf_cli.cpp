@@ -1,4 +1,8 @@
 #include <fast_pdf_parser/hierarchical_chunker.h>
+#include <fast_pdf_parser/chunk_output.h>
+#include <fast_pdf_parser/content_hash.h>
+#include <fast_pdf_parser/metrics.h>
+#include <fast_pdf_parser/parse_engine.h>
 #include <iostream>
 #include <filesystem>
 #include <chrono>
@@ -9,6 +13,9 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <set>
+#include <mutex>
+#include <cctype>
 #include <getopt.h>
 #include <fstream>
 
@@ -18,11 +25,28 @@ using namespace fast_pdf_parser;
 struct CLIOptions {
     std::string input_file;
     std::string output_file;
+    ChunkFormat format = ChunkFormat::Json;
     int max_chunk_size = 512;
     int min_chunk_size = 150;
     int overlap = 0;
     int page_limit = 0;
+    std::string pages;  // "" = every page
     int thread_count = 0;  // 0 = auto
+    MemoryLimits memory;
+    CpuAffinity cpu_affinity = CpuAffinity::None;
+    bool auto_tune = false;
+    TokenizerMode tokenizer_mode = TokenizerMode::Greedy;
+    bool section_headings = false;
+    std::string cache_dir;  // "" = no page text cache
+    bool stats = false;
+    bool emit_shard = false;
+    bool merge = false;
+    bool batch = false;
+    std::string output_dir;  // --batch outputs and manifest
+    int jobs = 4;            // --batch files chunked at once
+    std::vector<std::string> arguments;  // shard files for --merge, inputs for --batch
+    std::string trace_file;  // "" = no trace
+    std::string log_level;   // "" = warning, or info with --verbose
     bool verbose = false;
     bool quiet = false;
     bool analyze = true;
@@ -32,15 +56,52 @@ struct CLIOptions {
 
 void print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " [OPTIONS]\n";
+    std::cout << "       " << program_name << " --merge [OPTIONS] SHARD...\n";
+    std::cout << "       " << program_name << " --batch --output-dir DIR [OPTIONS] INPUT...\n";
     std::cout << "\nRequired:\n";
     std::cout << "  -i, --input FILE           Input PDF file path\n";
     std::cout << "\nOptional:\n";
-    std::cout << "  -o, --output FILE          Output JSON file path (default: auto-generated)\n";
+    std::cout << "  -o, --output FILE          Output file path (default: auto-generated)\n";
+    std::cout << "  --format FORMAT            json (default), jsonl (one chunk per line) or binary\n";
+    std::cout << "                             (length-prefixed records with an index)\n";
     std::cout << "  --max-chunk-size N         Maximum tokens per chunk (default: 512)\n";
     std::cout << "  --min-chunk-size N         Minimum tokens per chunk (default: 150)\n";
     std::cout << "  --overlap N                Token overlap between chunks (default: 0)\n";
     std::cout << "  --page-limit N             Process only first N pages (default: all)\n";
-    std::cout << "  --threads N                Number of threads (default: auto-detect)\n";
+    std::cout << "  --pages SPEC               Process only these pages, e.g. 10-20,50 or 1-3,r3-z\n";
+    std::cout << "                             (z = last page, rN = Nth from last, :N = every Nth)\n";
+    std::cout << "  --threads N                Number of threads (default: the CPUs available,\n";
+    std::cout << "                             cgroup CPU quota included)\n";
+    std::cout << "  --cpu-affinity MODE        Pin workers: none (default), cores (one CPU each,\n";
+    std::cout << "                             physical cores first) or numa (to a node's CPUs)\n";
+    std::cout << "  --auto-tune                Measure pages/s at a few worker counts and in-flight\n";
+    std::cout << "                             depths on the first pages and keep the fastest\n";
+    std::cout << "  --page-memory MB           Fail pages that need more than MB of MuPDF memory\n";
+    std::cout << "                             (default: 50, 0 = no limit)\n";
+    std::cout << "  --memory-budget MB         Start no new pages while MuPDF holds more than MB\n";
+    std::cout << "                             (default: 0 = no budget)\n";
+    std::cout << "  --store-limit MB           MuPDF resource cache size (default: 256, 0 = unlimited)\n";
+    std::cout << "  --tokenizer MODE           greedy (fast, default) or exact (cl100k BPE)\n";
+    std::cout << "  --section-headings         Treat numbered lines like \"3.2.1 Title\" as headings\n";
+    std::cout << "  --cache-dir DIR            Cache extracted page text in DIR; unchanged PDFs skip parsing\n";
+    std::cout << "  --emit-shard               Write the selected pages' annotated lines to the output\n";
+    std::cout << "                             (default: INPUT.shard) instead of chunking them\n";
+    std::cout << "  --merge                    Chunk the shard files given as arguments as one document;\n";
+    std::cout << "                             same output as chunking all their pages at once\n";
+    std::cout << "                             (not with --pages or --page-limit)\n";
+    std::cout << "  --batch                    Chunk every PDF in the INPUT arguments: directories\n";
+    std::cout << "                             (searched recursively), globs, files or @FILE lists\n";
+    std::cout << "                             of paths. Outputs are named by content hash and\n";
+    std::cout << "                             recorded in DIR/manifest.jsonl; a rerun resumes,\n";
+    std::cout << "                             skipping files already done or with the same content\n";
+    std::cout << "  --output-dir DIR           Where --batch writes outputs and the manifest\n";
+    std::cout << "  --jobs N                   Files --batch chunks at once on the shared threads\n";
+    std::cout << "                             (default: 4)\n";
+    std::cout << "  --stats                    Print pipeline counters, stage latencies and the engine\n";
+    std::cout << "                             settings in effect (JSON, to stderr)\n";
+    std::cout << "  --trace FILE               Write a Chrome trace of the pipeline stages to FILE\n";
+    std::cout << "  --log-level LEVEL          debug, info, warning (default), error or off; library\n";
+    std::cout << "                             messages go to stderr\n";
     std::cout << "  -v, --verbose              Verbose output\n";
     std::cout << "  -q, --quiet                Quiet mode (minimal output)\n";
     std::cout << "  --no-analyze               Skip chunk distribution analysis\n";
@@ -50,6 +111,12 @@ void print_usage(const char* program_name) {
     std::cout << "  " << program_name << " -i document.pdf\n";
     std::cout << "  " << program_name << " -i document.pdf -o chunks.json --max-chunk-size 1000\n";
     std::cout << "  " << program_name << " --input report.pdf --page-limit 10 --verbose\n";
+    std::cout << "  " << program_name << " -i document.pdf --format jsonl -o chunks.jsonl\n";
+    std::cout << "  " << program_name << " -i document.pdf --pages 1-3,r3-z\n";
+    std::cout << "  " << program_name << " -i document.pdf --stats --trace trace.json\n";
+    std::cout << "  " << program_name << " -i document.pdf --pages 1-500 --emit-shard -o part1.shard\n";
+    std::cout << "  " << program_name << " --merge part1.shard part2.shard -o chunks.json\n";
+    std::cout << "  " << program_name << " --batch --output-dir out/ --format jsonl corpus/ '*.pdf' @more.txt\n";
 }
 
 void print_version() {
@@ -57,6 +124,14 @@ void print_version() {
     std::cout << "Built with C++17, MuPDF, and tiktoken\n";
 }
 
+size_t parse_megabytes(const char* value, const char* option) {
+    int megabytes = std::stoi(value);
+    if (megabytes < 0) {
+        throw std::invalid_argument(std::string(option) + " cannot be negative");
+    }
+    return static_cast<size_t>(megabytes) * 1024 * 1024;
+}
+
 CLIOptions parse_arguments(int argc, char* argv[]) {
     CLIOptions options;
     
@@ -74,6 +149,24 @@ CLIOptions parse_arguments(int argc, char* argv[]) {
         {"no-analyze", no_argument, nullptr, 1006},
         {"help", no_argument, nullptr, 'h'},
         {"version", no_argument, nullptr, 1007},
+        {"tokenizer", required_argument, nullptr, 1008},
+        {"section-headings", no_argument, nullptr, 1009},
+        {"cache-dir", required_argument, nullptr, 1010},
+        {"format", required_argument, nullptr, 1011},
+        {"pages", required_argument, nullptr, 1012},
+        {"stats", no_argument, nullptr, 1013},
+        {"trace", required_argument, nullptr, 1014},
+        {"log-level", required_argument, nullptr, 1015},
+        {"page-memory", required_argument, nullptr, 1016},
+        {"memory-budget", required_argument, nullptr, 1017},
+        {"store-limit", required_argument, nullptr, 1018},
+        {"emit-shard", no_argument, nullptr, 1019},
+        {"merge", no_argument, nullptr, 1020},
+        {"batch", no_argument, nullptr, 1021},
+        {"output-dir", required_argument, nullptr, 1022},
+        {"jobs", required_argument, nullptr, 1023},
+        {"cpu-affinity", required_argument, nullptr, 1024},
+        {"auto-tune", no_argument, nullptr, 1025},
         {nullptr, 0, nullptr, 0}
     };
     
@@ -133,13 +226,106 @@ CLIOptions parse_arguments(int argc, char* argv[]) {
             case 1007:  // version
                 options.version = true;
                 return options;
+            case 1008: {  // tokenizer
+                std::string mode = optarg;
+                if (mode == "exact") {
+                    options.tokenizer_mode = TokenizerMode::ExactBpe;
+                } else if (mode == "greedy") {
+                    options.tokenizer_mode = TokenizerMode::Greedy;
+                } else {
+                    throw std::invalid_argument("tokenizer must be 'greedy' or 'exact'");
+                }
+                break;
+            }
+            case 1009:  // section-headings
+                options.section_headings = true;
+                break;
+            case 1010:  // cache-dir
+                options.cache_dir = optarg;
+                break;
+            case 1011:  // format
+                options.format = parse_chunk_format(optarg);
+                break;
+            case 1012:  // pages
+                PageSelection::parse(optarg);  // validated here, used by main
+                options.pages = optarg;
+                break;
+            case 1013:  // stats
+                options.stats = true;
+                break;
+            case 1014:  // trace
+                options.trace_file = optarg;
+                break;
+            case 1015:  // log-level
+                parse_log_level(optarg);  // validated here, applied by main
+                options.log_level = optarg;
+                break;
+            case 1016:  // page-memory
+                options.memory.max_memory_per_page = parse_megabytes(optarg, "page-memory");
+                break;
+            case 1017:  // memory-budget
+                options.memory.max_memory_in_flight = parse_megabytes(optarg, "memory-budget");
+                break;
+            case 1018:  // store-limit
+                options.memory.store_limit = parse_megabytes(optarg, "store-limit");
+                break;
+            case 1019:  // emit-shard
+                options.emit_shard = true;
+                break;
+            case 1020:  // merge
+                options.merge = true;
+                break;
+            case 1021:  // batch
+                options.batch = true;
+                break;
+            case 1022:  // output-dir
+                options.output_dir = optarg;
+                break;
+            case 1023:  // jobs
+                options.jobs = std::stoi(optarg);
+                if (options.jobs <= 0) {
+                    throw std::invalid_argument("jobs must be positive");
+                }
+                break;
+            case 1024:  // cpu-affinity
+                options.cpu_affinity = parse_cpu_affinity(optarg);
+                break;
+            case 1025:  // auto-tune
+                options.auto_tune = true;
+                break;
             default:
                 throw std::invalid_argument("Unknown option");
         }
     }
     
+    options.arguments.assign(argv + optind, argv + argc);
+    
     // Validate options
-    if (options.input_file.empty() && !options.help && !options.version) {
+    if (options.merge) {
+        if (options.arguments.empty()) {
+            throw std::invalid_argument("--merge needs at least one shard file");
+        }
+        if (!options.input_file.empty() || options.emit_shard) {
+            throw std::invalid_argument("--merge takes shard files, not --input or --emit-shard");
+        }
+        if (!options.pages.empty() || options.page_limit > 0) {
+            throw std::invalid_argument("--merge chunks whole shards; select pages with --pages and "
+                                        "--page-limit when emitting them");
+        }
+    } else if (options.batch) {
+        if (options.arguments.empty()) {
+            throw std::invalid_argument("--batch needs at least one directory, glob, file or @list");
+        }
+        if (options.output_dir.empty()) {
+            throw std::invalid_argument("--batch needs --output-dir");
+        }
+        if (!options.input_file.empty() || !options.output_file.empty() || options.emit_shard) {
+            throw std::invalid_argument("--batch takes inputs as arguments and writes to --output-dir, "
+                                        "not --input, --output or --emit-shard");
+        }
+    } else if (!options.arguments.empty()) {
+        throw std::invalid_argument("Unexpected argument: " + options.arguments.front());
+    } else if (options.input_file.empty() && !options.help && !options.version) {
         throw std::invalid_argument("Input file is required");
     }
     
@@ -163,23 +349,21 @@ CLIOptions parse_arguments(int argc, char* argv[]) {
             output_dir = ".";
         }
         std::string stem = input_path.stem().string();
-        options.output_file = (output_dir / (stem + "_chunks.json")).string();
+        const char* extension = options.emit_shard ? ".shard" :
+                                options.format == ChunkFormat::JsonLines ? "_chunks.jsonl" :
+                                options.format == ChunkFormat::Binary ? "_chunks.bin" : "_chunks.json";
+        options.output_file = (output_dir / (stem + extension)).string();
     }
     
     return options;
 }
 
-void analyze_chunk_distribution(const std::vector<ChunkResult>& chunks, bool quiet) {
-    if (chunks.empty()) {
+void analyze_chunk_distribution(std::vector<int> token_counts, bool quiet) {
+    if (token_counts.empty()) {
         if (!quiet) std::cout << "\nNo chunks created\n";
         return;
     }
     
-    std::vector<int> token_counts;
-    for (const auto& chunk : chunks) {
-        token_counts.push_back(chunk.token_count);
-    }
-    
     std::sort(token_counts.begin(), token_counts.end());
     
     int min_tokens = token_counts.front();
@@ -188,7 +372,7 @@ void analyze_chunk_distribution(const std::vector<ChunkResult>& chunks, bool qui
     
     if (!quiet) {
         std::cout << "\n=== Chunk Distribution Analysis ===\n";
-        std::cout << "Total chunks: " << chunks.size() << "\n";
+        std::cout << "Total chunks: " << token_counts.size() << "\n";
         std::cout << "Min tokens: " << min_tokens << "\n";
         std::cout << "Max tokens: " << max_tokens << "\n";
         std::cout << "Average tokens: " << static_cast<int>(avg_tokens) << "\n";
@@ -216,7 +400,7 @@ void analyze_chunk_distribution(const std::vector<ChunkResult>& chunks, bool qui
         
         std::cout << "\nToken Range Distribution:\n";
         for (const auto& [range, count] : distribution) {
-            double percentage = (count * 100.0) / chunks.size();
+            double percentage = (count * 100.0) / token_counts.size();
             std::cout << "  " << std::setw(10) << range << " tokens: " 
                       << std::setw(5) << count << " chunks (" 
                       << std::fixed << std::setprecision(1) << percentage << "%)\n";
@@ -224,6 +408,422 @@ void analyze_chunk_distribution(const std::vector<ChunkResult>& chunks, bool qui
     }
 }
 
+bool has_pdf_extension(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return extension == ".pdf";
+}
+
+// Whether name[n..] matches pattern[p..]: * and ? stand for any run of
+// characters and any one, [abc], [a-z] and [!abc] for one from a set
+bool wildcard_match(const std::string& pattern, size_t p, const std::string& name, size_t n) {
+    while (p < pattern.size()) {
+        char c = pattern[p];
+        if (c == '*') {
+            for (size_t rest = n; rest <= name.size(); ++rest) {
+                if (wildcard_match(pattern, p + 1, name, rest)) return true;
+            }
+            return false;
+        }
+        if (n == name.size()) return false;
+        if (c == '[') {
+            size_t first = p + 1;
+            bool negate = first < pattern.size() && (pattern[first] == '!' || pattern[first] == '^');
+            if (negate) ++first;
+            size_t close = pattern.find(']', first + 1);  // a leading ] is a member
+            if (close != std::string::npos) {
+                unsigned char ch = name[n];
+                bool member = false;
+                for (size_t i = first; i < close; ++i) {
+                    if (i + 2 < close && pattern[i + 1] == '-') {
+                        member |= static_cast<unsigned char>(pattern[i]) <= ch &&
+                                  ch <= static_cast<unsigned char>(pattern[i + 2]);
+                        i += 2;
+                    } else {
+                        member |= static_cast<unsigned char>(pattern[i]) == ch;
+                    }
+                }
+                if (member == negate) return false;
+                p = close + 1;
+                ++n;
+                continue;
+            }
+        }
+        if (c != '?' && c != name[n]) return false;
+        ++p;
+        ++n;
+    }
+    return n == name.size();
+}
+
+// The existing paths a shell-style glob names, sorted. Wildcards may be in
+// any component; as in a shell, they do not match a leading dot.
+std::vector<std::string> expand_glob(const std::string& pattern) {
+    fs::path path(pattern);
+    std::vector<fs::path> matches{path.root_path()};
+    for (const fs::path& part : path.relative_path()) {
+        std::string name = part.string();
+        if (name.empty()) continue;  // a trailing separator
+        bool wild = name.find_first_of("*?[") != std::string::npos;
+        std::vector<fs::path> next;
+        for (const fs::path& base : matches) {
+            std::error_code error;
+            if (!wild) {
+                if (fs::exists(base / part, error)) next.push_back(base / part);
+                continue;
+            }
+            for (const auto& entry : fs::directory_iterator(base.empty() ? fs::path(".") : base, error)) {
+                std::string entry_name = entry.path().filename().string();
+                if (entry_name[0] == '.' && name[0] != '.') continue;
+                if (wildcard_match(name, 0, entry_name, 0)) next.push_back(base / entry_name);
+            }
+        }
+        matches = std::move(next);
+    }
+    
+    std::vector<std::string> paths;
+    for (const fs::path& match : matches) {
+        paths.push_back(match.string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Expands the --batch arguments into PDF paths, in argument order; what a
+// directory or glob finds is sorted, and a path named twice is kept once
+std::vector<std::string> collect_batch_inputs(const std::vector<std::string>& arguments) {
+    std::vector<std::string> paths;
+    std::set<std::string> seen;
+    auto add = [&](const std::string& path) {
+        if (seen.insert(fs::path(path).lexically_normal().string()).second) {
+            paths.push_back(path);
+        }
+    };
+    
+    for (const std::string& argument : arguments) {
+        if (argument.size() > 1 && argument[0] == '@') {
+            // One path per line; blank lines and # comments are skipped
+            std::ifstream list(argument.substr(1));
+            if (!list) {
+                throw std::runtime_error("Cannot read input list: " + argument.substr(1));
+            }
+            std::string line;
+            while (std::getline(list, line)) {
+                size_t end = line.find_last_not_of(" \t\r");
+                size_t begin = line.find_first_not_of(" \t");
+                if (end == std::string::npos || line[begin] == '#') continue;
+                add(line.substr(begin, end + 1 - begin));
+            }
+        } else if (fs::is_directory(argument)) {
+            std::vector<std::string> found;
+            for (const auto& entry : fs::recursive_directory_iterator(
+                     argument, fs::directory_options::skip_permission_denied)) {
+                if (entry.is_regular_file() && has_pdf_extension(entry.path())) {
+                    found.push_back(entry.path().string());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            for (const std::string& path : found) add(path);
+        } else if (argument.find_first_of("*?[") != std::string::npos) {
+            std::vector<std::string> matches = expand_glob(argument);
+            if (matches.empty()) {
+                std::cerr << "Warning: nothing matches " << argument << "\n";
+            }
+            for (const std::string& path : matches) add(path);
+        } else {
+            add(argument);  // a missing file fails on its own when its turn comes
+        }
+    }
+    return paths;
+}
+
+// What the manifest records about a file chunked by an earlier run
+struct BatchRecord {
+    uintmax_t size = 0;
+    int64_t mtime = 0;
+    std::string output;
+};
+
+// Manifest records by input path, then by chunking_fingerprint
+using BatchManifest = std::map<std::string, std::map<std::string, BatchRecord>>;
+
+// 8 hex digits that change with every option shaping the chunks, so
+// outputs of a batch rerun with other options are not mistaken for its own
+std::string chunking_fingerprint(const CLIOptions& options) {
+    nlohmann::json settings = {
+        {"max_tokens", options.max_chunk_size},
+        {"min_tokens", options.min_chunk_size},
+        {"overlap_tokens", options.overlap},
+        {"page_limit", options.page_limit},
+        {"pages", options.pages},
+        {"tokenizer", options.tokenizer_mode == TokenizerMode::ExactBpe ? "exact" : "greedy"},
+        {"section_headings", options.section_headings},
+    };
+    std::string text = settings.dump();
+    return hash_to_hex(content_hash(text.data(), text.size())).substr(0, 8);
+}
+
+// Size and modification time (ns since the file clock's epoch, which is
+// the same from run to run on one platform) of a file; throws
+// std::runtime_error if it cannot be read
+void file_identity(const std::string& path, uintmax_t& size, int64_t& mtime) {
+    std::error_code error;
+    if (!fs::is_regular_file(path, error)) {
+        throw std::runtime_error("Cannot read file: " + path);
+    }
+    size = fs::file_size(path, error);
+    auto modified = fs::last_write_time(path, error);
+    if (error) {
+        throw std::runtime_error("Cannot read file: " + path);
+    }
+    mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(modified.time_since_epoch()).count();
+}
+
+// The latest record of each input under each set of options; a failed file
+// has none, so it is tried again. A line cut short by an interrupted run is
+// ignored, and so is one from before options were recorded.
+BatchManifest load_manifest(const fs::path& path) {
+    BatchManifest records;
+    std::ifstream manifest(path);
+    std::string line;
+    while (std::getline(manifest, line)) {
+        nlohmann::json entry = nlohmann::json::parse(line, nullptr, false);
+        if (!entry.is_object() || !entry.contains("input") || !entry["input"].is_string()) {
+            continue;
+        }
+        std::string input = entry["input"].get<std::string>();
+        std::string fingerprint = entry.value("options", std::string());
+        if (fingerprint.empty()) continue;
+        if (entry.contains("error") || !entry.contains("output")) {
+            records[input].erase(fingerprint);
+            continue;
+        }
+        BatchRecord& record = records[input][fingerprint];
+        record.size = entry.value("size", uintmax_t{0});
+        record.mtime = entry.value("mtime", int64_t{0});
+        record.output = entry.value("output", std::string());
+    }
+    return records;
+}
+
+// Chunks every input into output_dir, options.jobs files at a time on the
+// chunker's shared engine, so at most that many documents are open at
+// once. Each output is named by the content hash of its PDF and the
+// chunking_fingerprint of the options, and written under a temporary name
+// until it is complete; manifest.jsonl gets a line per file as it
+// finishes, so an interrupted batch resumes where it stopped. Returns the
+// exit status: 1 if any file failed.
+int run_batch(const CLIOptions& options, HierarchicalChunker& chunker) {
+    std::vector<std::string> inputs = collect_batch_inputs(options.arguments);
+    fs::path output_dir(options.output_dir);
+    fs::create_directories(output_dir);
+    fs::path manifest_path = output_dir / "manifest.jsonl";
+    BatchManifest done = load_manifest(manifest_path);
+    const std::string fingerprint = chunking_fingerprint(options);
+    std::ofstream manifest(manifest_path, std::ios::app);
+    if (!manifest) {
+        throw std::runtime_error("Cannot write manifest: " + manifest_path.string());
+    }
+    {
+        // A run killed while writing a line left it unfinished
+        std::ifstream existing(manifest_path, std::ios::binary | std::ios::ate);
+        if (existing && existing.tellg() > 0) {
+            existing.seekg(-1, std::ios::end);
+            if (existing.get() != '\n') manifest << "\n";
+        }
+    }
+    
+    const char* extension = options.format == ChunkFormat::JsonLines ? ".jsonl" :
+                            options.format == ChunkFormat::Binary ? ".bin" : ".json";
+    
+    std::mutex mutex;  // guards everything below shared by the jobs
+    std::set<uint64_t> claimed;  // hashes being or already chunked by this run
+    size_t next = 0;
+    size_t finished = 0, chunked = 0, skipped = 0, failed = 0;
+    uint64_t total_pages = 0, total_chunks = 0;
+    
+    // Appends to the manifest and reports one file
+    auto record = [&](const nlohmann::json& entry, const std::string& progress,
+                      const std::string& quiet_line) {
+        std::lock_guard<std::mutex> lock(mutex);
+        manifest << entry.dump() << "\n";
+        manifest.flush();
+        ++finished;
+        if (options.quiet) {
+            std::cout << quiet_line << "\n";
+        } else {
+            std::cout << "[" << finished << "/" << inputs.size() << "] " << progress << "\n";
+        }
+        std::cout.flush();
+    };
+    
+    auto process = [&](const std::string& input) {
+        auto file_start = std::chrono::high_resolution_clock::now();
+        uint64_t hash = 0;
+        bool owns_hash = false;
+        fs::path partial;
+        try {
+            uintmax_t size;
+            int64_t mtime;
+            file_identity(input, size, mtime);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                const BatchRecord* previous = nullptr;
+                auto runs = done.find(input);
+                if (runs != done.end()) {
+                    auto it = runs->second.find(fingerprint);
+                    if (it != runs->second.end()) previous = &it->second;
+                }
+                if (previous && previous->size == size && previous->mtime == mtime &&
+                    fs::exists(output_dir / previous->output)) {
+                    ++skipped;
+                    ++finished;
+                    if (options.quiet) {
+                        std::cout << "SKIPPED|" << input << "\n";
+                    } else if (options.verbose) {
+                        std::cout << "[" << finished << "/" << inputs.size() << "] "
+                                  << input << ": already done\n";
+                    }
+                    return;
+                }
+            }
+            
+            PdfSource source = PdfSource::mapped_file(input);
+            hash = content_hash(source);
+            std::string name = hash_to_hex(hash) + "-" + fingerprint + extension;
+            fs::path output = output_dir / name;
+            nlohmann::json entry = {{"input", input}, {"size", size}, {"mtime", mtime},
+                                    {"hash", hash_to_hex(hash)}, {"options", fingerprint},
+                                    {"output", name}};
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                owns_hash = claimed.insert(hash).second && !fs::exists(output);
+                if (!owns_hash) ++skipped;
+            }
+            if (!owns_hash) {
+                // Another input with the same bytes has (or will have) the output
+                entry["duplicate"] = true;
+                record(entry, input + ": " + name + " has its content already, skipped",
+                       "SKIPPED|" + input);
+                return;
+            }
+            
+            partial = output;
+            partial += ".part";
+            auto writer = ChunkWriter::create(options.format, partial.string(),
+                                              ChunkOrigin{fs::path(input).filename().string(), hash});
+            ChunkingResult result = chunker.chunk_file_to(source, *writer, options.page_limit);
+            if (!result.error.empty()) {
+                throw std::runtime_error(result.error);
+            }
+            writer->finish();
+            writer.reset();
+            fs::rename(partial, output);
+            
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - file_start).count();
+            entry["pages"] = result.total_pages;
+            entry["chunks"] = result.total_chunks;
+            entry["ms"] = elapsed;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++chunked;
+                total_pages += result.total_pages;
+                total_chunks += result.total_chunks;
+            }
+            record(entry, input + ": " + std::to_string(result.total_pages) + " pages, " +
+                              std::to_string(result.total_chunks) + " chunks, " +
+                              std::to_string(elapsed) + "ms",
+                   "SUCCESS|" + input + "|" + std::to_string(result.total_pages) + "|" +
+                       std::to_string(result.total_chunks) + "|" + std::to_string(elapsed));
+        } catch (const std::exception& e) {
+            std::error_code ignored;
+            if (!partial.empty()) fs::remove(partial, ignored);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++failed;
+                if (owns_hash) {
+                    claimed.erase(hash);  // lets a later input with the same bytes try
+                }
+            }
+            record({{"input", input}, {"options", fingerprint}, {"error", e.what()}},
+                   input + ": failed - " + e.what(), "ERROR|" + input + "|" + e.what());
+        }
+    };
+    
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> jobs;
+    size_t job_count = std::min(static_cast<size_t>(options.jobs), inputs.size());
+    for (size_t j = 0; j < job_count; ++j) {
+        jobs.emplace_back([&] {
+            for (;;) {
+                size_t i;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (next == inputs.size()) return;
+                    i = next++;
+                }
+                process(inputs[i]);
+            }
+        });
+    }
+    for (std::thread& job : jobs) {
+        job.join();
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start);
+    
+    if (!options.quiet) {
+        std::cout << "\n=== Batch Complete ===\n";
+        std::cout << "Files chunked: " << chunked << "\n";
+        std::cout << "Files skipped: " << skipped << "\n";
+        std::cout << "Files failed: " << failed << "\n";
+        std::cout << "Pages processed: " << total_pages << "\n";
+        std::cout << "Chunks created: " << total_chunks << "\n";
+        std::cout << "Total time: " << duration.count() << "ms\n";
+        if (duration.count() > 0) {
+            std::cout << "Performance: " << std::fixed << std::setprecision(1)
+                      << (total_pages * 1000.0) / duration.count() << " pages/second\n";
+        }
+        std::cout << "Manifest: " << manifest_path.string() << "\n";
+    }
+    return failed > 0 ? 1 : 0;
+}
+
+void write_trace_and_stats(const CLIOptions& options, HierarchicalChunker& chunker) {
+    if (!options.trace_file.empty()) {
+        stop_tracing();
+        std::ofstream trace(options.trace_file);
+        trace << trace_json().dump();
+        if (!trace) {
+            throw std::runtime_error("Cannot write trace file: " + options.trace_file);
+        }
+    }
+    if (options.stats) {
+        nlohmann::json stats = metrics_snapshot();
+        stats["engine"] = chunker.engine()->settings();
+        std::cerr << stats.dump(2) << "\n";
+    }
+}
+
+// Every shard must come from the same PDF; origin receives it
+PreparedDocument load_shards(const std::vector<std::string>& paths, ChunkOrigin& origin) {
+    std::vector<PreparedDocument> shards;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        ChunkOrigin shard_origin;
+        shards.push_back(PreparedDocument::load(paths[i], &shard_origin));
+        if (i == 0) {
+            origin = shard_origin;
+        } else if (shard_origin.binary_hash != origin.binary_hash) {
+            throw std::runtime_error(paths[i] + " is a shard of " + shard_origin.filename +
+                                     ", not of " + origin.filename);
+        }
+    }
+    return PreparedDocument::concatenate(shards);
+}
+
 int main(int argc, char* argv[]) {
     try {
         // Parse command-line arguments
@@ -240,8 +840,18 @@ int main(int argc, char* argv[]) {
             return 0;
         }
         
-        // Validate input file exists
-        if (!fs::exists(options.input_file)) {
+        // Shards are all loaded up front, so a bad one fails before any work
+        PreparedDocument merged;
+        ChunkOrigin origin;
+        if (options.merge) {
+            merged = load_shards(options.arguments, origin);
+            if (options.output_file.empty()) {
+                options.output_file = fs::path(origin.filename).stem().string() +
+                    (options.format == ChunkFormat::JsonLines ? "_chunks.jsonl" :
+                     options.format == ChunkFormat::Binary ? "_chunks.bin" : "_chunks.json");
+            }
+        } else if (!options.batch && !fs::exists(options.input_file)) {
+            // Validate input file exists
             throw std::runtime_error("Input file not found: " + options.input_file);
         }
         
@@ -255,32 +865,78 @@ int main(int argc, char* argv[]) {
             fs::create_directories(output_dir);
         }
         
+        if (!options.log_level.empty()) {
+            set_log_level(parse_log_level(options.log_level));
+        } else if (options.verbose) {
+            set_log_level(LogLevel::Info);
+        }
+        if (!options.trace_file.empty()) {
+            start_tracing();
+        }
+        
         // Configure chunker
         ChunkOptions chunk_opts;
         chunk_opts.max_tokens = options.max_chunk_size;
         chunk_opts.min_tokens = options.min_chunk_size;
         chunk_opts.overlap_tokens = options.overlap;
         chunk_opts.thread_count = options.thread_count;
+        chunk_opts.memory = options.memory;
+        chunk_opts.cpu_affinity = options.cpu_affinity;
+        chunk_opts.auto_tune = options.auto_tune;
+        chunk_opts.tokenizer_mode = options.tokenizer_mode;
+        chunk_opts.page_cache_dir = options.cache_dir;
+        if (!options.pages.empty()) {
+            chunk_opts.pages = PageSelection::parse(options.pages);
+        }
+        if (options.section_headings) {
+            auto classifier = std::make_shared<LineClassifier>();
+            classifier->add_rule(LineClassifier::numbered_section_rule());
+            chunk_opts.line_classifier = classifier;
+        }
         
         HierarchicalChunker chunker(chunk_opts);
         
         // Print configuration if not quiet
         if (!options.quiet) {
-            std::cout << "Processing: " << options.input_file << "\n";
-            std::cout << "Output: " << options.output_file << "\n";
+            if (options.merge) {
+                std::cout << "Merging " << options.arguments.size() << " shards of " << origin.filename << "\n";
+            } else if (!options.batch) {
+                std::cout << "Processing: " << options.input_file << "\n";
+            }
+            std::cout << "Output: " << (options.batch ? options.output_dir : options.output_file) << "\n";
             std::cout << "Configuration:\n";
             std::cout << "  Max chunk size: " << options.max_chunk_size << " tokens\n";
             std::cout << "  Min chunk size: " << options.min_chunk_size << " tokens\n";
             std::cout << "  Overlap: " << options.overlap << " tokens\n";
             std::cout << "  Threads: " << (options.thread_count > 0 ? 
                 std::to_string(options.thread_count) : "auto (" + 
-                std::to_string(std::thread::hardware_concurrency()) + ")") << "\n";
+                std::to_string(available_cpus()) + ")") << "\n";
+            if (options.cpu_affinity != CpuAffinity::None) {
+                std::cout << "  CPU affinity: " << cpu_affinity_name(options.cpu_affinity) << "\n";
+            }
+            if (options.auto_tune) {
+                std::cout << "  Auto-tune: on\n";
+            }
+            std::cout << "  Tokenizer: " << (options.tokenizer_mode == TokenizerMode::ExactBpe ?
+                "exact" : "greedy") << "\n";
+            if (!options.pages.empty()) {
+                std::cout << "  Pages: " << options.pages << "\n";
+            }
             if (options.page_limit > 0) {
                 std::cout << "  Page limit: " << options.page_limit << "\n";
             }
+            if (options.batch) {
+                std::cout << "  Jobs: " << options.jobs << "\n";
+            }
             std::cout << "\n";
         }
         
+        if (options.batch) {
+            int status = run_batch(options, chunker);
+            write_trace_and_stats(options, chunker);
+            return status;
+        }
+        
         auto start = std::chrono::high_resolution_clock::now();
         
         // Process the PDF
@@ -288,10 +944,47 @@ int main(int argc, char* argv[]) {
             std::cout << "Starting PDF processing...\n";
         }
         
-        auto result = chunker.chunk_file(options.input_file, options.page_limit);
+        if (!options.merge) {
+            origin = ChunkOrigin{fs::path(options.input_file).filename().string(),
+                                 content_hash(PdfSource(options.input_file))};
+        }
+        std::vector<int> token_counts;
+        ChunkingResult result;
         
-        if (!result.error.empty()) {
-            throw std::runtime_error("Chunking failed: " + result.error);
+        if (options.emit_shard) {
+            // Pass 1 only; a later --merge runs the rest over every shard
+            PreparedDocument shard = chunker.prepare(options.input_file, options.page_limit);
+            shard.save(options.output_file, origin);
+            result.total_pages = shard.page_count();
+            result.total_chunks = 0;
+        } else {
+            // One pass: chunks are written out as they are finalized and only
+            // their token counts are kept for the analysis
+            auto writer = ChunkWriter::create(options.format, options.output_file, origin);
+            auto on_chunk = [&](ChunkResult&& chunk) {
+                token_counts.push_back(chunk.token_count);
+                writer->write(chunk);
+                return true;
+            };
+            
+            if (options.merge) {
+                result = chunker.chunk(merged);
+                for (ChunkResult& chunk : result.chunks) {
+                    on_chunk(std::move(chunk));
+                }
+                result.chunks.clear();
+            } else {
+                result = chunker.chunk_file_streaming(options.input_file, on_chunk, options.page_limit);
+            }
+            
+            if (!result.error.empty()) {
+                throw std::runtime_error("Chunking failed: " + result.error);
+            }
+            
+            if (options.verbose) {
+                std::cout << "Finishing output file...\n";
+            }
+            writer->finish();
         }
         
         auto processing_end = std::chrono::high_resolution_clock::now();
@@ -299,27 +992,23 @@ int main(int argc, char* argv[]) {
         if (options.verbose) {
             std::cout << "Extracted " << result.total_pages << " pages\n";
             std::cout << "Created " << result.total_chunks << " chunks\n";
+            if (!options.cache_dir.empty()) {
+                std::cout << "Page cache: " << (result.page_cache_hit ? "hit" : "miss") << "\n";
+            }
+            uint64_t lookups = result.token_cache_hits + result.token_cache_misses;
+            if (lookups > 0) {
+                std::cout << "Token cache: " << result.token_cache_hits << " hits, "
+                          << result.token_cache_misses << " misses ("
+                          << (100 * result.token_cache_hits / lookups) << "% hit rate)\n";
+            }
         }
         
         // Analyze distribution if requested
-        if (options.analyze && !options.quiet) {
-            analyze_chunk_distribution(result.chunks, options.quiet);
+        if (options.analyze && !options.quiet && !options.emit_shard) {
+            analyze_chunk_distribution(std::move(token_counts), options.quiet);
         }
         
-        // Save to JSON
-        if (options.verbose) {
-            std::cout << "\nSaving chunks to JSON...\n";
-        }
-        
-        bool save_success = chunker.process_pdf_to_json(
-            options.input_file, 
-            options.output_file, 
-            options.page_limit
-        );
-        
-        if (!save_success) {
-            throw std::runtime_error("Failed to save JSON output");
-        }
+        write_trace_and_stats(options, chunker);
         
         auto end = std::chrono::high_resolution_clock::now();
         
@@ -339,7 +1028,7 @@ int main(int argc, char* argv[]) {
             std::cout << "Output saved to: " << options.output_file << "\n";
         } else {
             // In quiet mode, just output essential info in parseable format
-            std::cout << "SUCCESS|" << options.input_file << "|" 
+            std::cout << "SUCCESS|" << (options.merge ? origin.filename : options.input_file) << "|" 
                       << result.total_pages << "|" 
                       << result.total_chunks << "|"
                       << total_duration.count() << "\n";
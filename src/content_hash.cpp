@@ -0,0 +1,203 @@
+#include "fast_pdf_parser/content_hash.h"
+#include <cstring>
+
+namespace fast_pdf_parser {
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Little-endian loads regardless of host order; compilers turn these into
+// single loads on little-endian targets
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+inline uint32_t read32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t mix_round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t merge_round(uint64_t hash, uint64_t acc) {
+    hash ^= mix_round(0, acc);
+    return hash * kPrime1 + kPrime4;
+}
+
+// Consumes whole 32-byte stripes; returns where the unconsumed tail starts
+inline const unsigned char* consume_stripes(uint64_t acc[4], const unsigned char* p,
+                                            const unsigned char* end) {
+    while (end - p >= 32) {
+        acc[0] = mix_round(acc[0], read64(p));
+        acc[1] = mix_round(acc[1], read64(p + 8));
+        acc[2] = mix_round(acc[2], read64(p + 16));
+        acc[3] = mix_round(acc[3], read64(p + 24));
+        p += 32;
+    }
+    return p;
+}
+
+} // namespace
+
+ContentHasher::ContentHasher(uint64_t seed) : seed_(seed) {
+    acc_[0] = seed + kPrime1 + kPrime2;
+    acc_[1] = seed + kPrime2;
+    acc_[2] = seed;
+    acc_[3] = seed - kPrime1;
+}
+
+void ContentHasher::update(const void* data, size_t size) {
+    if (size == 0) return;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    total_size_ += size;
+    
+    if (buffered_ + size < sizeof(buffer_)) {
+        std::memcpy(buffer_ + buffered_, p, size);
+        buffered_ += size;
+        return;
+    }
+    
+    if (buffered_ > 0) {
+        size_t fill = sizeof(buffer_) - buffered_;
+        std::memcpy(buffer_ + buffered_, p, fill);
+        consume_stripes(acc_, buffer_, buffer_ + sizeof(buffer_));
+        p += fill;
+        buffered_ = 0;
+    }
+    
+    p = consume_stripes(acc_, p, end);
+    buffered_ = static_cast<size_t>(end - p);
+    std::memcpy(buffer_, p, buffered_);
+}
+
+uint64_t ContentHasher::digest() const {
+    uint64_t hash;
+    if (total_size_ >= 32) {
+        hash = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+        for (uint64_t acc : acc_) {
+            hash = merge_round(hash, acc);
+        }
+    } else {
+        hash = seed_ + kPrime5;
+    }
+    hash += total_size_;
+    
+    const unsigned char* p = buffer_;
+    const unsigned char* end = buffer_ + buffered_;
+    while (end - p >= 8) {
+        hash ^= mix_round(0, read64(p));
+        hash = rotl(hash, 27) * kPrime1 + kPrime4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        hash ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+        hash = rotl(hash, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    while (p < end) {
+        hash ^= *p * kPrime5;
+        hash = rotl(hash, 11) * kPrime1;
+        ++p;
+    }
+    
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t content_hash(const void* data, size_t size, uint64_t seed) {
+    ContentHasher hasher(seed);
+    hasher.update(data, size);
+    return hasher.digest();
+}
+
+uint64_t content_hash(const PdfSource& source) {
+    if (source.in_memory()) {
+        return content_hash(source.data(), source.size());
+    }
+    PdfSource mapped = PdfSource::mapped_file(source.name());
+    return content_hash(mapped.data(), mapped.size());
+}
+
+std::string hash_to_hex(uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        hex[i] = digits[hash & 0xF];
+        hash >>= 4;
+    }
+    return hex;
+}
+
+} // namespace fast_pdf_parser
+
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+TEST_CASE("ContentHasher matches XXH64") {
+    using namespace fast_pdf_parser;
+    
+    SUBCASE("Reference vectors") {
+        CHECK(content_hash("", 0) == 0xEF46DB3751D8E999ULL);
+        CHECK(content_hash("abc", 3) == 0x44BC2CF5AD770999ULL);
+        const std::string sentence = "Nobody inspects the spammish repetition";
+        CHECK(content_hash(sentence.data(), sentence.size()) == 0xFBCEA83C8A378BF1ULL);
+    }
+    
+    SUBCASE("Split updates give the one-shot digest") {
+        std::string data;
+        for (int i = 0; i < 1000; ++i) data += static_cast<char>(i * 31 + 7);
+        uint64_t expected = content_hash(data.data(), data.size());
+        
+        for (size_t step : {1, 3, 31, 32, 33, 100, 999}) {
+            ContentHasher hasher;
+            for (size_t offset = 0; offset < data.size(); offset += step) {
+                hasher.update(data.data() + offset, std::min(step, data.size() - offset));
+            }
+            CHECK(hasher.digest() == expected);
+        }
+        CHECK(content_hash(data.data(), data.size(), 1) != expected);
+    }
+    
+    SUBCASE("File and memory sources hash their bytes") {
+        auto path = std::filesystem::temp_directory_path() / "fast_pdf_parser_hash_test.pdf";
+        std::string contents = "%PDF-1.4\n" + std::string(5000, 'y') + "\n%%EOF\n";
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << contents;
+        }
+        
+        uint64_t expected = content_hash(contents.data(), contents.size());
+        CHECK(content_hash(PdfSource(path.string())) == expected);
+        CHECK(content_hash(PdfSource::memory(contents)) == expected);
+        std::filesystem::remove(path);
+    }
+    
+    SUBCASE("Hex formatting") {
+        CHECK(hash_to_hex(0xEF46DB3751D8E999ULL) == "ef46db3751d8e999");
+        CHECK(hash_to_hex(0) == "0000000000000000");
+    }
+}
+#endif // ENABLE_TESTS
\ No newline at end of file
@@ -0,0 +1,328 @@
+#include "fast_pdf_parser/cpu_topology.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace fast_pdf_parser {
+
+namespace {
+
+std::string read_file(const fs::path& path) {
+    std::ifstream in(path);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+// A whole non-negative number, or -1 if text is anything else
+int parse_index(const std::string& text) {
+    if (text.empty() || text.size() > 9) return -1;
+    int value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return -1;
+        value = value * 10 + (c - '0');
+    }
+    return value;
+}
+
+// The CPUs of the calling thread's affinity mask, ascending; empty if it
+// cannot be read or the OS has no such mask
+std::vector<int> affinity_cpus() {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return {};
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+#else
+    return {};
+#endif
+}
+
+#ifdef __linux__
+// root, then each directory down to the cgroup at path below it. Without a
+// cgroup namespace the path may not exist inside a container, whose own
+// cgroup is then mounted at root; walking every level covers both.
+std::vector<fs::path> cgroup_dirs(const fs::path& root, const std::string& path) {
+    std::vector<fs::path> dirs{root};
+    for (const fs::path& part : fs::path(path).relative_path()) {
+        if (!part.empty()) dirs.push_back(dirs.back() / part);
+    }
+    return dirs;
+}
+
+// The smallest CPU quota of the process's cgroups and their ancestors,
+// 0 if none has one
+double cgroup_cpu_quota() {
+    double quota = 0;
+    auto take = [&](double cpus) {
+        if (cpus > 0 && (quota == 0 || cpus < quota)) quota = cpus;
+    };
+    
+    // Lines are "hierarchy:controllers:path"; cgroup v2 has no controllers
+    std::ifstream self("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(self, line)) {
+        size_t first = line.find(':');
+        size_t second = first == std::string::npos ? first : line.find(':', first + 1);
+        if (second == std::string::npos) continue;
+        std::string controllers = "," + line.substr(first + 1, second - first - 1) + ",";
+        std::string path = line.substr(second + 1);
+        
+        if (controllers == ",,") {
+            for (const fs::path& dir : cgroup_dirs("/sys/fs/cgroup", path)) {
+                take(parse_cgroup_cpu_max(read_file(dir / "cpu.max")));
+            }
+        } else if (controllers.find(",cpu,") != std::string::npos) {
+            for (const char* mount : {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"}) {
+                for (const fs::path& dir : cgroup_dirs(mount, path)) {
+                    std::istringstream quota_us(read_file(dir / "cpu.cfs_quota_us"));
+                    std::istringstream period_us(read_file(dir / "cpu.cfs_period_us"));
+                    double quota_value = -1, period_value = 0;
+                    quota_us >> quota_value;
+                    period_us >> period_value;
+                    if (quota_value > 0 && period_value > 0) take(quota_value / period_value);
+                }
+            }
+        }
+    }
+    return quota;
+}
+#else
+// cgroups are Linux-only
+double cgroup_cpu_quota() {
+    return 0;
+}
+#endif
+
+} // namespace
+
+size_t available_cpus() {
+    static const size_t cpus = [] {
+        size_t count = affinity_cpus().size();
+        if (count == 0) count = std::thread::hardware_concurrency();
+        double quota = cgroup_cpu_quota();
+        if (quota > 0) {
+            count = std::min(count, static_cast<size_t>(std::ceil(quota)));
+        }
+        return std::max<size_t>(count, 1);
+    }();
+    return cpus;
+}
+
+CpuAffinity parse_cpu_affinity(const std::string& name) {
+    if (name == "none") return CpuAffinity::None;
+    if (name == "cores") return CpuAffinity::Cores;
+    if (name == "numa") return CpuAffinity::Numa;
+    throw std::invalid_argument("Unknown CPU affinity '" + name + "' (expected none, cores or numa)");
+}
+
+const char* cpu_affinity_name(CpuAffinity affinity) {
+    switch (affinity) {
+        case CpuAffinity::Cores: return "cores";
+        case CpuAffinity::Numa: return "numa";
+        default: return "none";
+    }
+}
+
+std::vector<CpuInfo> detect_cpus() {
+    std::vector<int> allowed = affinity_cpus();
+    if (allowed.empty()) {
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+            allowed.push_back(static_cast<int>(cpu));
+        }
+    }
+    
+    std::map<int, int> node_of;
+    std::error_code error;
+    for (const auto& entry : fs::directory_iterator("/sys/devices/system/node", error)) {
+        std::string name = entry.path().filename().string();
+        int node = name.compare(0, 4, "node") == 0 ? parse_index(name.substr(4)) : -1;
+        if (node < 0) continue;
+        for (int cpu : parse_cpu_list(read_file(entry.path() / "cpulist"))) {
+            node_of[cpu] = node;
+        }
+    }
+    
+    std::vector<CpuInfo> cpus;
+    for (int cpu : allowed) {
+        CpuInfo info;
+        info.cpu = cpu;
+        auto node = node_of.find(cpu);
+        info.node = node != node_of.end() ? node->second : 0;
+        std::vector<int> siblings = parse_cpu_list(read_file(
+            "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list"));
+        auto position = std::find(siblings.begin(), siblings.end(), cpu);
+        info.sibling = position != siblings.end() ? static_cast<int>(position - siblings.begin()) : 0;
+        cpus.push_back(info);
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> plan_cpu_affinity(CpuAffinity affinity, size_t thread_count,
+                                                const std::vector<CpuInfo>& cpus) {
+    std::vector<std::vector<int>> plan(thread_count);
+    if (affinity == CpuAffinity::None || cpus.empty()) return plan;
+    
+    if (affinity == CpuAffinity::Cores) {
+        std::vector<CpuInfo> order = cpus;
+        std::stable_sort(order.begin(), order.end(), [](const CpuInfo& a, const CpuInfo& b) {
+            return a.sibling != b.sibling ? a.sibling < b.sibling : a.cpu < b.cpu;
+        });
+        for (size_t i = 0; i < thread_count; ++i) {
+            plan[i] = {order[i % order.size()].cpu};
+        }
+    } else {
+        std::map<int, std::vector<int>> nodes;
+        for (const CpuInfo& info : cpus) {
+            nodes[info.node].push_back(info.cpu);
+        }
+        std::vector<const std::vector<int>*> node_cpus;
+        for (const auto& [node, list] : nodes) {
+            node_cpus.push_back(&list);
+        }
+        for (size_t i = 0; i < thread_count; ++i) {
+            plan[i] = *node_cpus[i % node_cpus.size()];
+        }
+    }
+    return plan;
+}
+
+bool pin_current_thread(const std::vector<int>& cpus) {
+    if (cpus.empty()) return true;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    // macOS only takes affinity hints and Windows masks stop at 64 CPUs;
+    // workers are left to the scheduler there
+    return false;
+#endif
+}
+
+std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream parts(list);
+    std::string part;
+    while (std::getline(parts, part, ',')) {
+        part.erase(std::remove_if(part.begin(), part.end(),
+                                  [](unsigned char c) { return std::isspace(c); }), part.end());
+        size_t dash = part.find('-');
+        int first = parse_index(part.substr(0, dash));
+        int last = dash == std::string::npos ? first : parse_index(part.substr(dash + 1));
+        if (first < 0 || last < first) continue;
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+double parse_cgroup_cpu_max(const std::string& content) {
+    std::istringstream fields(content);
+    std::string quota;
+    double period = 100000;  // the kernel's default when only a quota is written
+    if (!(fields >> quota) || quota == "max") return 0;
+    fields >> period;
+    char* end = nullptr;
+    double quota_us = std::strtod(quota.c_str(), &end);
+    if (*end != '\0' || quota_us <= 0 || period <= 0) return 0;
+    return quota_us / period;
+}
+
+} // namespace fast_pdf_parser
+
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+
+TEST_CASE("CPU topology") {
+    using namespace fast_pdf_parser;
+    
+    SUBCASE("CPU lists") {
+        CHECK(parse_cpu_list("0-3,8,10-11\n") == std::vector<int>{0, 1, 2, 3, 8, 10, 11});
+        CHECK(parse_cpu_list("5") == std::vector<int>{5});
+        CHECK(parse_cpu_list("").empty());
+        CHECK(parse_cpu_list("x,2,4-3") == std::vector<int>{2});  // bad parts are skipped
+    }
+    
+    SUBCASE("cgroup v2 quotas") {
+        CHECK(parse_cgroup_cpu_max("200000 100000\n") == 2.0);
+        CHECK(parse_cgroup_cpu_max("150000 100000") == 1.5);
+        CHECK(parse_cgroup_cpu_max("50000") == 0.5);
+        CHECK(parse_cgroup_cpu_max("max 100000\n") == 0);
+        CHECK(parse_cgroup_cpu_max("") == 0);
+        CHECK(parse_cgroup_cpu_max("lots 100000") == 0);
+    }
+    
+    SUBCASE("Affinity names") {
+        CHECK(parse_cpu_affinity("cores") == CpuAffinity::Cores);
+        CHECK(std::string(cpu_affinity_name(parse_cpu_affinity("numa"))) == "numa");
+        CHECK_THROWS_AS(parse_cpu_affinity("all"), std::invalid_argument);
+    }
+    
+    SUBCASE("Plans") {
+        // Two nodes of two cores with two hardware threads each
+        std::vector<CpuInfo> cpus;
+        for (int cpu = 0; cpu < 8; ++cpu) {
+            CpuInfo info;
+            info.cpu = cpu;
+            info.node = cpu % 4 < 2 ? 0 : 1;
+            info.sibling = cpu / 4;  // cpu n and n + 4 share a core
+            cpus.push_back(info);
+        }
+        
+        auto none = plan_cpu_affinity(CpuAffinity::None, 3, cpus);
+        CHECK(none.size() == 3);
+        CHECK(std::all_of(none.begin(), none.end(), [](const auto& list) { return list.empty(); }));
+        
+        auto cores = plan_cpu_affinity(CpuAffinity::Cores, 6, cpus);
+        CHECK(cores == std::vector<std::vector<int>>{{0}, {1}, {2}, {3}, {4}, {5}});
+        CHECK(plan_cpu_affinity(CpuAffinity::Cores, 9, cpus)[8] == std::vector<int>{0});
+        
+        auto numa = plan_cpu_affinity(CpuAffinity::Numa, 3, cpus);
+        CHECK(numa[0] == std::vector<int>{0, 1, 4, 5});
+        CHECK(numa[1] == std::vector<int>{2, 3, 6, 7});
+        CHECK(numa[2] == numa[0]);
+    }
+    
+    SUBCASE("This machine") {
+        CHECK(available_cpus() >= 1);
+        std::vector<CpuInfo> cpus = detect_cpus();
+        REQUIRE_FALSE(cpus.empty());
+        CHECK(available_cpus() <= cpus.size());
+        
+        bool pinned = false;
+        std::thread worker([&] {
+            pinned = pin_current_thread(plan_cpu_affinity(CpuAffinity::Cores, 1, cpus)[0]);
+        });
+        worker.join();
+#ifdef __linux__
+        CHECK(pinned);
+#else
+        CHECK_FALSE(pinned);
+#endif
+    }
+}
+
+#endif // ENABLE_TESTS
\ No newline at end of file
@@ -1,206 +1,289 @@
 #include "fast_pdf_parser/fast_pdf_parser.h"
-#include "fast_pdf_parser/thread_pool.h"
+#include "fast_pdf_parser/parse_engine.h"
 #include "fast_pdf_parser/text_extractor.h"
+#include "fast_pdf_parser/content_hash.h"
+#include "fast_pdf_parser/metrics.h"
 #include <filesystem>
 #include <chrono>
-#include <fstream>
-#include <sstream>
-#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <atomic>
 
 namespace fast_pdf_parser {
 
+namespace {
+
+MemoryLimits memory_limits(const ParseOptions& options) {
+    MemoryLimits limits;
+    limits.store_limit = options.store_limit;
+    limits.max_memory_per_page = options.max_memory_per_page;
+    limits.max_memory_in_flight = options.max_memory_in_flight;
+    return limits;
+}
+
+EngineTuning engine_tuning(const ParseOptions& options) {
+    EngineTuning tuning;
+    tuning.affinity = options.cpu_affinity;
+    tuning.auto_tune = options.auto_tune;
+    return tuning;
+}
+
+} // namespace
+
 class FastPdfParser::Impl {
 public:
-    Impl(const ParseOptions& options) 
+    Impl(const ParseOptions& options, std::shared_ptr<ParseEngine> engine) 
         : options_(options), 
-          thread_pool_(options.thread_count) {
-        stats_["pages_processed"] = 0;
-        stats_["documents_processed"] = 0;
-        stats_["total_processing_time_ms"] = 0;
+          engine_(engine ? std::move(engine) :
+                  std::make_shared<ParseEngine>(options.thread_count, options.max_pages_in_flight,
+                                                memory_limits(options), engine_tuning(options))) {
+        options_.thread_count = engine_->thread_count();
+        options_.cpu_affinity = engine_->tuning().affinity;
+        options_.auto_tune = engine_->tuning().auto_tune;
+        const MemoryLimits& limits = engine_->extractor().memory_limits();
+        options_.store_limit = limits.store_limit;
+        options_.max_memory_per_page = limits.max_memory_per_page;
+        options_.max_memory_in_flight = limits.max_memory_in_flight;
     }
 
-    nlohmann::json parse(const std::string& pdf_path) {
+    nlohmann::json parse(const PdfSource& source) {
         auto start_time = std::chrono::high_resolution_clock::now();
         
-        if (!std::filesystem::exists(pdf_path)) {
-            throw std::runtime_error("PDF file not found: " + pdf_path);
+        if (!source.in_memory() && !std::filesystem::exists(source.name())) {
+            throw std::runtime_error("PDF file not found: " + source.name());
         }
 
-        // Calculate file hash
-        int64_t file_hash = calculate_file_hash(pdf_path);
+        // Hashed in place (file sources are mapped), not copied into memory
+        uint64_t binary_hash = content_hash(source);
         
         // Extract text from all pages
-        TextExtractor extractor;
         ExtractOptions extract_opts;
         extract_opts.extract_positions = options_.extract_positions;
         extract_opts.extract_fonts = options_.extract_fonts;
         extract_opts.extract_colors = options_.extract_colors;
         
-        auto raw_output = extractor.extract_all_pages(pdf_path, extract_opts);
+        TextExtractor& extractor = engine_->extractor();
+        nlohmann::json raw_output;
+        if (options_.pages.all_pages()) {
+            raw_output = extractor.extract_all_pages(source, extract_opts);
+        } else {
+            int page_count = extractor.get_page_count(source);
+            raw_output["page_count"] = page_count;
+            raw_output["pages"] = nlohmann::json::array();
+            for (int page : options_.pages.resolve(page_count)) {
+                try {
+                    raw_output["pages"].push_back(extractor.extract_page(source, page, extract_opts));
+                } catch (const std::exception& e) {
+                    add_count(Counter::PageErrors);
+                    nlohmann::json error_page;
+                    error_page["page_number"] = page;
+                    error_page["error"] = e.what();
+                    raw_output["pages"].push_back(error_page);
+                }
+            }
+        }
+        
+        if (source.in_memory()) {
+            extractor.close(source);  // unpins the bytes, see ParseEngine
+        }
         
         // Convert to Docling format - removed JsonSerializer dependency
         // This method is not used by hierarchical_chunker
         auto docling_output = raw_output;
+        docling_output["binary_hash"] = binary_hash;
         
         // Update statistics
         auto end_time = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
         
-        stats_["documents_processed"] = stats_["documents_processed"].get<int>() + 1;
-        stats_["pages_processed"] = stats_["pages_processed"].get<int>() + raw_output["pages"].size();
-        stats_["total_processing_time_ms"] = stats_["total_processing_time_ms"].get<int>() + duration.count();
+        record_document(raw_output["pages"].size(), duration.count());
         
         return docling_output;
     }
 
-    void parse_streaming(const std::string& pdf_path, PageCallback callback) {
-        if (!std::filesystem::exists(pdf_path)) {
-            throw std::runtime_error("PDF file not found: " + pdf_path);
+    void parse_streaming(const PdfSource& source, PageCallback callback, PageWorkCallback on_extracted) {
+        if (!source.in_memory() && !std::filesystem::exists(source.name())) {
+            throw std::runtime_error("PDF file not found: " + source.name());
+        }
+
+        // A job on the engine like any other, so the document is opened on
+        // a worker and its pages share the scheduler, the memory budget
+        // and the auto-tuner with everything else on the engine. The
+        // engine keeps the pages in order and at most the window ahead of
+        // the callback.
+        ParseJob job;
+        job.source = source;
+        job.page_output = options_.page_output;
+        job.extract_options.extract_positions = options_.extract_positions;
+        job.extract_options.extract_fonts = options_.extract_fonts;
+        job.extract_options.extract_colors = options_.extract_colors;
+        job.pages = options_.pages;
+        job.max_pages_in_flight = options_.max_pages_in_flight;
+        job.on_extracted = std::move(on_extracted);
+        
+        // Everything below is captured by reference: on_done runs after the
+        // job's last callback, and this call waits for it
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        bool done = false;
+        std::string error;
+        std::exception_ptr failure;  // thrown by the callback, rethrown here
+        
+        job.on_page = [&callback, &failure](PageResult page) {
+            try {
+                if (callback(std::move(page))) return true;
+                log_message(LogLevel::Debug, "Stopping page processing as requested by callback");
+            } catch (...) {
+                failure = std::current_exception();
+            }
+            return false;
+        };
+        job.on_done = [&](int page_count, const std::string& job_error) {
+            if (job_error.empty() && log_enabled(LogLevel::Info)) {
+                log_message(LogLevel::Info, "Processed " + std::to_string(page_count) + " pages of " +
+                            source.name() + " with " + std::to_string(options_.thread_count) + " threads");
+            }
+            std::lock_guard<std::mutex> lock(done_mutex);
+            error = job_error;
+            done = true;
+            done_cv.notify_all();
+        };
+        engine_->submit(std::move(job));
+        
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [&] { return done; });
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        if (!error.empty()) {
+            throw std::runtime_error(error);
         }
+    }
 
-        TextExtractor extractor;
+    std::vector<nlohmann::json> parse_batch(const std::vector<std::string>& pdf_paths,
+                                           ProgressCallback progress) {
         ExtractOptions extract_opts;
         extract_opts.extract_positions = options_.extract_positions;
         extract_opts.extract_fonts = options_.extract_fonts;
         extract_opts.extract_colors = options_.extract_colors;
-
-        // Get page count first
-        int page_count = extractor.get_page_count(pdf_path);
-        std::cout << "Starting to process " << page_count << " pages with " 
-                  << options_.thread_count << " threads" << std::endl;
         
-        // Process pages in parallel batches
-        std::vector<std::future<PageResult>> futures;
+        // Every document goes to the engine at once, which interleaves their
+        // pages; a document's pages reach on_page in order, one at a time,
+        // so each builds its own result without locking
+        std::vector<nlohmann::json> results(pdf_paths.size());
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        size_t completed = 0;
         
-        for (size_t i = 0; i < page_count; i += options_.batch_size) {
-            size_t batch_end = std::min(i + options_.batch_size, static_cast<size_t>(page_count));
-            
-            for (size_t page_idx = i; page_idx < batch_end; ++page_idx) {
-                futures.push_back(
-                    thread_pool_.enqueue([this, pdf_path, page_idx, extract_opts]() {
-                        PageResult result;
-                        result.page_number = page_idx;
-                        
-                        try {
-                            TextExtractor page_extractor;
-                            result.content = page_extractor.extract_page(pdf_path, page_idx, extract_opts);
-                            result.success = true;
-                        } catch (const std::exception& e) {
-                            result.error = e.what();
-                            result.success = false;
-                        }
-                        
-                        return result;
-                    })
-                );
-            }
+        for (size_t i = 0; i < pdf_paths.size(); ++i) {
+            const std::string& path = pdf_paths[i];
+            auto start_time = std::chrono::high_resolution_clock::now();
+            results[i]["pages"] = nlohmann::json::array();
             
-            // Wait for batch completion and invoke callbacks
-            bool should_continue = true;
-            for (auto& future : futures) {
-                if (should_continue) {
-                    should_continue = callback(future.get());
+            ParseJob job;
+            job.source = path;
+            job.page_output = PageOutput::Json;
+            job.extract_options = extract_opts;
+            job.pages = options_.pages;
+            job.on_page = [&results, i](PageResult page) {
+                if (page.success) {
+                    results[i]["pages"].push_back(std::move(page.content));
                 } else {
-                    // Still need to get() all futures to avoid dangling threads
-                    future.get();
+                    nlohmann::json error_page;
+                    error_page["page_number"] = page.page_number;
+                    error_page["error"] = page.error;
+                    results[i]["pages"].push_back(error_page);
                 }
-            }
-            futures.clear();
+                return true;
+            };
+            job.on_done = [&, i, start_time](int page_count, const std::string& error) {
+                if (!error.empty()) {
+                    nlohmann::json error_result;
+                    error_result["error"] = error;
+                    error_result["file"] = pdf_paths[i];
+                    results[i] = error_result;
+                } else {
+                    results[i]["page_count"] = page_count;
+                    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::high_resolution_clock::now() - start_time);
+                    record_document(page_count, duration.count());
+                }
+                
+                // All under the lock: the waiter owns everything captured
+                // here and may return as soon as it sees the last document
+                std::lock_guard<std::mutex> lock(done_mutex);
+                completed++;
+                if (progress) {
+                    progress(completed, pdf_paths.size());
+                }
+                done_cv.notify_all();
+            };
             
-            // Stop processing if callback returned false
-            if (!should_continue) {
-                std::cout << "Stopping page processing as requested by callback" << std::endl;
-                break;
+            if (!std::filesystem::exists(path)) {
+                job.on_done(0, "PDF file not found: " + path);
+                continue;
             }
-        }
-    }
-
-    std::vector<nlohmann::json> parse_batch(const std::vector<std::string>& pdf_paths,
-                                           ProgressCallback progress) {
-        std::vector<nlohmann::json> results;
-        std::mutex results_mutex;
-        std::atomic<size_t> completed{0};
-        
-        std::vector<std::future<void>> futures;
-        
-        for (const auto& path : pdf_paths) {
-            futures.push_back(
-                thread_pool_.enqueue([this, path, &results, &results_mutex, &completed, &pdf_paths, progress]() {
-                    try {
-                        auto result = parse(path);
-                        
-                        {
-                            std::lock_guard<std::mutex> lock(results_mutex);
-                            results.push_back(result);
-                        }
-                    } catch (const std::exception& e) {
-                        nlohmann::json error_result;
-                        error_result["error"] = e.what();
-                        error_result["file"] = path;
-                        
-                        std::lock_guard<std::mutex> lock(results_mutex);
-                        results.push_back(error_result);
-                    }
-                    
-                    completed++;
-                    if (progress) {
-                        progress(completed, pdf_paths.size());
-                    }
-                })
-            );
+            engine_->submit(std::move(job));
         }
         
-        // Wait for all documents to complete
-        for (auto& future : futures) {
-            future.get();
-        }
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [&] { return completed == pdf_paths.size(); });
         
         return results;
     }
 
     nlohmann::json get_stats() const {
-        nlohmann::json stats = stats_;
+        uint64_t documents = documents_processed_.load(std::memory_order_relaxed);
+        uint64_t pages = pages_processed_.load(std::memory_order_relaxed);
+        uint64_t total_ms = total_processing_time_ms_.load(std::memory_order_relaxed);
         
-        if (stats["documents_processed"] > 0) {
-            double avg_time = static_cast<double>(stats["total_processing_time_ms"]) / 
-                            static_cast<double>(stats["documents_processed"]);
-            stats["average_processing_time_ms"] = avg_time;
-            
-            double pages_per_second = static_cast<double>(stats["pages_processed"]) / 
-                                    (static_cast<double>(stats["total_processing_time_ms"]) / 1000.0);
-            stats["pages_per_second"] = pages_per_second;
+        nlohmann::json stats;
+        stats["documents_processed"] = documents;
+        stats["pages_processed"] = pages;
+        stats["total_processing_time_ms"] = total_ms;
+        stats["mupdf_memory_in_use"] = mupdf_memory_in_use();
+        if (documents > 0) {
+            stats["average_processing_time_ms"] = static_cast<double>(total_ms) / documents;
+            stats["pages_per_second"] = total_ms > 0 ? pages / (total_ms / 1000.0) : 0.0;
         }
         
+        // Process-wide: every parser and chunker adds to the same metrics
+        stats["engine"] = engine_->settings();
+        stats["metrics"] = metrics_snapshot();
         return stats;
     }
 
 private:
-    int64_t calculate_file_hash(const std::string& path) {
-        std::ifstream file(path, std::ios::binary);
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        
-        // Simple hash for demo - in production use proper hash
-        std::hash<std::string> hasher;
-        return static_cast<int64_t>(hasher(buffer.str()));
+    // Called from engine workers when parse_batch documents finish
+    void record_document(size_t pages, int64_t duration_ms) {
+        documents_processed_.fetch_add(1, std::memory_order_relaxed);
+        pages_processed_.fetch_add(pages, std::memory_order_relaxed);
+        total_processing_time_ms_.fetch_add(static_cast<uint64_t>(std::max<int64_t>(duration_ms, 0)),
+                                            std::memory_order_relaxed);
     }
-
+    
     ParseOptions options_;
-    ThreadPool thread_pool_;
-    mutable nlohmann::json stats_;
+    std::shared_ptr<ParseEngine> engine_;
+    std::atomic<uint64_t> documents_processed_{0};
+    std::atomic<uint64_t> pages_processed_{0};
+    std::atomic<uint64_t> total_processing_time_ms_{0};
 };
 
 FastPdfParser::FastPdfParser(const ParseOptions& options) 
-    : pImpl(std::make_unique<Impl>(options)) {}
+    : pImpl(std::make_unique<Impl>(options, nullptr)) {}
+
+FastPdfParser::FastPdfParser(const ParseOptions& options, std::shared_ptr<ParseEngine> engine) 
+    : pImpl(std::make_unique<Impl>(options, std::move(engine))) {}
 
 FastPdfParser::~FastPdfParser() = default;
 
-nlohmann::json FastPdfParser::parse(const std::string& pdf_path) {
-    return pImpl->parse(pdf_path);
+nlohmann::json FastPdfParser::parse(const PdfSource& source) {
+    return pImpl->parse(source);
 }
 
-void FastPdfParser::parse_streaming(const std::string& pdf_path, PageCallback callback) {
-    pImpl->parse_streaming(pdf_path, callback);
+void FastPdfParser::parse_streaming(const PdfSource& source, PageCallback callback,
+                                    PageWorkCallback on_extracted) {
+    pImpl->parse_streaming(source, callback, on_extracted);
 }
 
 std::vector<nlohmann::json> FastPdfParser::parse_batch(const std::vector<std::string>& pdf_paths,
@@ -0,0 +1,66 @@
+// Build-time generator for the binary tokenizer vocabulary table.
+//
+// Decodes the embedded cl100k_base data once and writes the resulting table
+// (token offsets, trie and token bytes, see TiktokenTokenizer::VocabTableHeader)
+// either as a C++ source file that gets compiled into the library, or as a raw
+// sidecar file that the tokenizer can mmap via FAST_PDF_PARSER_VOCAB_FILE.
+//
+//   gen_vocab_table --cpp cl100k_vocab_table.cpp
+//   gen_vocab_table --binary cl100k_vocab.bin
+
+#include <fast_pdf_parser/tiktoken_tokenizer.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace fast_pdf_parser;
+
+static bool write_cpp(const std::vector<unsigned char>& table, const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
+    
+    out << "// Generated by gen_vocab_table from cl100k_base_data.h. Do not edit.\n";
+    out << "#include \"fast_pdf_parser/cl100k_vocab_table.h\"\n\n";
+    out << "namespace fast_pdf_parser {\n\n";
+    out << "alignas(16) const unsigned char cl100k_vocab_table[] = {\n";
+    
+    char hex[8];
+    for (size_t i = 0; i < table.size(); ++i) {
+        if (i % 12 == 0) out << "  ";
+        std::snprintf(hex, sizeof(hex), "0x%02x", table[i]);
+        out << hex;
+        if (i + 1 < table.size()) out << ",";
+        out << ((i % 12 == 11 || i + 1 == table.size()) ? "\n" : " ");
+    }
+    
+    out << "};\n";
+    out << "const unsigned int cl100k_vocab_table_len = " << table.size() << ";\n\n";
+    out << "} // namespace fast_pdf_parser\n";
+    return static_cast<bool>(out);
+}
+
+static bool write_binary(const std::vector<unsigned char>& table, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size()));
+    return static_cast<bool>(out);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3 || (std::string(argv[1]) != "--cpp" && std::string(argv[1]) != "--binary")) {
+        std::cerr << "Usage: " << argv[0] << " --cpp OUTPUT.cpp | --binary OUTPUT.bin\n";
+        return 1;
+    }
+    
+    std::vector<unsigned char> table = TiktokenTokenizer::build_vocab_table();
+    
+    bool ok = std::string(argv[1]) == "--cpp" ? write_cpp(table, argv[2])
+                                              : write_binary(table, argv[2]);
+    if (!ok) {
+        std::cerr << "Error: failed to write " << argv[2] << "\n";
+        return 1;
+    }
+    
+    return 0;
+}
\ No newline at end of file
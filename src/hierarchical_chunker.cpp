@@ -1,150 +1,660 @@
 #include <fast_pdf_parser/hierarchical_chunker.h>
 #include <fast_pdf_parser/fast_pdf_parser.h>
+#include <fast_pdf_parser/parse_engine.h>
+#include <fast_pdf_parser/page_text_cache.h>
+#include <fast_pdf_parser/content_hash.h>
+#include <fast_pdf_parser/chunk_output.h>
+#include <fast_pdf_parser/metrics.h>
 #include <fast_pdf_parser/tiktoken_tokenizer.h>
-#include <iostream>
 #include <fstream>
+#include <cstring>
+#include <stdexcept>
 #include <chrono>
 #include <filesystem>
 #include <nlohmann/json.hpp>
-#include <regex>
 #include <algorithm>
-#include <numeric>
-#include <iomanip>
 #include <set>
+#include <map>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 
 namespace fs = std::filesystem;
 using namespace fast_pdf_parser;
 
-// Configuration constants
-const int DEFAULT_MAX_TOKENS = 512;
-const int DEFAULT_OVERLAP_TOKENS = 50;
-const int DEFAULT_MIN_TOKENS = 150;  // Aggressive minimum to avoid small chunks
-
-// Annotation types
-enum class LineType {
-    NORMAL,
-    MAJOR_HEADING,  // #, ## level headings
-    MINOR_HEADING,  // ###+ level headings
-    LIST_ITEM,
-    BLANK,
-    CODE_BLOCK
-};
-
-// Annotated line structure
+// One line of page text in the document-wide line arena. text views into
+// the PageText buffers, which outlive chunking, and includes the line's
+// trailing '\n', so chunk text is a plain concatenation of line views.
+// Overlong lines are stored as several entries cut at token boundaries;
+// only the last of them ends in '\n'.
 struct AnnotatedLine {
-    std::string text;
+    std::string_view text;
     LineType type;
-    int tokens;
+    int tokens;  // of text, newline included
     int page;
     int heading_level = 0;  // 0 = not a heading, 1 = #, 2 = ##, etc.
+    bool skipped = false;   // blank line dropped at a unit boundary
 };
 
-// Semantic unit - a group of related lines
+// Semantic unit - a group of related lines, arena lines [begin, end)
 struct SemanticUnit {
-    std::vector<AnnotatedLine> lines;
+    uint32_t begin = 0;
+    uint32_t end = 0;
     int total_tokens = 0;
-    std::set<int> pages;
+    int start_page = -1;
+    int end_page = -1;
     bool has_major_heading = false;
     int max_heading_level = 999;  // Lower is more important
     
-    void add_line(const AnnotatedLine& line) {
-        lines.push_back(line);
+    bool empty() const { return begin == end; }
+    
+    void add_line(const AnnotatedLine& line, uint32_t index) {
+        if (empty()) begin = index;
+        end = index + 1;
         total_tokens += line.tokens;
-        pages.insert(line.page);
+        start_page = start_page == -1 ? line.page : std::min(start_page, line.page);
+        end_page = std::max(end_page, line.page);
         if (line.type == LineType::MAJOR_HEADING) {
             has_major_heading = true;
             max_heading_level = std::min(max_heading_level, line.heading_level);
         }
     }
-    
-    std::string get_text() const {
-        std::string result;
-        for (const auto& line : lines) {
-            result += line.text + "\n";
-        }
-        return result;
-    }
 };
 
-// Chunk structure
+// Chunk structure. A chunk covers arena lines [begin, end); lines marked
+// skipped inside that range are not part of its text or token count.
+// Overlap repeats the end of the previous chunk: line overlap_begin from
+// byte overlap_offset on, then the lines up to begin.
 struct Chunk {
-    std::string text;
-    int tokens = 0;
+    uint32_t begin = 0;
+    uint32_t end = 0;
+    int tokens = 0;  // excluding overlap
     int start_page = -1;
     int end_page = -1;
-    std::string overlap_text;
+    uint32_t overlap_begin = 0;
+    uint32_t overlap_offset = 0;
     int overlap_tokens = 0;
     bool has_major_heading = false;
     int min_heading_level = 999;  // Track most important heading
+    
+    bool empty() const { return begin == end; }
+    
+    // Appends next, which must start where this chunk ends
+    void merge(const Chunk& next) {
+        end = next.end;
+        tokens += next.tokens;
+        end_page = next.end_page;
+        if (next.has_major_heading) {
+            has_major_heading = true;
+            min_heading_level = std::min(min_heading_level, next.min_heading_level);
+        }
+    }
+};
+
+namespace fast_pdf_parser {
+
+// Pass 1 for one whole line, before any cut. Does not depend on chunk
+// sizes, so PreparedDocument keeps these to skip pass 1 when re-chunking.
+struct LineAnnotation {
+    LineType type;
+    int heading_level;
+    int tokens;  // newline included
+};
+
+// A prepared document's pages and the annotation of each of their lines
+struct PreparedDocument::Data {
+    TokenizerMode tokenizer_mode;
+    std::vector<PageText> pages;
+    std::vector<std::vector<LineAnnotation>> annotations;  // per page, per line
+};
+
+} // namespace fast_pdf_parser
+
+// Line l of page, newline included
+static std::string_view line_with_newline(const PageText& page, size_t l) {
+    size_t begin = page.line_offsets[l];
+    size_t end = l + 1 < page.line_count() ? page.line_offsets[l + 1] : page.text.size();
+    return std::string_view(page.text).substr(begin, end - begin);
+}
+
+static LineAnnotation annotate_line(const PageText& page, size_t l,
+                                    const TiktokenTokenizer& tokenizer,
+                                    const LineClassifier& classifier) {
+    auto [type, level] = classifier.classify(page.line(l));
+    int tokens = static_cast<int>(tokenizer.count_tokens(line_with_newline(page, l)));
+    return {type, level, tokens};
+}
+
+// Pass 1 for every line of a page. Pages are independent, so this runs on
+// the parse workers, each page right after it is extracted.
+static std::vector<LineAnnotation> annotate_lines(const PageText& page,
+                                                  const TiktokenTokenizer& tokenizer,
+                                                  const LineClassifier& classifier) {
+    StageTimer timer(Stage::Tokenize);
+    std::vector<LineAnnotation> annotations;
+    annotations.reserve(page.line_count());
+    uint64_t tokens = 0;
+    for (size_t l = 0; l < page.line_count(); ++l) {
+        annotations.push_back(annotate_line(page, l, tokenizer, classifier));
+        tokens += annotations.back().tokens;
+    }
+    add_count(Counter::LinesAnnotated, page.line_count());
+    add_count(Counter::TokensCounted, tokens);
+    return annotations;
+}
+
+// Pass-1 results made on parse workers, held until their page's turn in
+// page order comes
+class AnnotationSlots {
+public:
+    void put(int page, std::vector<LineAnnotation> annotations) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[page] = std::move(annotations);
+    }
+    
+    // False if the page was not annotated
+    bool take(int page, std::vector<LineAnnotation>& annotations) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = slots_.find(page);
+        if (it == slots_.end()) return false;
+        annotations = std::move(it->second);
+        slots_.erase(it);
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<int, std::vector<LineAnnotation>> slots_;
 };
 
-// Helper function to detect line type and heading level
-std::pair<LineType, int> detect_line_type(const std::string& line) {
-    // Check for blank line
-    if (line.empty() || std::all_of(line.begin(), line.end(), ::isspace)) {
-        return {LineType::BLANK, 0};
+// Appends an annotated line to the arena. A line of more than
+// max_line_tokens tokens is cut at token boundaries into entries of at
+// most that many; the pieces after the first continue the line, so they
+// are never headings.
+static void append_line(std::string_view line,
+                        const LineAnnotation& annotation,
+                        int page_num,
+                        const TiktokenTokenizer& tokenizer,
+                        int max_line_tokens,
+                        std::deque<AnnotatedLine>& annotated) {
+    LineType type = annotation.type;
+    int level = annotation.heading_level;
+    
+    if (annotation.tokens <= max_line_tokens) {
+        annotated.push_back({
+            line,
+            type,
+            annotation.tokens,
+            page_num,
+            level
+        });
+        return;
+    }
+    
+    auto offsets = tokenizer.token_offsets(line);
+    size_t count = offsets.size() - 1;
+    LineType rest_type = (type == LineType::MAJOR_HEADING || type == LineType::MINOR_HEADING)
+        ? LineType::NORMAL : type;
+    for (size_t t = 0; t < count; t += max_line_tokens) {
+        size_t t_end = std::min(count, t + max_line_tokens);
+        annotated.push_back({
+            line.substr(offsets[t], offsets[t_end] - offsets[t]),
+            t == 0 ? type : rest_type,
+            static_cast<int>(t_end - t),
+            page_num,
+            t == 0 ? level : 0
+        });
+    }
+}
+
+// Pass 1: Annotate the lines of one page with type and token count,
+// appending them to the arena
+void annotate_page(const PageText& page,
+                   const TiktokenTokenizer& tokenizer,
+                   const LineClassifier& classifier,
+                   int max_line_tokens,
+                   std::deque<AnnotatedLine>& annotated) {
+    StageTimer timer(Stage::Tokenize);
+    uint64_t tokens = 0;
+    for (size_t l = 0; l < page.line_count(); ++l) {
+        LineAnnotation annotation = annotate_line(page, l, tokenizer, classifier);
+        tokens += annotation.tokens;
+        append_line(line_with_newline(page, l), annotation,
+                    page.page_number, tokenizer, max_line_tokens, annotated);
+    }
+    add_count(Counter::LinesAnnotated, page.line_count());
+    add_count(Counter::TokensCounted, tokens);
+}
+
+// The seven chunking passes, run incrementally as pages arrive. Each pass
+// is a stage that hands finished results to the next one and keeps at most
+// a chunk or two of state, so a chunk is emitted as soon as no later page
+// can change it. Output is the same as running each pass over the whole
+// document.
+//
+// Lines live in a sliding window of the arena: line i is lines_[i - base_].
+// Everything before the last emitted chunk has been released, together
+// with the pages it viewed into; that chunk is kept for the next overlap.
+// The passes size chunks by the sum of their lines' counts, each line
+// counted with its newline. Pre-tokens that span a line break (".\n" then
+// "\n", runs of blank lines) come out differently in the joined text, so
+// each emitted chunk is counted once for its token_count. Overlap counts
+// against max_tokens: the passes size chunk bodies to
+// max_tokens - overlap_tokens.
+class ChunkPipeline {
+public:
+    using Emit = std::function<bool(ChunkResult&&)>;
+    
+    ChunkPipeline(const TiktokenTokenizer& tokenizer,
+                  const LineClassifier& classifier,
+                  int max_tokens, int overlap_tokens, int min_tokens,
+                  Emit emit)
+        : tokenizer_(tokenizer),
+          classifier_(classifier),
+          overlap_tokens_(std::max(overlap_tokens, 0)),
+          body_tokens_(std::max(max_tokens - overlap_tokens_, 1)),
+          min_tokens_(min_tokens),
+          max_line_tokens_(std::max(body_tokens_ / 5, 1)),
+          emit_(std::move(emit)) {
+    }
+    
+    // Pages must arrive in document order. Returns false once emit has
+    // asked to stop; later pages are ignored.
+    bool add_page(PageText page) {
+        if (stopped_) return false;
+        
+        page_first_line_.push_back(line_end());
+        pages_.push_back(std::move(page));
+        annotate_page(pages_.back(), tokenizer_, classifier_, max_line_tokens_, lines_);
+        return group_lines();
+    }
+    
+    // A page annotated by annotate_lines() already, e.g. by the worker
+    // that extracted it
+    bool add_page(PageText page, const std::vector<LineAnnotation>& annotations) {
+        if (stopped_) return false;
+        
+        page_first_line_.push_back(line_end());
+        pages_.push_back(std::move(page));
+        append_annotated(pages_.back(), annotations.data());
+        return group_lines();
+    }
+    
+    // A page whose lines were annotated already, one LineAnnotation per
+    // line. The page is viewed in place, so it must outlive the pipeline.
+    bool add_annotated_page(const PageText& page, const LineAnnotation* annotations) {
+        if (stopped_) return false;
+        
+        page_first_line_.push_back(line_end());
+        pages_.emplace_back();  // not owned; keeps pages_ in step with page_first_line_
+        append_annotated(page, annotations);
+        return group_lines();
+    }
+    
+    // Flushes every stage. Returns false if emit asked to stop.
+    bool finish() {
+        StageTimer timer(Stage::Chunk);
+        while (!stopped_ && next_line_ < line_end()) {
+            group_line(next_line_, nullptr);
+            ++next_line_;
+        }
+        if (!unit_.empty()) {
+            add_unit(unit_);
+            unit_ = SemanticUnit();
+        }
+        if (!initial_.empty()) {
+            merge_small(initial_);
+            initial_ = Chunk();
+        }
+        if (!merging_.empty()) {
+            split_oversized(merging_);
+            merging_ = Chunk();
+        }
+        if (!final_current_.empty()) close_final();
+        if (!final_prev_.empty()) {
+            add_overlap(final_prev_);
+            final_prev_ = Chunk();
+        }
+        return !stopped_;
+    }
+    
+    size_t chunks_emitted() const { return chunks_emitted_; }
+
+private:
+    uint32_t line_end() const { return base_ + static_cast<uint32_t>(lines_.size()); }
+    
+    void append_annotated(const PageText& page, const LineAnnotation* annotations) {
+        for (size_t l = 0; l < page.line_count(); ++l) {
+            append_line(line_with_newline(page, l), annotations[l], page.page_number,
+                        tokenizer_, max_line_tokens_, lines_);
+        }
+    }
+    AnnotatedLine& line(uint32_t i) { return lines_[i - base_]; }
+    
+    // Runs the new lines through the passes. Grouping a line looks at the
+    // one after it, so the last line waits for the next page.
+    bool group_lines() {
+        StageTimer timer(Stage::Chunk);
+        while (!stopped_ && next_line_ + 1 < line_end()) {
+            group_line(next_line_, &line(next_line_ + 1));
+            ++next_line_;
+        }
+        
+        release();
+        return !stopped_;
     }
     
-    // Check for markdown headings
-    std::regex heading_regex("^(#+)\\s+(.+)$");
-    std::smatch match;
-    if (std::regex_match(line, match, heading_regex)) {
-        int level = match[1].str().length();
-        if (level <= 2) {
-            return {LineType::MAJOR_HEADING, level};
+    // Pass 2: Group lines into semantic units
+    void group_line(uint32_t i, const AnnotatedLine* next) {
+        auto& current = line(i);
+        
+        // Start new unit on major headings or after blanks before headings
+        bool should_break = false;
+        
+        if (current.type == LineType::MAJOR_HEADING || current.type == LineType::MINOR_HEADING) {
+            should_break = true;
+        } else if (current.type == LineType::BLANK && next) {
+            // Look ahead - if next line is a heading, break here
+            if (next->type == LineType::MAJOR_HEADING || 
+                next->type == LineType::MINOR_HEADING) {
+                should_break = true;
+            }
+        }
+        
+        if (should_break && !unit_.empty()) {
+            add_unit(unit_);
+            unit_ = SemanticUnit();
+        }
+        
+        // Skip blank lines at unit boundaries
+        if (current.type == LineType::BLANK && unit_.empty()) {
+            current.skipped = true;
         } else {
-            return {LineType::MINOR_HEADING, level};
+            unit_.add_line(current, i);
         }
     }
     
-    // Check for list items
-    std::regex list_regex("^\\s*[-*+•]\\s+(.+)$|^\\s*\\d+\\.\\s+(.+)$");
-    if (std::regex_match(line, list_regex)) {
-        return {LineType::LIST_ITEM, 0};
+    // Pass 3: Create initial chunks from semantic units
+    void add_unit(const SemanticUnit& unit) {
+        // If adding this unit would exceed the budget, start a new chunk
+        // Exception: if current chunk is empty, add it anyway (unit > budget)
+        if (!initial_.empty() && 
+            initial_.tokens + unit.total_tokens > body_tokens_) {
+            merge_small(initial_);
+            initial_ = Chunk();
+        }
+        
+        // Add unit to current chunk; skipped blank lines in between stay
+        // inside the range but contribute nothing
+        if (initial_.empty()) initial_.begin = unit.begin;
+        initial_.end = unit.end;
+        initial_.tokens += unit.total_tokens;
+        
+        // Update page range
+        if (initial_.start_page == -1) {
+            initial_.start_page = unit.start_page;
+        }
+        initial_.end_page = unit.end_page;
+        
+        // Track heading information
+        if (unit.has_major_heading) {
+            initial_.has_major_heading = true;
+            initial_.min_heading_level = std::min(initial_.min_heading_level, 
+                                                  unit.max_heading_level);
+        }
     }
     
-    // Check for code blocks (simple heuristic)
-    if (line.find("```") != std::string::npos || 
-        (line.length() > 0 && line[0] == ' ' && line.find("  ") == 0)) {
-        return {LineType::CODE_BLOCK, 0};
+    // Pass 4: Enhanced merging with heuristics
+    void merge_small(const Chunk& next) {
+        if (merging_.empty()) {
+            merging_ = next;
+            return;
+        }
+        
+        // Try to merge with the following chunk if current is small
+        if (merging_.tokens < min_tokens_) {
+            // Calculate combined size
+            int combined_tokens = merging_.tokens + next.tokens;
+            
+            // Merge decision based on multiple factors
+            bool should_merge = false;
+            
+            // 1. Always merge if combined size is reasonable
+            if (combined_tokens <= body_tokens_) {
+                should_merge = true;
+            }
+            // 2. Allow slightly over if it prevents tiny chunks
+            else if (combined_tokens <= body_tokens_ * 1.1 && next.tokens < min_tokens_ / 2) {
+                should_merge = true;
+            }
+            
+            // Veto merging if next has major heading and current is already reasonable size
+            if (next.has_major_heading && next.min_heading_level <= 2 && merging_.tokens >= min_tokens_ / 2) {
+                should_merge = false;
+            }
+            
+            if (should_merge) {
+                merging_.merge(next);
+                return;
+            }
+        }
+        
+        split_oversized(merging_);
+        merging_ = next;
     }
     
-    return {LineType::NORMAL, 0};
-}
-
-// Pass 1: Annotate lines with type and token count
-std::vector<AnnotatedLine> annotate_lines(const std::vector<std::pair<std::string, int>>& pages,
-                                          const TiktokenTokenizer& tokenizer) {
-    std::vector<AnnotatedLine> annotated;
+    // Pass 5: Split oversized chunks at line boundaries. annotate_page keeps
+    // every entry within a fifth of the budget, so a split that would
+    // overflow is always at least 0.8 * budget full and gets closed first;
+    // split pieces never exceed the budget.
+    void split_oversized(const Chunk& chunk) {
+        if (chunk.tokens <= body_tokens_) {
+            final_merge(chunk);
+            return;
+        }
+        
+        // Need to split this chunk. Splits inherit the heading flags of the
+        // chunk they came from; their pages are those of their own lines.
+        Chunk current_split;
+        current_split.begin = chunk.begin;
+        current_split.end = chunk.begin;
+        
+        for (uint32_t i = chunk.begin; i < chunk.end; ++i) {
+            const AnnotatedLine& current = line(i);
+            if (current.skipped) {
+                current_split.end = i + 1;
+                continue;
+            }
+            
+            // Check if adding this line would exceed limit
+            if (current_split.start_page != -1 && 
+                current_split.tokens + current.tokens > body_tokens_) {
+                
+                // Look for semantic boundary (prefer line breaks, sentences)
+                if (current_split.tokens >= body_tokens_ * 0.8) {
+                    // Close enough to target, split here
+                    final_merge(current_split);
+                    
+                    current_split = Chunk();
+                    current_split.begin = i;
+                }
+            }
+            
+            current_split.end = i + 1;
+            current_split.tokens += current.tokens;
+            if (current_split.start_page == -1) current_split.start_page = current.page;
+            current_split.end_page = current.page;
+        }
+        
+        // Add final split
+        if (current_split.start_page != -1) {
+            final_merge(current_split);
+        }
+    }
     
-    for (const auto& [page_text, page_num] : pages) {
-        std::istringstream stream(page_text);
-        std::string line;
+    // Pass 6: Final merge pass to eliminate small chunks created by
+    // splitting. STRICT limit - no oversizing allowed in this pass.
+    void final_merge(const Chunk& next) {
+        if (final_current_.empty()) {
+            final_current_ = next;
+            return;
+        }
+        
+        // Merge small chunks forward while that stays within the budget
+        if (final_current_.tokens < min_tokens_ &&
+            final_current_.tokens + next.tokens <= body_tokens_) {
+            final_current_.merge(next);
+            return;
+        }
+        
+        close_final();
+        final_current_ = next;
+    }
+    
+    void close_final() {
+        // Try to merge with previous chunk if current is still small
+        if (final_current_.tokens < min_tokens_ && !final_prev_.empty() &&
+            final_prev_.tokens + final_current_.tokens <= body_tokens_) {
+            final_prev_.merge(final_current_);
+        } else {
+            // The previous chunk can no longer grow
+            if (!final_prev_.empty()) add_overlap(final_prev_);
+            final_prev_ = final_current_;
+        }
+        final_current_ = Chunk();
+    }
+    
+    // Pass 7: Add overlap. Each chunk after the first repeats the last
+    // overlap_tokens tokens of the chunk before it. Whole lines are taken
+    // by their stored counts; only the line the overlap starts in is
+    // tokenized again, to find the exact token boundary. The repeated text
+    // is then counted on its own for overlap_tokens, since a line's tail
+    // can tokenize differently from the same bytes inside the line.
+    void add_overlap(Chunk chunk) {
+        if (stopped_) return;
         
-        while (std::getline(stream, line)) {
-            auto [type, level] = detect_line_type(line);
-            int tokens = tokenizer.count_tokens(line);
+        size_t overlap_bytes = 0;
+        if (overlap_tokens_ > 0 && !last_emitted_.empty()) {
+            const Chunk& prev = last_emitted_;
+            uint32_t begin = prev.end;
+            uint32_t offset = 0;
+            int tokens = 0;
+            
+            while (begin > prev.begin && tokens < overlap_tokens_) {
+                const AnnotatedLine& candidate = line(begin - 1);
+                --begin;
+                if (candidate.skipped) continue;
+                
+                if (tokens + candidate.tokens <= overlap_tokens_) {
+                    tokens += candidate.tokens;
+                    overlap_bytes += candidate.text.size();
+                    continue;
+                }
+                
+                // Only the tail of this line fits
+                auto offsets = tokenizer_.token_offsets(candidate.text);
+                size_t count = offsets.size() - 1;
+                size_t take = std::min(count, static_cast<size_t>(overlap_tokens_ - tokens));
+                offset = offsets[count - take];
+                tokens += static_cast<int>(take);
+                overlap_bytes += candidate.text.size() - offset;
+                break;
+            }
             
-            annotated.push_back({
-                line,
-                type,
-                tokens,
-                page_num,
-                level
-            });
+            chunk.overlap_begin = begin;
+            chunk.overlap_offset = offset;
+            chunk.overlap_tokens = tokens;
         }
+        
+        ChunkResult result;
+        result.text = chunk_text(chunk);
+        result.token_count = static_cast<int>(tokenizer_.count_tokens(result.text));
+        result.overlap_tokens = overlap_bytes == 0 ? 0 : static_cast<int>(
+            tokenizer_.count_tokens(std::string_view(result.text).substr(0, overlap_bytes)));
+        result.start_page = chunk.start_page;
+        result.end_page = chunk.end_page;
+        result.has_major_heading = chunk.has_major_heading;
+        result.min_heading_level = chunk.min_heading_level;
+        
+        last_emitted_ = chunk;
+        ++chunks_emitted_;
+        add_count(Counter::ChunksEmitted);
+        if (!emit_(std::move(result))) stopped_ = true;
     }
     
-    return annotated;
-}
+    // Text of a chunk, overlap first, built in one allocation
+    std::string chunk_text(const Chunk& chunk) {
+        uint32_t first = chunk.overlap_tokens > 0 ? chunk.overlap_begin : chunk.begin;
+        uint32_t skip = chunk.overlap_tokens > 0 ? chunk.overlap_offset : 0;
+        
+        size_t size = 0;
+        for (uint32_t i = first; i < chunk.end; ++i) {
+            if (!line(i).skipped) size += line(i).text.size();
+        }
+        std::string text;
+        text.reserve(size - skip);
+        for (uint32_t i = first; i < chunk.end; ++i) {
+            if (line(i).skipped) continue;
+            text.append(i == first ? line(i).text.substr(skip) : line(i).text);
+        }
+        return text;
+    }
+    
+    // Drops lines no stage can refer to again, and pages left without lines
+    void release() {
+        if (last_emitted_.empty()) return;
+        
+        while (base_ < last_emitted_.begin) {
+            lines_.pop_front();
+            ++base_;
+        }
+        while (pages_.size() > 1 && page_first_line_[1] <= base_) {
+            pages_.pop_front();
+            page_first_line_.pop_front();
+        }
+    }
+    
+    const TiktokenTokenizer& tokenizer_;
+    const LineClassifier& classifier_;
+    const int overlap_tokens_;
+    const int body_tokens_;
+    const int min_tokens_;
+    const int max_line_tokens_;
+    Emit emit_;
+    bool stopped_ = false;
+    size_t chunks_emitted_ = 0;
+    
+    // Arena window and the pages its lines view into; deque elements
+    // never move, so the views stay valid while pages are appended
+    std::deque<PageText> pages_;
+    std::deque<uint32_t> page_first_line_;  // arena index of each page's first line
+    std::deque<AnnotatedLine> lines_;
+    uint32_t base_ = 0;
+    uint32_t next_line_ = 0;  // next line to group
+    
+    // Per-stage state
+    SemanticUnit unit_;     // pass 2
+    Chunk initial_;         // pass 3
+    Chunk merging_;         // pass 4
+    Chunk final_current_;   // pass 6
+    Chunk final_prev_;      // pass 6, may still absorb a small successor
+    Chunk last_emitted_;    // pass 7
+};
+
+#ifdef ENABLE_TESTS
+// The seven passes as they ran before ChunkPipeline, each over the whole
+// document at once. The tests check the pipeline against them, so they
+// share nothing with it past pass 1 and the line and chunk structs.
+namespace batch_reference {
 
 // Pass 2: Group lines into semantic units
-std::vector<SemanticUnit> create_semantic_units(const std::vector<AnnotatedLine>& lines) {
+std::vector<SemanticUnit> create_semantic_units(std::vector<AnnotatedLine>& lines) {
     std::vector<SemanticUnit> units;
     SemanticUnit current_unit;
     
     for (size_t i = 0; i < lines.size(); ++i) {
-        const auto& line = lines[i];
+        auto& line = lines[i];
         
         // Start new unit on major headings or after blanks before headings
         bool should_break = false;
@@ -159,19 +669,21 @@ std::vector<SemanticUnit> create_semantic_units(const std::vector<AnnotatedLine>
             }
         }
         
-        if (should_break && !current_unit.lines.empty()) {
+        if (should_break && !current_unit.empty()) {
             units.push_back(current_unit);
             current_unit = SemanticUnit();
         }
         
         // Skip blank lines at unit boundaries
-        if (!(line.type == LineType::BLANK && current_unit.lines.empty())) {
-            current_unit.add_line(line);
+        if (line.type == LineType::BLANK && current_unit.empty()) {
+            line.skipped = true;
+        } else {
+            current_unit.add_line(line, static_cast<uint32_t>(i));
         }
     }
     
     // Don't forget the last unit
-    if (!current_unit.lines.empty()) {
+    if (!current_unit.empty()) {
         units.push_back(current_unit);
     }
     
@@ -187,23 +699,21 @@ std::vector<Chunk> create_initial_chunks(const std::vector<SemanticUnit>& units,
     for (const auto& unit : units) {
         // If adding this unit would exceed max_tokens, start a new chunk
         // Exception: if current chunk is empty, add it anyway (unit > max_tokens)
-        if (!current_chunk.text.empty() && 
+        if (!current_chunk.empty() && 
             current_chunk.tokens + unit.total_tokens > max_tokens) {
             chunks.push_back(current_chunk);
             current_chunk = Chunk();
         }
         
-        // Add unit to current chunk
-        current_chunk.text += unit.get_text();
+        if (current_chunk.empty()) current_chunk.begin = unit.begin;
+        current_chunk.end = unit.end;
         current_chunk.tokens += unit.total_tokens;
         
         // Update page range
-        if (!unit.pages.empty()) {
-            if (current_chunk.start_page == -1) {
-                current_chunk.start_page = *unit.pages.begin();
-            }
-            current_chunk.end_page = *unit.pages.rbegin();
+        if (current_chunk.start_page == -1) {
+            current_chunk.start_page = unit.start_page;
         }
+        current_chunk.end_page = unit.end_page;
         
         // Track heading information
         if (unit.has_major_heading) {
@@ -214,44 +724,17 @@ std::vector<Chunk> create_initial_chunks(const std::vector<SemanticUnit>& units,
     }
     
     // Don't forget the last chunk
-    if (!current_chunk.text.empty()) {
+    if (!current_chunk.empty()) {
         chunks.push_back(current_chunk);
     }
     
     return chunks;
 }
 
-// Pass 4: Add overlap text
-std::vector<Chunk> add_overlap(std::vector<Chunk>& chunks, 
-                               int overlap_tokens,
-                               const TiktokenTokenizer& tokenizer) {
-    for (size_t i = 1; i < chunks.size(); ++i) {
-        // Extract last overlap_tokens worth of text from previous chunk
-        const std::string& prev_text = chunks[i-1].text;
-        
-        // Simple approach: take last N characters and count tokens
-        size_t chars_to_take = std::min(prev_text.length(), size_t(overlap_tokens * 5));
-        std::string overlap_text = prev_text.substr(prev_text.length() - chars_to_take);
-        
-        // Trim to actual token count
-        while (tokenizer.count_tokens(overlap_text) > overlap_tokens && overlap_text.length() > 10) {
-            overlap_text = overlap_text.substr(10);
-        }
-        
-        chunks[i].overlap_text = overlap_text;
-        chunks[i].overlap_tokens = tokenizer.count_tokens(overlap_text);
-    }
-    
-    return chunks;
-}
-
-// Pass 5: Enhanced merging with heuristics
+// Pass 4: Enhanced merging with heuristics
 std::vector<Chunk> merge_small_chunks_hierarchically(const std::vector<Chunk>& chunks,
                                                      int min_tokens,
-                                                     int max_tokens,
-                                                     const TiktokenTokenizer& tokenizer) {
-    if (chunks.empty()) return chunks;
-    
+                                                     int max_tokens) {
     std::vector<Chunk> merged;
     size_t i = 0;
     
@@ -261,8 +744,6 @@ std::vector<Chunk> merge_small_chunks_hierarchically(const std::vector<Chunk>& c
         // Try to merge with following chunks if current is small
         while (current.tokens < min_tokens && i + 1 < chunks.size()) {
             const Chunk& next = chunks[i + 1];
-            
-            // Calculate combined size
             int combined_tokens = current.tokens + next.tokens;
             
             // Merge decision based on multiple factors
@@ -284,15 +765,7 @@ std::vector<Chunk> merge_small_chunks_hierarchically(const std::vector<Chunk>& c
             
             if (!should_merge) break;
             
-            // Perform merge
-            current.text += next.text;
-            current.tokens = combined_tokens;
-            current.end_page = next.end_page;
-            if (next.has_major_heading) {
-                current.has_major_heading = true;
-                current.min_heading_level = std::min(current.min_heading_level, next.min_heading_level);
-            }
-            
+            current.merge(next);
             i++;  // Skip the merged chunk
         }
         
@@ -303,10 +776,10 @@ std::vector<Chunk> merge_small_chunks_hierarchically(const std::vector<Chunk>& c
     return merged;
 }
 
-// Pass 6: Split oversized chunks at semantic boundaries
+// Pass 5: Split oversized chunks at line boundaries
 std::vector<Chunk> split_oversized_chunks(const std::vector<Chunk>& chunks,
-                                          int max_tokens,
-                                          const TiktokenTokenizer& tokenizer) {
+                                          const std::vector<AnnotatedLine>& lines,
+                                          int max_tokens) {
     std::vector<Chunk> result;
     
     for (const auto& chunk : chunks) {
@@ -315,37 +788,35 @@ std::vector<Chunk> split_oversized_chunks(const std::vector<Chunk>& chunks,
             continue;
         }
         
-        // Need to split this chunk
-        std::istringstream stream(chunk.text);
-        std::string line;
+        // Splits inherit the heading flags of the chunk they came from;
+        // their pages are those of their own lines
         Chunk current_split;
-        current_split.start_page = chunk.start_page;
+        current_split.begin = chunk.begin;
+        current_split.end = chunk.begin;
         
-        while (std::getline(stream, line)) {
-            int line_tokens = tokenizer.count_tokens(line);
+        for (uint32_t i = chunk.begin; i < chunk.end; ++i) {
+            const AnnotatedLine& line = lines[i];
+            if (line.skipped) {
+                current_split.end = i + 1;
+                continue;
+            }
             
-            // Check if adding this line would exceed limit
-            if (!current_split.text.empty() && 
-                current_split.tokens + line_tokens > max_tokens) {
-                
-                // Look for semantic boundary (prefer line breaks, sentences)
-                if (current_split.tokens >= max_tokens * 0.8) {
-                    // Close enough to target, split here
-                    current_split.end_page = chunk.end_page; // Approximate
-                    result.push_back(current_split);
-                    
-                    current_split = Chunk();
-                    current_split.start_page = chunk.start_page; // Approximate
-                }
+            // Close the split once it is close enough to the target
+            if (current_split.start_page != -1 && 
+                current_split.tokens + line.tokens > max_tokens &&
+                current_split.tokens >= max_tokens * 0.8) {
+                result.push_back(current_split);
+                current_split = Chunk();
+                current_split.begin = i;
             }
             
-            current_split.text += line + "\n";
-            current_split.tokens += line_tokens;
+            current_split.end = i + 1;
+            current_split.tokens += line.tokens;
+            if (current_split.start_page == -1) current_split.start_page = line.page;
+            current_split.end_page = line.page;
         }
         
-        // Add final split
-        if (!current_split.text.empty()) {
-            current_split.end_page = chunk.end_page;
+        if (current_split.start_page != -1) {
             result.push_back(current_split);
         }
     }
@@ -353,13 +824,10 @@ std::vector<Chunk> split_oversized_chunks(const std::vector<Chunk>& chunks,
     return result;
 }
 
-// Pass 7: Final merge pass to eliminate small chunks created by splitting
+// Pass 6: Final merge pass to eliminate small chunks created by splitting
 std::vector<Chunk> final_merge_pass(const std::vector<Chunk>& chunks,
                                     int min_tokens,
-                                    int max_tokens,
-                                    const TiktokenTokenizer& tokenizer) {
-    if (chunks.empty()) return chunks;
-    
+                                    int max_tokens) {
     std::vector<Chunk> final_chunks;
     size_t i = 0;
     
@@ -367,43 +835,18 @@ std::vector<Chunk> final_merge_pass(const std::vector<Chunk>& chunks,
         Chunk current = chunks[i];
         
         // Merge small chunks while respecting max_tokens limit strictly
-        while (current.tokens < min_tokens && i + 1 < chunks.size()) {
-            const Chunk& next = chunks[i + 1];
-            int combined_tokens = current.tokens + next.tokens;
-            
-            // STRICT limit - no oversizing allowed in final pass
-            if (combined_tokens <= max_tokens) {
-                current.text += next.text;
-                current.tokens = combined_tokens;
-                current.end_page = next.end_page;
-                if (next.has_major_heading) {
-                    current.has_major_heading = true;
-                    current.min_heading_level = std::min(current.min_heading_level, next.min_heading_level);
-                }
-                i++;
-            } else {
-                // Can't merge forward without exceeding limit
-                break;
-            }
+        while (current.tokens < min_tokens && i + 1 < chunks.size() &&
+               current.tokens + chunks[i + 1].tokens <= max_tokens) {
+            current.merge(chunks[i + 1]);
+            i++;
         }
         
         // Try to merge with previous chunk if current is still small
-        if (current.tokens < min_tokens && !final_chunks.empty()) {
-            Chunk& prev = final_chunks.back();
-            int combined_tokens = prev.tokens + current.tokens;
-            
-            // STRICT limit - no oversizing allowed in final pass
-            if (combined_tokens <= max_tokens) {
-                prev.text += current.text;
-                prev.tokens = combined_tokens;
-                prev.end_page = current.end_page;
-                if (current.has_major_heading) {
-                    prev.has_major_heading = true;
-                    prev.min_heading_level = std::min(prev.min_heading_level, current.min_heading_level);
-                }
-                i++;
-                continue;  // Skip adding current
-            }
+        if (current.tokens < min_tokens && !final_chunks.empty() &&
+            final_chunks.back().tokens + current.tokens <= max_tokens) {
+            final_chunks.back().merge(current);
+            i++;
+            continue;
         }
         
         final_chunks.push_back(current);
@@ -413,214 +856,347 @@ std::vector<Chunk> final_merge_pass(const std::vector<Chunk>& chunks,
     return final_chunks;
 }
 
-// Internal chunking function
-static std::vector<Chunk> create_hierarchical_chunks_internal(const std::vector<std::pair<std::string, int>>& pages,
-                                                              const TiktokenTokenizer& tokenizer,
-                                                              int max_tokens = DEFAULT_MAX_TOKENS,
-                                                              int overlap_tokens = DEFAULT_OVERLAP_TOKENS,
-                                                              int min_tokens = DEFAULT_MIN_TOKENS) {
+// Pass 7: Add overlap. Each chunk after the first repeats the last
+// overlap_tokens tokens of the chunk before it.
+void add_overlap(std::vector<Chunk>& chunks,
+                 const std::vector<AnnotatedLine>& lines,
+                 const TiktokenTokenizer& tokenizer,
+                 int overlap_tokens) {
+    if (overlap_tokens <= 0) return;
     
-    // Filter out empty pages
-    std::vector<std::pair<std::string, int>> non_empty_pages;
-    for (const auto& [text, page_num] : pages) {
-        if (!text.empty()) {
-            non_empty_pages.push_back({text, page_num});
+    for (size_t i = 1; i < chunks.size(); ++i) {
+        const Chunk& prev = chunks[i - 1];
+        uint32_t begin = prev.end;
+        uint32_t offset = 0;
+        int tokens = 0;
+        
+        while (begin > prev.begin && tokens < overlap_tokens) {
+            const AnnotatedLine& line = lines[begin - 1];
+            --begin;
+            if (line.skipped) continue;
+            
+            if (tokens + line.tokens <= overlap_tokens) {
+                tokens += line.tokens;
+                continue;
+            }
+            
+            // Only the tail of this line fits
+            auto offsets = tokenizer.token_offsets(line.text);
+            size_t count = offsets.size() - 1;
+            size_t take = std::min(count, static_cast<size_t>(overlap_tokens - tokens));
+            offset = offsets[count - take];
+            tokens += static_cast<int>(take);
+            break;
         }
+        
+        chunks[i].overlap_begin = begin;
+        chunks[i].overlap_offset = offset;
+        chunks[i].overlap_tokens = tokens;
     }
+}
+
+// Text of a chunk, overlap first
+std::string chunk_text(const std::vector<AnnotatedLine>& lines, const Chunk& chunk) {
+    uint32_t first = chunk.overlap_tokens > 0 ? chunk.overlap_begin : chunk.begin;
+    uint32_t skip = chunk.overlap_tokens > 0 ? chunk.overlap_offset : 0;
     
-    if (non_empty_pages.empty()) {
-        return {};
+    std::string text;
+    for (uint32_t i = first; i < chunk.end; ++i) {
+        if (lines[i].skipped) continue;
+        text.append(i == first ? lines[i].text.substr(skip) : lines[i].text);
     }
+    return text;
+}
+
+} // namespace batch_reference
+
+// Chunks pages already in memory with the batch_reference passes. As in
+// the pipeline, token_count and overlap_tokens count the emitted text.
+static std::vector<ChunkResult> create_hierarchical_chunks_internal(const std::vector<PageText>& pages,
+                                                                    const TiktokenTokenizer& tokenizer,
+                                                                    const LineClassifier& classifier,
+                                                                    int max_tokens, int overlap_tokens,
+                                                                    int min_tokens) {
+    using namespace batch_reference;
     
-    // Pass 1: Annotate lines
-    auto annotated_lines = annotate_lines(non_empty_pages, tokenizer);
-    
-    // Pass 2: Create semantic units
-    auto semantic_units = create_semantic_units(annotated_lines);
-    
-    // Pass 3: Create initial chunks
-    auto chunks = create_initial_chunks(semantic_units, max_tokens);
-    
-    // Pass 4: Add overlap
-    chunks = add_overlap(chunks, overlap_tokens, tokenizer);
+    overlap_tokens = std::max(overlap_tokens, 0);
+    int body_tokens = std::max(max_tokens - overlap_tokens, 1);
     
-    // Pass 5: Merge small chunks
-    chunks = merge_small_chunks_hierarchically(chunks, min_tokens, max_tokens, tokenizer);
+    // Pass 1: Annotate lines
+    std::deque<AnnotatedLine> annotated;
+    for (const auto& page : pages) {
+        annotate_page(page, tokenizer, classifier, std::max(body_tokens / 5, 1), annotated);
+    }
+    std::vector<AnnotatedLine> lines(annotated.begin(), annotated.end());
     
-    // Pass 6: Split oversized chunks
-    chunks = split_oversized_chunks(chunks, max_tokens, tokenizer);
+    // Passes 2-7
+    auto semantic_units = create_semantic_units(lines);
+    auto chunks = create_initial_chunks(semantic_units, body_tokens);
+    chunks = merge_small_chunks_hierarchically(chunks, min_tokens, body_tokens);
+    chunks = split_oversized_chunks(chunks, lines, body_tokens);
+    chunks = final_merge_pass(chunks, min_tokens, body_tokens);
+    add_overlap(chunks, lines, tokenizer, overlap_tokens);
     
-    // Pass 7: Final merge pass to eliminate any small chunks created by splitting
-    chunks = final_merge_pass(chunks, min_tokens, max_tokens, tokenizer);
+    std::vector<ChunkResult> output;
+    for (const auto& chunk : chunks) {
+        Chunk body = chunk;
+        body.overlap_tokens = 0;
+        
+        ChunkResult result;
+        result.text = chunk_text(lines, chunk);
+        result.token_count = static_cast<int>(tokenizer.count_tokens(result.text));
+        size_t overlap_bytes = result.text.size() - chunk_text(lines, body).size();
+        result.overlap_tokens = static_cast<int>(
+            tokenizer.count_tokens(std::string_view(result.text).substr(0, overlap_bytes)));
+        result.start_page = chunk.start_page;
+        result.end_page = chunk.end_page;
+        result.has_major_heading = chunk.has_major_heading;
+        result.min_heading_level = chunk.min_heading_level;
+        output.push_back(std::move(result));
+    }
     
-    // Final recalculation of tokens to ensure accuracy
-    for (auto& chunk : chunks) {
-        chunk.tokens = tokenizer.count_tokens(chunk.text);
+    return output;
+}
+
+// Chunks pages already in memory with ChunkPipeline
+static std::vector<ChunkResult> stream_chunks(const std::vector<PageText>& pages,
+                                              const TiktokenTokenizer& tokenizer,
+                                              const LineClassifier& classifier,
+                                              int max_tokens, int overlap_tokens, int min_tokens) {
+    std::vector<ChunkResult> chunks;
+    ChunkPipeline pipeline(tokenizer, classifier, max_tokens, overlap_tokens, min_tokens,
+                           [&chunks](ChunkResult&& chunk) {
+                               chunks.push_back(std::move(chunk));
+                               return true;
+                           });
+    for (const auto& page : pages) {
+        pipeline.add_page(page);
     }
+    pipeline.finish();
     
     return chunks;
 }
+#endif // ENABLE_TESTS
 
-static void analyze_chunk_distribution(const std::vector<Chunk>& chunks) {
-    if (chunks.empty()) {
-        std::cout << "No chunks to analyze\n";
-        return;
-    }
+// Implementation of HierarchicalChunker class
+namespace fast_pdf_parser {
+
+class HierarchicalChunker::Impl {
+public:
+    ChunkOptions options;
+    TiktokenTokenizer tokenizer;
+    std::shared_ptr<ParseEngine> engine;
+    bool owns_engine = true;
+    std::mutex engine_mutex;  // chunk_file may run on several threads at once
+    std::unique_ptr<PageTextCache> page_cache;
     
-    // Collect token counts
-    std::vector<int> token_counts;
-    for (const auto& chunk : chunks) {
-        token_counts.push_back(chunk.tokens);
+    Impl(const ChunkOptions& opts, std::shared_ptr<ParseEngine> shared_engine)
+        : options(opts), engine(std::move(shared_engine)), owns_engine(!engine) {
+        configure();
     }
     
-    // Sort for quintile analysis
-    std::sort(token_counts.begin(), token_counts.end());
+    void configure() {
+        tokenizer = TiktokenTokenizer(options.tokenizer_mode);
+        if (options.token_cache_entries > 0) {
+            tokenizer.enable_count_cache(options.token_cache_entries);
+        }
+        page_cache = options.page_cache_dir.empty() ? nullptr
+            : std::make_unique<PageTextCache>(options.page_cache_dir);
+    }
     
-    // Calculate quintiles
-    auto get_quintile = [&](double percentile) -> int {
-        size_t index = static_cast<size_t>(percentile * (token_counts.size() - 1));
-        return token_counts[index];
-    };
-    
-    std::cout << "\n=== Final Chunk Distribution Analysis ===\n";
-    std::cout << "Total chunks: " << chunks.size() << "\n";
-    std::cout << "Min tokens: " << token_counts.front() << "\n";
-    std::cout << "Max tokens: " << token_counts.back() << "\n";
-    std::cout << "Average tokens: " << std::accumulate(token_counts.begin(), token_counts.end(), 0) / chunks.size() << "\n";
-    
-    std::cout << "\nQuintiles:\n";
-    std::cout << "  20th percentile: " << get_quintile(0.2) << " tokens\n";
-    std::cout << "  40th percentile: " << get_quintile(0.4) << " tokens\n";
-    std::cout << "  60th percentile: " << get_quintile(0.6) << " tokens\n";
-    std::cout << "  80th percentile: " << get_quintile(0.8) << " tokens\n";
-    
-    // Token range distribution
-    std::map<std::string, int> distribution;
-    for (int tokens : token_counts) {
-        if (tokens <= 50) distribution["1-50"]++;
-        else if (tokens <= 100) distribution["51-100"]++;
-        else if (tokens <= 150) distribution["101-150"]++;
-        else if (tokens <= 200) distribution["151-200"]++;
-        else if (tokens <= 300) distribution["201-300"]++;
-        else if (tokens <= 400) distribution["301-400"]++;
-        else if (tokens <= 500) distribution["401-500"]++;
-        else if (tokens <= 512) distribution["501-512"]++;
-        else distribution["513+"]++;
-    }
-    
-    std::cout << "\nToken Range Distribution:\n";
-    for (const auto& [range, count] : distribution) {
-        double percentage = (count * 100.0) / chunks.size();
-        std::cout << "  " << range << " tokens: " << count << " chunks (" 
-                  << std::fixed << std::setprecision(1) << percentage << "%)\n";
+    // Page cache key of a file, or "" when there is no cache or the file is
+    // missing (the parser then reports that as usual)
+    std::string page_cache_key(const PdfSource& source) const {
+        if (!page_cache || (!source.in_memory() && !fs::exists(source.name()))) {
+            return "";
+        }
+        ExtractOptions text_options;  // what PageOutput::PlainText extraction runs with
+        text_options.extract_positions = false;
+        text_options.extract_fonts = false;
+        return PageTextCache::key(content_hash(source), text_options);
     }
     
-    // Check for problematic small chunks
-    int small_chunks = 0;
-    for (int tokens : token_counts) {
-        if (tokens < DEFAULT_MIN_TOKENS) {
-            small_chunks++;
+    // Kept for the chunker's lifetime so every file reuses the same workers
+    // and their open MuPDF contexts; an owned engine is restarted when
+    // thread_count, the memory limits or the tuning change
+    std::shared_ptr<ParseEngine> get_engine() {
+        std::lock_guard<std::mutex> lock(engine_mutex);
+        if (owns_engine) {
+            size_t threads = options.thread_count > 0 ? options.thread_count : available_cpus();
+            EngineTuning tuning;
+            tuning.affinity = options.cpu_affinity;
+            tuning.auto_tune = options.auto_tune;
+            if (!engine || engine->thread_count() != threads ||
+                engine->extractor().memory_limits() != options.memory || engine->tuning() != tuning) {
+                engine = std::make_shared<ParseEngine>(threads, 0, options.memory, tuning);
+            }
         }
+        return engine;
     }
     
-    if (small_chunks > 0) {
-        std::cout << "\nWARNING: " << small_chunks << " chunks are below the minimum threshold of " 
-                  << DEFAULT_MIN_TOKENS << " tokens\n";
-    } else {
-        std::cout << "\nSUCCESS: All chunks meet the minimum threshold of " 
-                  << DEFAULT_MIN_TOKENS << " tokens\n";
+    const LineClassifier& classifier() const {
+        return options.line_classifier ? *options.line_classifier : LineClassifier::default_classifier();
     }
-}
-
-// Implementation of HierarchicalChunker class
-namespace fast_pdf_parser {
-
-class HierarchicalChunker::Impl {
-public:
-    ChunkOptions options;
-    TiktokenTokenizer tokenizer;
     
-    Impl(const ChunkOptions& opts) : options(opts) {}
-};
-
-HierarchicalChunker::HierarchicalChunker(const ChunkOptions& options) 
-    : pImpl(std::make_unique<Impl>(options)) {
-}
-
-HierarchicalChunker::~HierarchicalChunker() = default;
-
-ChunkingResult HierarchicalChunker::chunk_file(const std::string& pdf_path, int page_limit) {
-    ChunkingResult result;
-    auto start_time = std::chrono::high_resolution_clock::now();
+    // options.pages, taking at most page_limit of them
+    PageSelection page_selection(int page_limit) const {
+        PageSelection selection = options.pages;
+        if (page_limit > 0 && (selection.max_pages() <= 0 || page_limit < selection.max_pages())) {
+            selection.limit(page_limit);
+        }
+        return selection;
+    }
     
-    try {
+    // Hands a file's selected pages to on_page in order, with the pass-1
+    // annotations of their lines, skipping pages that fail to parse, until
+    // on_page returns false or page_limit pages were handed over. Parsed
+    // pages are annotated by the worker that extracted them. A file parsed
+    // in full before comes from the page cache without being opened
+    // (cache_hit is then set); otherwise its pages are stored as they
+    // arrive. Returns the number of pages handed over.
+    int read_pages(const PdfSource& source, int page_limit,
+                   const std::function<bool(PageText&&, std::vector<LineAnnotation>&&)>& on_page,
+                   bool& cache_hit) {
+        PageSelection selection = page_selection(page_limit);
+        std::unique_ptr<PageTextCache::Entry> cached;
+        std::unique_ptr<PageTextCache::Writer> cache_writer;
+        std::string cache_key = page_cache_key(source);
+        if (!cache_key.empty()) {
+            cached = page_cache->load(cache_key);
+            if (!cached && options.pages.all_pages()) {
+                cache_writer = page_cache->store(cache_key);
+            }
+            add_count(cached ? Counter::PageCacheHits : Counter::PageCacheMisses);
+        }
+        
+        int page_count = 0;
+        if (cached) {
+            // Entries hold every page, so page i is entry page i
+            for (int page : selection.resolve(static_cast<int>(cached->page_count()))) {
+                page_count++;
+                PageText text = cached->page(page);
+                std::vector<LineAnnotation> annotations = annotate_lines(text, tokenizer, classifier());
+                if (!on_page(std::move(text), std::move(annotations))) {
+                    break;
+                }
+            }
+            cache_hit = true;
+            return page_count;
+        }
+        
         // Set up parser options
         ParseOptions parse_opts;
-        parse_opts.thread_count = pImpl->options.thread_count > 0 ? 
-            pImpl->options.thread_count : std::thread::hardware_concurrency();
-        parse_opts.batch_size = 10;
         parse_opts.extract_positions = false;
         parse_opts.extract_fonts = false;
+        parse_opts.page_output = PageOutput::PlainText;  // only line text is needed
+        parse_opts.pages = selection;  // unselected pages are never extracted
         
-        FastPdfParser parser(parse_opts);
-        
-        // Extract pages
-        std::vector<std::pair<std::string, int>> pages;
-        int page_count = 0;
+        FastPdfParser parser(parse_opts, get_engine());
+        bool complete = true;  // every page parsed, so the cache entry is whole
+        AnnotationSlots annotated;
+        const LineClassifier& line_classifier = classifier();
         
-        parser.parse_streaming(pdf_path, [&](PageResult page_result) -> bool {
+        parser.parse_streaming(source, [&](PageResult page_result) -> bool {
             if (!page_result.success) {
+                complete = false;
                 return true; // Continue despite individual page errors
             }
             
             page_count++;
-            
-            // Extract text from the page result - properly formatted
-            std::string page_text;
-            if (page_result.content.contains("blocks")) {
-                for (const auto& block : page_result.content["blocks"]) {
-                    for (const auto& line : block["lines"]) {
-                        if (!page_text.empty()) page_text += "\n";
-                        page_text += line["text"].get<std::string>();
-                    }
-                }
+            if (cache_writer) {
+                cache_writer->add_page(page_result.text);
             }
             
-            pages.push_back({page_text, page_result.page_number});
+            std::vector<LineAnnotation> annotations;
+            if (!annotated.take(page_result.page_number, annotations)) {
+                annotations = annotate_lines(page_result.text, tokenizer, line_classifier);
+            }
+            if (!on_page(std::move(page_result.text), std::move(annotations))) {
+                complete = false;
+                return false;
+            }
             
             // Stop if we've hit the page limit
             if (page_limit > 0 && page_count >= page_limit) {
+                complete = false;
                 return false;
             }
             
             return true;
+        }, [&](PageResult& page_result) {
+            annotated.put(page_result.page_number,
+                          annotate_lines(page_result.text, tokenizer, line_classifier));
         });
         
-        result.total_pages = page_count;
+        if (cache_writer && complete) {
+            cache_writer->commit();
+        }
+        return page_count;
+    }
+};
+
+HierarchicalChunker::HierarchicalChunker(const ChunkOptions& options) 
+    : pImpl(std::make_unique<Impl>(options, nullptr)) {
+}
+
+HierarchicalChunker::HierarchicalChunker(const ChunkOptions& options, std::shared_ptr<ParseEngine> engine) 
+    : pImpl(std::make_unique<Impl>(options, std::move(engine))) {
+}
+
+HierarchicalChunker::~HierarchicalChunker() = default;
+
+ChunkingResult HierarchicalChunker::chunk_file(const PdfSource& source, int page_limit) {
+    std::vector<ChunkResult> chunks;
+    auto result = chunk_file_streaming(source, [&chunks](ChunkResult&& chunk) {
+        chunks.push_back(std::move(chunk));
+        return true;
+    }, page_limit);
+    result.chunks = std::move(chunks);
+    return result;
+}
+
+ChunkingResult HierarchicalChunker::chunk_file_to(const PdfSource& source, ChunkWriter& writer, int page_limit) {
+    return chunk_file_streaming(source, [&writer](ChunkResult&& chunk) {
+        writer.write(chunk);
+        return true;
+    }, page_limit);
+}
+
+ChunkingResult HierarchicalChunker::chunk_file_streaming(const PdfSource& source,
+                                                         const ChunkCallback& on_chunk,
+                                                         int page_limit) {
+    ChunkingResult result;
+    result.total_pages = 0;
+    result.total_chunks = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    try {
+        const TokenCountCache* cache = pImpl->tokenizer.count_cache();
+        uint64_t hits_before = cache ? cache->hits() : 0;
+        uint64_t misses_before = cache ? cache->misses() : 0;
         
-        // Create chunks
-        auto chunks = create_hierarchical_chunks_internal(
-            pages,
+        // Chunk pages as the parser delivers them
+        ChunkPipeline pipeline(
             pImpl->tokenizer,
+            pImpl->classifier(),
             pImpl->options.max_tokens,
             pImpl->options.overlap_tokens,
-            pImpl->options.min_tokens
+            pImpl->options.min_tokens,
+            on_chunk
         );
+        int page_count = pImpl->read_pages(source, page_limit,
+                                           [&pipeline](PageText&& page, std::vector<LineAnnotation>&& annotations) {
+            return pipeline.add_page(std::move(page), annotations);  // false once on_chunk asked to stop
+        }, result.page_cache_hit);
+        pipeline.finish();
         
-        // Convert to ChunkResult
-        for (const auto& chunk : chunks) {
-            ChunkResult chunk_result;
-            chunk_result.text = chunk.text;
-            chunk_result.token_count = chunk.tokens;
-            chunk_result.start_page = chunk.start_page;
-            chunk_result.end_page = chunk.end_page;
-            chunk_result.has_major_heading = chunk.has_major_heading;
-            chunk_result.min_heading_level = chunk.min_heading_level;
-            
-            result.chunks.push_back(chunk_result);
-        }
+        result.total_pages = page_count;
+        result.total_chunks = static_cast<int>(pipeline.chunks_emitted());
         
-        result.total_chunks = result.chunks.size();
+        if (cache) {
+            result.token_cache_hits = cache->hits() - hits_before;
+            result.token_cache_misses = cache->misses() - misses_before;
+        }
         
     } catch (const std::exception& e) {
         result.error = std::string("Error chunking PDF: ") + e.what();
@@ -633,58 +1209,410 @@ ChunkingResult HierarchicalChunker::chunk_file(const std::string& pdf_path, int
     return result;
 }
 
-bool HierarchicalChunker::process_pdf_to_json(const std::string& pdf_path, const std::string& output_path, int page_limit) {
-    try {
-        auto result = chunk_file(pdf_path, page_limit);
-        
-        if (!result.error.empty()) {
-            return false;
+void HierarchicalChunker::chunk_files(const std::vector<std::string>& pdf_paths,
+                                      const FileChunkCallback& on_file,
+                                      int page_limit) {
+    // One pipeline per file. The engine hands each file's pages over in
+    // order and one at a time, so a file's state is only ever touched by
+    // one worker at once; the tokenizer and its cache are thread-safe.
+    struct FileState {
+        std::unique_ptr<ChunkPipeline> pipeline;
+        std::vector<ChunkResult> chunks;
+        ChunkingResult result;
+        int page_count = 0;
+        std::unique_ptr<PageTextCache::Writer> cache_writer;
+        bool complete = true;  // no page failed or was skipped
+        AnnotationSlots annotated;  // pass 1, run as each page is extracted
+    };
+    std::vector<FileState> files(pdf_paths.size());
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    std::deque<size_t> done;  // files ready for on_file
+    std::atomic<bool> abandoned{false};
+    
+    auto finish_file = [&](size_t i, const std::string& error) {
+        FileState& state = files[i];
+        if (error.empty() && state.pipeline) {
+            try {
+                state.pipeline->finish();
+            } catch (const std::exception& e) {
+                state.result.error = std::string("Error chunking PDF: ") + e.what();
+            }
+        } else if (!error.empty()) {
+            state.result.error = std::string("Error chunking PDF: ") + error;
+        }
+        // With a page limit the engine stops without saying whether pages
+        // were left, so only a shorter document is known to be whole
+        if (error.empty() && state.cache_writer && state.complete &&
+            (page_limit <= 0 || state.page_count < page_limit)) {
+            state.cache_writer->commit();
         }
+        state.cache_writer.reset();
+        state.result.total_pages = state.page_count;
+        state.result.total_chunks = state.pipeline ? static_cast<int>(state.pipeline->chunks_emitted()) : 0;
+        state.result.chunks = std::move(state.chunks);
+        state.pipeline.reset();  // drops the page text
         
-        // Generate JSON output
-        nlohmann::json output = nlohmann::json::array();
-        std::hash<std::string> hasher;
-        int64_t file_hash = static_cast<int64_t>(hasher(pdf_path));
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - start_time);
+        state.result.processing_time_ms = duration.count();
         
-        for (size_t i = 0; i < result.chunks.size(); ++i) {
-            const auto& chunk = result.chunks[i];
-            
-            nlohmann::json chunk_json;
-            chunk_json["text"] = chunk.text;
-            
-            nlohmann::json meta;
-            meta["schema_name"] = "docling_core.transforms.chunker.DocMeta";
-            meta["version"] = "1.0.0";
-            meta["start_page"] = chunk.start_page;
-            meta["end_page"] = chunk.end_page;
-            meta["page_count"] = chunk.end_page - chunk.start_page + 1;
-            meta["chunk_index"] = static_cast<int>(i);
-            meta["total_chunks"] = result.total_chunks;
-            meta["token_count"] = chunk.token_count;
-            meta["has_major_heading"] = chunk.has_major_heading;
-            meta["min_heading_level"] = chunk.min_heading_level;
-            
-            nlohmann::json origin;
-            origin["mimetype"] = "application/pdf";
-            origin["binary_hash"] = file_hash;
-            origin["filename"] = fs::path(pdf_path).filename().string();
-            origin["uri"] = nullptr;
-            
-            meta["origin"] = origin;
-            meta["doc_items"] = nlohmann::json::array();
-            meta["headings"] = nlohmann::json::array();
-            meta["captions"] = nullptr;
-            
-            chunk_json["meta"] = meta;
-            output.push_back(chunk_json);
+        // Notify under the lock: the caller owns done_cv and may return as
+        // soon as it has the last file
+        std::lock_guard<std::mutex> lock(done_mutex);
+        done.push_back(i);
+        done_cv.notify_all();
+    };
+    
+    PageSelection selection = pImpl->page_selection(page_limit);
+    const TiktokenTokenizer& tokenizer = pImpl->tokenizer;
+    const LineClassifier& classifier = pImpl->classifier();
+    std::shared_ptr<ParseEngine> engine;  // started by the first file not in the page cache
+    for (size_t i = 0; i < pdf_paths.size(); ++i) {
+        FileState& state = files[i];
+        state.result.total_pages = 0;
+        state.result.total_chunks = 0;
+        
+        if (!fs::exists(pdf_paths[i])) {
+            finish_file(i, "PDF file not found: " + pdf_paths[i]);
+            continue;
         }
         
-        std::ofstream outfile(output_path);
-        outfile << output.dump(2);
-        outfile.close();
+        state.pipeline = std::make_unique<ChunkPipeline>(
+            pImpl->tokenizer,
+            pImpl->classifier(),
+            pImpl->options.max_tokens,
+            pImpl->options.overlap_tokens,
+            pImpl->options.min_tokens,
+            [&state](ChunkResult&& chunk) {
+                state.chunks.push_back(std::move(chunk));
+                return true;
+            }
+        );
         
+        // Cached files are chunked right here; hashing maps each file on
+        // this thread before its pages are queued
+        std::string cache_key;
+        try {
+            cache_key = pImpl->page_cache_key(pdf_paths[i]);
+        } catch (const std::exception&) {
+            // unreadable: left to the parser to report
+        }
+        if (!cache_key.empty()) {
+            if (auto cached = pImpl->page_cache->load(cache_key)) {
+                for (int page : selection.resolve(static_cast<int>(cached->page_count()))) {
+                    state.page_count++;
+                    state.pipeline->add_page(cached->page(page));
+                }
+                state.result.page_cache_hit = true;
+                add_count(Counter::PageCacheHits);
+                finish_file(i, "");
+                continue;
+            }
+            add_count(Counter::PageCacheMisses);
+            if (pImpl->options.pages.all_pages()) {
+                state.cache_writer = pImpl->page_cache->store(cache_key);
+            }
+        }
+        
+        ParseJob job;
+        job.source = pdf_paths[i];
+        job.page_output = PageOutput::PlainText;
+        job.pages = selection;
+        job.on_extracted = [&state, &tokenizer, &classifier](PageResult& page_result) {
+            state.annotated.put(page_result.page_number, annotate_lines(page_result.text, tokenizer, classifier));
+        };
+        job.on_page = [&state, &abandoned, &tokenizer, &classifier](PageResult page_result) -> bool {
+            if (abandoned.load(std::memory_order_relaxed)) {
+                state.complete = false;
+                return false;
+            }
+            if (!page_result.success) {
+                state.complete = false;
+                return true; // Continue despite individual page errors
+            }
+            state.page_count++;
+            if (state.cache_writer) {
+                state.cache_writer->add_page(page_result.text);
+            }
+            std::vector<LineAnnotation> annotations;
+            if (!state.annotated.take(page_result.page_number, annotations)) {
+                annotations = annotate_lines(page_result.text, tokenizer, classifier);
+            }
+            return state.pipeline->add_page(std::move(page_result.text), annotations);
+        };
+        job.on_done = [&finish_file, i](int, const std::string& error) {
+            finish_file(i, error);
+        };
+        if (!engine) {
+            engine = pImpl->get_engine();
+        }
+        engine->submit(std::move(job));
+    }
+    
+    // Every file reports back exactly once, so this also waits out the
+    // engine's references to files and the callbacks above
+    std::exception_ptr failure;
+    for (size_t reported = 0; reported < pdf_paths.size(); ++reported) {
+        size_t i;
+        {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            done_cv.wait(lock, [&done] { return !done.empty(); });
+            i = done.front();
+            done.pop_front();
+        }
+        if (failure) continue;
+        try {
+            on_file(pdf_paths[i], std::move(files[i].result));
+        } catch (...) {
+            failure = std::current_exception();
+            abandoned = true;
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+std::shared_ptr<ParseEngine> HierarchicalChunker::engine() {
+    return pImpl->get_engine();
+}
+
+PreparedDocument HierarchicalChunker::prepare(const PdfSource& source, int page_limit) {
+    auto data = std::make_shared<PreparedDocument::Data>();
+    data->tokenizer_mode = pImpl->options.tokenizer_mode;
+    
+    bool cache_hit = false;
+    pImpl->read_pages(source, page_limit, [&](PageText&& page, std::vector<LineAnnotation>&& annotations) {
+        data->pages.push_back(std::move(page));
+        data->annotations.push_back(std::move(annotations));
         return true;
+    }, cache_hit);
+    
+    PreparedDocument prepared;
+    prepared.data_ = std::move(data);
+    return prepared;
+}
+
+ChunkingResult HierarchicalChunker::chunk(const PreparedDocument& prepared, const ChunkOptions& options) const {
+    ChunkingResult result;
+    result.total_pages = prepared.page_count();
+    result.total_chunks = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    if (prepared.data_) {
+        // Only cuts and overlap boundaries are tokenized here, in the mode
+        // the stored counts were made in
+        TiktokenTokenizer tokenizer(prepared.data_->tokenizer_mode);
+        std::vector<ChunkResult> chunks;
+        ChunkPipeline pipeline(tokenizer, pImpl->classifier(),
+                               options.max_tokens, options.overlap_tokens, options.min_tokens,
+                               [&chunks](ChunkResult&& chunk) {
+                                   chunks.push_back(std::move(chunk));
+                                   return true;
+                               });
+        const auto& pages = prepared.data_->pages;
+        for (size_t p = 0; p < pages.size(); ++p) {
+            pipeline.add_annotated_page(pages[p], prepared.data_->annotations[p].data());
+        }
+        pipeline.finish();
         
+        result.total_chunks = static_cast<int>(chunks.size());
+        result.chunks = std::move(chunks);
+    }
+    
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    result.processing_time_ms = duration.count() / 1000.0;
+    return result;
+}
+
+ChunkingResult HierarchicalChunker::chunk(const PreparedDocument& prepared) const {
+    return chunk(prepared, pImpl->options);
+}
+
+int PreparedDocument::page_count() const {
+    return data_ ? static_cast<int>(data_->pages.size()) : 0;
+}
+
+size_t PreparedDocument::line_count() const {
+    size_t lines = 0;
+    if (data_) {
+        for (const auto& page : data_->pages) lines += page.line_count();
+    }
+    return lines;
+}
+
+TokenizerMode PreparedDocument::tokenizer_mode() const {
+    return data_ ? data_->tokenizer_mode : TokenizerMode::Greedy;
+}
+
+// Shard file layout, integers little-endian:
+//   "FPSHARD", u8 format version, u32 tokenizer mode, u64 binary_hash,
+//   u32 filename size, filename bytes, u32 page count
+//   per page: u32 page number, u32 text size, u32 line count, text bytes,
+//             per line: u32 offset, u32 LineType, u32 heading level, u32 tokens
+static constexpr char kShardMagic[7] = {'F', 'P', 'S', 'H', 'A', 'R', 'D'};
+static constexpr unsigned char kShardVersion = 1;
+
+static void put_le(std::ofstream& out, uint64_t value, int bytes) {
+    unsigned char buffer[8];
+    for (int i = 0; i < bytes; ++i) buffer[i] = static_cast<unsigned char>(value >> (8 * i));
+    out.write(reinterpret_cast<const char*>(buffer), bytes);
+}
+
+void PreparedDocument::save(const std::string& path, const ChunkOrigin& origin) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot create shard file: " + path);
+    }
+    
+    out.write(kShardMagic, sizeof(kShardMagic));
+    out.put(static_cast<char>(kShardVersion));
+    put_le(out, static_cast<uint32_t>(tokenizer_mode()), 4);
+    put_le(out, origin.binary_hash, 8);
+    put_le(out, origin.filename.size(), 4);
+    out.write(origin.filename.data(), origin.filename.size());
+    put_le(out, static_cast<uint32_t>(page_count()), 4);
+    
+    for (int p = 0; p < page_count(); ++p) {
+        const PageText& page = data_->pages[p];
+        const auto& annotations = data_->annotations[p];
+        put_le(out, static_cast<uint32_t>(page.page_number), 4);
+        put_le(out, page.text.size(), 4);
+        put_le(out, page.line_count(), 4);
+        out.write(page.text.data(), page.text.size());
+        for (size_t l = 0; l < page.line_count(); ++l) {
+            put_le(out, page.line_offsets[l], 4);
+            put_le(out, static_cast<uint32_t>(annotations[l].type), 4);
+            put_le(out, static_cast<uint32_t>(annotations[l].heading_level), 4);
+            put_le(out, static_cast<uint32_t>(annotations[l].tokens), 4);
+        }
+    }
+    
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Failed to write shard file: " + path);
+    }
+}
+
+PreparedDocument PreparedDocument::load(const std::string& path, ChunkOrigin* origin) {
+    PdfSource file = PdfSource::mapped_file(path);
+    const unsigned char* p = file.data();
+    const unsigned char* end = p + file.size();
+    auto damaged = [&path]() { return std::runtime_error("Damaged shard file: " + path); };
+    auto take = [&](size_t bytes) {
+        if (static_cast<size_t>(end - p) < bytes) throw damaged();
+        const unsigned char* at = p;
+        p += bytes;
+        return at;
+    };
+    auto take_le = [&](int bytes) {
+        const unsigned char* at = take(bytes);
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) value |= static_cast<uint64_t>(at[i]) << (8 * i);
+        return value;
+    };
+    
+    if (file.size() < sizeof(kShardMagic) + 1 ||
+        std::memcmp(file.data(), kShardMagic, sizeof(kShardMagic)) != 0) {
+        throw std::runtime_error("Not a shard file: " + path);
+    }
+    take(sizeof(kShardMagic));
+    if (*take(1) != kShardVersion) {
+        throw std::runtime_error("Unsupported shard version: " + path);
+    }
+    
+    auto data = std::make_shared<Data>();
+    uint32_t mode = static_cast<uint32_t>(take_le(4));
+    if (mode > static_cast<uint32_t>(TokenizerMode::ExactBpe)) throw damaged();
+    data->tokenizer_mode = static_cast<TokenizerMode>(mode);
+    ChunkOrigin stored;
+    stored.binary_hash = take_le(8);
+    size_t name_size = take_le(4);
+    stored.filename.assign(reinterpret_cast<const char*>(take(name_size)), name_size);
+    
+    uint32_t page_count = static_cast<uint32_t>(take_le(4));
+    for (uint32_t i = 0; i < page_count; ++i) {
+        PageText page;
+        page.page_number = static_cast<int>(take_le(4));
+        size_t text_size = take_le(4);
+        size_t line_count = take_le(4);
+        if (i > 0 && page.page_number <= data->pages.back().page_number) throw damaged();
+        page.text.assign(reinterpret_cast<const char*>(take(text_size)), text_size);
+        if (line_count > static_cast<size_t>(end - p) / 16) throw damaged();
+        
+        std::vector<LineAnnotation> annotations(line_count);
+        page.line_offsets.resize(line_count);
+        for (size_t l = 0; l < line_count; ++l) {
+            uint32_t offset = static_cast<uint32_t>(take_le(4));
+            uint32_t type = static_cast<uint32_t>(take_le(4));
+            if (offset >= text_size || (l == 0 ? offset != 0 : offset <= page.line_offsets[l - 1]) ||
+                type > static_cast<uint32_t>(LineType::CODE_BLOCK)) {
+                throw damaged();
+            }
+            page.line_offsets[l] = offset;
+            annotations[l].type = static_cast<LineType>(type);
+            annotations[l].heading_level = static_cast<int>(take_le(4));
+            annotations[l].tokens = static_cast<int>(take_le(4));
+        }
+        if (line_count > 0 && page.text.back() != '\n') throw damaged();
+        
+        data->pages.push_back(std::move(page));
+        data->annotations.push_back(std::move(annotations));
+    }
+    if (p != end) throw damaged();
+    
+    if (origin) *origin = std::move(stored);
+    PreparedDocument prepared;
+    prepared.data_ = std::move(data);
+    return prepared;
+}
+
+PreparedDocument PreparedDocument::concatenate(const std::vector<PreparedDocument>& shards) {
+    std::vector<const Data*> parts;
+    for (const auto& shard : shards) {
+        if (shard.page_count() > 0) parts.push_back(shard.data_.get());
+    }
+    std::sort(parts.begin(), parts.end(), [](const Data* a, const Data* b) {
+        return a->pages.front().page_number < b->pages.front().page_number;
+    });
+    
+    auto data = std::make_shared<Data>();
+    data->tokenizer_mode = parts.empty() ? TokenizerMode::Greedy : parts.front()->tokenizer_mode;
+    for (const Data* part : parts) {
+        if (part->tokenizer_mode != data->tokenizer_mode) {
+            throw std::invalid_argument("Shards were prepared with different tokenizer modes");
+        }
+        if (!data->pages.empty() && part->pages.front().page_number <= data->pages.back().page_number) {
+            throw std::invalid_argument("Shards overlap at page " +
+                                        std::to_string(part->pages.front().page_number + 1));
+        }
+        data->pages.insert(data->pages.end(), part->pages.begin(), part->pages.end());
+        data->annotations.insert(data->annotations.end(), part->annotations.begin(), part->annotations.end());
+    }
+    
+    PreparedDocument joined;
+    joined.data_ = std::move(data);
+    return joined;
+}
+
+bool HierarchicalChunker::process_pdf_to_json(const std::string& pdf_path, const std::string& output_path, int page_limit) {
+    try {
+        // Docling's binary_hash identifies the document's bytes, not its path
+        ChunkOrigin origin{fs::path(pdf_path).filename().string(), content_hash(PdfSource(pdf_path))};
+        auto writer = ChunkWriter::create(ChunkFormat::Json, output_path, origin);
+        
+        auto result = chunk_file_to(pdf_path, *writer, page_limit);
+        if (!result.error.empty()) {
+            return false;
+        }
+        
+        writer->finish();
+        return true;
+    
     } catch (const std::exception& e) {
         return false;
     }
@@ -696,6 +1624,47 @@ ChunkOptions HierarchicalChunker::get_options() const {
 
 void HierarchicalChunker::set_options(const ChunkOptions& options) {
     pImpl->options = options;
+    pImpl->configure();
+}
+
+class StreamingChunker::Impl {
+public:
+    ChunkOptions options;
+    TiktokenTokenizer tokenizer;
+    ChunkPipeline pipeline;
+    
+    Impl(const ChunkOptions& opts, ChunkCallback on_chunk)
+        : options(opts),
+          tokenizer(opts.tokenizer_mode),
+          pipeline(tokenizer,
+                   options.line_classifier ? *options.line_classifier
+                                           : LineClassifier::default_classifier(),
+                   options.max_tokens,
+                   options.overlap_tokens,
+                   options.min_tokens,
+                   std::move(on_chunk)) {
+        if (options.token_cache_entries > 0) {
+            tokenizer.enable_count_cache(options.token_cache_entries);
+        }
+    }
+};
+
+StreamingChunker::StreamingChunker(const ChunkOptions& options, ChunkCallback on_chunk)
+    : pImpl(std::make_unique<Impl>(options, std::move(on_chunk))) {
+}
+
+StreamingChunker::~StreamingChunker() = default;
+
+bool StreamingChunker::add_page(PageText page) {
+    return pImpl->pipeline.add_page(std::move(page));
+}
+
+bool StreamingChunker::finish() {
+    return pImpl->pipeline.finish();
+}
+
+size_t StreamingChunker::chunks_emitted() const {
+    return pImpl->pipeline.chunks_emitted();
 }
 
 } // namespace fast_pdf_parser
@@ -704,6 +1673,55 @@ void HierarchicalChunker::set_options(const ChunkOptions& options) {
 #ifdef ENABLE_TESTS
 #include "../deps/doctest.h"
 
+// Every field of every chunk, in order
+static void check_same_chunks(const std::vector<ChunkResult>& actual,
+                              const std::vector<ChunkResult>& expected) {
+    REQUIRE(actual.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        CAPTURE(i);
+        CHECK(actual[i].text == expected[i].text);
+        CHECK(actual[i].token_count == expected[i].token_count);
+        CHECK(actual[i].overlap_tokens == expected[i].overlap_tokens);
+        CHECK(actual[i].start_page == expected[i].start_page);
+        CHECK(actual[i].end_page == expected[i].end_page);
+        CHECK(actual[i].has_major_heading == expected[i].has_major_heading);
+        CHECK(actual[i].min_heading_level == expected[i].min_heading_level);
+    }
+}
+
+// Synthetic pages of the given number of lines each, laid out like the
+// extractor's PageText; line_for(page, line) gives a line's text
+static std::vector<PageText> make_pages(int count, int lines,
+                                        const std::function<std::string(int page, int line)>& line_for) {
+    std::vector<PageText> pages(count);
+    for (int p = 0; p < count; ++p) {
+        pages[p].page_number = p;
+        for (int l = 0; l < lines; ++l) {
+            pages[p].line_offsets.push_back(static_cast<uint32_t>(pages[p].text.size()));
+            pages[p].text += line_for(p, l) + "\n";
+        }
+    }
+    return pages;
+}
+
+// Writes bytes to pdf_path and stores pages as their page cache entry, so
+// chunking the file never reaches MuPDF
+static void write_cached_document(const std::string& pdf_path, const std::string& bytes,
+                                  const std::vector<PageText>& pages, const std::string& cache_dir) {
+    {
+        std::ofstream out(pdf_path, std::ios::binary);
+        out << bytes;
+    }
+    ExtractOptions text_options;
+    text_options.extract_positions = false;
+    text_options.extract_fonts = false;
+    PageTextCache cache(cache_dir);
+    auto writer = cache.store(PageTextCache::key(content_hash(bytes.data(), bytes.size()), text_options));
+    REQUIRE(writer != nullptr);
+    for (const auto& page : pages) writer->add_page(page);
+    REQUIRE(writer->commit());
+}
+
 TEST_CASE("HierarchicalChunker text chunking") {
     using namespace fast_pdf_parser;
     
@@ -737,6 +1755,452 @@ TEST_CASE("HierarchicalChunker text chunking") {
     }
 }
 
+TEST_CASE("Chunk passes over the line arena") {
+    using namespace fast_pdf_parser;
+    
+    // Runs of blank lines after a full stop tokenize differently once the
+    // lines are joined
+    std::vector<PageText> pages = make_pages(2, 40, [](int, int l) {
+        return l % 10 == 0 ? "## Section " + std::to_string(l)
+             : l % 4 == 0 || l % 5 == 0 ? std::string()
+             : "Some ordinary words on line " + std::to_string(l) + ".";
+    });
+    std::string expected = pages[0].text + pages[1].text;
+    
+    for (TokenizerMode mode : {TokenizerMode::Greedy, TokenizerMode::ExactBpe}) {
+        TiktokenTokenizer tokenizer(mode);
+        auto chunks = stream_chunks(pages, tokenizer, LineClassifier::default_classifier(), 100, 0, 30);
+        REQUIRE(!chunks.empty());
+        check_same_chunks(chunks, create_hierarchical_chunks_internal(
+            pages, tokenizer, LineClassifier::default_classifier(), 100, 0, 30));
+        
+        std::string joined;
+        for (const auto& chunk : chunks) {
+            joined += chunk.text;
+            CHECK(chunk.token_count <= 100);
+            CHECK(chunk.start_page <= chunk.end_page);
+            CHECK(chunk.token_count == static_cast<int>(tokenizer.count_tokens(chunk.text)));
+        }
+        CHECK(joined == expected);
+        CHECK(chunks.front().start_page == 0);
+        CHECK(chunks.back().end_page == 1);
+    }
+}
+
+TEST_CASE("Overlap and long lines are cut at token boundaries") {
+    using namespace fast_pdf_parser;
+    
+    // One paragraph far longer than a chunk, then some short lines
+    std::string paragraph;
+    for (int w = 0; w < 600; ++w) paragraph += "word" + std::to_string(w % 37) + " ";
+    const std::string lines[] = {paragraph, "A short line.", "Another one."};
+    std::vector<PageText> pages = make_pages(1, 3, [&lines](int, int l) { return lines[l]; });
+    
+    for (TokenizerMode mode : {TokenizerMode::Greedy, TokenizerMode::ExactBpe}) {
+        TiktokenTokenizer tokenizer(mode);
+        auto chunks = stream_chunks(pages, tokenizer, LineClassifier::default_classifier(), 200, 20, 50);
+        REQUIRE(chunks.size() > 1);
+        check_same_chunks(chunks, create_hierarchical_chunks_internal(
+            pages, tokenizer, LineClassifier::default_classifier(), 200, 20, 50));
+        CHECK(chunks.front().overlap_tokens == 0);
+        
+        std::string joined = chunks.front().text;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            CHECK(chunks[i].token_count <= 200);
+            if (i == 0) continue;
+            
+            // The overlap is exactly the last overlap_tokens tokens of the
+            // previous chunk, and overlap_tokens is the count of that text
+            const std::string& prev = chunks[i - 1].text;
+            std::vector<uint32_t> offsets = tokenizer.token_offsets(prev);
+            CHECK(chunks[i].overlap_tokens == 20);
+            std::string tail = prev.substr(offsets[offsets.size() - 1 - chunks[i].overlap_tokens]);
+            REQUIRE(chunks[i].text.compare(0, tail.size(), tail) == 0);
+            CHECK(chunks[i].overlap_tokens == static_cast<int>(tokenizer.count_tokens(tail)));
+            joined += chunks[i].text.substr(tail.size());
+        }
+        CHECK(joined == pages[0].text);
+    }
+}
+
+TEST_CASE("StreamingChunker matches whole-document chunking") {
+    using namespace fast_pdf_parser;
+    
+    std::vector<PageText> pages = make_pages(30, 25, [](int p, int l) {
+        return l % 12 == 0 ? "# Part " + std::to_string(p) : l % 7 == 0 ? std::string()
+             : "Line " + std::to_string(l) + " of page " + std::to_string(p) + " with some text.";
+    });
+    
+    ChunkOptions opts;
+    opts.max_tokens = 120;
+    opts.min_tokens = 40;
+    opts.overlap_tokens = 15;
+    TiktokenTokenizer tokenizer;
+    auto expected = create_hierarchical_chunks_internal(pages, tokenizer, LineClassifier::default_classifier(),
+                                                        opts.max_tokens, opts.overlap_tokens, opts.min_tokens);
+    
+    SUBCASE("Same chunks, emitted before the last page") {
+        std::vector<ChunkResult> streamed;
+        size_t emitted_before_last = 0;
+        StreamingChunker chunker(opts, [&](ChunkResult&& chunk) {
+            streamed.push_back(std::move(chunk));
+            return true;
+        });
+        for (size_t p = 0; p < pages.size(); ++p) {
+            if (p + 1 == pages.size()) emitted_before_last = streamed.size();
+            CHECK(chunker.add_page(pages[p]));
+        }
+        CHECK(chunker.finish());
+        
+        CHECK(emitted_before_last > 0);
+        CHECK(chunker.chunks_emitted() == expected.size());
+        check_same_chunks(streamed, expected);
+    }
+    
+    SUBCASE("Same chunks at every size and in both tokenizer modes") {
+        // Heading levels, runs of blanks, one-line sections that the merge
+        // heuristics and vetoes have to decide on, lines long enough to be
+        // cut, pages that end in a blank before a heading on the next one,
+        // an empty page and a small last section
+        std::vector<PageText> varied(17);
+        for (int p = 0; p < 17; ++p) {
+            varied[p].page_number = p;
+            int line_count = p == 9 ? 0 : p == 16 ? 3 : 25 + (p * 7) % 20;
+            for (int l = 0; l < line_count; ++l) {
+                std::string line;
+                if (p % 4 == 1) {
+                    // Sections followed by a small subsection, which pass 4 may merge
+                    line = l % 6 == 0 ? "## Topic " + std::to_string(l) : l % 6 == 4 ? "### Note"
+                         : l % 6 == 5 ? "Short." : "Sentence " + std::to_string(l) + " on page " + std::to_string(p) + ".";
+                } else if (l % 13 == 0) line = std::string(1 + (p + l) % 3, '#') + " Heading " + std::to_string(p);
+                else if (l % 11 == 0 || l % 11 == 1 || (p % 2 == 0 && l == line_count - 1)) line = "";
+                else if (l == 20 && p % 3 == 0) for (int w = 0; w < 90; ++w) line += "term" + std::to_string(w) + " ";
+                else if (l % 17 == 5 || p % 4 == 3) line = "Short.";
+                else line = "Sentence " + std::to_string(l) + " on page " + std::to_string(p) + ", which goes on.";
+                varied[p].line_offsets.push_back(static_cast<uint32_t>(varied[p].text.size()));
+                varied[p].text += line + "\n";
+            }
+        }
+        
+        struct Sizes { int max_tokens, min_tokens, overlap_tokens; };
+        for (TokenizerMode mode : {TokenizerMode::Greedy, TokenizerMode::ExactBpe}) {
+            TiktokenTokenizer mode_tokenizer(mode);
+            for (Sizes sizes : {Sizes{512, 150, 0}, Sizes{512, 150, 50}, Sizes{120, 40, 15},
+                                Sizes{64, 30, 8}, Sizes{40, 39, 0}, Sizes{35, 34, 0},
+                                Sizes{100, 95, 10}, Sizes{150, 140, 0}, Sizes{1000, 300, 100}}) {
+                CAPTURE(sizes.max_tokens);
+                CAPTURE(sizes.overlap_tokens);
+                ChunkOptions sized;
+                sized.tokenizer_mode = mode;
+                sized.max_tokens = sizes.max_tokens;
+                sized.min_tokens = sizes.min_tokens;
+                sized.overlap_tokens = sizes.overlap_tokens;
+                
+                std::vector<ChunkResult> streamed;
+                StreamingChunker chunker(sized, [&](ChunkResult&& chunk) {
+                    streamed.push_back(std::move(chunk));
+                    return true;
+                });
+                for (const auto& page : varied) chunker.add_page(page);
+                chunker.finish();
+                
+                check_same_chunks(streamed, create_hierarchical_chunks_internal(
+                    varied, mode_tokenizer, LineClassifier::default_classifier(),
+                    sizes.max_tokens, sizes.overlap_tokens, sizes.min_tokens));
+            }
+        }
+    }
+    
+    SUBCASE("The callback can stop the stream") {
+        int calls = 0;
+        StreamingChunker chunker(opts, [&](ChunkResult&&) { return ++calls < 2; });
+        bool accepted = true;
+        for (const auto& page : pages) accepted = accepted && chunker.add_page(page);
+        CHECK_FALSE(accepted);
+        CHECK_FALSE(chunker.finish());
+        CHECK(calls == 2);
+    }
+}
+
+// Lines of the kinds PDFs hold: prose, headings, code, tables of figures
+// and text outside ASCII
+static const char* const kSampleLines[] = {
+    "# 1 Introduction",
+    "The semantic descriptions in this International Standard define a parameterized",
+    "nondeterministic abstract machine. This International Standard places no requirement",
+    "on the structure of conforming implementations. In particular, they need not copy or",
+    "emulate the structure of the abstract machine.",
+    "",
+    "## 1.1 Scope",
+    "Certain aspects and operations of the abstract machine are described in this",
+    "International Standard as implementation-defined (for example, sizeof(int)).",
+    "    for (size_t i = 0; i < page.line_count(); ++i) {",
+    "        tokens += tokenizer.count_tokens(line_with_newline(page, i));",
+    "    }",
+    "Table 3 - Throughput at 1, 2, 4 and 8 threads",
+    "1 thread     41.7 pages/s    12.3 MB/s",
+    "8 threads   288.4 pages/s    85.1 MB/s",
+    "Revenue grew 14.2% year over year, to $3,512,000 in fiscal 2023.",
+    "- Appendix B lists every grammar production; see [dcl.fct] and [temp.res].",
+    "Les résultats présentés ici confirment l'hypothèse énoncée plus haut.",
+    "Die Ergebnisse bestätigen die oben formulierte Hypothese größtenteils.",
+    "東京大学の研究チームは新しい手法を提案した。",
+    "Build passed ✅ on all platforms 🎉 — see the release notes.",
+    "https://example.com/docs/v2/api?query=chunk&limit=512#overview",
+};
+
+TEST_CASE("estimate_tokens stays within estimate_error_bound") {
+    using namespace fast_pdf_parser;
+    
+    CHECK(TiktokenTokenizer::estimate_tokens("") == 0);
+    CHECK(TiktokenTokenizer::estimate_error_bound(0) == 0);
+    CHECK(TiktokenTokenizer::estimate_error_bound(60) > TiktokenTokenizer::estimate_error_bound(6));
+    
+    for (TokenizerMode mode : {TokenizerMode::Greedy, TokenizerMode::ExactBpe}) {
+        TiktokenTokenizer tokenizer(mode);
+        size_t estimated = 0;
+        size_t exact = 0;
+        for (const char* text : kSampleLines) {
+            std::string line = std::string(text) + "\n";
+            size_t estimate = TiktokenTokenizer::estimate_tokens(line);
+            size_t count = tokenizer.count_tokens(line);
+            CAPTURE(line);
+            CHECK(estimate >= 1);
+            CHECK(std::abs(static_cast<int>(count) - static_cast<int>(estimate)) <=
+                  static_cast<int>(TiktokenTokenizer::estimate_error_bound(estimate)));
+            estimated += estimate;
+            exact += count;
+        }
+        CHECK(std::abs(static_cast<double>(estimated) - exact) <= 0.1 * exact);
+    }
+}
+
+TEST_CASE("Page text cache hits skip parsing") {
+    using namespace fast_pdf_parser;
+    
+    auto dir = fs::temp_directory_path() / "fast_pdf_parser_chunker_cache_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    
+    std::string bytes = "not really a pdf";
+    auto pdf_path = (dir / "doc.pdf").string();
+    
+    std::vector<PageText> pages = make_pages(3, 20, [](int p, int l) {
+        return l == 0 ? "# Section " + std::to_string(p)
+             : "Sentence " + std::to_string(l) + " on page " + std::to_string(p) + ".";
+    });
+    
+    ChunkOptions opts;
+    opts.max_tokens = 100;
+    opts.min_tokens = 20;
+    opts.page_cache_dir = (dir / "cache").string();
+    write_cached_document(pdf_path, bytes, pages, opts.page_cache_dir);
+    
+    TiktokenTokenizer tokenizer;
+    auto expected = create_hierarchical_chunks_internal(pages, tokenizer, LineClassifier::default_classifier(),
+                                                        opts.max_tokens, opts.overlap_tokens, opts.min_tokens);
+    HierarchicalChunker chunker(opts);
+    
+    SUBCASE("chunk_file, from a path or a buffer with the same bytes") {
+        for (const PdfSource& source : {PdfSource(pdf_path), PdfSource::memory(bytes)}) {
+            ChunkingResult result = chunker.chunk_file(source);
+            CHECK(result.error.empty());
+            CHECK(result.page_cache_hit);
+            CHECK(result.total_pages == 3);
+            REQUIRE(result.chunks.size() == expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                CHECK(result.chunks[i].text == expected[i].text);
+                CHECK(result.chunks[i].end_page == expected[i].end_page);
+            }
+        }
+        
+        CHECK(chunker.chunk_file(pdf_path, 2).total_pages == 2);
+    }
+    
+    SUBCASE("chunk_files") {
+        int files = 0;
+        chunker.chunk_files({pdf_path}, [&](const std::string&, ChunkingResult&& result) {
+            files++;
+            CHECK(result.page_cache_hit);
+            CHECK(result.chunks.size() == expected.size());
+        });
+        CHECK(files == 1);
+    }
+    
+    SUBCASE("Counted in the metrics") {
+        reset_metrics();
+        ChunkingResult result = chunker.chunk_file(pdf_path);
+        chunker.chunk_files({pdf_path}, [](const std::string&, ChunkingResult&&) {});
+        
+        nlohmann::json snapshot = metrics_snapshot();
+        CHECK(snapshot["counters"]["page_cache_hits"] == 2);
+        CHECK(snapshot["counters"]["pages_extracted"] == 0);
+        CHECK(snapshot["counters"]["lines_annotated"] == 120);
+        CHECK(snapshot["counters"]["chunks_emitted"] == 2 * result.total_chunks);
+        CHECK(snapshot["stages"]["tokenize"]["count"] == 6);
+        CHECK(snapshot["stages"]["chunk"]["count"].get<int>() >= 6);
+        reset_metrics();
+    }
+    
+    SUBCASE("Page selection") {
+        std::vector<PageText> last_page = {pages[2]};
+        auto expected_last = create_hierarchical_chunks_internal(last_page, tokenizer,
+                                                                 LineClassifier::default_classifier(),
+                                                                 opts.max_tokens, opts.overlap_tokens, opts.min_tokens);
+        ChunkOptions selected = opts;
+        selected.pages = PageSelection::parse("z");
+        chunker.set_options(selected);
+        
+        ChunkingResult result = chunker.chunk_file(pdf_path);
+        CHECK(result.page_cache_hit);
+        CHECK(result.total_pages == 1);
+        REQUIRE(result.chunks.size() == expected_last.size());
+        CHECK(result.chunks.front().start_page == 2);
+        CHECK(result.chunks.back().text == expected_last.back().text);
+        
+        selected.pages = PageSelection::parse("1-z:2");
+        chunker.set_options(selected);
+        CHECK(chunker.chunk_file(pdf_path).total_pages == 2);
+        CHECK(chunker.chunk_file(pdf_path, 1).total_pages == 1);
+        chunker.chunk_files({pdf_path}, [&](const std::string&, ChunkingResult&& result) {
+            CHECK(result.total_pages == 2);
+            CHECK(result.chunks.back().end_page == 2);
+        });
+    }
+    
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Prepared documents re-chunk like chunk_file") {
+    using namespace fast_pdf_parser;
+    
+    auto dir = fs::temp_directory_path() / "fast_pdf_parser_prepare_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    
+    // Headings, blanks and a few very long lines, which get cut at sizes
+    // that depend on max_tokens
+    std::vector<PageText> pages = make_pages(12, 30, [](int p, int l) {
+        std::string line;
+        if (l % 10 == 0) line = "## Heading " + std::to_string(p) + "." + std::to_string(l);
+        else if (l % 9 == 0) line = "";
+        else if (l == 17) for (int w = 0; w < 120; ++w) line += "word" + std::to_string(w) + " ";
+        else line = "Body line " + std::to_string(l) + " on page " + std::to_string(p) + " of the document.";
+        return line;
+    });
+    
+    ChunkOptions opts;
+    opts.page_cache_dir = (dir / "cache").string();
+    auto pdf_path = (dir / "doc.pdf").string();
+    write_cached_document(pdf_path, "prepared document bytes", pages, opts.page_cache_dir);
+    
+    HierarchicalChunker chunker(opts);
+    PreparedDocument prepared = chunker.prepare(pdf_path);
+    CHECK(prepared.page_count() == 12);
+    CHECK(prepared.line_count() == 12 * 30);
+    
+    struct Sizes { int max_tokens, min_tokens, overlap_tokens; };
+    for (Sizes sizes : {Sizes{512, 150, 0}, Sizes{200, 60, 20}, Sizes{64, 16, 8}, Sizes{1000, 300, 100}}) {
+        ChunkOptions sized = opts;
+        sized.max_tokens = sizes.max_tokens;
+        sized.min_tokens = sizes.min_tokens;
+        sized.overlap_tokens = sizes.overlap_tokens;
+        
+        ChunkingResult expected = HierarchicalChunker(sized).chunk_file(pdf_path);
+        ChunkingResult result = chunker.chunk(prepared, sized);
+        REQUIRE(expected.error.empty());
+        CHECK(result.error.empty());
+        CHECK(result.total_pages == expected.total_pages);
+        REQUIRE(result.chunks.size() == expected.chunks.size());
+        for (size_t i = 0; i < expected.chunks.size(); ++i) {
+            CHECK(result.chunks[i].text == expected.chunks[i].text);
+            CHECK(result.chunks[i].token_count == expected.chunks[i].token_count);
+            CHECK(result.chunks[i].overlap_tokens == expected.chunks[i].overlap_tokens);
+            CHECK(result.chunks[i].start_page == expected.chunks[i].start_page);
+            CHECK(result.chunks[i].min_heading_level == expected.chunks[i].min_heading_level);
+        }
+    }
+    
+    CHECK(chunker.prepare(pdf_path, 5).page_count() == 5);
+    CHECK(chunker.chunk(PreparedDocument()).chunks.empty());
+    
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Shards join into the whole document") {
+    using namespace fast_pdf_parser;
+    
+    auto dir = fs::temp_directory_path() / "fast_pdf_parser_shard_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    
+    std::vector<PageText> pages = make_pages(9, 25, [](int p, int l) {
+        return l == 0 ? "# Part " + std::to_string(p) : l % 10 == 0 ? std::string()
+             : "Line " + std::to_string(l) + " of page " + std::to_string(p) + ", which carries on a bit.";
+    });
+    
+    ChunkOptions opts;
+    opts.max_tokens = 120;
+    opts.min_tokens = 40;
+    opts.overlap_tokens = 10;
+    opts.page_cache_dir = (dir / "cache").string();
+    auto pdf_path = (dir / "doc.pdf").string();
+    write_cached_document(pdf_path, "sharded document bytes", pages, opts.page_cache_dir);
+    ChunkingResult expected = HierarchicalChunker(opts).chunk_file(pdf_path);
+    REQUIRE(expected.error.empty());
+    
+    // Saved out of page order, and loaded back
+    ChunkOrigin origin{"doc.pdf", 42};
+    std::vector<PreparedDocument> shards;
+    for (const char* range : {"7-9", "1-3", "4-6"}) {
+        ChunkOptions shard_opts = opts;
+        shard_opts.pages = PageSelection::parse(range);
+        auto shard_path = (dir / (std::string("shard-") + range)).string();
+        HierarchicalChunker(shard_opts).prepare(pdf_path).save(shard_path, origin);
+        
+        ChunkOrigin loaded_origin;
+        shards.push_back(PreparedDocument::load(shard_path, &loaded_origin));
+        CHECK(shards.back().page_count() == 3);
+        CHECK(loaded_origin.filename == "doc.pdf");
+        CHECK(loaded_origin.binary_hash == 42);
+    }
+    
+    SUBCASE("Same chunks as chunking every page at once") {
+        PreparedDocument joined = PreparedDocument::concatenate(shards);
+        CHECK(joined.page_count() == 9);
+        ChunkingResult result = HierarchicalChunker(opts).chunk(joined);
+        REQUIRE(result.chunks.size() == expected.chunks.size());
+        for (size_t i = 0; i < expected.chunks.size(); ++i) {
+            CHECK(result.chunks[i].text == expected.chunks[i].text);
+            CHECK(result.chunks[i].token_count == expected.chunks[i].token_count);
+            CHECK(result.chunks[i].start_page == expected.chunks[i].start_page);
+            CHECK(result.chunks[i].end_page == expected.chunks[i].end_page);
+        }
+    }
+    
+    SUBCASE("Overlapping or mismatched shards are refused") {
+        CHECK_THROWS_AS(PreparedDocument::concatenate({shards[0], shards[1], shards[0]}), std::invalid_argument);
+        
+        ChunkOptions exact = opts;
+        exact.tokenizer_mode = TokenizerMode::ExactBpe;
+        exact.pages = PageSelection::parse("4-6");
+        auto exact_path = (dir / "shard-exact").string();
+        HierarchicalChunker(exact).prepare(pdf_path).save(exact_path, origin);
+        CHECK_THROWS_AS(PreparedDocument::concatenate({shards[1], PreparedDocument::load(exact_path)}),
+                        std::invalid_argument);
+    }
+    
+    SUBCASE("Damaged files are refused") {
+        auto shard_path = (dir / "shard-1-3").string();
+        auto size = fs::file_size(shard_path);
+        fs::resize_file(shard_path, size - 5);
+        CHECK_THROWS_AS(PreparedDocument::load(shard_path), std::runtime_error);
+        CHECK_THROWS_AS(PreparedDocument::load(pdf_path), std::runtime_error);
+    }
+    
+    fs::remove_all(dir);
+}
+
 TEST_CASE("ChunkResult structure") {
     using namespace fast_pdf_parser;
     
@@ -0,0 +1,248 @@
+#include "fast_pdf_parser/line_classifier.h"
+
+namespace fast_pdf_parser {
+
+namespace {
+
+// ASCII whitespace, as matched by \s and ::isspace in the C locale
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool is_line_break(char c) {
+    return c == '\n' || c == '\r';
+}
+
+// Whether line[pos..] is "\s+(.+)$": at least one whitespace character and
+// then at least one more character, with no line break in that last part.
+bool whitespace_then_text(std::string_view line, size_t pos) {
+    if (pos >= line.size() || !is_space(line[pos])) return false;
+    
+    size_t last_break = std::string_view::npos;
+    for (size_t i = pos; i < line.size(); ++i) {
+        if (is_line_break(line[i])) last_break = i;
+    }
+    if (last_break == std::string_view::npos) return line.size() > pos + 1;
+    
+    // The text part has to start after the last break
+    for (size_t i = pos; i < last_break; ++i) {
+        if (!is_space(line[i])) return false;
+    }
+    return last_break + 1 < line.size();
+}
+
+// Byte length of the list bullet at line[pos], 0 if there is none
+size_t bullet_length(std::string_view line, size_t pos) {
+    static constexpr std::string_view kBullets[] = {
+        "-", "*", "+",
+        "\xE2\x80\xA2",  // • U+2022
+        "\xE2\x97\xA6",  // ◦ U+25E6
+        "\xE2\x96\xAA",  // ▪ U+25AA
+        "\xE2\x97\x8F",  // ● U+25CF
+        "\xE2\x80\xA3",  // ‣ U+2023
+        "\xE2\x81\x83",  // ⁃ U+2043
+    };
+    std::string_view rest = line.substr(pos);
+    for (std::string_view bullet : kBullets) {
+        if (rest.substr(0, bullet.size()) == bullet) return bullet.size();
+    }
+    return 0;
+}
+
+bool is_blank(std::string_view line) {
+    for (char c : line) {
+        if (!is_space(c)) return false;
+    }
+    return true;
+}
+
+bool classify_heading(std::string_view line, LineClass& out) {
+    size_t level = 0;
+    while (level < line.size() && line[level] == '#') ++level;
+    if (level == 0 || !whitespace_then_text(line, level)) return false;
+    
+    out.type = level <= 2 ? LineType::MAJOR_HEADING : LineType::MINOR_HEADING;
+    out.heading_level = static_cast<int>(level);
+    return true;
+}
+
+bool is_list_item(std::string_view line) {
+    size_t i = 0;
+    while (i < line.size() && is_space(line[i])) ++i;
+    
+    if (size_t bullet = bullet_length(line, i)) {
+        return whitespace_then_text(line, i + bullet);
+    }
+    
+    size_t digits_end = i;
+    while (digits_end < line.size() && is_digit(line[digits_end])) ++digits_end;
+    return digits_end > i && digits_end < line.size() && line[digits_end] == '.' &&
+           whitespace_then_text(line, digits_end + 1);
+}
+
+bool is_code(std::string_view line) {
+    return line.find("```") != std::string_view::npos || line.substr(0, 2) == "  ";
+}
+
+} // namespace
+
+LineClass LineClassifier::classify(std::string_view line) const {
+    LineClass result;
+    if (is_blank(line)) {
+        result.type = LineType::BLANK;
+        return result;
+    }
+    
+    for (const auto& rule : rules_) {
+        LineClass custom;
+        if (rule(line, custom)) return custom;
+    }
+    
+    if (classify_heading(line, result)) return result;
+    
+    if (is_list_item(line)) {
+        result.type = LineType::LIST_ITEM;
+    } else if (is_code(line)) {
+        result.type = LineType::CODE_BLOCK;
+    }
+    return result;
+}
+
+void LineClassifier::add_rule(Rule rule) {
+    rules_.push_back(std::move(rule));
+}
+
+LineClassifier::Rule LineClassifier::numbered_section_rule() {
+    return [](std::string_view line, LineClass& out) {
+        if (line.size() > 80) return false;
+        
+        // Dot-separated numbers, optionally ending in a dot
+        size_t i = 0;
+        int components = 0;
+        for (;;) {
+            size_t start = i;
+            while (i < line.size() && is_digit(line[i])) ++i;
+            if (i == start) return false;
+            ++components;
+            if (i < line.size() && line[i] == '.') {
+                ++i;
+                if (i < line.size() && is_digit(line[i])) continue;
+            }
+            break;
+        }
+        if (components < 2) return false;
+        
+        if (i >= line.size() || (line[i] != ' ' && line[i] != '\t')) return false;
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) ++i;
+        
+        // Title starts with a capital (any non-ASCII letter is accepted)
+        unsigned char first = i < line.size() ? static_cast<unsigned char>(line[i]) : 0;
+        if (!((first >= 'A' && first <= 'Z') || first >= 0x80)) return false;
+        
+        out.type = components <= 2 ? LineType::MAJOR_HEADING : LineType::MINOR_HEADING;
+        out.heading_level = components;
+        return true;
+    };
+}
+
+const LineClassifier& LineClassifier::default_classifier() {
+    static const LineClassifier classifier;
+    return classifier;
+}
+
+} // namespace fast_pdf_parser
+
+// Unit tests
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+
+TEST_CASE("LineClassifier built-in rules") {
+    using namespace fast_pdf_parser;
+    const LineClassifier& classifier = LineClassifier::default_classifier();
+    
+    SUBCASE("Blank lines") {
+        CHECK(classifier.classify("").type == LineType::BLANK);
+        CHECK(classifier.classify(" \t ").type == LineType::BLANK);
+    }
+    
+    SUBCASE("Markdown headings") {
+        auto h1 = classifier.classify("# Title");
+        CHECK(h1.type == LineType::MAJOR_HEADING);
+        CHECK(h1.heading_level == 1);
+        
+        auto h2 = classifier.classify("## Section");
+        CHECK(h2.type == LineType::MAJOR_HEADING);
+        CHECK(h2.heading_level == 2);
+        
+        auto h4 = classifier.classify("#### Detail");
+        CHECK(h4.type == LineType::MINOR_HEADING);
+        CHECK(h4.heading_level == 4);
+        
+        CHECK(classifier.classify("#hashtag").type == LineType::NORMAL);
+        CHECK(classifier.classify("## ").type == LineType::NORMAL);
+    }
+    
+    SUBCASE("List items") {
+        CHECK(classifier.classify("- item").type == LineType::LIST_ITEM);
+        CHECK(classifier.classify("  * item").type == LineType::LIST_ITEM);
+        CHECK(classifier.classify("+ item").type == LineType::LIST_ITEM);
+        CHECK(classifier.classify("\xE2\x80\xA2 bullet").type == LineType::LIST_ITEM);
+        CHECK(classifier.classify("12. numbered").type == LineType::LIST_ITEM);
+        CHECK(classifier.classify("-dash").type == LineType::NORMAL);
+        CHECK(classifier.classify("12.5 percent").type == LineType::NORMAL);
+    }
+    
+    SUBCASE("Code blocks") {
+        CHECK(classifier.classify("```cpp").type == LineType::CODE_BLOCK);
+        CHECK(classifier.classify("    return 0;").type == LineType::CODE_BLOCK);
+        CHECK(classifier.classify(" single indent").type == LineType::NORMAL);
+    }
+    
+    SUBCASE("Plain text") {
+        auto normal = classifier.classify("Just a sentence.");
+        CHECK(normal.type == LineType::NORMAL);
+        CHECK(normal.heading_level == 0);
+    }
+}
+
+TEST_CASE("LineClassifier extra rules") {
+    using namespace fast_pdf_parser;
+    
+    SUBCASE("Numbered section headings") {
+        LineClassifier classifier;
+        classifier.add_rule(LineClassifier::numbered_section_rule());
+        
+        auto major = classifier.classify("3.2 Results");
+        CHECK(major.type == LineType::MAJOR_HEADING);
+        CHECK(major.heading_level == 2);
+        
+        auto minor = classifier.classify("3.2.1. Error analysis");
+        CHECK(minor.type == LineType::MINOR_HEADING);
+        CHECK(minor.heading_level == 3);
+        
+        CHECK(classifier.classify("3.5 million people").type == LineType::NORMAL);
+        CHECK(classifier.classify("1. First step").type == LineType::LIST_ITEM);
+    }
+    
+    SUBCASE("Rules run in registration order before the built-ins") {
+        LineClassifier classifier;
+        classifier.add_rule([](std::string_view line, LineClass& out) {
+            if (line.substr(0, 2) != "- ") return false;
+            out.type = LineType::CODE_BLOCK;
+            return true;
+        });
+        classifier.add_rule([](std::string_view, LineClass& out) {
+            out.type = LineType::MINOR_HEADING;
+            return true;
+        });
+        
+        CHECK(classifier.classify("- item").type == LineType::CODE_BLOCK);
+        CHECK(classifier.classify("# Title").type == LineType::MINOR_HEADING);
+        CHECK(classifier.classify("   ").type == LineType::BLANK);
+    }
+}
+#endif // ENABLE_TESTS
\ No newline at end of file
@@ -0,0 +1,442 @@
+#include "fast_pdf_parser/metrics.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace fast_pdf_parser {
+
+namespace detail {
+std::atomic<int> log_threshold{static_cast<int>(LogLevel::Warning)};
+}
+
+namespace {
+
+constexpr size_t kStages = static_cast<size_t>(Stage::Count);
+constexpr size_t kCounters = static_cast<size_t>(Counter::Count);
+
+// Bucket 0 holds latencies under 1us, bucket b > 0 those in [2^(b-1), 2^b)
+// us; the last one also takes everything longer
+constexpr size_t kBuckets = 32;
+
+struct Histogram {
+    std::atomic<uint64_t> buckets[kBuckets] = {};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+};
+
+struct Span {
+    Stage stage;
+    int64_t start_ns;  // since tracing started
+    int64_t duration_ns;
+};
+
+// Written only by the thread that owns it, read by snapshots
+struct alignas(64) ThreadMetrics {
+    std::atomic<uint64_t> counters[kCounters] = {};
+    Histogram stages[kStages];
+    int track = 0;  // tid in traces
+    std::mutex spans_mutex;  // contended only while a trace is exported
+    std::vector<Span> spans;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadMetrics>> threads;  // never shrinks
+    std::vector<ThreadMetrics*> released;  // slots of exited threads, reused
+    
+    std::mutex log_mutex;
+    LogSink sink;  // empty = stderr
+    
+    std::atomic<bool> tracing{false};
+    std::atomic<size_t> spans_left{0};
+    std::atomic<int64_t> trace_start_ns{0};  // steady_clock
+};
+
+// Never destroyed: pool threads may still exit after static destructors ran
+Registry& registry() {
+    static Registry* instance = new Registry;
+    return *instance;
+}
+
+// A thread's claim on a slot, handed back when the thread exits
+class ThreadSlot {
+public:
+    ThreadSlot() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (!r.released.empty()) {
+            metrics_ = r.released.back();
+            r.released.pop_back();
+        } else {
+            r.threads.push_back(std::make_unique<ThreadMetrics>());
+            metrics_ = r.threads.back().get();
+            metrics_->track = static_cast<int>(r.threads.size());
+        }
+    }
+    
+    ~ThreadSlot() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.released.push_back(metrics_);
+    }
+    
+    ThreadMetrics& metrics() { return *metrics_; }
+
+private:
+    ThreadMetrics* metrics_;
+};
+
+ThreadMetrics& local_metrics() {
+    thread_local ThreadSlot slot;
+    return slot.metrics();
+}
+
+int64_t steady_ns(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+const char* level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warning: return "warning";
+        case LogLevel::Error: return "error";
+        default: return "off";
+    }
+}
+
+// Upper bound of the bucket holding quantile q, at most the maximum seen
+double percentile_us(const uint64_t* buckets, uint64_t count, double q, double max_us) {
+    uint64_t target = std::max<uint64_t>(static_cast<uint64_t>(q * count + 0.5), 1);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBuckets; ++b) {
+        seen += buckets[b];
+        if (seen >= target) {
+            return std::min(static_cast<double>(uint64_t(1) << b), max_us);
+        }
+    }
+    return max_us;
+}
+
+} // namespace
+
+void set_log_sink(LogSink sink) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.log_mutex);
+    r.sink = std::move(sink);
+}
+
+void set_log_level(LogLevel level) {
+    detail::log_threshold.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+LogLevel log_level() {
+    return static_cast<LogLevel>(detail::log_threshold.load(std::memory_order_relaxed));
+}
+
+LogLevel parse_log_level(const std::string& name) {
+    for (LogLevel level : {LogLevel::Debug, LogLevel::Info, LogLevel::Warning,
+                           LogLevel::Error, LogLevel::Off}) {
+        if (name == level_name(level)) return level;
+    }
+    throw std::invalid_argument("unknown log level '" + name + "'");
+}
+
+void log_message(LogLevel level, const std::string& message) {
+    if (level == LogLevel::Off || !log_enabled(level)) return;
+    
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.log_mutex);
+    if (r.sink) {
+        r.sink(level, message);
+    } else {
+        std::cerr << "[fast_pdf_parser] " << level_name(level) << ": " << message << "\n";
+    }
+}
+
+void add_count(Counter counter, uint64_t n) {
+    local_metrics().counters[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void record_latency(Stage stage, std::chrono::steady_clock::time_point start,
+                    std::chrono::steady_clock::time_point end) {
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    uint64_t ns = elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0;
+    
+    ThreadMetrics& metrics = local_metrics();
+    Histogram& histogram = metrics.stages[static_cast<size_t>(stage)];
+    size_t bucket = 0;
+    for (uint64_t us = ns / 1000; us > 0 && bucket + 1 < kBuckets; us >>= 1) ++bucket;
+    histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    if (ns > histogram.max_ns.load(std::memory_order_relaxed)) {
+        histogram.max_ns.store(ns, std::memory_order_relaxed);  // only this thread raises it
+    }
+    
+    Registry& r = registry();
+    if (!r.tracing.load(std::memory_order_acquire)) return;
+    size_t left = r.spans_left.load(std::memory_order_relaxed);
+    while (left > 0 && !r.spans_left.compare_exchange_weak(left, left - 1, std::memory_order_relaxed)) {
+    }
+    if (left == 0) return;
+    
+    int64_t trace_start = r.trace_start_ns.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(metrics.spans_mutex);
+    metrics.spans.push_back({stage, steady_ns(start) - trace_start, static_cast<int64_t>(ns)});
+}
+
+nlohmann::json metrics_snapshot() {
+    uint64_t counters[kCounters] = {};
+    uint64_t buckets[kStages][kBuckets] = {};
+    uint64_t total_ns[kStages] = {};
+    uint64_t max_ns[kStages] = {};
+    
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const auto& thread : r.threads) {
+            for (size_t c = 0; c < kCounters; ++c) {
+                counters[c] += thread->counters[c].load(std::memory_order_relaxed);
+            }
+            for (size_t s = 0; s < kStages; ++s) {
+                const Histogram& histogram = thread->stages[s];
+                for (size_t b = 0; b < kBuckets; ++b) {
+                    buckets[s][b] += histogram.buckets[b].load(std::memory_order_relaxed);
+                }
+                total_ns[s] += histogram.total_ns.load(std::memory_order_relaxed);
+                max_ns[s] = std::max(max_ns[s], histogram.max_ns.load(std::memory_order_relaxed));
+            }
+        }
+    }
+    
+    nlohmann::json snapshot;
+    snapshot["counters"] = nlohmann::json::object();
+    for (size_t c = 0; c < kCounters; ++c) {
+        snapshot["counters"][counter_name(static_cast<Counter>(c))] = counters[c];
+    }
+    
+    snapshot["stages"] = nlohmann::json::object();
+    for (size_t s = 0; s < kStages; ++s) {
+        uint64_t count = 0;
+        for (size_t b = 0; b < kBuckets; ++b) count += buckets[s][b];
+        
+        nlohmann::json stage;
+        stage["count"] = count;
+        stage["total_ms"] = total_ns[s] / 1e6;
+        if (count > 0) {
+            double max_us = max_ns[s] / 1e3;
+            stage["mean_us"] = total_ns[s] / 1e3 / count;
+            stage["p50_us"] = percentile_us(buckets[s], count, 0.50, max_us);
+            stage["p90_us"] = percentile_us(buckets[s], count, 0.90, max_us);
+            stage["p99_us"] = percentile_us(buckets[s], count, 0.99, max_us);
+            stage["max_us"] = max_us;
+        }
+        snapshot["stages"][stage_name(static_cast<Stage>(s))] = std::move(stage);
+    }
+    return snapshot;
+}
+
+void reset_metrics() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto& thread : r.threads) {
+        for (auto& counter : thread->counters) counter.store(0, std::memory_order_relaxed);
+        for (auto& histogram : thread->stages) {
+            for (auto& bucket : histogram.buckets) bucket.store(0, std::memory_order_relaxed);
+            histogram.total_ns.store(0, std::memory_order_relaxed);
+            histogram.max_ns.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void start_tracing(size_t max_spans) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.tracing.store(false, std::memory_order_relaxed);
+    for (const auto& thread : r.threads) {
+        std::lock_guard<std::mutex> spans_lock(thread->spans_mutex);
+        thread->spans.clear();
+    }
+    r.trace_start_ns.store(steady_ns(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    r.spans_left.store(max_spans, std::memory_order_relaxed);
+    r.tracing.store(true, std::memory_order_release);
+}
+
+void stop_tracing() {
+    registry().tracing.store(false, std::memory_order_release);
+}
+
+bool tracing_enabled() {
+    return registry().tracing.load(std::memory_order_relaxed);
+}
+
+nlohmann::json trace_json() {
+    nlohmann::json events = nlohmann::json::array();
+    
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto& thread : r.threads) {
+        std::lock_guard<std::mutex> spans_lock(thread->spans_mutex);
+        if (thread->spans.empty()) continue;
+        
+        nlohmann::json name;
+        name["name"] = "thread_name";
+        name["ph"] = "M";
+        name["pid"] = 1;
+        name["tid"] = thread->track;
+        name["args"]["name"] = "thread " + std::to_string(thread->track);
+        events.push_back(std::move(name));
+        
+        for (const Span& span : thread->spans) {
+            nlohmann::json event;
+            event["name"] = stage_name(span.stage);
+            event["cat"] = "fast_pdf_parser";
+            event["ph"] = "X";
+            event["ts"] = span.start_ns / 1e3;  // microseconds
+            event["dur"] = span.duration_ns / 1e3;
+            event["pid"] = 1;
+            event["tid"] = thread->track;
+            events.push_back(std::move(event));
+        }
+    }
+    
+    nlohmann::json trace;
+    trace["traceEvents"] = std::move(events);
+    trace["displayTimeUnit"] = "ms";
+    return trace;
+}
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::Open: return "open";
+        case Stage::LoadPage: return "load_page";
+        case Stage::Stext: return "stext";
+        case Stage::Tokenize: return "tokenize";
+        case Stage::Chunk: return "chunk";
+        default: return "unknown";
+    }
+}
+
+const char* counter_name(Counter counter) {
+    switch (counter) {
+        case Counter::DocumentsOpened: return "documents_opened";
+        case Counter::PagesExtracted: return "pages_extracted";
+        case Counter::PageErrors: return "page_errors";
+        case Counter::PagesOverMemoryLimit: return "pages_over_memory_limit";
+        case Counter::MemoryBudgetWaits: return "memory_budget_waits";
+        case Counter::PageCacheHits: return "page_cache_hits";
+        case Counter::PageCacheMisses: return "page_cache_misses";
+        case Counter::LinesAnnotated: return "lines_annotated";
+        case Counter::TokensCounted: return "tokens_counted";
+        case Counter::ChunksEmitted: return "chunks_emitted";
+        case Counter::MupdfAllocations: return "mupdf_allocations";
+        case Counter::MupdfAllocationsPooled: return "mupdf_allocations_pooled";
+        default: return "unknown";
+    }
+}
+
+} // namespace fast_pdf_parser
+
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+#include <thread>
+
+TEST_CASE("Metrics, logging and traces") {
+    using namespace fast_pdf_parser;
+    
+    SUBCASE("Log levels filter before the sink") {
+        std::vector<std::string> messages;
+        set_log_sink([&messages](LogLevel level, const std::string& message) {
+            messages.push_back(std::to_string(static_cast<int>(level)) + " " + message);
+        });
+        LogLevel saved = log_level();
+        
+        set_log_level(LogLevel::Info);
+        CHECK_FALSE(log_enabled(LogLevel::Debug));
+        CHECK(log_enabled(LogLevel::Error));
+        log_message(LogLevel::Debug, "dropped");
+        log_message(LogLevel::Info, "kept");
+        log_message(LogLevel::Error, "also kept");
+        set_log_level(LogLevel::Off);
+        log_message(LogLevel::Error, "dropped too");
+        
+        set_log_level(saved);
+        set_log_sink(nullptr);
+        CHECK(messages == std::vector<std::string>{"1 kept", "3 also kept"});
+        
+        CHECK(parse_log_level("debug") == LogLevel::Debug);
+        CHECK(parse_log_level("off") == LogLevel::Off);
+        CHECK_THROWS_AS(parse_log_level("verbose"), std::invalid_argument);
+    }
+    
+    SUBCASE("Counters add up across threads, exited ones included") {
+        reset_metrics();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([] {
+                for (int i = 0; i < 1000; ++i) add_count(Counter::LinesAnnotated);
+                add_count(Counter::TokensCounted, 250);
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        add_count(Counter::TokensCounted, 7);
+        
+        nlohmann::json snapshot = metrics_snapshot();
+        CHECK(snapshot["counters"]["lines_annotated"] == 4000);
+        CHECK(snapshot["counters"]["tokens_counted"] == 1007);
+        CHECK(snapshot["counters"]["chunks_emitted"] == 0);
+        
+        reset_metrics();
+        CHECK(metrics_snapshot()["counters"]["tokens_counted"] == 0);
+    }
+    
+    SUBCASE("Latency histograms") {
+        reset_metrics();
+        auto start = std::chrono::steady_clock::now();
+        using std::chrono::microseconds;
+        for (int i = 0; i < 98; ++i) record_latency(Stage::LoadPage, start, start + microseconds(3));
+        record_latency(Stage::LoadPage, start, start + microseconds(100));
+        record_latency(Stage::LoadPage, start, start + microseconds(5000));
+        
+        nlohmann::json stage = metrics_snapshot()["stages"]["load_page"];
+        CHECK(stage["count"] == 100);
+        CHECK(stage["total_ms"].get<double>() == doctest::Approx(5.394));
+        CHECK(stage["p50_us"].get<double>() == 4);  // bucket [2, 4)
+        CHECK(stage["p99_us"].get<double>() == 128);
+        CHECK(stage["max_us"].get<double>() == 5000);
+        CHECK(metrics_snapshot()["stages"]["open"]["count"] == 0);
+        reset_metrics();
+    }
+    
+    SUBCASE("Trace spans in Chrome trace format") {
+        CHECK(trace_json()["traceEvents"].empty());
+        start_tracing(3);
+        CHECK(tracing_enabled());
+        for (int i = 0; i < 5; ++i) {
+            StageTimer timer(Stage::Tokenize);
+        }
+        stop_tracing();
+        {
+            StageTimer timer(Stage::Chunk);  // not traced
+        }
+        
+        nlohmann::json events = trace_json()["traceEvents"];
+        REQUIRE(events.size() == 4);  // thread name, then the spans that fit
+        CHECK(events[0]["ph"] == "M");
+        for (size_t i = 1; i < events.size(); ++i) {
+            CHECK(events[i]["name"] == "tokenize");
+            CHECK(events[i]["ph"] == "X");
+            CHECK(events[i]["ts"].get<double>() >= 0);
+            CHECK(events[i]["tid"] == events[0]["tid"]);
+        }
+        
+        start_tracing();
+        stop_tracing();
+        CHECK(trace_json()["traceEvents"].empty());
+        reset_metrics();
+    }
+}
+#endif // ENABLE_TESTS
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "fast_pdf_parser/page_selection.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace fast_pdf_parser {
+
+namespace {
+
+// A whole positive number, or -1 if text is anything else
+int parse_count(const std::string& text) {
+    if (text.empty() || text.size() > 9) return -1;
+    int value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return -1;
+        value = value * 10 + (c - '0');
+    }
+    return value > 0 ? value : -1;
+}
+
+// "N" (1-based), "z" or "rN" as a 0-based page, negative from the end
+int parse_page(const std::string& text, const std::string& spec) {
+    if (text == "z") return -1;
+    int value = parse_count(text[0] == 'r' ? text.substr(1) : text);
+    if (value < 0) {
+        throw std::invalid_argument("invalid page '" + text + "' in page selection '" + spec + "'");
+    }
+    return text[0] == 'r' ? -value : value - 1;
+}
+
+} // namespace
+
+PageSelection PageSelection::parse(const std::string& spec) {
+    PageSelection selection;
+    size_t start = 0;
+    for (;;) {
+        size_t comma = spec.find(',', start);
+        std::string item = spec.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (item.empty()) {
+            throw std::invalid_argument("empty item in page selection '" + spec + "'");
+        }
+        
+        int stride = 1;
+        size_t colon = item.find(':');
+        if (colon != std::string::npos) {
+            stride = parse_count(item.substr(colon + 1));
+            if (stride < 0) {
+                throw std::invalid_argument("invalid stride in page selection '" + spec + "'");
+            }
+            item.resize(colon);
+        }
+        
+        size_t dash = item.find('-');
+        int first = parse_page(item.substr(0, dash), spec);
+        int last = first;
+        if (dash != std::string::npos) {
+            std::string end = item.substr(dash + 1);
+            last = end.empty() ? -1 : parse_page(end, spec);  // "N-" runs to the end
+        }
+        if ((first >= 0) == (last >= 0) && first > last) {
+            throw std::invalid_argument("descending range '" + item + "' in page selection '" + spec + "'");
+        }
+        selection.add_range(first, last, stride);
+        
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return selection;
+}
+
+PageSelection& PageSelection::add_range(int first, int last, int stride) {
+    if (stride < 1) {
+        throw std::invalid_argument("page selection stride must be positive");
+    }
+    ranges_.push_back(Range{first, last, stride});
+    return *this;
+}
+
+PageSelection& PageSelection::limit(int max_pages) {
+    max_pages_ = std::max(max_pages, 0);
+    return *this;
+}
+
+std::vector<int> PageSelection::resolve(int page_count) const {
+    std::vector<int> pages;
+    if (ranges_.empty()) {
+        int count = max_pages_ > 0 ? std::min(page_count, max_pages_) : page_count;
+        pages.resize(std::max(count, 0));
+        for (int i = 0; i < count; ++i) pages[i] = i;
+        return pages;
+    }
+    
+    std::vector<bool> selected(std::max(page_count, 0), false);
+    for (const Range& range : ranges_) {
+        int first = range.first < 0 ? page_count + range.first : range.first;
+        int last = std::min(range.last < 0 ? page_count + range.last : range.last, page_count - 1);
+        if (first < 0) {
+            // Pages before the start still set the stride's phase
+            first += (-first + range.stride - 1) / range.stride * range.stride;
+        }
+        for (int page = first; page <= last; page += range.stride) {
+            selected[page] = true;
+        }
+    }
+    for (int page = 0; page < page_count; ++page) {
+        if (!selected[page]) continue;
+        if (max_pages_ > 0 && static_cast<int>(pages.size()) >= max_pages_) break;
+        pages.push_back(page);
+    }
+    return pages;
+}
+
+} // namespace fast_pdf_parser
+
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+
+TEST_CASE("PageSelection") {
+    using namespace fast_pdf_parser;
+    
+    using Pages = std::vector<int>;
+    auto pages = [](const std::string& spec, int page_count) {
+        return PageSelection::parse(spec).resolve(page_count);
+    };
+    
+    SUBCASE("Every page by default") {
+        PageSelection all;
+        CHECK(all.all_pages());
+        CHECK(all.resolve(4) == Pages{0, 1, 2, 3});
+        CHECK(all.resolve(0).empty());
+        CHECK(PageSelection().limit(2).resolve(4) == Pages{0, 1});
+        CHECK_FALSE(PageSelection().limit(2).all_pages());
+    }
+    
+    SUBCASE("Pages and ranges") {
+        CHECK(pages("3", 10) == Pages{2});
+        CHECK(pages("2-4,7", 10) == Pages{1, 2, 3, 6});
+        CHECK(pages("7,2-4,3", 10) == Pages{1, 2, 3, 6});  // ordered, once each
+        CHECK(pages("8-", 10) == Pages{7, 8, 9});
+        CHECK(pages("9-20,30", 10) == Pages{8, 9});  // past the end is ignored
+    }
+    
+    SUBCASE("Counting from the end") {
+        CHECK(pages("z", 10) == Pages{9});
+        CHECK(pages("r2", 10) == Pages{8});
+        CHECK(pages("1-2,r2-z", 10) == Pages{0, 1, 8, 9});
+        CHECK(pages("1-2,r2-z", 3) == Pages{0, 1, 2});
+        CHECK(pages("r5-z", 3) == Pages{0, 1, 2});
+        CHECK(pages("r3-2", 10).empty());  // descending once resolved
+    }
+    
+    SUBCASE("Strides") {
+        CHECK(pages("1-z:3", 10) == Pages{0, 3, 6, 9});
+        CHECK(pages("2-8:3", 10) == Pages{1, 4, 7});
+        CHECK(pages("r12-z:4", 10) == Pages{2, 6});  // phase kept from page -2
+    }
+    
+    SUBCASE("Limit caps the selected pages") {
+        CHECK(PageSelection::parse("5-z:2").limit(3).resolve(20) == Pages{4, 6, 8});
+        CHECK(PageSelection().add_range(0, 1).add_range(-1, -1).resolve(5) == Pages{0, 1, 4});
+    }
+    
+    SUBCASE("Malformed specs") {
+        for (const char* spec : {"", "0", "1,,2", "a", "3-1", "1-2:0", "r0", "1-2-3", "-3", "1:x"}) {
+            CHECK_THROWS_AS(PageSelection::parse(spec), std::invalid_argument);
+        }
+    }
+}
+#endif // ENABLE_TESTS
\ No newline at end of file
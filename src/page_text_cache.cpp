@@ -0,0 +1,285 @@
+#include "fast_pdf_parser/page_text_cache.h"
+#include "fast_pdf_parser/content_hash.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace fast_pdf_parser {
+
+namespace {
+
+// File layout, all integers little-endian u32:
+//   magic, format version, key size, key bytes
+//   per page: page number, text size, line count, text bytes, line offsets
+//   page count, end magic
+constexpr uint32_t kMagic = 0x43545046;     // "FPTC"
+constexpr uint32_t kEndMagic = 0x45545046;  // "FPTE"
+constexpr uint32_t kFormatVersion = 1;
+
+void put32(std::ofstream& out, uint32_t value) {
+    unsigned char bytes[4] = {
+        static_cast<unsigned char>(value), static_cast<unsigned char>(value >> 8),
+        static_cast<unsigned char>(value >> 16), static_cast<unsigned char>(value >> 24)
+    };
+    out.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+uint32_t get32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Bounds-checked cursor over a mapped cache file
+struct Reader {
+    const unsigned char* p;
+    const unsigned char* end;
+    
+    bool take(size_t bytes, const unsigned char*& out) {
+        if (static_cast<size_t>(end - p) < bytes) return false;
+        out = p;
+        p += bytes;
+        return true;
+    }
+    
+    bool take32(uint32_t& value) {
+        const unsigned char* at;
+        if (!take(4, at)) return false;
+        value = get32(at);
+        return true;
+    }
+};
+
+// Distinguishes temporary files of concurrent writers, across processes too
+std::string unique_suffix() {
+    static const uint64_t process_token = std::random_device{}();
+    static std::atomic<uint64_t> counter{0};
+    return hash_to_hex(process_token) + "-" + std::to_string(counter.fetch_add(1));
+}
+
+} // namespace
+
+PageTextCache::PageTextCache(std::string directory) : directory_(std::move(directory)) {
+}
+
+std::string PageTextCache::key(uint64_t content_hash, const ExtractOptions& options) {
+    unsigned flags = (options.extract_positions ? 1 : 0) | (options.extract_fonts ? 2 : 0) |
+                     (options.extract_colors ? 4 : 0) | (options.structured_output ? 8 : 0);
+    return hash_to_hex(content_hash) + "-" + std::to_string(flags) + "-v" + std::to_string(kTextVersion);
+}
+
+std::string PageTextCache::path_for(const std::string& key) const {
+    return (fs::path(directory_) / (key + ".pages")).string();
+}
+
+std::unique_ptr<PageTextCache::Entry> PageTextCache::load(const std::string& key) const {
+    std::string path = path_for(key);
+    std::error_code ec;
+    if (!fs::exists(path, ec)) return nullptr;
+    
+    auto entry = std::make_unique<Entry>();
+    try {
+        entry->mapping_ = PdfSource::mapped_file(path);
+    } catch (const std::runtime_error&) {
+        return nullptr;
+    }
+    
+    Reader in{entry->mapping_.data(), entry->mapping_.data() + entry->mapping_.size()};
+    uint32_t magic, version, key_size;
+    const unsigned char* stored_key;
+    if (!in.take32(magic) || magic != kMagic || !in.take32(version) || version != kFormatVersion ||
+        !in.take32(key_size) || !in.take(key_size, stored_key) ||
+        std::string(reinterpret_cast<const char*>(stored_key), key_size) != key) {
+        return nullptr;
+    }
+    
+    // Everything is checked up front, so a damaged file is a miss rather
+    // than a failure halfway through delivering its pages
+    for (;;) {
+        if (static_cast<size_t>(in.end - in.p) == 8) {
+            uint32_t page_count = 0, end_magic = 0;
+            in.take32(page_count);
+            in.take32(end_magic);
+            if (end_magic != kEndMagic || page_count != entry->pages_.size()) return nullptr;
+            return entry;
+        }
+        
+        Entry::PageRecord page;
+        uint32_t page_number;
+        if (!in.take32(page_number) || !in.take32(page.text_size) || !in.take32(page.line_count) ||
+            !in.take(page.text_size, page.text) ||
+            page.line_count > (static_cast<size_t>(in.end - in.p)) / 4 ||
+            !in.take(static_cast<size_t>(page.line_count) * 4, page.line_offsets)) {
+            return nullptr;
+        }
+        page.page_number = static_cast<int>(page_number);
+        
+        uint32_t previous = 0;
+        for (uint32_t l = 0; l < page.line_count; ++l) {
+            uint32_t offset = get32(page.line_offsets + 4 * l);
+            if (offset < previous || offset >= page.text_size || (l == 0 && offset != 0)) return nullptr;
+            previous = offset;
+        }
+        if (page.line_count > 0 && page.text[page.text_size - 1] != '\n') return nullptr;
+        entry->pages_.push_back(page);
+    }
+}
+
+PageText PageTextCache::Entry::page(size_t i) const {
+    const PageRecord& record = pages_[i];
+    PageText page;
+    page.page_number = record.page_number;
+    page.text.assign(reinterpret_cast<const char*>(record.text), record.text_size);
+    page.line_offsets.resize(record.line_count);
+    for (uint32_t l = 0; l < record.line_count; ++l) {
+        page.line_offsets[l] = get32(record.line_offsets + 4 * l);
+    }
+    return page;
+}
+
+std::unique_ptr<PageTextCache::Writer> PageTextCache::store(const std::string& key) const {
+    std::error_code ec;
+    fs::create_directories(directory_, ec);
+    if (ec) return nullptr;
+    
+    std::string final_path = path_for(key);
+    std::unique_ptr<Writer> writer(new Writer(final_path + ".tmp-" + unique_suffix(), final_path));
+    if (!writer->out_) return nullptr;
+    
+    put32(writer->out_, kMagic);
+    put32(writer->out_, kFormatVersion);
+    put32(writer->out_, static_cast<uint32_t>(key.size()));
+    writer->out_.write(key.data(), key.size());
+    return writer;
+}
+
+PageTextCache::Writer::Writer(std::string temp_path, std::string final_path)
+    : temp_path_(std::move(temp_path)),
+      final_path_(std::move(final_path)),
+      out_(temp_path_, std::ios::binary | std::ios::trunc) {
+}
+
+PageTextCache::Writer::~Writer() {
+    if (committed_) return;
+    out_.close();
+    std::error_code ec;
+    fs::remove(temp_path_, ec);
+}
+
+void PageTextCache::Writer::add_page(const PageText& page) {
+    put32(out_, static_cast<uint32_t>(page.page_number));
+    put32(out_, static_cast<uint32_t>(page.text.size()));
+    put32(out_, static_cast<uint32_t>(page.line_offsets.size()));
+    out_.write(page.text.data(), page.text.size());
+    for (uint32_t offset : page.line_offsets) {
+        put32(out_, offset);
+    }
+    page_count_++;
+}
+
+bool PageTextCache::Writer::commit() {
+    if (committed_) return true;
+    put32(out_, page_count_);
+    put32(out_, kEndMagic);
+    out_.close();
+    if (!out_) return false;
+    
+    std::error_code ec;
+    fs::rename(temp_path_, final_path_, ec);
+    if (ec) return false;
+    committed_ = true;
+    return true;
+}
+
+} // namespace fast_pdf_parser
+
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+
+TEST_CASE("PageTextCache stores and loads pages") {
+    using namespace fast_pdf_parser;
+    
+    auto dir = fs::temp_directory_path() / "fast_pdf_parser_page_cache_test";
+    fs::remove_all(dir);
+    PageTextCache cache(dir.string());
+    
+    auto make_page = [](int number, const std::vector<std::string>& lines) {
+        PageText page;
+        page.page_number = number;
+        for (const auto& line : lines) {
+            page.line_offsets.push_back(static_cast<uint32_t>(page.text.size()));
+            page.text += line;
+            page.text += '\n';
+        }
+        return page;
+    };
+    
+    std::string key = PageTextCache::key(0x1234, ExtractOptions{});
+    
+    SUBCASE("Keys depend on content and options") {
+        ExtractOptions other;
+        other.extract_fonts = false;
+        CHECK(PageTextCache::key(0x1234) == key);
+        CHECK(PageTextCache::key(0x1235) != key);
+        CHECK(PageTextCache::key(0x1234, other) != key);
+    }
+    
+    SUBCASE("Round trip") {
+        CHECK(cache.load(key) == nullptr);
+        
+        auto writer = cache.store(key);
+        REQUIRE(writer != nullptr);
+        writer->add_page(make_page(0, {"Title", "First line"}));
+        writer->add_page(make_page(1, {}));
+        writer->add_page(make_page(2, {"Last"}));
+        CHECK(cache.load(key) == nullptr);  // not visible before commit
+        REQUIRE(writer->commit());
+        
+        auto entry = cache.load(key);
+        REQUIRE(entry != nullptr);
+        REQUIRE(entry->page_count() == 3);
+        PageText first = entry->page(0);
+        CHECK(first.page_number == 0);
+        REQUIRE(first.line_count() == 2);
+        CHECK(first.line(0) == "Title");
+        CHECK(first.line(1) == "First line");
+        CHECK(entry->page(1).line_count() == 0);
+        CHECK(entry->page(2).page_number == 2);
+        CHECK(entry->page(2).line(0) == "Last");
+    }
+    
+    SUBCASE("Uncommitted writers leave nothing behind") {
+        {
+            auto writer = cache.store(key);
+            REQUIRE(writer != nullptr);
+            writer->add_page(make_page(0, {"Draft"}));
+        }
+        CHECK(cache.load(key) == nullptr);
+        CHECK(fs::is_empty(dir));
+    }
+    
+    SUBCASE("Damaged entries are misses") {
+        auto writer = cache.store(key);
+        REQUIRE(writer != nullptr);
+        writer->add_page(make_page(0, {"Some text on the page"}));
+        REQUIRE(writer->commit());
+        
+        auto path = dir / (key + ".pages");
+        fs::resize_file(path, fs::file_size(path) - 3);
+        CHECK(cache.load(key) == nullptr);
+        
+        // An entry renamed to another key does not answer for it
+        std::string other_key = PageTextCache::key(0x9999);
+        auto other = cache.store(other_key);
+        REQUIRE(other != nullptr);
+        REQUIRE(other->commit());
+        fs::rename(dir / (other_key + ".pages"), path);
+        CHECK(cache.load(key) == nullptr);
+    }
+    
+    fs::remove_all(dir);
+}
+#endif // ENABLE_TESTS
\ No newline at end of file
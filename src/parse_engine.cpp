@@ -0,0 +1,877 @@
+#include "fast_pdf_parser/parse_engine.h"
+#include "fast_pdf_parser/metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace fast_pdf_parser {
+
+class ParseEngine::Impl {
+public:
+    Impl(size_t thread_count, size_t max_pages_in_flight, const MemoryLimits& memory,
+         const EngineTuning& tuning)
+        : thread_count_(std::max<size_t>(thread_count, 1)),
+          tuning_(tuning),
+          auto_window_(max_pages_in_flight == 0),
+          concurrency_(thread_count_),
+          window_(max_pages_in_flight > 0 ? max_pages_in_flight : 2 * thread_count_),
+          cpu_plan_(plan_cpu_affinity(tuning.affinity, thread_count_,
+                                      tuning.affinity == CpuAffinity::None ? std::vector<CpuInfo>{}
+                                                                           : detect_cpus())),
+          extractor_(memory),
+          pool_(thread_count_, [this](size_t worker) {
+              if (!cpu_plan_[worker].empty() && pin_current_thread(cpu_plan_[worker])) {
+                  pinned_workers_++;
+              }
+          }) {
+        if (tuning_.auto_tune) {
+            // All, three quarters and half of the workers; the depths
+            // follow once the fastest is known
+            for (size_t workers : {thread_count_, (3 * thread_count_ + 3) / 4, (thread_count_ + 1) / 2}) {
+                if (probe_plan_.empty() || workers < probe_plan_.back().concurrency) {
+                    probe_plan_.push_back({workers, auto_window_ ? 2 * workers : window_, 0});
+                }
+            }
+            apply_probe_locked();
+        }
+    }
+    
+    ~Impl() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutting_down_ = true;
+    }
+    
+    void submit(ParseJob job) {
+        auto doc = std::make_shared<Document>();
+        doc->job = std::move(job);
+        
+        std::lock_guard<std::mutex> lock(mutex_);
+        doc->sequence = next_sequence_++;
+        active_.push_back(doc);
+        schedule_locked();
+    }
+    
+    size_t thread_count() const { return thread_count_; }
+    const EngineTuning& tuning() const { return tuning_; }
+    
+    size_t max_pages_in_flight() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return window_;
+    }
+    
+    nlohmann::json settings() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        nlohmann::json probes = nlohmann::json::array();
+        for (size_t i = 0; i < next_probe_; ++i) {
+            probes.push_back({{"concurrency", probe_plan_[i].concurrency},
+                              {"max_pages_in_flight", probe_plan_[i].window},
+                              {"pages_per_second", probe_plan_[i].pages_per_second}});
+        }
+        return {{"threads", thread_count_},
+                {"available_cpus", available_cpus()},
+                {"affinity", cpu_affinity_name(tuning_.affinity)},
+                {"pinned_workers", pinned_workers_.load()},
+                {"concurrency", concurrency_},
+                {"max_pages_in_flight", window_},
+                {"auto_tune", !tuning_.auto_tune ? "off" : tuned_ ? "done" : "probing"},
+                {"probes", probes}};
+    }
+    ThreadPool& pool() { return pool_; }
+    TextExtractor& extractor() { return extractor_; }
+
+private:
+    struct Document {
+        ParseJob job;
+        uint64_t sequence = 0;
+        int page_count = -1;   // selected pages; unknown until opened
+        std::vector<int> pages;  // the selected page numbers, ascending
+        bool opening = false;
+        int next_page = 0;     // next index into pages to dispatch
+        int next_deliver = 0;  // next index on_page expects
+        int extracting = 0;    // dispatched pages not back yet
+        std::map<int, PageResult> ready;  // finished out of order, by index
+        bool delivering = false;
+        bool stopped = false;
+        bool finished = false;
+        std::string error;
+    };
+    using DocumentPtr = std::shared_ptr<Document>;
+    
+    size_t window(const Document& doc) const {
+        return doc.job.max_pages_in_flight > 0 ? doc.job.max_pages_in_flight : window_;
+    }
+    
+    // Settings the tuner measures; pages_per_second is set once measured
+    struct Probe {
+        size_t concurrency;
+        size_t window;
+        double pages_per_second;
+    };
+    
+    // Pages a probe measures: enough for every worker to finish a few
+    size_t probe_pages() const { return std::max<size_t>(4 * concurrency_, 16); }
+    static constexpr std::chrono::milliseconds kMinProbeTime{50};
+    
+    // Switches to the next probe's settings. Pages already running were
+    // started under the previous ones and are not counted.
+    void apply_probe_locked() {
+        const Probe& probe = probe_plan_[next_probe_];
+        concurrency_ = probe.concurrency;
+        window_ = probe.window;
+        probe_skip_ = running_;
+        probe_pages_ = 0;
+        probe_started_ = false;
+    }
+    
+    // Counts a finished page towards the current probe and moves on once it
+    // has measured enough
+    void probe_page_done_locked() {
+        if (!tuning_.auto_tune || tuned_) return;
+        if (probe_skip_ > 0) {
+            probe_skip_--;
+            return;
+        }
+        if (!probe_started_ || ++probe_pages_ < probe_pages()) return;
+        auto elapsed = std::chrono::steady_clock::now() - probe_start_;
+        if (elapsed < kMinProbeTime) return;
+        
+        probe_plan_[next_probe_].pages_per_second =
+            probe_pages_ / std::chrono::duration<double>(elapsed).count();
+        next_probe_++;
+        
+        if (next_probe_ == probe_plan_.size() && !probing_depths_ && auto_window_) {
+            // Depths of one and four pages per worker at the fastest
+            // concurrency; two was measured with it
+            size_t workers = best_probe().concurrency;
+            probe_plan_.push_back({workers, workers, 0});
+            probe_plan_.push_back({workers, 4 * workers, 0});
+            probing_depths_ = true;
+        }
+        if (next_probe_ < probe_plan_.size()) {
+            apply_probe_locked();
+            return;
+        }
+        
+        const Probe& best = best_probe();
+        concurrency_ = best.concurrency;
+        window_ = best.window;
+        tuned_ = true;
+        if (log_enabled(LogLevel::Info)) {
+            log_message(LogLevel::Info, "Auto-tuned to " + std::to_string(concurrency_) + " of " +
+                        std::to_string(thread_count_) + " workers, " + std::to_string(window_) +
+                        " pages in flight (" + std::to_string(static_cast<int>(best.pages_per_second)) +
+                        " pages/s)");
+        }
+    }
+    
+    // The fastest measured probe. A later probe has to beat an earlier one
+    // by 5% to win, so noise does not move the engine off the defaults,
+    // which are probed first.
+    const Probe& best_probe() const {
+        const Probe* best = &probe_plan_[0];
+        for (size_t i = 1; i < next_probe_; ++i) {
+            if (probe_plan_[i].pages_per_second > 1.05 * best->pages_per_second) {
+                best = &probe_plan_[i];
+            }
+        }
+        return *best;
+    }
+    
+    // Nothing running and no page waiting for on_page. A full window with
+    // nothing running is not enough: its pages may just not have been
+    // delivered yet.
+    bool out_of_work_locked() const {
+        if (running_ > 0) return false;
+        for (const auto& doc : active_) {
+            if (doc->delivering || !doc->ready.empty()) return false;
+        }
+        return true;
+    }
+    
+    // Starts work until every worker is busy. Decisions are made only when
+    // a worker is free, so a document submitted later still gets the next
+    // free worker instead of queueing behind pages already handed out.
+    // Over the memory budget, free workers stay idle until a running task
+    // finishes and calls back in here.
+    void schedule_locked() {
+        if (shutting_down_) return;
+        
+        while (running_ < concurrency_) {
+            DocumentPtr best;
+            for (const auto& doc : active_) {
+                if (doc->stopped || doc->opening) continue;
+                bool runnable = doc->page_count < 0 ||
+                    (doc->next_page < doc->page_count &&
+                     static_cast<size_t>(doc->next_page - doc->next_deliver) < window(*doc));
+                if (!runnable) continue;
+                if (!best || doc->next_page < best->next_page ||
+                    (doc->next_page == best->next_page && doc->sequence < best->sequence)) {
+                    best = doc;
+                }
+            }
+            if (!best) {
+                if (out_of_work_locked()) {
+                    probe_started_ = false;  // idle time says nothing about the settings
+                    probe_pages_ = 0;
+                }
+                break;
+            }
+            if (running_ > 0 && extractor_.over_memory_budget()) {
+                add_count(Counter::MemoryBudgetWaits);
+                break;
+            }
+            
+            running_++;
+            if (!probe_started_) {
+                probe_started_ = true;
+                probe_start_ = std::chrono::steady_clock::now();
+            }
+            if (best->page_count < 0) {
+                best->opening = true;
+                pool_.submit([this, best]() { open(best); });
+            } else {
+                int index = best->next_page++;
+                best->extracting++;
+                pool_.submit([this, best, index]() { extract(best, index); });
+            }
+        }
+    }
+    
+    void open(const DocumentPtr& doc) {
+        int page_count = 0;
+        std::string error;
+        try {
+            page_count = extractor_.get_page_count(doc->job.source);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_--;
+        doc->opening = false;
+        if (!error.empty()) {
+            doc->error = error;
+            doc->stopped = true;
+            page_count = 0;
+        }
+        // Unselected pages are never dispatched, so never loaded
+        doc->pages = doc->job.pages.resolve(page_count);
+        if (doc->job.page_limit > 0 && static_cast<int>(doc->pages.size()) > doc->job.page_limit) {
+            doc->pages.resize(doc->job.page_limit);
+        }
+        doc->page_count = static_cast<int>(doc->pages.size());
+        schedule_locked();
+        finish_if_done(doc, lock);
+    }
+    
+    void extract(const DocumentPtr& doc, int index) {
+        const int page = doc->pages[index];  // set before any page was dispatched
+        PageResult result;
+        result.page_number = page;
+        result.success = false;
+        
+        bool skip;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            skip = doc->stopped || shutting_down_;
+        }
+        
+        if (skip) {
+            result.error = "cancelled";
+        } else {
+            const ParseJob& job = doc->job;
+            try {
+                if (job.page_output == PageOutput::PlainText) {
+                    result.text = extractor_.extract_page_text(job.source, page);
+                } else if (job.page_output == PageOutput::Layout) {
+                    result.layout = extractor_.extract_page_layout(job.source, page, job.extract_options);
+                } else {
+                    result.content = extractor_.extract_page(job.source, page, job.extract_options);
+                }
+                result.success = true;
+                if (job.on_extracted) {
+                    job.on_extracted(result);
+                }
+            } catch (const std::exception& e) {
+                result.error = e.what();
+                result.success = false;
+                add_count(Counter::PageErrors);
+            }
+        }
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_--;
+        doc->extracting--;
+        if (!skip) probe_page_done_locked();
+        if (!doc->stopped) {
+            doc->ready.emplace(index, std::move(result));
+        }
+        schedule_locked();
+        deliver(doc, lock);
+    }
+    
+    // Hands ready pages to on_page in order. Only one thread delivers for
+    // a document at a time; a page finishing meanwhile is picked up by the
+    // thread already delivering.
+    void deliver(const DocumentPtr& doc, std::unique_lock<std::mutex>& lock) {
+        if (doc->delivering) return;
+        doc->delivering = true;
+        
+        while (!doc->stopped && !shutting_down_ && !doc->ready.empty() && doc->ready.begin()->first == doc->next_deliver) {
+            PageResult result = std::move(doc->ready.begin()->second);
+            doc->ready.erase(doc->ready.begin());
+            doc->next_deliver++;
+            
+            lock.unlock();
+            bool keep_going;
+            std::string error;
+            try {
+                keep_going = doc->job.on_page(std::move(result));
+            } catch (const std::exception& e) {
+                keep_going = false;
+                error = e.what();
+            }
+            lock.lock();
+            
+            if (!keep_going) {
+                doc->stopped = true;
+                doc->ready.clear();
+                if (!error.empty()) doc->error = error;
+            }
+            schedule_locked();  // the window moved on
+        }
+        
+        doc->delivering = false;
+        finish_if_done(doc, lock);
+    }
+    
+    void finish_if_done(const DocumentPtr& doc, std::unique_lock<std::mutex>& lock) {
+        if (doc->finished || doc->delivering || doc->page_count < 0) return;
+        if (!doc->stopped && doc->next_deliver < doc->page_count) return;
+        if (doc->extracting > 0) return;  // on_extracted may still be running
+        
+        doc->finished = true;
+        active_.remove(doc);
+        if (shutting_down_) return;
+        
+        int page_count = doc->page_count;
+        std::string error = doc->error;
+        lock.unlock();
+        // A memory source's key is unique to its bytes, so its cached
+        // documents are of no use to later jobs and would only pin them
+        if (doc->job.source.in_memory()) extractor_.close(doc->job.source);
+        if (doc->job.on_done) doc->job.on_done(page_count, error);
+        lock.lock();
+    }
+    
+    const size_t thread_count_;
+    const EngineTuning tuning_;
+    const bool auto_window_;  // max_pages_in_flight was left to the engine
+    size_t concurrency_;      // workers pages may occupy at once
+    size_t window_;
+    
+    // The tuner; see EngineTuning::auto_tune
+    std::vector<Probe> probe_plan_;
+    size_t next_probe_ = 0;  // probes before it are measured
+    bool probing_depths_ = false;
+    bool tuned_ = false;
+    bool probe_started_ = false;
+    std::chrono::steady_clock::time_point probe_start_;
+    size_t probe_pages_ = 0;
+    size_t probe_skip_ = 0;  // pages still running from the previous probe
+    
+    const std::vector<std::vector<int>> cpu_plan_;  // per worker, see CpuAffinity
+    std::atomic<size_t> pinned_workers_{0};
+    
+    std::mutex mutex_;
+    std::list<DocumentPtr> active_;
+    uint64_t next_sequence_ = 0;
+    size_t running_ = 0;  // open and extract tasks on the pool
+    bool shutting_down_ = false;
+    
+    TextExtractor extractor_;  // must outlive pool_, whose tasks use it
+    ThreadPool pool_;          // destroyed first: joins the workers
+};
+
+ParseEngine::ParseEngine(size_t thread_count, size_t max_pages_in_flight, const MemoryLimits& memory,
+                         const EngineTuning& tuning)
+    : pImpl(std::make_unique<Impl>(thread_count, max_pages_in_flight, memory, tuning)) {
+}
+
+ParseEngine::~ParseEngine() = default;
+
+void ParseEngine::submit(ParseJob job) {
+    pImpl->submit(std::move(job));
+}
+
+size_t ParseEngine::thread_count() const {
+    return pImpl->thread_count();
+}
+
+const EngineTuning& ParseEngine::tuning() const {
+    return pImpl->tuning();
+}
+
+size_t ParseEngine::max_pages_in_flight() const {
+    return pImpl->max_pages_in_flight();
+}
+
+nlohmann::json ParseEngine::settings() const {
+    return pImpl->settings();
+}
+
+ThreadPool& ParseEngine::pool() {
+    return pImpl->pool();
+}
+
+TextExtractor& ParseEngine::extractor() {
+    return pImpl->extractor();
+}
+
+} // namespace fast_pdf_parser
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+#include <condition_variable>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+using namespace fast_pdf_parser;
+
+const char* const kFixture = "n3797.pdf";
+const char* const kSecondFixture = "tests/test_data/test.pdf";
+
+// Whether the fixture exists and MuPDF can open it; the tests run from
+// the repository root
+bool fixture_available(const char* path) {
+    if (!std::filesystem::exists(path)) return false;
+    try {
+        TextExtractor extractor;
+        return extractor.get_page_count(path) > 0;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+#define REQUIRE_FIXTURE(path)                                           \
+    if (!fixture_available(path)) {                                     \
+        MESSAGE("skipped: " << std::string(path) << " missing or MuPDF unavailable"); \
+        return;                                                         \
+    }
+
+// Submits the jobs and waits for every on_done, which is wrapped to record
+// its arguments and then call the job's own
+struct JobRunner {
+    struct Done {
+        int page_count = -1;
+        std::string error;
+        bool called = false;
+    };
+    
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<Done> done;
+    size_t remaining = 0;
+    
+    void run(ParseEngine& engine, std::vector<ParseJob> jobs) {
+        done.assign(jobs.size(), Done{});
+        remaining = jobs.size();
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            auto on_done = std::move(jobs[i].on_done);
+            jobs[i].on_done = [this, i, on_done](int page_count, const std::string& error) {
+                if (on_done) on_done(page_count, error);
+                std::lock_guard<std::mutex> lock(mutex);
+                done[i] = {page_count, error, true};
+                remaining--;
+                cv.notify_all();
+            };
+            engine.submit(std::move(jobs[i]));
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return remaining == 0; });
+    }
+};
+
+ParseJob first_pages(const char* path, int pages) {
+    ParseJob job;
+    job.source = path;
+    job.page_limit = pages;
+    job.on_page = [](PageResult) { return true; };
+    return job;
+}
+
+} // namespace
+
+TEST_CASE("ParseEngine schedules pages across documents") {
+    REQUIRE_FIXTURE(kFixture);
+    REQUIRE_FIXTURE(kSecondFixture);
+    
+    ParseEngine engine(2, 2);
+    std::mutex mutex;
+    std::vector<int> order;  // the job each extracted page belongs to
+    std::vector<std::vector<int>> delivered(2);
+    std::vector<ParseJob> jobs;
+    for (int j = 0; j < 2; ++j) {
+        ParseJob job = first_pages(j == 0 ? kFixture : kSecondFixture, 20);
+        job.on_extracted = [&, j](PageResult&) {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(j);
+        };
+        job.on_page = [&, j](PageResult page) {
+            CHECK(page.success);
+            delivered[j].push_back(page.page_number);
+            return true;
+        };
+        jobs.push_back(std::move(job));
+    }
+    
+    JobRunner runner;
+    runner.run(engine, std::move(jobs));
+    
+    for (int j = 0; j < 2; ++j) {
+        CHECK(runner.done[j].page_count == 20);
+        CHECK(runner.done[j].error.empty());
+        REQUIRE(delivered[j].size() == 20);
+        for (int i = 0; i < 20; ++i) CHECK(delivered[j][i] == i);
+    }
+    
+    // Fewest pages dispatched first: the pages interleave, so by the time
+    // either document has all of its pages the other has most of its own
+    REQUIRE(order.size() == 40);
+    int first_done = -1;
+    int counts[2] = {0, 0};
+    for (int j : order) {
+        if (++counts[j] == 20) {
+            first_done = j;
+            break;
+        }
+    }
+    REQUIRE(first_done >= 0);
+    CHECK(counts[1 - first_done] >= 10);
+}
+
+TEST_CASE("ParseEngine lets a small document past a large one") {
+    REQUIRE_FIXTURE(kFixture);
+    REQUIRE_FIXTURE(kSecondFixture);
+    
+    ParseEngine engine(2, 4);
+    std::mutex mutex;
+    std::vector<int> finished;
+    std::vector<ParseJob> jobs;
+    for (int j = 0; j < 2; ++j) {
+        ParseJob job = first_pages(j == 0 ? kFixture : kSecondFixture, j == 0 ? 60 : 3);
+        job.on_done = [&, j](int, const std::string&) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(j);
+        };
+        jobs.push_back(std::move(job));
+    }
+    
+    JobRunner runner;
+    runner.run(engine, std::move(jobs));
+    CHECK(finished == std::vector<int>{1, 0});
+}
+
+TEST_CASE("ParseEngine keeps each document within max_pages_in_flight") {
+    REQUIRE_FIXTURE(kFixture);
+    
+    const int window = 3;
+    ParseEngine engine(4, window);
+    CHECK(engine.max_pages_in_flight() == window);
+    
+    // A page is dispatched only while it is fewer than window pages past
+    // the next one on_page expects, which is at most one past the pages
+    // on_page has been entered for
+    std::atomic<int> entered{0};
+    std::atomic<int> max_ahead{0};
+    ParseJob job = first_pages(kFixture, 30);
+    job.on_extracted = [&](PageResult& page) {
+        int ahead = page.page_number - entered.load();
+        int seen = max_ahead.load();
+        while (ahead > seen && !max_ahead.compare_exchange_weak(seen, ahead)) {
+        }
+    };
+    job.on_page = [&](PageResult) {
+        entered++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return true;
+    };
+    
+    JobRunner runner;
+    runner.run(engine, {std::move(job)});
+    CHECK(entered == 30);
+    CHECK(max_ahead.load() >= 1);  // the slow callback lets the workers get ahead
+    CHECK(max_ahead.load() <= window);
+}
+
+TEST_CASE("ParseEngine holds back pages over the memory budget") {
+    REQUIRE_FIXTURE(kFixture);
+    
+    MemoryLimits memory;
+    memory.max_memory_in_flight = 1;  // always over once a page is loaded
+    ParseEngine engine(4, 8, memory);
+    reset_metrics();
+    
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    std::atomic<int> pages{0};
+    ParseJob job = first_pages(kFixture, 12);
+    job.on_extracted = [&](PageResult&) {
+        int now = ++running;
+        int seen = max_running.load();
+        while (now > seen && !max_running.compare_exchange_weak(seen, now)) {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        running--;
+    };
+    job.on_page = [&](PageResult page) {
+        CHECK(page.success);
+        pages++;
+        return true;
+    };
+    
+    JobRunner runner;
+    runner.run(engine, {std::move(job)});
+    
+    // Every page still runs, one at a time, rather than stalling
+    CHECK(pages == 12);
+    CHECK(runner.done[0].page_count == 12);
+    CHECK(metrics_snapshot()["counters"]["memory_budget_waits"].get<uint64_t>() > 0);
+    CHECK(max_running.load() == 1);
+    reset_metrics();
+}
+
+TEST_CASE("ParseEngine stops a job when on_page returns false") {
+    REQUIRE_FIXTURE(kFixture);
+    
+    ParseEngine engine(4, 8);
+    std::atomic<int> calls{0};
+    std::atomic<bool> after_done{false};
+    std::atomic<bool> done{false};
+    
+    SUBCASE("Returning false") {
+        ParseJob job = first_pages(kFixture, 40);
+        job.on_page = [&](PageResult page) {
+            if (done) after_done = true;
+            CHECK(page.page_number == calls.load());
+            return ++calls < 5;
+        };
+        job.on_done = [&](int, const std::string&) { done = true; };
+        
+        JobRunner runner;
+        runner.run(engine, {std::move(job)});
+        CHECK(calls == 5);
+        CHECK(runner.done[0].error.empty());
+    }
+    
+    SUBCASE("Throwing stops the job with the exception's message") {
+        ParseJob job = first_pages(kFixture, 40);
+        job.on_page = [&](PageResult) -> bool {
+            if (done) after_done = true;
+            if (++calls == 3) throw std::runtime_error("callback failed");
+            return true;
+        };
+        job.on_done = [&](int, const std::string&) { done = true; };
+        
+        JobRunner runner;
+        runner.run(engine, {std::move(job)});
+        CHECK(calls == 3);
+        CHECK(runner.done[0].error == "callback failed");
+    }
+    
+    // Pages already extracting when the job stopped are never delivered
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK_FALSE(after_done);
+    
+    // The engine carries on with other jobs
+    JobRunner runner;
+    runner.run(engine, {first_pages(kFixture, 4)});
+    CHECK(runner.done[0].page_count == 4);
+}
+
+TEST_CASE("ParseEngine runs on_done last") {
+    REQUIRE_FIXTURE(kFixture);
+    
+    ParseEngine engine(4, 8);
+    std::atomic<int> extracting{0};
+    std::atomic<int> extracted{0};
+    std::atomic<int> delivered{0};
+    int extracting_at_done = -1;
+    int delivered_at_done = -1;
+    
+    SUBCASE("After the last page") {
+        ParseJob job = first_pages(kFixture, 16);
+        job.on_extracted = [&](PageResult&) {
+            extracting++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            extracted++;
+            extracting--;
+        };
+        job.on_page = [&](PageResult) {
+            delivered++;
+            return true;
+        };
+        job.on_done = [&](int, const std::string&) {
+            extracting_at_done = extracting;
+            delivered_at_done = delivered;
+        };
+        
+        JobRunner runner;
+        runner.run(engine, {std::move(job)});
+        CHECK(delivered_at_done == 16);
+        CHECK(extracting_at_done == 0);
+        CHECK(extracted == 16);
+    }
+    
+    SUBCASE("After a stop, once every on_extracted has returned") {
+        ParseJob job = first_pages(kFixture, 40);
+        std::atomic<bool> done{false};
+        std::atomic<bool> extracted_after_done{false};
+        job.on_extracted = [&](PageResult&) {
+            extracting++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            if (done) extracted_after_done = true;
+            extracted++;
+            extracting--;
+        };
+        job.on_page = [&](PageResult) { return ++delivered < 2; };
+        job.on_done = [&](int, const std::string&) {
+            extracting_at_done = extracting;
+            delivered_at_done = delivered;
+            done = true;
+        };
+        
+        JobRunner runner;
+        runner.run(engine, {std::move(job)});
+        CHECK(delivered_at_done == 2);
+        CHECK(extracting_at_done == 0);
+        CHECK(extracted >= 2);
+        
+        // Pages already extracting when the job stopped finish first
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_FALSE(extracted_after_done);
+    }
+    
+    SUBCASE("When the document cannot be opened") {
+        ParseJob job = first_pages("no_such_file.pdf", 4);
+        job.on_page = [&](PageResult) {
+            delivered++;
+            return true;
+        };
+        
+        JobRunner runner;
+        runner.run(engine, {std::move(job)});
+        CHECK(delivered == 0);
+        CHECK(runner.done[0].page_count == 0);
+        CHECK_FALSE(runner.done[0].error.empty());
+    }
+}
+
+TEST_CASE("ParseEngine auto-tunes on the pages parse_streaming extracts") {
+    REQUIRE_FIXTURE(kFixture);
+    
+    EngineTuning tuning;
+    tuning.auto_tune = true;
+    auto engine = std::make_shared<ParseEngine>(4, 0, MemoryLimits{}, tuning);
+    ParseOptions options;
+    options.page_output = PageOutput::PlainText;
+    FastPdfParser parser(options, engine);
+    auto state = [&]() { return engine->settings()["auto_tune"].get<std::string>(); };
+    CHECK(state() == "probing");
+    
+    // Every probe needs a few dozen pages; the document is read again if
+    // it runs out first, which restarts the probe it was in
+    for (int run = 0; run < 20 && state() != "done"; ++run) {
+        int pages = 0;
+        parser.parse_streaming(kFixture, [&](PageResult) {
+            return ++pages % 16 != 0 || state() != "done";
+        });
+    }
+    
+    nlohmann::json settings = engine->settings();
+    REQUIRE(settings["auto_tune"] == "done");
+    // Three worker counts, then two more depths at the fastest of them
+    REQUIRE(settings["probes"].size() == 5);
+    for (const auto& probe : settings["probes"]) {
+        CHECK(probe["pages_per_second"].get<double>() > 0);
+    }
+    CHECK(settings["concurrency"].get<size_t>() >= 2);
+    CHECK(settings["concurrency"].get<size_t>() <= 4);
+    CHECK(engine->max_pages_in_flight() == settings["max_pages_in_flight"].get<size_t>());
+}
+
+TEST_CASE("parse_streaming keeps a sliding window of pages") {
+    REQUIRE_FIXTURE(kFixture);
+    
+    const int window = 3;
+    ParseOptions options;
+    options.thread_count = 4;
+    options.max_pages_in_flight = window;
+    options.page_output = PageOutput::PlainText;
+    options.pages.limit(30);
+    FastPdfParser parser(options);
+    
+    // The engine moves the window on as page i is handed to the callback,
+    // so pages up to i + window may be in flight then
+    std::atomic<int> entered{0};
+    std::atomic<int> max_ahead{0};
+    auto on_extracted = [&](PageResult& page) {
+        int ahead = page.page_number - entered.load();
+        int seen = max_ahead.load();
+        while (ahead > seen && !max_ahead.compare_exchange_weak(seen, ahead)) {
+        }
+    };
+    
+    SUBCASE("Every page, in order") {
+        std::vector<int> pages;
+        parser.parse_streaming(kFixture, [&](PageResult page) {
+            entered++;
+            CHECK(page.success);
+            pages.push_back(page.page_number);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            return true;
+        }, on_extracted);
+        
+        REQUIRE(pages.size() == 30);
+        for (int i = 0; i < 30; ++i) CHECK(pages[i] == i);
+        CHECK(max_ahead.load() >= 1);
+        CHECK(max_ahead.load() <= window);
+    }
+    
+    SUBCASE("Stopping early") {
+        std::atomic<int> extracted{0};
+        int calls = 0;
+        parser.parse_streaming(kFixture, [&](PageResult page) {
+            entered++;
+            CHECK(page.page_number == calls);
+            return ++calls < 5;
+        }, [&](PageResult& page) {
+            on_extracted(page);
+            extracted++;
+        });
+        
+        // on_extracted calls have all returned; nothing past the window ran
+        CHECK(calls == 5);
+        int after = extracted.load();
+        CHECK(after <= 5 + window);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(extracted.load() == after);
+        CHECK(max_ahead.load() <= window);
+    }
+    
+    SUBCASE("A throwing callback") {
+        int calls = 0;
+        CHECK_THROWS_AS(parser.parse_streaming(kFixture, [&](PageResult) -> bool {
+            if (++calls == 3) throw std::logic_error("stop");
+            return true;
+        }), std::logic_error);
+        CHECK(calls == 3);
+    }
+}
+#endif // ENABLE_TESTS
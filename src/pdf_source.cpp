@@ -0,0 +1,189 @@
+#include "fast_pdf_parser/pdf_source.h"
+#include <atomic>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fast_pdf_parser {
+
+namespace {
+
+// Paths cannot contain NUL, so memory keys never collide with a file's
+std::string next_memory_key() {
+    static std::atomic<uint64_t> next_id{1};
+    return std::string(1, '\0') + "memory:" + std::to_string(next_id.fetch_add(1));
+}
+
+// A read-only view of a whole file, unmapped when the last copy of the
+// source lets go of it
+class FileMapping {
+public:
+    explicit FileMapping(const std::string& path) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open PDF file: " + path);
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to stat PDF file: " + path);
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                data_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+        if (size_ > 0 && !data_) {
+            throw std::runtime_error("Failed to map PDF file: " + path);
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open PDF file: " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat PDF file: " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data_ = mapped;
+                // MuPDF seeks around (xref at the end, objects on demand)
+                ::madvise(mapped, size_, MADV_RANDOM);
+            }
+        }
+        ::close(fd);
+        if (size_ > 0 && !data_) {
+            throw std::runtime_error("Failed to map PDF file: " + path);
+        }
+#endif
+    }
+    
+    ~FileMapping() {
+        if (!data_) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        ::munmap(data_, size_);
+#endif
+    }
+    
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+    
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace
+
+PdfSource::PdfSource(std::string path) : name_(path), key_(std::move(path)) {
+}
+
+PdfSource PdfSource::memory(const void* data, size_t size, std::shared_ptr<const void> owner,
+                            std::string name) {
+    PdfSource source;
+    source.name_ = std::move(name);
+    source.key_ = next_memory_key();
+    source.in_memory_ = true;
+    source.data_ = static_cast<const unsigned char*>(data);
+    source.size_ = size;
+    source.owner_ = std::move(owner);
+    return source;
+}
+
+PdfSource PdfSource::memory(std::string bytes, std::string name) {
+    auto owned = std::make_shared<const std::string>(std::move(bytes));
+    return memory(owned->data(), owned->size(), owned, std::move(name));
+}
+
+PdfSource PdfSource::mapped_file(const std::string& path) {
+    auto mapping = std::make_shared<const FileMapping>(path);
+    return memory(mapping->data(), mapping->size(), mapping, path);
+}
+
+} // namespace fast_pdf_parser
+
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+TEST_CASE("PdfSource memory, file and mapped sources") {
+    using namespace fast_pdf_parser;
+    
+    SUBCASE("Paths convert to file sources keyed by path") {
+        PdfSource source = std::string("docs/a.pdf");
+        CHECK_FALSE(source.in_memory());
+        CHECK(source.name() == "docs/a.pdf");
+        CHECK(source.key() == "docs/a.pdf");
+    }
+    
+    SUBCASE("Memory sources share a key across copies only") {
+        PdfSource first = PdfSource::memory(std::string("%PDF-1.4 first"));
+        PdfSource copy = first;
+        PdfSource second = PdfSource::memory(std::string("%PDF-1.4 first"));
+        
+        CHECK(first.in_memory());
+        CHECK(copy.key() == first.key());
+        CHECK(copy.data() == first.data());
+        CHECK(second.key() != first.key());
+        CHECK(first.key() != "memory.pdf");
+        CHECK(std::string(reinterpret_cast<const char*>(first.data()), first.size()) == "%PDF-1.4 first");
+    }
+    
+    SUBCASE("Memory sources keep their owner alive") {
+        auto bytes = std::make_shared<std::string>("%PDF-1.7");
+        std::weak_ptr<std::string> watch = bytes;
+        {
+            PdfSource source = PdfSource::memory(bytes->data(), bytes->size(), bytes, "in.pdf");
+            bytes.reset();
+            CHECK_FALSE(watch.expired());
+            CHECK(source.name() == "in.pdf");
+        }
+        CHECK(watch.expired());
+    }
+    
+    SUBCASE("Mapped files read the file's bytes") {
+        auto path = std::filesystem::temp_directory_path() / "fast_pdf_parser_source_test.pdf";
+        std::string contents = "%PDF-1.4\n" + std::string(10000, 'x') + "\n%%EOF\n";
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << contents;
+        }
+        
+        {
+            PdfSource source = PdfSource::mapped_file(path.string());
+            CHECK(source.in_memory());
+            CHECK(source.name() == path.string());
+            REQUIRE(source.size() == contents.size());
+            CHECK(std::memcmp(source.data(), contents.data(), contents.size()) == 0);
+        }
+        std::filesystem::remove(path);
+        
+        CHECK_THROWS_AS(PdfSource::mapped_file(path.string()), std::runtime_error);
+    }
+}
+#endif // ENABLE_TESTS
\ No newline at end of file
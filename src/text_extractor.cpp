@@ -1,131 +1,755 @@
 #include "fast_pdf_parser/text_extractor.h"
+#include "fast_pdf_parser/metrics.h"
 #include <mupdf/fitz.h>
 #include <mupdf/pdf.h>
 #include <stdexcept>
 #include <vector>
 #include <memory>
-#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
 
 namespace fast_pdf_parser {
 
+namespace {
+
+// Open documents kept per worker context. Small on purpose: a worker usually
+// only touches the document currently being parsed.
+constexpr size_t kMaxCachedDocuments = 8;
+
+// MuPDF allocates through the functions below, which account for every
+// byte. Each block starts with a header holding its size so that frees
+// can be subtracted; 16 bytes keeps the payload max-aligned.
+constexpr size_t kAllocHeader = 16;
+static_assert(kAllocHeader >= alignof(std::max_align_t), "MuPDF blocks must stay max-aligned");
+
+// Live MuPDF bytes, process-wide. Threads collect their changes locally
+// and publish them once they pass kFlushBytes, so allocating does not
+// bounce a shared cache line between workers.
+constexpr int64_t kFlushBytes = 64 * 1024;
+std::atomic<int64_t> g_mupdf_bytes{0};
+
+struct UnflushedBytes {
+    int64_t bytes = 0;
+    ~UnflushedBytes() { g_mupdf_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+};
+thread_local UnflushedBytes t_unflushed;
+
+// The page this thread is loading, while it has a ceiling
+struct PageBudget {
+    int64_t limit = 0;  // 0 = no page in progress, or no ceiling
+    int64_t held = 0;   // net bytes allocated on this thread since the page began
+    bool exceeded = false;
+};
+thread_local PageBudget t_page;
+
+void account(int64_t delta) {
+    int64_t& bytes = t_unflushed.bytes;
+    bytes += delta;
+    if (bytes >= kFlushBytes || bytes <= -kFlushBytes) {
+        g_mupdf_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        bytes = 0;
+    }
+    if (t_page.limit > 0) {
+        t_page.held += delta;
+    }
+}
+
+// Refusing an allocation makes MuPDF evict from its store and retry, then
+// throw, which fails the page
+bool page_allows(size_t more) {
+    if (t_page.limit == 0 || t_page.held + static_cast<int64_t>(more) <= t_page.limit) {
+        return true;
+    }
+    t_page.exceeded = true;
+    return false;
+}
+
+// Small blocks (stext chars and lines, PDF objects) are recycled through
+// a per-thread cache of free blocks in 16-byte size classes, so the burst
+// of allocations while a page is built and the frees when it is dropped
+// stay off the shared heap. There is no arena reset: a page also creates
+// fonts, store entries and document objects that outlive it, so its
+// blocks cannot be freed in bulk. Instead each finished page trims the
+// cache back to kRetainedBytes. Every block is a plain malloc block sized
+// round_up(size) for small sizes, so any thread may free or realloc it.
+constexpr size_t kSizeClass = 16;
+constexpr size_t kMaxPooledSize = 512;
+constexpr size_t kClasses = kMaxPooledSize / kSizeClass;
+constexpr size_t kMaxCachedBytes = 4 * 1024 * 1024;  // per thread, while a page runs
+constexpr size_t kRetainedBytes = 1024 * 1024;       // per thread, between pages
+
+size_t block_capacity(size_t size) {
+    return size <= kMaxPooledSize ? (size + kSizeClass - 1) / kSizeClass * kSizeClass : size;
+}
+
+struct BlockCache {
+    void *free_blocks[kClasses] = {};  // linked through their first bytes
+    size_t bytes = 0;
+    bool alive = true;  // frees after thread exit go straight to the heap
+    // Not yet added to the metrics; published when a page ends
+    uint64_t allocations = 0;
+    uint64_t pooled = 0;
+    
+    static size_t class_of(size_t size) { return (block_capacity(size) - 1) / kSizeClass; }
+    
+    void *take(size_t size) {
+        if (size == 0 || size > kMaxPooledSize) return nullptr;
+        size_t c = class_of(size);
+        void *block = free_blocks[c];
+        if (block) {
+            std::memcpy(&free_blocks[c], block, sizeof(void*));
+            bytes -= (c + 1) * kSizeClass;
+            pooled++;
+        }
+        return block;
+    }
+    
+    bool give(void *block, size_t size) {
+        if (!alive || size == 0 || size > kMaxPooledSize || bytes + block_capacity(size) > kMaxCachedBytes) {
+            return false;
+        }
+        size_t c = class_of(size);
+        std::memcpy(block, &free_blocks[c], sizeof(void*));
+        free_blocks[c] = block;
+        bytes += (c + 1) * kSizeClass;
+        return true;
+    }
+    
+    // Largest classes go first; the small ones are reused the most
+    void trim(size_t keep) {
+        for (size_t c = kClasses; c-- > 0 && bytes > keep;) {
+            while (free_blocks[c] && bytes > keep) {
+                void *block = free_blocks[c];
+                std::memcpy(&free_blocks[c], block, sizeof(void*));
+                std::free(block);
+                bytes -= (c + 1) * kSizeClass;
+            }
+        }
+    }
+    
+    void publish() {
+        if (allocations > 0) add_count(Counter::MupdfAllocations, allocations);
+        if (pooled > 0) add_count(Counter::MupdfAllocationsPooled, pooled);
+        allocations = 0;
+        pooled = 0;
+    }
+    
+    ~BlockCache() {
+        trim(0);
+        alive = false;
+    }
+};
+thread_local BlockCache t_blocks;
+
+// Called once a page's text and page objects are dropped
+void end_page_allocations() {
+    t_blocks.trim(kRetainedBytes);
+    t_blocks.publish();
+}
+
+void *mupdf_malloc(void *, size_t size) {
+    if (!page_allows(size)) return nullptr;
+    t_blocks.allocations++;
+    auto *block = static_cast<unsigned char*>(t_blocks.take(size));
+    if (!block) {
+        block = static_cast<unsigned char*>(std::malloc(block_capacity(size) + kAllocHeader));
+        if (!block) return nullptr;
+    }
+    std::memcpy(block, &size, sizeof(size));
+    account(static_cast<int64_t>(size));
+    return block + kAllocHeader;
+}
+
+void *mupdf_realloc(void *, void *old, size_t size) {
+    if (!old) return mupdf_malloc(nullptr, size);
+    
+    auto *block = static_cast<unsigned char*>(old) - kAllocHeader;
+    size_t old_size;
+    std::memcpy(&old_size, block, sizeof(old_size));
+    if (size > old_size && !page_allows(size - old_size)) return nullptr;
+    
+    // Same size class: the block already has room
+    unsigned char *moved = block;
+    if (block_capacity(size) != block_capacity(old_size)) {
+        moved = static_cast<unsigned char*>(std::realloc(block, block_capacity(size) + kAllocHeader));
+        if (!moved) return nullptr;
+    }
+    std::memcpy(moved, &size, sizeof(size));
+    account(static_cast<int64_t>(size) - static_cast<int64_t>(old_size));
+    return moved + kAllocHeader;
+}
+
+void mupdf_free(void *, void *ptr) {
+    if (!ptr) return;
+    auto *block = static_cast<unsigned char*>(ptr) - kAllocHeader;
+    size_t size;
+    std::memcpy(&size, block, sizeof(size));
+    account(-static_cast<int64_t>(size));
+    if (!t_blocks.give(block, size)) {
+        std::free(block);
+    }
+}
+
+const fz_alloc_context kMupdfAlloc = { nullptr, mupdf_malloc, mupdf_realloc, mupdf_free };
+
+} // namespace
+
+size_t mupdf_memory_in_use() {
+    int64_t bytes = g_mupdf_bytes.load(std::memory_order_relaxed);
+    return bytes > 0 ? static_cast<size_t>(bytes) : 0;  // frees may be published first
+}
+
 class TextExtractor::Impl {
 public:
-    Impl() {
-        ctx = fz_new_context(NULL, NULL, FZ_STORE_UNLIMITED);
+    explicit Impl(const MemoryLimits& limits) : limits_(limits) {
+        locks_.user = this;
+        locks_.lock = lock_callback;
+        locks_.unlock = unlock_callback;
+        
+        // The store limit is shared by the cloned worker contexts
+        ctx = fz_new_context(&kMupdfAlloc, &locks_, limits_.store_limit);
         if (!ctx) {
             throw std::runtime_error("Failed to create MuPDF context");
         }
         fz_register_document_handlers(ctx);
+        handle_ = std::make_shared<Handle>();
+        handle_->impl = this;
     }
     
     ~Impl() {
+        // Waits for a thread that is exiting to finish releasing its context
+        {
+            std::lock_guard<std::mutex> lock(handle_->mutex);
+            handle_->impl = nullptr;
+        }
+        
+        // Cloned contexts share the base context's store and locks, so they
+        // (and the documents opened in them) must go first.
+        for (auto& [id, worker] : workers_) {
+            drop_worker(*worker);
+        }
+        workers_.clear();
+        
         if (ctx) {
             fz_drop_context(ctx);
         }
     }
-
-    nlohmann::json extract_page(const std::string& pdf_path, int page_number, 
+    
+    nlohmann::json extract_page(const PdfSource& source, int page_number,
                                const ExtractOptions& options) {
-        if (page_number % 50 == 0) {
-            std::cout << "[TextExtractor::extract_page] Extracting page " << page_number << std::endl;
+        if (page_number % 50 == 0 && log_enabled(LogLevel::Debug)) {
+            log_message(LogLevel::Debug, "[TextExtractor::extract_page] Extracting page " + std::to_string(page_number));
         }
         
-        fz_document *doc = nullptr;
-        fz_page *page = nullptr;
-        fz_stext_page *stext = nullptr;
+        WorkerContext& worker = worker_context();
+        std::lock_guard<std::mutex> in_use(worker.in_use);
+        CachedDocument& cached = open_cached_document(worker, source);
         
-        fz_var(doc);
-        fz_var(page);
-        fz_var(stext);
+        if (page_number < 0 || page_number >= cached.page_count) {
+            throw std::out_of_range("Page number out of range");
+        }
+        
+        return extract_page_from_document(worker.ctx, cached.doc, page_number, options);
+    }
+    
+    PageText extract_page_text(const PdfSource& source, int page_number) {
+        if (page_number % 50 == 0 && log_enabled(LogLevel::Debug)) {
+            log_message(LogLevel::Debug, "[TextExtractor::extract_page_text] Extracting page " + std::to_string(page_number));
+        }
+        
+        WorkerContext& worker = worker_context();
+        std::lock_guard<std::mutex> in_use(worker.in_use);
+        CachedDocument& cached = open_cached_document(worker, source);
+        
+        if (page_number < 0 || page_number >= cached.page_count) {
+            throw std::out_of_range("Page number out of range");
+        }
+        
+        PageText result;
+        result.page_number = page_number;
+        
+        with_stext_page(worker.ctx, cached.doc, page_number, [&](fz_stext_page *stext) {
+            stext_to_text(stext, result);
+        });
+        
+        return result;
+    }
+    
+    PageLayout extract_page_layout(const PdfSource& source, int page_number,
+                                   const ExtractOptions& options) {
+        if (page_number % 50 == 0 && log_enabled(LogLevel::Debug)) {
+            log_message(LogLevel::Debug, "[TextExtractor::extract_page_layout] Extracting page " + std::to_string(page_number));
+        }
+        
+        WorkerContext& worker = worker_context();
+        std::lock_guard<std::mutex> in_use(worker.in_use);
+        CachedDocument& cached = open_cached_document(worker, source);
+        
+        if (page_number < 0 || page_number >= cached.page_count) {
+            throw std::out_of_range("Page number out of range");
+        }
+        
+        PageLayout result;
+        result.page_number = page_number;
+        
+        with_stext_page(worker.ctx, cached.doc, page_number, [&](fz_stext_page *stext) {
+            stext_to_layout(worker.ctx, stext, options, result);
+        });
+        
+        return result;
+    }
+    
+    nlohmann::json extract_all_pages(const PdfSource& source,
+                                    const ExtractOptions& options) {
+        if (log_enabled(LogLevel::Debug)) {
+            log_message(LogLevel::Debug, "[TextExtractor::extract_all_pages] Starting extraction for all pages from " + source.name());
+        }
         
         nlohmann::json result;
+        result["pages"] = nlohmann::json::array();
+        
+        WorkerContext& worker = worker_context();
+        std::lock_guard<std::mutex> in_use(worker.in_use);
+        CachedDocument& cached = open_cached_document(worker, source);
+        
+        int page_count = cached.page_count;
+        if (log_enabled(LogLevel::Debug)) {
+            log_message(LogLevel::Debug, "[TextExtractor::extract_all_pages] Document has " + std::to_string(page_count) + " pages");
+        }
+        result["page_count"] = page_count;
+        
+        for (int i = 0; i < page_count; ++i) {
+            if (i % 50 == 0 && log_enabled(LogLevel::Debug)) {
+                log_message(LogLevel::Debug, "[TextExtractor::extract_all_pages] Processing page " +
+                            std::to_string(i) + "/" + std::to_string(page_count));
+            }
+            try {
+                auto page_data = extract_page_from_document(worker.ctx, cached.doc, i, options);
+                result["pages"].push_back(page_data);
+            } catch (const std::exception& e) {
+                // Log error but continue processing
+                add_count(Counter::PageErrors);
+                nlohmann::json error_page;
+                error_page["page_number"] = i;
+                error_page["error"] = e.what();
+                result["pages"].push_back(error_page);
+            }
+        }
+        
+        return result;
+    }
+    
+    int get_page_count(const PdfSource& source) {
+        if (log_enabled(LogLevel::Debug)) {
+            log_message(LogLevel::Debug, "[TextExtractor::get_page_count] Getting page count for " + source.name());
+        }
+        
+        WorkerContext& worker = worker_context();
+        int page_count;
+        {
+            std::lock_guard<std::mutex> in_use(worker.in_use);
+            page_count = open_cached_document(worker, source).page_count;
+        }
+        if (log_enabled(LogLevel::Debug)) {
+            log_message(LogLevel::Debug, "[TextExtractor::get_page_count] Document has " +
+                        std::to_string(page_count) + " pages");
+        }
         
-        fz_try(ctx) {
-            doc = fz_open_document(ctx, pdf_path.c_str());
-            if (!doc) {
-                throw std::runtime_error("Failed to open PDF document");
+        return page_count;
+    }
+    
+    const MemoryLimits& memory_limits() const { return limits_; }
+    
+    bool over_memory_budget() const {
+        return limits_.max_memory_in_flight > 0 && mupdf_memory_in_use() > limits_.max_memory_in_flight;
+    }
+    
+    // Drops source from every worker's cache. The documents are dropped
+    // on this thread, with each worker's context while its owner is not
+    // using it, which MuPDF allows.
+    void close(const PdfSource& source) {
+        std::vector<std::shared_ptr<WorkerContext>> workers;
+        {
+            std::lock_guard<std::mutex> lock(workers_mutex_);
+            for (const auto& entry : workers_) {
+                workers.push_back(entry.second);
+            }
+        }
+        for (const auto& worker : workers) {
+            std::lock_guard<std::mutex> in_use(worker->in_use);
+            if (!worker->ctx) continue;  // released meanwhile
+            auto& documents = worker->documents;
+            for (auto it = documents.begin(); it != documents.end();) {
+                if (it->key == source.key()) {
+                    fz_drop_document(worker->ctx, it->doc);
+                    it = documents.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+private:
+    struct CachedDocument {
+        std::string key;  // PdfSource::key()
+        std::filesystem::file_time_type mtime;
+        std::uintmax_t size = 0;
+        std::shared_ptr<const void> bytes;  // a memory source's owner, read by doc
+        fz_document *doc = nullptr;
+        int page_count = 0;
+    };
+    
+    // One cloned context per calling thread, together with the documents that
+    // thread has open. A context and its documents are used by one thread at
+    // a time, which is what MuPDF requires: the thread that owns them, or
+    // close() under in_use. They are released when that thread exits (see
+    // ThreadContexts).
+    struct WorkerContext {
+        fz_context *ctx = nullptr;  // null once released
+        std::vector<CachedDocument> documents;  // most recently used last
+        std::mutex in_use;  // held by the owner while extracting, and by close()
+    };
+    
+    // Lets a thread that is exiting reach the extractors it has a context
+    // in; impl is cleared before the extractor goes away
+    struct Handle {
+        std::mutex mutex;
+        Impl *impl = nullptr;
+    };
+    
+    // Per thread: releases the thread's contexts when it exits, so threads
+    // that come and go (callers' own threads, a pool torn down before the
+    // extractor) do not leave a context and its open documents behind for
+    // the extractor's lifetime. Created after the thread's first MuPDF
+    // allocation, so it is destroyed before the allocator's thread_locals
+    // that releasing the context still uses.
+    struct ThreadContexts {
+        std::vector<std::weak_ptr<Handle>> extractors;
+        
+        ~ThreadContexts() {
+            for (auto& weak : extractors) {
+                if (auto handle = weak.lock()) {
+                    std::lock_guard<std::mutex> lock(handle->mutex);
+                    if (handle->impl) handle->impl->release_worker(std::this_thread::get_id());
+                }
             }
+        }
+    };
+    
+    static ThreadContexts& thread_contexts() {
+        thread_local ThreadContexts contexts;
+        return contexts;
+    }
+    
+    static void drop_worker(WorkerContext& worker) {
+        std::lock_guard<std::mutex> in_use(worker.in_use);
+        for (auto& cached : worker.documents) {
+            fz_drop_document(worker.ctx, cached.doc);
+        }
+        worker.documents.clear();
+        fz_drop_context(worker.ctx);
+        worker.ctx = nullptr;
+    }
+    
+    void release_worker(std::thread::id id) {
+        std::shared_ptr<WorkerContext> worker;
+        {
+            std::lock_guard<std::mutex> lock(workers_mutex_);
+            auto it = workers_.find(id);
+            if (it == workers_.end()) return;
+            worker = std::move(it->second);
+            workers_.erase(it);
+        }
+        drop_worker(*worker);
+    }
+    
+    static void lock_callback(void *user, int lock) {
+        static_cast<Impl*>(user)->mupdf_mutexes_[lock].lock();
+    }
+    
+    static void unlock_callback(void *user, int lock) {
+        static_cast<Impl*>(user)->mupdf_mutexes_[lock].unlock();
+    }
+    
+    WorkerContext& worker_context() {
+        std::lock_guard<std::mutex> lock(workers_mutex_);
+        
+        auto& worker = workers_[std::this_thread::get_id()];
+        if (!worker) {
+            auto created = std::make_shared<WorkerContext>();
+            created->ctx = fz_clone_context(ctx);
+            if (!created->ctx) {
+                workers_.erase(std::this_thread::get_id());
+                throw std::runtime_error("Failed to clone MuPDF context");
+            }
+            worker = std::move(created);
+            
+            auto& extractors = thread_contexts().extractors;
+            extractors.erase(std::remove_if(extractors.begin(), extractors.end(),
+                                            [](const std::weak_ptr<Handle>& weak) { return weak.expired(); }),
+                             extractors.end());
+            extractors.push_back(handle_);
+        }
+        return *worker;
+    }
+    
+    CachedDocument& open_cached_document(WorkerContext& worker, const PdfSource& source) {
+        // A file rewritten in place must not be served from a stale handle.
+        // Memory sources cannot change, their keys are unique to the bytes.
+        std::error_code ec;
+        std::filesystem::file_time_type mtime;
+        std::uintmax_t size = 0;
+        if (!source.in_memory()) {
+            mtime = std::filesystem::last_write_time(source.name(), ec);
+            size = ec ? 0 : std::filesystem::file_size(source.name(), ec);
+        }
+        
+        auto& documents = worker.documents;
+        for (size_t i = 0; i < documents.size(); ++i) {
+            if (documents[i].key != source.key()) continue;
             
-            int page_count = fz_count_pages(ctx, doc);
-            if (page_number < 0 || page_number >= page_count) {
-                throw std::out_of_range("Page number out of range");
+            if (!ec && documents[i].mtime == mtime && documents[i].size == size) {
+                if (i + 1 != documents.size()) {
+                    std::rotate(documents.begin() + i, documents.begin() + i + 1, documents.end());
+                }
+                return documents.back();
             }
             
-            page = fz_load_page(ctx, doc, page_number);
+            fz_drop_document(worker.ctx, documents[i].doc);
+            documents.erase(documents.begin() + i);
+            break;
+        }
+        
+        fz_context *wctx = worker.ctx;
+        fz_document *doc = nullptr;
+        fz_stream *stream = nullptr;
+        int page_count = 0;
+        bool failed = false;
+        fz_var(doc);
+        fz_var(stream);
+        auto open_start = std::chrono::steady_clock::now();
+        
+        fz_try(wctx) {
+            if (source.in_memory()) {
+                // Read in place; the name doubles as the format hint
+                stream = fz_open_memory(wctx, source.data(), source.size());
+                doc = fz_open_document_with_stream(wctx, source.name().c_str(), stream);
+            } else {
+                doc = fz_open_document(wctx, source.name().c_str());
+            }
+            page_count = fz_count_pages(wctx, doc);
+        }
+        fz_always(wctx) {
+            fz_drop_stream(wctx, stream);  // the document keeps its own reference
+        }
+        fz_catch(wctx) {
+            if (doc) fz_drop_document(wctx, doc);
+            doc = nullptr;
+            failed = true;
+        }
+        
+        if (failed || !doc) {
+            throw std::runtime_error("Failed to open PDF document");
+        }
+        record_latency(Stage::Open, open_start, std::chrono::steady_clock::now());
+        add_count(Counter::DocumentsOpened);
+        
+        if (documents.size() >= kMaxCachedDocuments) {
+            fz_drop_document(wctx, documents.front().doc);
+            documents.erase(documents.begin());
+        }
+        
+        CachedDocument cached;
+        cached.key = source.key();
+        cached.mtime = mtime;
+        cached.size = size;
+        cached.bytes = source.owner();
+        cached.doc = doc;
+        cached.page_count = page_count;
+        documents.push_back(std::move(cached));
+        return documents.back();
+    }
+    
+    nlohmann::json extract_page_from_document(fz_context *wctx, fz_document *doc, int page_number,
+                                              const ExtractOptions& options) {
+        nlohmann::json result;
+        
+        with_stext_page(wctx, doc, page_number, [&](fz_stext_page *stext) {
+            // Convert to JSON
+            result = stext_to_json(wctx, stext, options);
+            result["page_number"] = page_number;
+        });
+        
+        return result;
+    }
+    
+    // Loads the page, builds its structured text and hands it to `consume`.
+    // `consume` runs outside the MuPDF try block, so it may throw C++
+    // exceptions freely; the page is released either way.
+    template<typename Consume>
+    void with_stext_page(fz_context *wctx, fz_document *doc, int page_number, Consume&& consume) {
+        fz_page *page = nullptr;
+        fz_stext_page *stext = nullptr;
+        bool failed = false;
+        
+        auto load_start = std::chrono::steady_clock::now();
+        auto stext_start = load_start;
+        
+        fz_var(page);
+        fz_var(stext);
+        fz_var(stext_start);
+        
+        // Counts what this thread allocates until the text is built; the
+        // page's own buffers are freed later, outside the budget
+        t_page = PageBudget{static_cast<int64_t>(limits_.max_memory_per_page), 0, false};
+        
+        fz_try(wctx) {
+            page = fz_load_page(wctx, doc, page_number);
+            stext_start = std::chrono::steady_clock::now();
             
             // Extract structured text
             fz_stext_options opts = { 0 };
             opts.flags = FZ_STEXT_PRESERVE_LIGATURES | FZ_STEXT_PRESERVE_WHITESPACE;
             // Don't inhibit spaces - we need them for proper text extraction
             
-            stext = fz_new_stext_page_from_page(ctx, page, &opts);
-            
-            // Convert to JSON
-            result = stext_to_json(stext, options);
-            result["page_number"] = page_number;
+            stext = fz_new_stext_page_from_page(wctx, page, &opts);
         }
-        fz_always(ctx) {
-            if (stext) fz_drop_stext_page(ctx, stext);
-            if (page) fz_drop_page(ctx, page);
-            if (doc) fz_drop_document(ctx, doc);
+        fz_catch(wctx) {
+            failed = true;
         }
-        fz_catch(ctx) {
+        bool over_budget = t_page.exceeded;
+        t_page = PageBudget{};
+        
+        // MuPDF may have recovered from a refused allocation with a partial
+        // page; that page still fails
+        if (failed || over_budget) {
+            if (stext) fz_drop_stext_page(wctx, stext);
+            if (page) fz_drop_page(wctx, page);
+            end_page_allocations();
+            if (over_budget) {
+                add_count(Counter::PagesOverMemoryLimit);
+                throw std::runtime_error("Page " + std::to_string(page_number) + " needs more than " +
+                                         std::to_string(limits_.max_memory_per_page / (1024 * 1024)) +
+                                         " MB (max_memory_per_page)");
+            }
             throw std::runtime_error("MuPDF error during text extraction");
         }
+        auto stext_end = std::chrono::steady_clock::now();
+        record_latency(Stage::LoadPage, load_start, stext_start);
+        record_latency(Stage::Stext, stext_start, stext_end);
         
-        return result;
+        try {
+            consume(stext);
+        } catch (...) {
+            fz_drop_stext_page(wctx, stext);
+            fz_drop_page(wctx, page);
+            end_page_allocations();
+            throw;
+        }
+        
+        fz_drop_stext_page(wctx, stext);
+        fz_drop_page(wctx, page);
+        end_page_allocations();
+        add_count(Counter::PagesExtracted);
     }
     
-    nlohmann::json extract_all_pages(const std::string& pdf_path,
-                                    const ExtractOptions& options) {
-        std::cout << "[TextExtractor::extract_all_pages] Starting extraction for all pages from " << pdf_path << std::endl;
+    void stext_to_text(fz_stext_page *stext, PageText& out) {
+        for (fz_stext_block *block = stext->first_block; block; block = block->next) {
+            if (block->type != FZ_STEXT_BLOCK_TEXT) continue;
+            
+            for (fz_stext_line *line = block->u.t.first_line; line; line = line->next) {
+                out.line_offsets.push_back(static_cast<uint32_t>(out.text.size()));
+                
+                for (fz_stext_char *ch = line->first_char; ch; ch = ch->next) {
+                    char utf8[8];
+                    int len = fz_runetochar(utf8, ch->c);
+                    out.text.append(utf8, len);
+                }
+                out.text.push_back('\n');
+            }
+        }
+    }
+    
+    void stext_to_layout(fz_context *wctx, fz_stext_page *stext, const ExtractOptions& options,
+                         PageLayout& out) {
+        out.has_positions = options.extract_positions;
+        out.has_fonts = options.extract_fonts;
         
-        fz_document *doc = nullptr;
-        fz_var(doc);
+        std::unordered_map<fz_font*, uint16_t> font_ids;
         
-        nlohmann::json result;
-        result["pages"] = nlohmann::json::array();
+        auto push_rect = [](std::vector<float>& dst, const fz_rect& r) {
+            dst.insert(dst.end(), {r.x0, r.y0, r.x1, r.y1});
+        };
         
-        std::cout << "[TextExtractor::extract_all_pages] About to open document" << std::endl;
-        fz_try(ctx) {
-            doc = fz_open_document(ctx, pdf_path.c_str());
-            std::cout << "[TextExtractor::extract_all_pages] Document opened" << std::endl;
-            if (!doc) {
-                throw std::runtime_error("Failed to open PDF document");
-            }
+        for (fz_stext_block *block = stext->first_block; block; block = block->next) {
+            if (block->type != FZ_STEXT_BLOCK_TEXT) continue;
             
-            int page_count = fz_count_pages(ctx, doc);
-            std::cout << "[TextExtractor::extract_all_pages] Document has " << page_count << " pages" << std::endl;
-            result["page_count"] = page_count;
+            out.block_line_begin.push_back(static_cast<uint32_t>(out.line_char_begin.size()));
+            if (out.has_positions) push_rect(out.block_bboxes, block->bbox);
             
-            for (int i = 0; i < page_count; ++i) {
-                if (i % 50 == 0) {
-                    std::cout << "[TextExtractor::extract_all_pages] Processing page " << i << "/" << page_count << std::endl;
-                }
-                try {
-                    auto page_data = extract_page(pdf_path, i, options);
-                    result["pages"].push_back(page_data);
-                } catch (const std::exception& e) {
-                    // Log error but continue processing
-                    nlohmann::json error_page;
-                    error_page["page_number"] = i;
-                    error_page["error"] = e.what();
-                    result["pages"].push_back(error_page);
+            for (fz_stext_line *line = block->u.t.first_line; line; line = line->next) {
+                out.line_offsets.push_back(static_cast<uint32_t>(out.text.size()));
+                out.line_char_begin.push_back(static_cast<uint32_t>(out.char_offsets.size()));
+                if (out.has_positions) push_rect(out.line_bboxes, line->bbox);
+                
+                for (fz_stext_char *ch = line->first_char; ch; ch = ch->next) {
+                    out.char_offsets.push_back(static_cast<uint32_t>(out.text.size()));
+                    
+                    char utf8[8];
+                    int len = fz_runetochar(utf8, ch->c);
+                    out.text.append(utf8, len);
+                    
+                    if (out.has_positions) {
+                        const fz_quad& q = ch->quad;
+                        out.quads.insert(out.quads.end(), {q.ul.x, q.ul.y, q.ur.x, q.ur.y,
+                                                           q.ll.x, q.ll.y, q.lr.x, q.lr.y});
+                        out.origins.insert(out.origins.end(), {ch->origin.x, ch->origin.y});
+                    }
+                    
+                    if (out.has_fonts) {
+                        out.sizes.push_back(ch->size);
+                        out.font_ids.push_back(intern_font(wctx, ch->font, font_ids, out.fonts));
+                    }
                 }
+                out.text.push_back('\n');
             }
         }
-        fz_always(ctx) {
-            if (doc) fz_drop_document(ctx, doc);
-        }
-        fz_catch(ctx) {
-            throw std::runtime_error("MuPDF error during document processing");
-        }
+    }
+    
+    uint16_t intern_font(fz_context *wctx, fz_font *font,
+                         std::unordered_map<fz_font*, uint16_t>& ids,
+                         std::vector<FontInfo>& fonts) {
+        if (!font) return PageLayout::kNoFont;
         
-        return result;
+        auto it = ids.find(font);
+        if (it != ids.end()) return it->second;
+        
+        // A page with more distinct fonts than ids left just stops interning
+        if (fonts.size() >= PageLayout::kNoFont) return PageLayout::kNoFont;
+        
+        FontInfo info;
+        const char *name = fz_font_name(wctx, font);
+        info.name = name ? name : "unknown";
+        info.is_bold = fz_font_is_bold(wctx, font);
+        info.is_italic = fz_font_is_italic(wctx, font);
+        info.is_monospace = fz_font_is_monospaced(wctx, font);
+        
+        uint16_t id = static_cast<uint16_t>(fonts.size());
+        fonts.push_back(std::move(info));
+        ids.emplace(font, id);
+        return id;
     }
-
-private:
-    nlohmann::json stext_to_json(fz_stext_page *stext, const ExtractOptions& options) {
+    
+    nlohmann::json stext_to_json(fz_context *wctx, fz_stext_page *stext, const ExtractOptions& options) {
         nlohmann::json result;
         result["blocks"] = nlohmann::json::array();
         
@@ -167,7 +791,7 @@ private:
                         }
                         
                         if (options.extract_fonts) {
-                            char_json["font"] = font_to_json(ch->font);
+                            char_json["font"] = font_to_json(wctx, ch->font);
                             char_json["size"] = ch->size;
                         }
                         
@@ -208,65 +832,481 @@ private:
         };
     }
     
-    nlohmann::json font_to_json(fz_font *font) {
+    nlohmann::json font_to_json(fz_context *wctx, fz_font *font) {
         if (!font) return nullptr;
         
         nlohmann::json font_json;
-        const char *name = fz_font_name(ctx, font);
+        const char *name = fz_font_name(wctx, font);
         font_json["name"] = name ? name : "unknown";
-        font_json["is_bold"] = fz_font_is_bold(ctx, font);
-        font_json["is_italic"] = fz_font_is_italic(ctx, font);
-        font_json["is_monospace"] = fz_font_is_monospaced(ctx, font);
+        font_json["is_bold"] = fz_font_is_bold(wctx, font);
+        font_json["is_italic"] = fz_font_is_italic(wctx, font);
+        font_json["is_monospace"] = fz_font_is_monospaced(wctx, font);
         
         return font_json;
     }
     
-public:
-    int get_page_count(const std::string& pdf_path) {
-        std::cout << "[TextExtractor::get_page_count] Getting page count for " << pdf_path << std::endl;
-        
-        fz_document *doc = nullptr;
-        fz_var(doc);
-        
-        int page_count = 0;
+    const MemoryLimits limits_;
+    fz_context *ctx;
+    fz_locks_context locks_;
+    std::mutex mupdf_mutexes_[FZ_LOCK_MAX];
+    
+    std::mutex workers_mutex_;
+    // Shared with close(), which may still hold one released meanwhile
+    std::unordered_map<std::thread::id, std::shared_ptr<WorkerContext>> workers_;
+    std::shared_ptr<Handle> handle_;
+};
+
+nlohmann::json PageLayout::to_json() const {
+    auto rect_json = [](const std::vector<float>& v, size_t i) -> nlohmann::json {
+        const float *r = &v[i * 4];
+        return {{"x0", r[0]}, {"y0", r[1]}, {"x1", r[2]}, {"y1", r[3]}};
+    };
+    
+    nlohmann::json result;
+    result["blocks"] = nlohmann::json::array();
+    
+    size_t lines = line_count();
+    size_t chars = char_count();
+    
+    for (size_t b = 0; b < block_count(); ++b) {
+        nlohmann::json block_json;
+        block_json["type"] = "text";
+        block_json["lines"] = nlohmann::json::array();
+        if (has_positions) block_json["bbox"] = rect_json(block_bboxes, b);
         
-        fz_try(ctx) {
-            doc = fz_open_document(ctx, pdf_path.c_str());
-            if (!doc) {
-                throw std::runtime_error("Failed to open PDF document");
+        size_t line_end = b + 1 < block_count() ? block_line_begin[b + 1] : lines;
+        for (size_t l = block_line_begin[b]; l < line_end; ++l) {
+            nlohmann::json line_json;
+            line_json["chars"] = nlohmann::json::array();
+            if (has_positions) line_json["bbox"] = rect_json(line_bboxes, l);
+            
+            size_t char_end = l + 1 < lines ? line_char_begin[l + 1] : chars;
+            for (size_t c = line_char_begin[l]; c < char_end; ++c) {
+                size_t byte_end = c + 1 < char_end ? char_offsets[c + 1]
+                                                   : (l + 1 < lines ? line_offsets[l + 1] : text.size()) - 1;
+                
+                nlohmann::json char_json;
+                char_json["char"] = text.substr(char_offsets[c], byte_end - char_offsets[c]);
+                
+                if (has_positions) {
+                    const float *q = &quads[c * 8];
+                    char_json["bbox"] = {
+                        {"ul_x", q[0]}, {"ul_y", q[1]},
+                        {"ur_x", q[2]}, {"ur_y", q[3]},
+                        {"ll_x", q[4]}, {"ll_y", q[5]},
+                        {"lr_x", q[6]}, {"lr_y", q[7]}
+                    };
+                    char_json["origin_x"] = origins[c * 2];
+                    char_json["origin_y"] = origins[c * 2 + 1];
+                }
+                
+                if (has_fonts) {
+                    if (font_ids[c] == kNoFont) {
+                        char_json["font"] = nullptr;
+                    } else {
+                        const FontInfo& font = fonts[font_ids[c]];
+                        char_json["font"] = {
+                            {"name", font.name},
+                            {"is_bold", static_cast<int>(font.is_bold)},
+                            {"is_italic", static_cast<int>(font.is_italic)},
+                            {"is_monospace", static_cast<int>(font.is_monospace)}
+                        };
+                    }
+                    char_json["size"] = sizes[c];
+                }
+                
+                line_json["chars"].push_back(char_json);
             }
             
-            page_count = fz_count_pages(ctx, doc);
-            std::cout << "[TextExtractor::get_page_count] Document has " << page_count << " pages" << std::endl;
-        }
-        fz_always(ctx) {
-            if (doc) fz_drop_document(ctx, doc);
-        }
-        fz_catch(ctx) {
-            throw std::runtime_error("MuPDF error getting page count");
+            size_t text_begin = line_offsets[l];
+            size_t text_end = (l + 1 < lines ? line_offsets[l + 1] : text.size()) - 1;
+            line_json["text"] = text.substr(text_begin, text_end - text_begin);
+            block_json["lines"].push_back(line_json);
         }
         
-        return page_count;
+        result["blocks"].push_back(block_json);
     }
     
-    fz_context *ctx;
-};
+    result["page_number"] = page_number;
+    return result;
+}
 
-TextExtractor::TextExtractor() : pImpl(std::make_unique<Impl>()) {}
+TextExtractor::TextExtractor(const MemoryLimits& limits) : pImpl(std::make_unique<Impl>(limits)) {}
 TextExtractor::~TextExtractor() = default;
 
-nlohmann::json TextExtractor::extract_page(const std::string& pdf_path, int page_number, 
+const MemoryLimits& TextExtractor::memory_limits() const {
+    return pImpl->memory_limits();
+}
+
+bool TextExtractor::over_memory_budget() const {
+    return pImpl->over_memory_budget();
+}
+
+nlohmann::json TextExtractor::extract_page(const PdfSource& source, int page_number,
                                           const ExtractOptions& options) {
-    return pImpl->extract_page(pdf_path, page_number, options);
+    return pImpl->extract_page(source, page_number, options);
+}
+
+PageText TextExtractor::extract_page_text(const PdfSource& source, int page_number) {
+    return pImpl->extract_page_text(source, page_number);
+}
+
+PageLayout TextExtractor::extract_page_layout(const PdfSource& source, int page_number,
+                                              const ExtractOptions& options) {
+    return pImpl->extract_page_layout(source, page_number, options);
 }
 
-nlohmann::json TextExtractor::extract_all_pages(const std::string& pdf_path,
+nlohmann::json TextExtractor::extract_all_pages(const PdfSource& source,
                                                const ExtractOptions& options) {
-    return pImpl->extract_all_pages(pdf_path, options);
+    return pImpl->extract_all_pages(source, options);
+}
+
+int TextExtractor::get_page_count(const PdfSource& source) {
+    return pImpl->get_page_count(source);
+}
+
+void TextExtractor::close(const PdfSource& source) {
+    pImpl->close(source);
+}
+
+} // namespace fast_pdf_parser
+#ifdef ENABLE_TESTS
+#include "../deps/doctest.h"
+
+namespace {
+
+using namespace fast_pdf_parser;
+
+// MuPDF bytes live in the process, the calling thread's unpublished
+// share included
+int64_t live_mupdf_bytes() {
+    return g_mupdf_bytes.load() + t_unflushed.bytes;
 }
 
-int TextExtractor::get_page_count(const std::string& pdf_path) {
-    return pImpl->get_page_count(pdf_path);
+const char* const kFixture = "n3797.pdf";
+
+// Whether the fixture exists and MuPDF can open it; the tests run from
+// the repository root
+bool fixture_available() {
+    if (!std::filesystem::exists(kFixture)) return false;
+    try {
+        TextExtractor extractor;
+        return extractor.get_page_count(kFixture) > 0;
+    } catch (const std::exception&) {
+        return false;
+    }
 }
 
-} // namespace fast_pdf_parser
\ No newline at end of file
+#define REQUIRE_FIXTURE()                                                         \
+    if (!fixture_available()) {                                                   \
+        MESSAGE("skipped: " << std::string(kFixture) << " missing or MuPDF unavailable"); \
+        return;                                                                   \
+    }
+
+} // namespace
+
+TEST_CASE("MuPDF allocator") {
+    REQUIRE(t_page.limit == 0);
+    end_page_allocations();  // start from a trimmed cache
+    const int64_t live = live_mupdf_bytes();
+    
+    SUBCASE("Blocks are aligned, accounted and resized in place within a size class") {
+        auto *p = static_cast<unsigned char*>(mupdf_malloc(nullptr, 100));
+        REQUIRE(p != nullptr);
+        CHECK(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t) == 0);
+        CHECK(live_mupdf_bytes() == live + 100);
+        for (int i = 0; i < 100; ++i) p[i] = static_cast<unsigned char>(i);
+        
+        CHECK(mupdf_realloc(nullptr, p, 110) == p);  // 112-byte class either way
+        CHECK(live_mupdf_bytes() == live + 110);
+        
+        p = static_cast<unsigned char*>(mupdf_realloc(nullptr, p, 5000));
+        REQUIRE(p != nullptr);
+        CHECK(live_mupdf_bytes() == live + 5000);
+        p = static_cast<unsigned char*>(mupdf_realloc(nullptr, p, 40));
+        REQUIRE(p != nullptr);
+        CHECK(live_mupdf_bytes() == live + 40);
+        bool intact = true;
+        for (int i = 0; i < 40; ++i) intact = intact && p[i] == i;
+        CHECK(intact);
+        
+        mupdf_free(nullptr, p);
+        mupdf_free(nullptr, nullptr);
+        CHECK(live_mupdf_bytes() == live);
+        
+        void *q = mupdf_realloc(nullptr, nullptr, 24);  // realloc of nothing allocates
+        REQUIRE(q != nullptr);
+        CHECK(live_mupdf_bytes() == live + 24);
+        mupdf_free(nullptr, q);
+    }
+    
+    SUBCASE("Freed small blocks are reused by their size class") {
+        void *p = mupdf_malloc(nullptr, 40);
+        mupdf_free(nullptr, p);
+        uint64_t pooled = t_blocks.pooled;
+        CHECK(mupdf_malloc(nullptr, 33) == p);  // 48-byte class
+        CHECK(t_blocks.pooled == pooled + 1);
+        
+        void *other = mupdf_malloc(nullptr, 64);  // another class, another block
+        CHECK(other != p);
+        mupdf_free(nullptr, other);
+        mupdf_free(nullptr, p);
+        
+        // Large blocks go back to the heap
+        size_t cached = t_blocks.bytes;
+        mupdf_free(nullptr, mupdf_malloc(nullptr, kMaxPooledSize + 1));
+        CHECK(t_blocks.bytes == cached);
+    }
+    
+    SUBCASE("The cache is capped while a page runs and trimmed after it") {
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < 2 * kMaxCachedBytes / kMaxPooledSize; ++i) {
+            blocks.push_back(mupdf_malloc(nullptr, kMaxPooledSize));
+        }
+        for (void *block : blocks) mupdf_free(nullptr, block);
+        CHECK(t_blocks.bytes <= kMaxCachedBytes);
+        CHECK(t_blocks.bytes > kRetainedBytes);
+        
+        end_page_allocations();
+        CHECK(t_blocks.bytes <= kRetainedBytes);
+        CHECK(live_mupdf_bytes() == live);
+    }
+    
+    SUBCASE("Blocks may be freed and resized on another thread") {
+        auto *p = static_cast<unsigned char*>(mupdf_malloc(nullptr, 200));
+        std::memset(p, 7, 200);
+        void *reused = nullptr;
+        bool intact = false;
+        
+        std::thread other([&]() {
+            p = static_cast<unsigned char*>(mupdf_realloc(nullptr, p, 300));
+            intact = p && p[0] == 7 && p[199] == 7;
+            mupdf_free(nullptr, p);  // lands in this thread's cache
+            reused = mupdf_malloc(nullptr, 300);
+            mupdf_free(nullptr, reused);
+        });  // exiting publishes its bytes and empties its cache
+        other.join();
+        
+        CHECK(intact);
+        CHECK(reused == p);
+        CHECK(live_mupdf_bytes() == live);
+        
+        // Frees after a thread's cache is gone go straight to the heap
+        BlockCache gone;
+        gone.alive = false;
+        void *q = mupdf_malloc(nullptr, 16);
+        CHECK_FALSE(gone.give(static_cast<unsigned char*>(q) - kAllocHeader, 16));
+        mupdf_free(nullptr, q);
+    }
+    
+    end_page_allocations();
+}
+TEST_CASE("Per-page memory budget") {
+    REQUIRE(t_page.limit == 0);
+    
+    SUBCASE("Allocations past the page's limit are refused") {
+        t_page = PageBudget{1000, 0, false};
+        void *first = mupdf_malloc(nullptr, 600);
+        REQUIRE(first != nullptr);
+        CHECK(t_page.held == 600);
+        
+        CHECK(mupdf_malloc(nullptr, 600) == nullptr);
+        CHECK(t_page.exceeded);
+        CHECK(t_page.held == 600);
+        
+        // Growing past the limit fails and leaves the block as it was
+        CHECK(mupdf_realloc(nullptr, first, 1200) == nullptr);
+        first = mupdf_realloc(nullptr, first, 900);
+        REQUIRE(first != nullptr);
+        CHECK(t_page.held == 900);
+        
+        // Freeing makes room again
+        mupdf_free(nullptr, first);
+        CHECK(t_page.held == 0);
+        void *again = mupdf_malloc(nullptr, 1000);
+        CHECK(again != nullptr);
+        mupdf_free(nullptr, again);
+    }
+    
+    SUBCASE("No limit and no page in progress allow anything") {
+        t_page = PageBudget{};
+        void *big = mupdf_malloc(nullptr, 1 << 20);
+        CHECK(big != nullptr);
+        CHECK_FALSE(t_page.exceeded);
+        CHECK(t_page.held == 0);  // only counted while a page has a ceiling
+        mupdf_free(nullptr, big);
+    }
+    
+    t_page = PageBudget{};
+    end_page_allocations();
+}
+
+TEST_CASE("TextExtractor memory limits") {
+    REQUIRE_FIXTURE();
+    
+    SUBCASE("A page over max_memory_per_page fails alone") {
+        MemoryLimits limits;
+        limits.max_memory_per_page = 16 * 1024;
+        TextExtractor extractor(limits);
+        CHECK(extractor.memory_limits() == limits);
+        reset_metrics();
+        
+        CHECK_THROWS_WITH_AS(extractor.extract_page_text(kFixture, 0),
+                             doctest::Contains("max_memory_per_page"), std::runtime_error);
+        CHECK(metrics_snapshot()["counters"]["pages_over_memory_limit"] == 1);
+        CHECK(t_page.limit == 0);  // the budget ends with the page
+        
+        // The worker and the document carry on
+        CHECK(extractor.get_page_count(kFixture) > 0);
+        TextExtractor unlimited(MemoryLimits{0, 0, 0});
+        CHECK_FALSE(unlimited.extract_page_text(kFixture, 0).text.empty());
+        reset_metrics();
+    }
+    
+    SUBCASE("A small store evicts instead of failing pages") {
+        // Bytes an extractor still holds after extracting the first pages
+        auto held_after_pages = [](size_t store_limit) {
+            MemoryLimits limits;
+            limits.store_limit = store_limit;
+            limits.max_memory_per_page = 0;
+            TextExtractor extractor(limits);
+            extractor.get_page_count(kFixture);
+            end_page_allocations();
+            int64_t before = live_mupdf_bytes();
+            for (int page = 0; page < 30; ++page) {
+                CHECK_FALSE(extractor.extract_page_text(kFixture, page).text.empty());
+            }
+            return live_mupdf_bytes() - before;
+        };
+        
+        int64_t unlimited = held_after_pages(0);
+        int64_t limited = held_after_pages(256 * 1024);
+        CHECK(limited <= unlimited);
+    }
+    
+    SUBCASE("Over max_memory_in_flight while MuPDF holds more") {
+        MemoryLimits limits;
+        limits.max_memory_in_flight = 1;
+        TextExtractor extractor(limits);
+        extractor.get_page_count(kFixture);
+        CHECK(extractor.over_memory_budget());
+        
+        TextExtractor no_budget;
+        CHECK_FALSE(no_budget.over_memory_budget());
+    }
+}
+
+TEST_CASE("TextExtractor::close drops a cached document") {
+    REQUIRE_FIXTURE();
+    TextExtractor extractor;
+    
+    SUBCASE("A memory source's bytes are released") {
+        PdfSource source = PdfSource::mapped_file(kFixture);
+        std::weak_ptr<const void> bytes = source.owner();
+        CHECK_FALSE(extractor.extract_page_text(source, 0).text.empty());
+        CHECK(bytes.use_count() == 2);  // the source and the cached document
+        
+        extractor.close(source);
+        CHECK(bytes.use_count() == 1);
+        // Opened again when used again
+        CHECK_FALSE(extractor.extract_page_text(source, 1).text.empty());
+        extractor.close(source);
+        source = PdfSource();
+        CHECK(bytes.expired());
+    }
+    
+    SUBCASE("Other documents stay open") {
+        extractor.get_page_count(kFixture);
+        PdfSource other = PdfSource::mapped_file(kFixture);
+        extractor.get_page_count(other);
+        reset_metrics();
+        extractor.close(other);
+        extractor.get_page_count(kFixture);
+        CHECK(metrics_snapshot()["counters"]["documents_opened"] == 0);
+        extractor.get_page_count(other);
+        CHECK(metrics_snapshot()["counters"]["documents_opened"] == 1);
+        reset_metrics();
+    }
+}
+TEST_CASE("PageLayout::to_json") {
+    SUBCASE("Rebuilds blocks, lines and glyphs from the columns") {
+        // Two blocks: "Hé" and "x" in the first, an empty line in the second
+        PageLayout layout;
+        layout.page_number = 3;
+        layout.has_positions = true;
+        layout.has_fonts = true;
+        layout.text = "H\xC3\xA9\nx\n\n";
+        layout.line_offsets = {0, 4, 6};
+        layout.char_offsets = {0, 1, 4};
+        layout.quads = {0, 0, 1, 0, 0, 1, 1, 1,
+                        1, 0, 2, 0, 1, 1, 2, 1,
+                        0, 2, 1, 2, 0, 3, 1, 3};
+        layout.origins = {0, 1, 1, 1, 0, 3};
+        layout.sizes = {10, 10, 8};
+        layout.font_ids = {0, 0, PageLayout::kNoFont};
+        layout.fonts = {FontInfo{"Times", true, false, false}};
+        layout.line_char_begin = {0, 2, 3};
+        layout.line_bboxes = {0, 0, 2, 1, 0, 2, 1, 3, 0, 4, 0, 4};
+        layout.block_line_begin = {0, 2};
+        layout.block_bboxes = {0, 0, 2, 3, 0, 4, 0, 4};
+        
+        nlohmann::json page = layout.to_json();
+        CHECK(page["page_number"] == 3);
+        REQUIRE(page["blocks"].size() == 2);
+        
+        const nlohmann::json& first = page["blocks"][0];
+        CHECK(first["type"] == "text");
+        CHECK(first["bbox"] == nlohmann::json{{"x0", 0.0}, {"y0", 0.0}, {"x1", 2.0}, {"y1", 3.0}});
+        REQUIRE(first["lines"].size() == 2);
+        CHECK(first["lines"][0]["text"] == "H\xC3\xA9");
+        REQUIRE(first["lines"][0]["chars"].size() == 2);
+        
+        const nlohmann::json& e = first["lines"][0]["chars"][1];
+        CHECK(e["char"] == "\xC3\xA9");
+        CHECK(e["bbox"] == nlohmann::json{{"ul_x", 1.0}, {"ul_y", 0.0}, {"ur_x", 2.0}, {"ur_y", 0.0},
+                                          {"ll_x", 1.0}, {"ll_y", 1.0}, {"lr_x", 2.0}, {"lr_y", 1.0}});
+        CHECK(e["origin_x"] == 1.0);
+        CHECK(e["font"] == nlohmann::json{{"name", "Times"}, {"is_bold", 1}, {"is_italic", 0}, {"is_monospace", 0}});
+        CHECK(e["size"] == 10.0);
+        
+        const nlohmann::json& x = first["lines"][1]["chars"][0];
+        CHECK(first["lines"][1]["text"] == "x");
+        CHECK(x["char"] == "x");
+        CHECK(x["font"].is_null());
+        CHECK(x["size"] == 8.0);
+        
+        const nlohmann::json& second = page["blocks"][1];
+        REQUIRE(second["lines"].size() == 1);
+        CHECK(second["lines"][0]["text"] == "");
+        CHECK(second["lines"][0]["chars"].empty());
+        
+        // Without positions and fonts only the text is left
+        layout.has_positions = false;
+        layout.has_fonts = false;
+        nlohmann::json bare = layout.to_json();
+        CHECK_FALSE(bare["blocks"][0].contains("bbox"));
+        CHECK(bare["blocks"][0]["lines"][0]["chars"][1] == nlohmann::json{{"char", "\xC3\xA9"}});
+    }
+    
+    SUBCASE("Matches extract_page for every combination of options") {
+        REQUIRE_FIXTURE();
+        TextExtractor extractor;
+        int pages = std::min(extractor.get_page_count(kFixture), 12);
+        
+        for (bool positions : {true, false}) {
+            for (bool fonts : {true, false}) {
+                ExtractOptions options;
+                options.extract_positions = positions;
+                options.extract_fonts = fonts;
+                for (int page = 0; page < pages; ++page) {
+                    CAPTURE(positions);
+                    CAPTURE(fonts);
+                    CAPTURE(page);
+                    CHECK(extractor.extract_page_layout(kFixture, page, options).to_json() ==
+                          extractor.extract_page(kFixture, page, options));
+                }
+            }
+        }
+    }
+}
+#endif // ENABLE_TESTS
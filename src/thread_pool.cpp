@@ -2,62 +2,150 @@
 
 namespace fast_pdf_parser {
 
-ThreadPool::ThreadPool(size_t num_threads) {
+namespace {
+
+// The pool and deque index of the current thread, if it is a worker
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t num_threads, std::function<void(size_t worker)> on_start) {
+    // A pool without workers still needs somewhere to queue tasks
+    size_t queue_count = num_threads > 0 ? num_threads : 1;
+    for(size_t i = 0; i < queue_count; ++i) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    
+    // With on_start, the constructor waits for every worker to have run it
+    std::mutex start_mutex;
+    std::condition_variable started;
+    const bool hooked = static_cast<bool>(on_start);
+    size_t starting = hooked ? num_threads : 0;
     for(size_t i = 0; i < num_threads; ++i) {
-        workers.emplace_back([this] {
-            for(;;) {
-                std::function<void()> task;
-                
-                {
-                    std::unique_lock<std::mutex> lock(this->queue_mutex);
-                    this->condition.wait(lock, [this]{ 
-                        return this->stop || !this->tasks.empty(); 
-                    });
-                    
-                    if(this->stop && this->tasks.empty()) {
-                        return;
-                    }
-                    
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
-                }
-                
-                task();
-                
-                active_tasks--;
-                finished.notify_all();
+        // The references are only used before the constructor returns
+        workers.emplace_back([this, i, hooked, &on_start, &start_mutex, &started, &starting] {
+            if(hooked) {
+                on_start(i);
+                std::lock_guard<std::mutex> lock(start_mutex);
+                if(--starting == 0) started.notify_one();
             }
+            worker_loop(i);
         });
     }
+    std::unique_lock<std::mutex> lock(start_mutex);
+    started.wait(lock, [&starting] { return starting == 0; });
 }
 
 ThreadPool::~ThreadPool() {
     {
-        std::unique_lock<std::mutex> lock(queue_mutex);
+        std::unique_lock<std::mutex> lock(sleep_mutex);
         stop = true;
     }
     
-    condition.notify_all();
+    wake.notify_all();
     
     for(std::thread &worker: workers) {
         worker.join();
     }
 }
 
+void ThreadPool::push(PoolTask task) {
+    size_t index = current_pool == this ? current_index
+                                        : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        WorkerQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(stop) {
+            throw std::runtime_error("enqueue on stopped ThreadPool");
+        }
+        queue.tasks.push_back(std::move(task));
+        unfinished++;
+        pending++;
+    }
+    
+    // A worker going to sleep counts itself in sleeping before it checks
+    // pending, both under sleep_mutex, so it either sees this task or is
+    // woken for it
+    if(sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::pop_local(size_t index, PoolTask& task) {
+    WorkerQueue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    pending--;
+    return true;
+}
+
+bool ThreadPool::steal(size_t index, PoolTask& task) {
+    for(size_t offset = 1; offset < queues.size(); ++offset) {
+        WorkerQueue& queue = *queues[(index + offset) % queues.size()];
+        std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+        if(!lock.owns_lock() || queue.tasks.empty()) {
+            continue;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        pending--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    current_pool = this;
+    current_index = index;
+    
+    for(;;) {
+        PoolTask task;
+        if(pop_local(index, task) || steal(index, task)) {
+            task();
+            task = PoolTask();
+            
+            if(--unfinished == 0) {
+                std::lock_guard<std::mutex> lock(done_mutex);
+                finished.notify_all();
+            }
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        if(stop && pending == 0) {
+            return;
+        }
+        sleeping++;
+        wake.wait(lock, [this]{ 
+            return this->stop || this->pending > 0; 
+        });
+        sleeping--;
+    }
+}
+
 void ThreadPool::wait_all() {
-    std::unique_lock<std::mutex> lock(queue_mutex);
+    std::unique_lock<std::mutex> lock(done_mutex);
     finished.wait(lock, [this]{ 
-        return tasks.empty() && active_tasks == 0; 
+        return unfinished == 0; 
     });
 }
 
 size_t ThreadPool::queue_size() const {
-    std::unique_lock<std::mutex> lock(queue_mutex);
-    return tasks.size();
+    return pending.load();
 }
 
 size_t ThreadPool::active_threads() const {
-    return active_tasks.load();
+    return unfinished.load();
+}
+
+size_t ThreadPool::thread_count() const {
+    return workers.size();
 }
 
 } // namespace fast_pdf_parser
@@ -67,6 +155,7 @@ size_t ThreadPool::active_threads() const {
 #include "../deps/doctest.h"
 #include <chrono>
 #include <atomic>
+#include <set>
 
 TEST_CASE("ThreadPool basic functionality") {
     using namespace fast_pdf_parser;
@@ -80,6 +169,34 @@ TEST_CASE("ThreadPool basic functionality") {
         CHECK(true); // If we got here, no crash occurred
     }
     
+    SUBCASE("Start hook runs on every worker before the pool is used") {
+        std::mutex mutex;
+        std::set<size_t> started;
+        std::set<std::thread::id> hooked;
+        {
+            ThreadPool pool(3, [&](size_t worker) {
+                std::lock_guard<std::mutex> lock(mutex);
+                started.insert(worker);
+                hooked.insert(std::this_thread::get_id());
+            });
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                CHECK(started == std::set<size_t>{0, 1, 2});  // before the constructor returned
+            }
+            std::vector<std::future<bool>> ran;
+            for (int i = 0; i < 30; ++i) {
+                ran.push_back(pool.enqueue([&] {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return hooked.count(std::this_thread::get_id()) == 1;
+                }));
+            }
+            for (auto& task : ran) {
+                CHECK(task.get());
+            }
+        }
+        CHECK(hooked.size() == 3);
+    }
+    
     SUBCASE("Single task execution") {
         ThreadPool pool(2);
         std::atomic<int> counter{0};
@@ -191,6 +308,69 @@ TEST_CASE("ThreadPool exception handling") {
     }
 }
 
+TEST_CASE("ThreadPool work stealing and fire-and-forget tasks") {
+    using namespace fast_pdf_parser;
+    using namespace std::chrono_literals;
+    
+    SUBCASE("PoolTask stores small callables inline and owns move-only state") {
+        int calls = 0;
+        auto small = [&calls]() { calls++; };
+        CHECK(PoolTask::fits_inline<decltype(small)>());
+        
+        char big_state[256] = {};
+        auto big = [&calls, big_state]() { calls += 1 + big_state[0]; };
+        CHECK_FALSE(PoolTask::fits_inline<decltype(big)>());
+        
+        auto owned = std::make_unique<int>(5);
+        PoolTask a(small), b(big), c([&calls, p = std::move(owned)]() { calls += *p; });
+        PoolTask moved = std::move(c);
+        CHECK_FALSE(static_cast<bool>(c));
+        a();
+        b();
+        moved();
+        CHECK(calls == 7);
+    }
+    
+    SUBCASE("submit runs every task and wait_all waits for them") {
+        ThreadPool pool(4);
+        std::atomic<int> counter{0};
+        for (int i = 0; i < 10000; ++i) {
+            pool.submit([&counter]() { counter++; });
+        }
+        pool.wait_all();
+        CHECK(counter == 10000);
+        CHECK(pool.queue_size() == 0);
+        CHECK(pool.active_threads() == 0);
+    }
+    
+    SUBCASE("Tasks queued by a busy worker are stolen by idle ones") {
+        ThreadPool pool(4);
+        std::mutex ids_mutex;
+        std::set<std::thread::id> ids;
+        
+        // Everything lands on one worker's deque; the others have to steal
+        pool.submit([&]() {
+            for (int i = 0; i < 64; ++i) {
+                pool.submit([&]() {
+                    std::this_thread::sleep_for(2ms);
+                    std::lock_guard<std::mutex> lock(ids_mutex);
+                    ids.insert(std::this_thread::get_id());
+                });
+            }
+        });
+        pool.wait_all();
+        CHECK(ids.size() > 1);
+    }
+    
+    SUBCASE("enqueue accepts arguments and move-only callables") {
+        ThreadPool pool(2);
+        auto sum = pool.enqueue([](int a, int b) { return a + b; }, 2, 3);
+        auto owned = pool.enqueue([p = std::make_unique<int>(7)]() { return *p; });
+        CHECK(sum.get() == 5);
+        CHECK(owned.get() == 7);
+    }
+}
+
 TEST_CASE("ThreadPool performance characteristics") {
     using namespace fast_pdf_parser;
     using namespace std::chrono;
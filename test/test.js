@@ -97,4 +97,77 @@ try {
     console.log('✓ Properly caught error:', err.message);
 }
 
-console.log('\nAll tests completed!');
\ No newline at end of file
+// Test 5: Async and streaming chunking
+console.log('\n5. Testing async chunking...');
+(async () => {
+    if (fs.existsSync(testPdf)) {
+        try {
+            const chunker = new HierarchicalChunker();
+            const result = await chunker.chunkFileAsync(testPdf, { pageLimit: 10 });
+            console.log(`✓ chunkFileAsync created ${result.totalChunks} chunks`);
+            
+            let streamed = 0;
+            for await (const chunk of chunker.chunkFileStream(testPdf, { pageLimit: 10 })) {
+                if (chunk.tokenCount > 0) streamed++;
+            }
+            console.log(`✓ chunkFileStream yielded ${streamed} chunks (matches: ${streamed === result.totalChunks})`);
+            
+            if (typeof AbortController !== 'undefined') {
+                const controller = new AbortController();
+                const pending = chunker.chunkFileAsync(testPdf, { signal: controller.signal });
+                controller.abort();
+                await pending.then(
+                    () => console.error('✗ Should have been aborted'),
+                    err => console.log(`✓ Aborted: ${err.name}`)
+                );
+            }
+        } catch (err) {
+            console.error('✗ Error:', err.message);
+        }
+    }
+    
+    // Test 6: Compact results
+    console.log('\n6. Testing compact results...');
+    if (fs.existsSync(testPdf)) {
+        try {
+            const chunker = new HierarchicalChunker();
+            const full = chunker.chunkFile(testPdf, 10);
+            const compact = chunker.chunkFile(testPdf, 10, { compact: true });
+            const same = compact.chunks.length === full.chunks.length &&
+                full.chunks.every((chunk, i) => JSON.stringify(chunk) === JSON.stringify(compact.chunks.get(i)));
+            console.log(`✓ Compact result has ${compact.chunks.length} chunks (matches: ${same})`);
+            
+            const compactAsync = await chunker.chunkFileAsync(testPdf, { pageLimit: 10, compact: true });
+            console.log(`✓ Compact async result has ${compactAsync.chunks.length} chunks`);
+        } catch (err) {
+            console.error('✗ Error:', err.message);
+        }
+    }
+    
+    // Test 7: Buffer input
+    console.log('\n7. Testing Buffer input...');
+    if (fs.existsSync(testPdf)) {
+        try {
+            const chunker = new HierarchicalChunker();
+            const bytes = fs.readFileSync(testPdf);
+            const fromPath = chunker.chunkFile(testPdf, 10);
+            const fromBuffer = chunker.chunkFile(bytes, 10);
+            const same = JSON.stringify(fromPath.chunks) === JSON.stringify(fromBuffer.chunks);
+            console.log(`✓ Buffer result has ${fromBuffer.chunks.length} chunks (matches: ${same})`);
+            
+            const fromBufferAsync = await chunker.chunkFileAsync(bytes, { pageLimit: 10 });
+            console.log(`✓ Async Buffer result has ${fromBufferAsync.chunks.length} chunks`);
+        } catch (err) {
+            console.error('✗ Error:', err.message);
+        }
+    }
+    
+    try {
+        await new HierarchicalChunker().chunkFileAsync('nonexistent.pdf');
+        console.error('✗ Should have rejected');
+    } catch (err) {
+        console.log('✓ Properly rejected:', err.message);
+    }
+    
+    console.log('\nAll tests completed!');
+})();
\ No newline at end of file
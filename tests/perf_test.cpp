@@ -20,7 +20,6 @@ int main(int argc, char* argv[]) {
         for (size_t threads : thread_counts) {
             fast_pdf_parser::ParseOptions options;
             options.thread_count = threads;
-            options.batch_size = 10;
             options.extract_positions = false;  // Faster without positions
             options.extract_fonts = false;      // Faster without fonts
             
@@ -58,5 +58,112 @@ int main() {
     std::cout << "\nDecoded: \"" << decoded << "\"\n";
     std::cout << "Match: " << (test == decoded ? "YES" : "NO") << "\n";
     
+    // count_tokens walks the same trie without building the token vector
+    std::cout << "\nCount-only Test:\n";
+    bool counts_match = true;
+    for (const auto& text : test_strings) {
+        std::string_view view(text);
+        if (tokenizer.count_tokens(view.substr(0, view.size() / 2)) !=
+            tokenizer.encode(view.substr(0, view.size() / 2)).size()) {
+            counts_match = false;
+        }
+    }
+    std::cout << "count_tokens == encode().size(): " << (counts_match ? "YES" : "NO") << "\n";
+    
+    // Exact mode must reproduce Python tiktoken's ids
+    std::cout << "\nExact BPE Test:\n";
+    fast_pdf_parser::TiktokenTokenizer exact(fast_pdf_parser::TokenizerMode::ExactBpe);
+    const std::vector<std::pair<std::string, std::vector<int>>> expected = {
+        {"Hello, world!", {9906, 11, 1917, 0}},
+        {"Special chars: @#$%^&*()", {20989, 23861, 25, 571, 49177, 46999, 5, 9, 368}},
+        {"tiktoken is great!", {83, 1609, 5963, 374, 2294, 0}},
+        // Contractions are pieces of their own, in any case
+        {"It's what they're saying, isn't it? WE'RE SURE IT'S fine",
+         {2181, 596, 1148, 814, 2351, 5605, 11, 4536, 956, 433, 30, 20255, 95253, 328, 4622, 8871, 13575, 7060}},
+        // Digit runs split into groups of at most three
+        {"Item 1234567 costs 10000000 on 2024-10-15",
+         {1256, 220, 4513, 10961, 22, 7194, 220, 1041, 931, 410, 389, 220, 2366, 19, 12, 605, 12, 868}},
+        {"Total: 99,999,999.99 USD\r\n", {7749, 25, 220, 1484, 11, 5500, 11, 5500, 13, 1484, 20121, 319}},
+        // Whitespace before a newline and at the end of the input
+        {"end of line   \nnext line\n\n  indented \t\nlast   ",
+         {408, 315, 1584, 5996, 3684, 1584, 271, 220, 1280, 16243, 17934, 4354, 262}},
+        {"    \n", {1084}},
+        {"tabs\t\t\tthen spaces    ", {32093, 298, 59733, 12908, 257}},
+        // Multi-byte UTF-8; the second piece is over 64 bytes, so it is
+        // merged through the heap
+        {"na\u00efve caf\u00e9 \u2014 \u65e5\u672c\u8a9e\u306e\u30c6\u30ad\u30b9\u30c8\u3092\u5206\u5272\u3059\u308b",
+         {3458, 38672, 588, 53050, 2001, 76502, 22656, 45918, 252, 16144, 57933, 62903, 71634, 30512, 17620, 21403, 110,
+          54926}},
+        {"\u65e5\u672c\u8a9e\u306e\u6587\u7ae0\u306f\u30b9\u30da\u30fc\u30b9\u306a\u3057\u3067\u66f8\u304b"
+         "\u308c\u308b\u306e\u3067\u4e00\u3064\u306e\u9577\u3044\u30d4\u30fc\u30b9\u306b\u306a\u308a\u307e\u3059",
+         {9080, 22656, 45918, 252, 16144, 83125, 15682, 22398, 99695, 61398, 26854, 15024, 16556, 27552, 116, 32149,
+          33121, 30369, 16144, 16556, 15120, 59739, 16144, 39622, 115, 16995, 70563, 61398, 20230, 26854, 31431, 33541}},
+        // Long runs of one character, also merged through the heap; equal
+        // ranks merge leftmost first
+        {std::string(100, 'a'),
+         {70540, 70540, 70540, 70540, 70540, 70540, 70540, 70540, 70540, 70540, 70540, 70540, 29558}},
+        {std::string(100, '='), {8315, 3134, 608}},
+        {std::string(120, '.'), {43369, 16971, 57341}},
+        {"Section 2 " + std::string(71, '-') + " end", {9817, 220, 17, 8633, 21622, 842}},
+    };
+    // Control characters escaped, long texts cut short
+    auto shown = [](const std::string& text) {
+        std::string out;
+        for (char c : text.substr(0, 40)) {
+            out += c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\t' ? "\\t" : std::string(1, c);
+        }
+        return text.size() > 40 ? out + "..." : out;
+    };
+    bool exact_match = true;
+    for (const auto& [text, ids] : expected) {
+        auto got = exact.encode(text);
+        bool ok = got == ids && exact.count_tokens(text) == ids.size() && exact.decode(got) == text;
+        std::cout << "  \"" << shown(text) << "\": " << (ok ? "OK" : "MISMATCH") << "\n";
+        exact_match = exact_match && ok;
+    }
+    std::cout << "Exact ids match tiktoken: " << (exact_match ? "YES" : "NO") << "\n";
+    
+    // Repeated short lines are answered from the count cache
+    std::cout << "\nCount Cache Test:\n";
+    fast_pdf_parser::TiktokenTokenizer cached;
+    cached.enable_count_cache();
+    const std::vector<std::string_view> lines = {"Page 1 of 20", "CONFIDENTIAL", "Page 1 of 20", "CONFIDENTIAL"};
+    bool cache_ok = true;
+    for (auto line : lines) {
+        cache_ok = cache_ok && cached.count_tokens(line) == tokenizer.count_tokens(line);
+    }
+    cache_ok = cache_ok && cached.count_cache()->hits() == 2 && cached.count_cache()->misses() == 2;
+    std::cout << "Cached counts match, 2 hits / 2 misses: " << (cache_ok ? "YES" : "NO") << "\n";
+    
+    // Batch counting over a pool gives the same counts as one-by-one
+    std::cout << "\nBatch Count Test:\n";
+    std::vector<std::string_view> batch;
+    for (int i = 0; i < 1000; ++i) {
+        batch.push_back(test_strings[i % test_strings.size()]);
+    }
+    fast_pdf_parser::ThreadPool pool(4);
+    auto batch_counts = cached.count_tokens_batch(batch, &pool);
+    bool batch_ok = batch_counts.size() == batch.size();
+    for (size_t i = 0; batch_ok && i < batch.size(); ++i) {
+        batch_ok = batch_counts[i] == tokenizer.count_tokens(batch[i]);
+    }
+    std::cout << "count_tokens_batch == count_tokens: " << (batch_ok ? "YES" : "NO") << "\n";
+    
+    // Token offsets slice the text into exactly the encoded tokens
+    std::cout << "\nToken Offsets Test:\n";
+    bool offsets_ok = true;
+    for (const auto* tok : {&tokenizer, &exact}) {
+        for (const auto& str : test_strings) {
+            std::vector<uint32_t> offsets;
+            auto ids = tok->encode(str, &offsets);
+            offsets_ok = offsets_ok && offsets.size() == ids.size() + 1 &&
+                         offsets.back() == str.size() && tok->token_offsets(str) == offsets;
+            for (size_t i = 0; offsets_ok && i < ids.size(); ++i) {
+                offsets_ok = tok->decode({ids[i]}) == str.substr(offsets[i], offsets[i + 1] - offsets[i]);
+            }
+        }
+    }
+    std::cout << "Offsets match decoded tokens (greedy and exact): " << (offsets_ok ? "YES" : "NO") << "\n";
+    
     return 0;
 }
\ No newline at end of file